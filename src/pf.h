@@ -42,11 +42,36 @@ typedef int PageNum;
 //
 const int PF_PAGE_SIZE = 4096 - sizeof(int);    /*4092*/
 
+//
+// Default number of pages in the buffer (see PF_BufferConfig)
+//
+const int PF_BUFFER_SIZE = 40;
+
+//
+// PF_ReplacePolicy: how the buffer manager picks a page to replace
+//
+enum PF_ReplacePolicy {
+   PF_REPLACE_LRU,                                // least recently used
+   PF_REPLACE_CLOCK,                              // clock (second chance)
+   PF_REPLACE_2Q                                  // scan resistant 2Q
+};
+
+//
+// PF_IOBackend: how the buffer manager performs asynchronous page I/O
+//
+enum PF_IOBackend {
+   PF_IO_AUTO,                                    // io_uring if the kernel
+                                                  // has it, else PF_IO_THREADS
+   PF_IO_THREADS                                  // blocking I/O on a pool
+                                                  // of threads
+};
+
 //
 // PF_PageHandle: PF page interface
 //
 class PF_PageHandle {
    friend class PF_FileHandle;
+   friend class PF_PageFuture;
 public:
    PF_PageHandle  ();                            // Default constructor
    ~PF_PageHandle ();                            // Destructor
@@ -64,19 +89,65 @@ private:
    char *pPageData;                               // pointer to page data
 };
 
+//
+// PF_PageFuture: a page read started by PF_FileHandle::GetPageAsync
+//
+// The page is pinned from GetPageAsync on.  Wait blocks until the page is
+// in the buffer and hands it over like GetThisPage; the client unpins it
+// afterwards as usual.  The optional callback runs on an I/O thread when
+// the read completes, just before the future becomes ready; it must not
+// call back into PF.  A started future must stay alive until it has been
+// waited for (the destructor waits, and unpins the page itself).
+//
+class PF_BufferMgr;
+class PF_WarmList;
+struct PF_FileMap;
+struct PF_PageMap;
+struct PF_FileSnapshot;
+
+typedef void (*PF_PageCallback)(PageNum pageNum, RC rc, void *pArg);
+
+class PF_PageFuture {
+   friend class PF_FileHandle;
+   friend class PF_BufferMgr;
+public:
+   PF_PageFuture  ();                            // Default constructor
+   ~PF_PageFuture ();                            // Destructor
+
+   int IsReady    () const;                      // TRUE once Wait won't block
+   RC  Wait       (PF_PageHandle &pageHandle);   // Wait for the page and
+                                                 // set pageHandle to it
+private:
+   // Not copyable: the buffer manager links pending futures together
+   PF_PageFuture  (const PF_PageFuture &future);
+   PF_PageFuture& operator=(const PF_PageFuture &future);
+
+   PF_BufferMgr    *pBufferMgr;                  // manager of the page
+   int             fd;                           // OS file descriptor
+   PageNum         pageNum;                      // page being read
+   int             slot;                         // buffer slot of the page
+   RC              rc;                           // result of the read
+   int             bStarted;                     // GetPageAsync done, not
+                                                 // waited for yet
+   int             bPending;                     // read not completed yet
+   PF_PageCallback pfnDone;                      // completion callback
+   void            *pArg;                        // for pfnDone
+   PF_PageFuture   *pNextWaiter;                 // next future of the page
+};
+
 //
 // PF_FileHdr: Header structure for files
 //
 struct PF_FileHdr {
    int firstFree;     // first free page in the linked list
    int numPages;      // # of pages in the file
+   int format;        // how free pages are found: PF_FORMAT_FREELIST
+                      // (0, files of old) or PF_FORMAT_BITMAP
 };
 
 //
 // PF_FileHandle: PF File interface
 //
-class PF_BufferMgr;
-
 class PF_FileHandle {
    friend class PF_Manager;                     /*指定友元类,可直接访问私有数据,而不必通过函数提供接口!*/
 public:
@@ -94,22 +165,58 @@ public:
    // Get the next page after current
    RC GetNextPage (PageNum current, PF_PageHandle &pageHandle) const;
    // Get a specific page => 会被pin在缓冲区中,必须手动显示地unpin
-   RC GetThisPage (PageNum pageNum, PF_PageHandle &pageHandle) const;
+   // SEQUENTIAL_HINT tells the buffer the page is part of a scan, so it
+   // is not promoted over the working set (see PF_ReplacePolicy)
+   RC GetThisPage (PageNum pageNum, PF_PageHandle &pageHandle,
+                   ClientHint hint = NO_HINT) const;
+   // Start reading a specific page and return at once; future.Wait
+   // then gives the pinned page.  pfnDone(pageNum, rc, pArg) is called
+   // when the read has completed (right away on a buffer hit).
+   RC GetPageAsync(PageNum pageNum, PF_PageFuture &future,
+                   ClientHint hint = NO_HINT,
+                   PF_PageCallback pfnDone = NULL, void *pArg = NULL) const;
    // Get the last page
    RC GetLastPage(PF_PageHandle &pageHandle) const;
    // Get the prev page after current
    RC GetPrevPage (PageNum current, PF_PageHandle &pageHandle) const;
 
    RC AllocatePage(PF_PageHandle &pageHandle);    // Allocate a new page
+   // Allocate numAlloc pages at once, pinned, into pageHandles[]: free
+   // pages first, then new pages at the end of the file, reserved with
+   // one extent update and one header update.  A file with a free-page
+   // bitmap cannot grow past PF_BITMAP_PAGES pages (PF_FILEFULL).
+   RC AllocatePages(int numAlloc, PF_PageHandle pageHandles[]);
    RC DisposePage (PageNum pageNum);              // Dispose of a page
    RC MarkDirty   (PageNum pageNum) const;        // Mark page as dirty
    RC UnpinPage   (PageNum pageNum) const;        // Unpin the page
 
-   // Flush pages from buffer pool.  Will write dirty pages to disk.
-   RC FlushPages  () const;
+   // Flush pages from buffer pool.  Will write dirty pages to disk, in
+   // page order, and fdatasync the file after if bSync is set.
+   RC FlushPages  (int bSync=FALSE) const;
 
    // Force a page or pages to disk (but do not remove from the buffer pool)
-   RC ForcePages  (PageNum pageNum=ALL_PAGES) const;
+   RC ForcePages  (PageNum pageNum=ALL_PAGES, int bSync=FALSE) const;
+
+   // Make every change to the file durable: force the header and all the
+   // pages, then fdatasync the file if anything was written since the
+   // last sync
+   RC Sync        () const;
+
+   // TRUE if the file was opened with PF_OPEN_DIRECT and the file system
+   // accepted O_DIRECT
+   int IsDirectIO () const;
+
+   // TRUE if the file was opened with PF_OPEN_MMAP: its pages are read
+   // in place from a read-only mapping instead of the buffer pool
+   int IsMapped   () const;
+
+   // TRUE if the file was created with PF_CREATE_BITMAP: free pages are
+   // found in a bitmap kept in the file header instead of a list
+   int HasBitmap  () const;
+
+   // Frames of the file in the buffer pool and hits of its GetPages
+   // (see PF_Manager::GetSnapshot); all zero for a mapped file
+   RC GetSnapshot (PF_FileSnapshot &snapshot) const;
 
 private:
 
@@ -117,11 +224,125 @@ private:
    // otherwise
    int IsValidPageNum (PageNum pageNum) const;
 
+   // Read / write the file header block (aligned, so O_DIRECT accepts it)
+   RC ReadHdr     ();
+   RC WriteHdr    () const;
+
+   // Reserve disk space for the pages below endPage, a whole extent at
+   // a time; and set up a page just taken for AllocatePages
+   RC Preallocate (PageNum endPage);
+   RC InitNewPage (PageNum pageNum, char *pPageBuf,
+                   PF_PageHandle &pageHandle);
+
+   // Map / unmap the file (PF_OPEN_MMAP), and pin a page of the mapping
+   RC MapFile     ();
+   void UnmapFile ();
+   RC GetMappedPage(PageNum pageNum, PF_PageHandle &pageHandle) const;
+   // Tell the kernel a scan is moving through the mapping in direction
+   // dir (1 forward, -1 backward) and is at pageNum
+   void AdviseScan(PageNum pageNum, int dir) const;
+
    PF_BufferMgr *pBufferMgr;                      // pointer to buffer manager
    PF_FileHdr hdr;                                // file header
    int bFileOpen;                                 // file open flag
    int bHdrChanged;                               // dirty flag for file hdr
    int unixfd;                                    // OS file descriptor
+   int bDirectIO;                                 // opened with O_DIRECT
+   PF_FileMap *pMap;                              // mapping, if PF_OPEN_MMAP
+   PF_PageMap *pPageMap;                          // pages in use, if the
+                                                  // file has a bitmap
+   int extentPages;                               // pages reserved at once,
+                                                  // 0 or 1: none
+   PageNum extentEnd;                             // pages below are reserved
+};
+
+//
+// Flags of PF_Manager::OpenFile
+//
+const int PF_OPEN_DIRECT = 0x1;   // read and write pages with O_DIRECT,
+                                  // bypassing the OS page cache
+const int PF_OPEN_MMAP   = 0x2;   // read-only: map the file and hand out
+                                  // pointers into the mapping (zero copy)
+
+//
+// Flags of PF_Manager::CreateFile
+//
+const int PF_CREATE_BITMAP = 0x1; // keep a bitmap of the pages in use in
+                                  // the file header instead of chaining
+                                  // the free pages through themselves
+
+//
+// PF_BufferConfig: sizing of the buffer pool, given to PF_Manager
+//
+struct PF_BufferConfig {
+   int              numPages;    // frames in the buffer pool
+   int              hashSize;    // pages the hash tables are sized for
+                                 // (at least numPages; they grow on resize)
+   int              numShards;   // latched shards the buffer is split into
+   PF_ReplacePolicy policy;      // page replacement policy
+   int              bHugePages;  // back the frames with transparent huge
+                                 // pages (madvise) where available
+   PF_IOBackend     ioBackend;   // asynchronous I/O implementation
+   int              bReadAhead;  // prefetch ahead of sequential readers
+   int              bBgWriter;   // write dirty pages in a background thread
+   int              bgDirtyPct;  // dirty pages per hundred frames it aims at
+   int              bgMaxRate;   // pages it writes per second at most
+   int              extentPages; // disk space is reserved for this many
+                                 // pages at once as a file grows (fallocate,
+                                 // 0 or 1: page by page)
+   int              bFreeBitmap; // CreateFile makes every file with a
+                                 // free-page bitmap (PF_CREATE_BITMAP)
+   const char       *psWarmFile; // list of the resident pages, saved when
+                                 // the PF_Manager is destroyed and read
+                                 // ahead by OpenFile in the next run
+                                 // (NULL: the buffer starts cold)
+
+   PF_BufferConfig(int numPages = PF_BUFFER_SIZE, int numShards = 1,
+                   PF_ReplacePolicy policy = PF_REPLACE_LRU);
+
+   // Override numPages, hashSize, bHugePages, ioBackend, bReadAhead,
+   // bBgWriter, extentPages, bFreeBitmap and psWarmFile from the
+   // environment variables REDBASE_PF_BUFFER_SIZE, REDBASE_PF_HASH_SIZE,
+   // REDBASE_PF_HUGE_PAGES, REDBASE_PF_IO, REDBASE_PF_READAHEAD,
+   // REDBASE_PF_BGWRITER, REDBASE_PF_EXTENT, REDBASE_PF_BITMAP and
+   // REDBASE_PF_WARMUP when they are set
+   void ReadEnv();
+};
+
+//
+// PF_FileSnapshot: the frames of one file in the buffer pool, and the
+// hits and misses of its GetPage calls (see PF_Manager::GetSnapshot)
+//
+const int PF_AGE_CLASSES = 8;    // classes of PF_FileSnapshot::ageHist
+
+struct PF_FileSnapshot {
+   int       fd;                 // OS file descriptor (-1: the blocks of
+                                 // AllocateBlock, or every file)
+   int       numResident;        // frames holding its pages
+   int       numPinned;          //   of which pinned
+   int       numDirty;           //   of which dirty
+   int       numIO;              //   of which being read or written
+   int       ageHist[PF_AGE_CLASSES];  // frames by position in the
+                                 // replacement order of their shard: class 0
+                                 // is the hottest eighth, the last one the
+                                 // eighth the next victims come from
+   long long numHits;            // GetPages that found the page, and that
+   long long numMisses;          // had to read it, since the last reset
+
+   PF_FileSnapshot();
+   // numHits / (numHits + numMisses), 0 without any GetPage
+   double HitRatio() const;
+};
+
+//
+// PF_BufferSnapshot: the whole buffer pool
+//
+struct PF_BufferSnapshot {
+   int             numPages;     // frames in the pool
+   int             numShards;    // shards they are split into
+   int             numFree;      // frames holding no page
+   int             numFiles;     // files with frames or GetPages counted
+   PF_FileSnapshot total;        // every frame and GetPage
 };
 
 //
@@ -129,14 +350,29 @@ private:
 //
 class PF_Manager {
 public:
-   PF_Manager    ();                              // Constructor
+   // numShards > 1 splits the buffer into independently latched shards so
+   // that several threads may pin and unpin pages concurrently.  The pool
+   // has PF_BUFFER_SIZE frames unless the environment says otherwise.
+   PF_Manager    (int numShards = 1,              // Constructor
+                  PF_ReplacePolicy policy = PF_REPLACE_LRU);
+   PF_Manager    (const PF_BufferConfig &config); // Constructor
    ~PF_Manager   ();                              // Destructor
-   RC CreateFile    (const char *fileName);       // Create a new file
+   RC CreateFile    (const char *fileName,        // Create a new file
+                     int flags = 0);             // flags: PF_CREATE_*
    RC DestroyFile   (const char *fileName);       // Delete a file
 
-   // Open and close file methods
-   RC OpenFile      (const char *fileName, PF_FileHandle &fileHandle);
-   RC CloseFile     (PF_FileHandle &fileHandle);
+   // Open and close file methods.  With a warm-up list (see
+   // PF_BufferConfig::psWarmFile) OpenFile starts reading the pages the
+   // file had in the buffer in the last run, and returns without waiting
+   // for them.
+   RC OpenFile      (const char *fileName, PF_FileHandle &fileHandle,
+                     int flags = 0);             // flags: PF_OPEN_*
+   RC CloseFile     (PF_FileHandle &fileHandle,  // bSync: sync it first
+                     int bSync = FALSE);
+
+   // Group commit: force several open files, then fdatasync the ones
+   // written since their last sync, all at once
+   RC SyncFiles     (PF_FileHandle *const fileHandles[], int numFiles);
 
    // Three methods that manipulate the buffer manager.  The calls are
    // forwarded to the PF_BufferMgr instance and are called by parse.y
@@ -145,6 +381,15 @@ public:
    RC PrintBuffer   ();
    RC ResizeBuffer  (int iNewSize);
 
+   // Snapshot of the buffer pool for monitoring: the totals, and the
+   // first maxFiles files by descriptor in files.  The shards are
+   // latched one at a time, so the pool keeps running meanwhile and the
+   // snapshot is consistent per shard only.  Hits and misses are counted
+   // since the last ResetAccessCounts (or the file was opened).
+   RC GetSnapshot   (PF_BufferSnapshot &snapshot,
+                     PF_FileSnapshot files[] = NULL, int maxFiles = 0);
+   RC ResetAccessCounts();
+
    // Three Methods for manipulating raw memory buffers.  These memory
    // locations are handled by the buffer manager, but are not
    // associated with a particular file.  These should be used if you
@@ -165,7 +410,14 @@ public:
    RC DisposeBlock  (char *buffer);
 
 private:
+   // Build the warm-up list of config, if it names one
+   void InitWarmList(const PF_BufferConfig &config);
+
    PF_BufferMgr *pBufferMgr;                      // page-buffer manager; PF_Manager的构造函数中动态分配
+   int          extentPages;                      // see PF_BufferConfig
+   int          bFreeBitmap;                      // see PF_BufferConfig
+   PF_WarmList  *pWarmList;                       // resident pages kept over
+                                                  // restarts, or NULL
 };
 
 //
@@ -182,7 +434,9 @@ void PF_PrintError(RC rc);
 #define PF_PAGEUNPINNED    (START_PF_WARN + 6) // page already unpinned
 #define PF_EOF             (START_PF_WARN + 7) // end of file
 #define PF_TOOSMALL        (START_PF_WARN + 8) // Resize buffer too small
-#define PF_LASTWARN        PF_TOOSMALL
+#define PF_READONLY        (START_PF_WARN + 9) // file opened read-only
+#define PF_FILEFULL        (START_PF_WARN + 10) // no page number left
+#define PF_LASTWARN        PF_FILEFULL
 
 #define PF_NOMEM           (START_PF_ERR - 0)  // no memory
 #define PF_NOBUF           (START_PF_ERR - 1)  // no buffer space
@@ -13,11 +13,33 @@
 //       pf_test2.cc for a demo.
 // 1998: The statistics manager is now instantiated in this file and is
 //       created and destroyed by the buffer manager.
+// The buffer is split into latched shards; every public method takes the
+// latch of the shard(s) it touches, so the manager may be shared by
+// several threads.  Page I/O uses preadv/pwritev because the file offset
+// of a descriptor is shared by all threads; a run of adjacent pages is
+// transferred with a single call.
+// New pages go through Admit, accesses through Touch and victims through
+// ChooseVictim, which implement the replacement policy (LRU, CLOCK or 2Q).
+// Synchronous page I/O is done by PF_IOEngine::Transfer in the calling
+// thread; GetPageAsync, FlushPages and ForcePages submit requests to the
+// engine and let several I/Os be in flight at once.
+// ReadAhead watches the pages asked for per file and, on a sequential
+// reader, reads the next pages with one vectored request per window.
+// The optional background writer cleans the cold end of the lists with
+// WriteSlots; a miss that finds every unpinned page being written waits
+// for the writes instead of failing with PF_NOBUF.
 //
 
 #include <cstdio>
+#include <cstddef>
 #include <unistd.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
 #include <iostream>
+#include <algorithm>
+#include <vector>
+#include <chrono>
+#include <cerrno>
 #include "pf_buffermgr.h"
 
 using namespace std;
@@ -27,10 +49,21 @@ using namespace std;
 #ifdef PF_STATS            // 是否需要统计PF层信息,如果需要 =>编译时加上PF_STATS
 #include "statistics.h"   // For StatisticsMgr interface
 
-// Global variable for the statistics manager
+// Global variable for the statistics manager, shared by the buffer
+// managers alive: the first creates it and the last destroys it
 StatisticsMgr *pStatisticsMgr;
+static mutex statsLatch;                   // guards numStatsUsers
+static int numStatsUsers = 0;
+
+// The PF statistics have fixed counters (Stat_Counter STAT_<key>), which
+// are lock free
+#define PF_STAT_ADDONE(key)         pStatisticsMgr->Add(STAT_##key)
+#define PF_STAT_ADDVALUE(key, value) pStatisticsMgr->Add(STAT_##key, (value))
 #endif
 
+#define MEMORY_FD -1                // 这是一个表示内存的文件描述符
+#define PF_ALL_FILES -2             // every file, for SnapshotShard
+
 #ifdef PF_LOG             // 是否需要打印日志
 
 //
@@ -98,58 +131,60 @@ void WriteLog(const char *psMessage)
 //       can be pinned multiple times).  If not, it reads it from the file
 //       and pins it.  If the buffer is full and a new page needs to be
 //       inserted, an unpinned page is replaced according to an LRU
-// In:   numPages - the number of pages in the buffer
+//       (or CLOCK) policy
+// In:   config - the number of pages in the buffer, the number of
+//       latched shards, the page replacement policy, the pages the hash
+//       tables are sized for (never fewer than the frames of a shard),
+//       whether the frames should use huge pages, the backend of
+//       asynchronous I/O, read-ahead and the background writer
 //
-// Note: The constructor will initialize the global pStatisticsMgr.  We
-//       make it global so that other components may use it and to allow
-//       easy access.
+// Note: The constructor will initialize the global pStatisticsMgr (the
+//       first buffer manager alive creates it).  We make it global so
+//       that other components may use it and to allow easy access.
 //
 // Aut2003
 // numPages changed to _numPages for to eliminate CC warnings
 // 
 // 1.初始化PF_BufferMgr的部分成员变量
 // 2.动态分配PF_BUFFER_SIZE个缓冲区,之后将作为page在内存的buffer
-PF_BufferMgr::PF_BufferMgr(int _numPages) : hashTable(PF_HASH_TBL_SIZE)
+// 3.将缓冲区切分为numShards个分片(见InitShards)
+PF_BufferMgr::PF_BufferMgr(const PF_BufferConfig &config)
 {  
-   // PF_HashTable使用PF_HASH_TBL_SIZE初始化(见上面)
-
    // Initialize local variables
-   this->numPages = _numPages;                        /*使用PF_BUFFER_SIZE,40*/
    pageSize = PF_PAGE_SIZE + sizeof(PF_PageHdr);      /*4096*/
+   shards = NULL;
+   policy = config.policy;
+   hashSize = config.hashSize;
+   bHugePages = config.bHugePages;
+   arenas = NULL;
+   nextBlockShard = 0;
+   bReadAheadOn = config.bReadAhead;
+   for (int i = 0; i < PF_READAHEAD_FILES; i++)
+      raTable[i].fd = -1;
+   bgDirtyPct = config.bgDirtyPct;
+   bgMaxRate = config.bgMaxRate;
+   bBgStop = FALSE;
 
 #ifdef PF_STATS
    // Initialize the global variable for the statistics manager
-   pStatisticsMgr = new StatisticsMgr();
+   {
+      lock_guard<mutex> statsGuard(statsLatch);
+      if (numStatsUsers++ == 0)
+         pStatisticsMgr = new StatisticsMgr();
+   }
 #endif
 
 #ifdef PF_LOG
    char psMessage[100];
    sprintf (psMessage, "Creating buffer manager. %d pages of size %d.\n",
-         numPages, PF_PAGE_SIZE+sizeof(PF_PageHdr));
+         config.numPages, PF_PAGE_SIZE+sizeof(PF_PageHdr));
    WriteLog(psMessage);
 #endif
 
-   // Allocate memory for buffer page description table
-   bufTable = new PF_BufPageDesc[numPages];
-
-   // Initialize the buffer table and allocate memory for buffer pages.
-   // Initially, the free list contains all pages
-   for (int i = 0; i < numPages; i++) {                  /*初始化缓冲区*/
-      if ((bufTable[i].pData = new char[pageSize]) == NULL) {
-         cerr << "Not enough memory for buffer\n";
-         exit(1);
-      }
-
-      memset ((void *)bufTable[i].pData, 0, pageSize);   /*清空缓冲区page*/
-
-      bufTable[i].prev = i - 1;        
-      bufTable[i].next = i + 1;
-   }
-
-
-   bufTable[0].prev = bufTable[numPages - 1].next = INVALID_SLOT;   /*第一个和最后一个特殊处理*/
-   free = 0;
-   first = last = INVALID_SLOT;
+   InitShards(config.numPages, config.numShards);
+   pIOEngine = new PF_IOEngine(config.ioBackend, PF_IO_NUM_THREADS);
+   if (config.bBgWriter)
+      bgWriter = thread(&PF_BufferMgr::BgWriter, this);
 
 #ifdef PF_LOG
    WriteLog("Succesfully created the buffer manager.\n");
@@ -164,15 +199,31 @@ PF_BufferMgr::PF_BufferMgr(int _numPages) : hashTable(PF_HASH_TBL_SIZE)
 // 需要释放缓冲区
 PF_BufferMgr::~PF_BufferMgr()
 {
-   // Free up buffer pages and tables
-   for (int i = 0; i < this->numPages; i++)
-      delete [] bufTable[i].pData;
+   // Stop the background writer
+   {
+      lock_guard<mutex> bgGuard(bgLatch);
+      bBgStop = TRUE;
+   }
+   bgWake.notify_all();
+   if (bgWriter.joinable())
+      bgWriter.join();
 
-   delete [] bufTable;
+   // Let the I/O in flight complete before the frames go away
+   delete pIOEngine;
+
+   // Free up buffer pages and tables
+   FreeShards();
+   ShrinkArenas(0);
 
 #ifdef PF_STATS
    // Destroy the global statistics manager
-   delete pStatisticsMgr;
+   {
+      lock_guard<mutex> statsGuard(statsLatch);
+      if (--numStatsUsers == 0) {
+         delete pStatisticsMgr;
+         pStatisticsMgr = NULL;
+      }
+   }
 #endif
 
 #ifdef PF_LOG
@@ -180,6 +231,230 @@ PF_BufferMgr::~PF_BufferMgr()
 #endif
 }
 
+//
+// InitShards
+//
+// Desc: Internal.  Allocate the buffer table, map frames for the pages
+//       if the arenas do not hold enough yet, then split the slots into
+//       _numShards contiguous ranges.  Each shard starts
+//       with all its slots on its free list.  Each shard gets a hash
+//       table sized for its frames or its share of hashSize, whichever
+//       is larger.  A resize keeps the shards themselves: other threads
+//       may be waiting on their latches, so only what the latch protects
+//       is rebuilt.
+// In:   _numPages - the number of pages in the buffer
+//       _numShards - the number of shards (clamped to [1, _numPages]);
+//       on a resize, the current number
+//
+// 分片i管理的slot区间为[i*numPages/numShards, (i+1)*numPages/numShards)
+void PF_BufferMgr::InitShards(int _numPages, int _numShards)
+{
+   if (_numShards < 1)
+      _numShards = 1;
+   if (_numShards > _numPages)
+      _numShards = _numPages;
+
+   // numShards stays as it is over a resize, read by ShardOf without a
+   // latch
+   this->numPages = _numPages;                        /*默认PF_BUFFER_SIZE,40*/
+   if (shards == NULL)
+      this->numShards = _numShards;
+
+   // Allocate memory for buffer page description table
+   bufTable = new PF_BufPageDesc[numPages];
+
+   // Make sure there is a frame for every slot
+   GrowArenas(numPages);
+
+   // Initialize the buffer table and point every slot at its frame
+   for (int i = 0; i < numPages; i++) {                  /*初始化缓冲区*/
+      bufTable[i].pData = FrameOf(i);
+      bufTable[i].fd = -1;
+      bufTable[i].pinCount = 0;
+      bufTable[i].bDirty = FALSE;
+      bufTable[i].bRef = FALSE;
+      bufTable[i].bProbation = FALSE;
+      bufTable[i].hint = NO_HINT;
+      bufTable[i].bReadAhead = FALSE;
+      bufTable[i].ioState = PF_PAGE_IO_NONE;
+      bufTable[i].ioRC = 0;
+      bufTable[i].pWaiters = NULL;
+   }
+
+   // Initially, the free list of every shard contains all its pages
+   int bResize = (shards != NULL);
+   if (!bResize)
+      shards = new PF_BufShard[numShards];
+   for (int s = 0; s < numShards; s++) {
+      PF_BufShard &shard = shards[s];
+      shard.lo = (int)((long)s * numPages / numShards);
+      shard.hi = (int)((long)(s + 1) * numPages / numShards);
+      if (bResize)
+         delete shard.hashTable;
+      shard.hashTable = new PF_HashTable(max(shard.hi - shard.lo, hashSize / numShards));
+
+      for (int i = shard.lo; i < shard.hi; i++) {
+         bufTable[i].prev = i - 1;
+         bufTable[i].next = i + 1;
+      }
+      bufTable[shard.lo].prev = bufTable[shard.hi - 1].next = INVALID_SLOT;  /*第一个和最后一个特殊处理*/
+      shard.free = shard.lo;
+      shard.first = shard.last = INVALID_SLOT;
+      shard.a1First = shard.a1Last = INVALID_SLOT;
+      shard.a1Len = 0;
+      shard.hand = shard.lo;
+      shard.numDirty = 0;
+      shard.numWriting = 0;
+
+      // The hit and miss counts go on over a resize
+      if (!bResize) {
+         shard.numHits = shard.numMisses = 0;
+         shard.fileHits = new long long[PF_ACCESS_FDS]();
+         shard.fileMisses = new long long[PF_ACCESS_FDS]();
+      }
+   }
+}
+
+//
+// FreeShards
+//
+// Desc: Internal.  Release what InitShards allocated, except the frames
+//       which stay mapped in the arenas
+//
+void PF_BufferMgr::FreeShards()
+{
+   delete [] bufTable;
+
+   for (int s = 0; s < numShards; s++) {
+      delete shards[s].hashTable;
+      delete [] shards[s].fileHits;
+      delete [] shards[s].fileMisses;
+   }
+   delete [] shards;
+}
+
+//
+// GrowArenas
+//
+// Desc: Internal.  Map one more arena if the arenas hold fewer than
+//       _numPages frames.  The mapping is anonymous, so the frames start
+//       zeroed and page aligned.  With bHugePages the arena is aligned to
+//       and padded up to PF_HUGE_PAGE_SIZE and advised for transparent
+//       huge pages.
+// In:   _numPages - the number of frames needed
+//
+// 缓冲区页不再逐个new,而是由mmap得到的连续区域(arena)按slot切分;扩大缓冲区时追加一个arena
+void PF_BufferMgr::GrowArenas(int _numPages)
+{
+   PF_Arena **ppLast = &arenas;
+   int numSlots = 0;
+   for (; *ppLast != NULL; ppLast = &(*ppLast)->next)
+      numSlots += (*ppLast)->numSlots;
+
+   if (numSlots >= _numPages)
+      return;
+
+   PF_Arena *pArena = new PF_Arena;
+   pArena->firstSlot = numSlots;
+   pArena->numSlots = _numPages - numSlots;
+   pArena->length = (size_t)pArena->numSlots * pageSize;
+   pArena->next = NULL;
+
+   size_t align = bHugePages ? PF_HUGE_PAGE_SIZE : 0;
+   if (align)
+      pArena->length = (pArena->length + align - 1) / align * align;
+
+   // Over-map by align bytes and trim both ends to an aligned region
+   char *pMap = (char *)mmap(NULL, pArena->length + align,
+         PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+   if (pMap == (char *)MAP_FAILED) {
+      cerr << "Not enough memory for buffer\n";
+      exit(1);
+   }
+   pArena->base = pMap;
+   if (align) {
+      pArena->base = (char *)(((size_t)pMap + align - 1) / align * align);
+      if (pArena->base > pMap)
+         munmap(pMap, pArena->base - pMap);
+      if (pMap + align > pArena->base)
+         munmap(pArena->base + pArena->length, pMap + align - pArena->base);
+#ifdef MADV_HUGEPAGE
+      madvise(pArena->base, pArena->length, MADV_HUGEPAGE);
+#endif
+   }
+
+   *ppLast = pArena;
+}
+
+//
+// ShrinkArenas
+//
+// Desc: Internal.  Unmap the arenas that only hold frames at or past
+//       _numPages, and give the memory of the remaining frames past
+//       _numPages back to the system (they stay mapped and read as zero
+//       if the buffer grows again).
+// In:   _numPages - the number of frames still needed
+//
+void PF_BufferMgr::ShrinkArenas(int _numPages)
+{
+   PF_Arena **ppArena = &arenas;
+   while (*ppArena != NULL) {
+      PF_Arena *pArena = *ppArena;
+      if (pArena->firstSlot >= _numPages) {
+         munmap(pArena->base, pArena->length);
+         *ppArena = pArena->next;
+         delete pArena;
+         continue;
+      }
+      if (pArena->firstSlot + pArena->numSlots > _numPages) {
+         char *pFirst = FrameOf(_numPages);
+         madvise(pFirst, pArena->base + pArena->length - pFirst, MADV_DONTNEED);
+      }
+      ppArena = &pArena->next;
+   }
+}
+
+//
+// FrameOf
+//
+// Desc: Internal.  Address of the frame of slot
+// Ret:  the frame, or NULL if no arena backs the slot
+//
+char *PF_BufferMgr::FrameOf(int slot) const
+{
+   for (PF_Arena *pArena = arenas; pArena != NULL; pArena = pArena->next)
+      if (slot < pArena->firstSlot + pArena->numSlots)
+         return (pArena->base + (size_t)(slot - pArena->firstSlot) * pageSize);
+   return (NULL);
+}
+
+//
+// ShardOf
+//
+// Desc: Internal.  Map (fd,pageNum) to the shard holding the page.  The
+//       pair is mixed so that consecutive pages of a file spread over the
+//       shards.  Memory blocks (MEMORY_FD) use their slot as page number
+//       and therefore live in the shard owning that slot.
+// Ret:  reference to the shard
+//
+PF_BufShard &PF_BufferMgr::ShardOf(int fd, PageNum pageNum) const
+{
+   if (numShards == 1)
+      return shards[0];
+
+   if (fd == MEMORY_FD) {
+      for (int s = 0; s < numShards; s++)
+         if (pageNum >= shards[s].lo && pageNum < shards[s].hi)
+            return shards[s];
+   }
+
+   unsigned int h = (unsigned int)fd * 0x9E3779B1u ^ (unsigned int)pageNum;
+   h ^= h >> 16;
+   h *= 0x85EBCA6Bu;
+   h ^= h >> 13;
+   return shards[h % numShards];
+}
+
 //
 // GetPage
 //
@@ -191,6 +466,7 @@ PF_BufferMgr::~PF_BufferMgr()
 // In:   fd - OS file descriptor of the file to read
 //       pageNum - number of the page to read
 //       bMultiplePins - if FALSE, it is an error to ask for a page that is already pinned in the buffer.
+//       hint - SEQUENTIAL_HINT if the page is read as part of a scan
 // Out:  ppBuffer - set *ppBuffer to point to the page in the buffer
 // Ret:  PF return code
 //
@@ -201,7 +477,8 @@ PF_BufferMgr::~PF_BufferMgr()
 // 主要被PF_FileHandle::GetThisPage()调用,比如:
 // char* pPageBuf;
 // pBufferMgr->GetPage(unixfd, pageNum, &pPageBuf); 由于需要修改指针,故传入双指针&pPageBuf
-RC PF_BufferMgr::GetPage(int fd, PageNum pageNum, char **ppBuffer,int bMultiplePins)
+RC PF_BufferMgr::GetPage(int fd, PageNum pageNum, char **ppBuffer,int bMultiplePins,
+      ClientHint hint)
 {
    RC  rc;     // return code
    int slot;   // buffer slot where page is located,在bucket中的编号
@@ -214,67 +491,117 @@ RC PF_BufferMgr::GetPage(int fd, PageNum pageNum, char **ppBuffer,int bMultipleP
 
 
 #ifdef PF_STATS
-   pStatisticsMgr->Register(PF_GETPAGE, STAT_ADDONE);
+   PF_STAT_ADDONE(PF_GETPAGE);
+   long long startNs = pStatisticsMgr->IsTiming() ? StatisticsMgr::Now() : 0;
 #endif
 
+   PF_BufShard &shard = ShardOf(fd, pageNum);
+   unique_lock<mutex> guard(shard.latch);
+
    // Search for page in buffer,获取这个page在缓冲区中的编号slot
-   if ((rc = hashTable.Find(fd, pageNum, slot)) && (rc != PF_HASHNOTFOUND))
-      return (rc);                // unexpected error
+   // A page still being read (by another GetPage, read-ahead or
+   // GetPageAsync) is waited for and looked up again, since a failed read
+   // may drop it.  If the page is not in the buffer, allocate an empty
+   // page, this will also promote the newly allocated page to the MRU
+   // slot (or the probationary list under 2Q); when the only unpinned
+   // pages are being written, wait for the writes and look again, and
+   // look again at once after writing a dirty victim
+   // 页正在被读入(或可置换的页都在被写回)时等待其完成后重新查找
+   int bFound;
+   for (;;) {
+      if ((rc = shard.hashTable->Find(fd, pageNum, slot)) && (rc != PF_HASHNOTFOUND))
+         return (rc);                // unexpected error
+      bFound = (rc == 0);
+      if (bFound ? bufTable[slot].ioState != PF_PAGE_IO_READ :
+            ((rc = InternalAlloc(shard, guard, slot, hint)) != PF_NOBUF ||
+             shard.numWriting == 0)) {
+         if (rc != PF_ALLOCAGAIN)
+            break;
+      }
+      else
+         shard.ioDone.wait(guard);
+   }
 
    // If page not in buffer(PF_HASHNOTFOUND对应bucket号<0)...
-   if (rc == PF_HASHNOTFOUND) {
+   if (!bFound) {
 
 #ifdef PF_STATS
-   pStatisticsMgr->Register(PF_PAGENOTFOUND, STAT_ADDONE);
+   PF_STAT_ADDONE(PF_PAGENOTFOUND);
 #endif
 
-      // Allocate an empty page, this will also promote the newly allocated
-      // page to the MRU slot
-      if ((rc = InternalAlloc(slot)))
+      if (rc)
          return (rc);
+      CountAccess(shard, fd, FALSE);
 
-      // read the page, insert it into the hash table,
-      // and initialize the page description entry
-      if ((rc = ReadPage(fd, pageNum, bufTable[slot].pData)) ||
-            (rc = hashTable.Insert(fd, pageNum, slot)) ||
+      // insert the page into the hash table, initialize the page
+      // description entry, and read the page
+      if ((rc = shard.hashTable->Insert(fd, pageNum, slot)) ||
             (rc = InitPageDesc(fd, pageNum, slot))) {
 
             // Put the slot back on the free list before returning the error
-            Unlink(slot);
-            InsertFree(slot);
+            Unlink(shard, slot);
+            InsertFree(shard, slot);
             return (rc);
       }
+
+      // The page is read without the latch, pinned and marked
+      // PF_PAGE_IO_READ so that other GetPage calls wait for it and
+      // GetPageAsync calls join it; FinishRead wakes them
+      // 读盘期间不持有latch
+      bufTable[slot].ioState = PF_PAGE_IO_READ;
+      bufTable[slot].ioRC = 0;
+      bufTable[slot].pWaiters = NULL;
+      guard.unlock();
+
+      rc = ReadPage(fd, pageNum, bufTable[slot].pData);
+      FinishRead(slot, rc);
+
+      guard.lock();
+      if (rc) {
+         ReleaseFailed(shard, slot);
+         return (rc);
+      }
 #ifdef PF_LOG
    WriteLog("Page not found in buffer. Loaded.\n");
 #endif
    }
    else {   // Page is in the buffer...
 
-#ifdef PF_STATS
-   pStatisticsMgr->Register(PF_PAGEFOUND, STAT_ADDONE);
-#endif
-
       // Error if we don't want to get a pinned page=> 如果不允许多次pin到内存
       if (!bMultiplePins && bufTable[slot].pinCount > 0)
          return (PF_PAGEPINNED);
 
-      // Page is alredy in memory, just increment pin count
-      bufTable[slot].pinCount++;
+      // Page is alredy in memory, just increment pin count and make it
+      // the most recently used page
+      // 将slot对应节点从当前链表取出,然后放到used链表头部,作为MRU(CLOCK只置引用位)
+      if ((rc = Access(shard, slot, hint)))
+         return (rc);
 #ifdef PF_LOG
       sprintf (psMessage, "Page found in buffer.  %d pin count.\n",
             bufTable[slot].pinCount);
       WriteLog(psMessage);
 #endif
 
-      // Make this page the most recently used page
-      // 将slot对应节点从当前链表取出,然后放到used链表头部,作为MRU
-      if ((rc = Unlink(slot)) || (rc = LinkHead (slot)))
+      // The asynchronous read of the page may have failed; the pins
+      // taken on it meanwhile keep it until they are dropped
+      if ((rc = bufTable[slot].ioRC)) {
+         ReleaseFailed(shard, slot);
          return (rc);
+      }
    }
 
    // Point ppBuffer to page
    *ppBuffer = bufTable[slot].pData;
 
+#ifdef PF_STATS
+   // Only the successful calls are timed, waits for I/O included
+   if (startNs) {
+      guard.unlock();
+      pStatisticsMgr->AddLatency(fd, bFound ? STAT_LAT_GETHIT :
+            STAT_LAT_GETMISS, StatisticsMgr::Now() - startNs);
+   }
+#endif
+
    // Return ok
    return (0);
 }
@@ -306,24 +633,36 @@ RC PF_BufferMgr::AllocatePage(int fd, PageNum pageNum, char **ppBuffer)
    WriteLog(psMessage);
 #endif
 
-   // If page is already in buffer, return an error, 已经在缓冲区中了
-   if (!(rc = hashTable.Find(fd, pageNum, slot)))
-      return (PF_PAGEINBUF);
-   else if (rc != PF_HASHNOTFOUND)
-      return (rc);              // unexpected error
+   PF_BufShard &shard = ShardOf(fd, pageNum);
+   unique_lock<mutex> guard(shard.latch);
+
+   for (;;) {
+      // If page is already in buffer, return an error, 已经在缓冲区中了
+      if (!(rc = shard.hashTable->Find(fd, pageNum, slot)))
+         return (PF_PAGEINBUF);
+      else if (rc != PF_HASHNOTFOUND)
+         return (rc);              // unexpected error
 
-   // Allocate an empty page
-   if ((rc = InternalAlloc(slot)))        // 获得一个可用缓冲区
+      // Allocate an empty page, waiting for the pages being written if
+      // they are the only unpinned ones, and looking again after writing
+      // a dirty victim
+      if ((rc = InternalAlloc(shard, guard, slot)) == PF_ALLOCAGAIN)
+         continue;
+      if (rc != PF_NOBUF || shard.numWriting == 0)
+         break;
+      shard.ioDone.wait(guard);
+   }
+   if (rc)                                       // 获得一个可用缓冲区
       return (rc);
 
    // Insert the page into the hash table,
    // and initialize the page description entry
-   if ((rc = hashTable.Insert(fd, pageNum, slot)) ||
+   if ((rc = shard.hashTable->Insert(fd, pageNum, slot)) ||
          (rc = InitPageDesc(fd, pageNum, slot))) {
 
       // Put the slot back on the free list before returning the error
-      Unlink(slot);
-      InsertFree(slot);
+      Unlink(shard, slot);
+      InsertFree(shard, slot);
       return (rc);
    }
 
@@ -338,6 +677,255 @@ RC PF_BufferMgr::AllocatePage(int fd, PageNum pageNum, char **ppBuffer)
    return (0);
 }
 
+//
+// GetPageAsync
+//
+// Desc: Pin a page and return without waiting for it to be read.  If the
+//       page is in the buffer the future is ready at once; otherwise a
+//       slot is allocated for it, entered in the hash table pinned and
+//       marked PF_PAGE_IO_READ, and the read is submitted to the I/O
+//       engine after the latch is released.  Several futures may wait
+//       for the same read, each holding a pin.
+// In:   fd - OS file descriptor of the file to read
+//       pageNum - number of the page to read
+//       hint - SEQUENTIAL_HINT if the page is read as part of a scan
+//       pfnDone, pArg - called once the page is in the buffer
+// Out:  future - to wait for the page with (WaitPage)
+// Ret:  PF return code; the result of the read itself is given by WaitPage
+//
+// 异步读:先占住slot并放入hashtable(pin住,状态为正在读),释放latch后再提交给I/O引擎
+RC PF_BufferMgr::GetPageAsync(int fd, PageNum pageNum, PF_PageFuture &future,
+      ClientHint hint, PF_PageCallback pfnDone, void *pArg)
+{
+   RC  rc;     // return code
+   int slot;   // buffer slot where page is located
+
+   if (future.bStarted)
+      return (PF_PAGEPINNED);
+
+#ifdef PF_STATS
+   PF_STAT_ADDONE(PF_GETPAGE);
+#endif
+
+   future.pBufferMgr = this;
+   future.fd = fd;
+   future.pageNum = pageNum;
+   future.rc = 0;
+   future.bPending = FALSE;
+   future.pfnDone = pfnDone;
+   future.pArg = pArg;
+   future.pNextWaiter = NULL;
+
+   PF_BufShard &shard = ShardOf(fd, pageNum);
+   unique_lock<mutex> guard(shard.latch);
+
+   // Look the page up; if it is not in the buffer, get a slot for it,
+   // waiting for the pages being written if they are the only unpinned
+   // ones, and looking again after writing a dirty victim
+   int bFound;
+   for (;;) {
+      if ((rc = shard.hashTable->Find(fd, pageNum, slot)) && (rc != PF_HASHNOTFOUND))
+         return (rc);                // unexpected error
+      bFound = (rc == 0);
+      if (bFound || (rc = InternalAlloc(shard, guard, slot, hint)) != PF_NOBUF ||
+            shard.numWriting == 0) {
+         if (rc != PF_ALLOCAGAIN)
+            break;
+      }
+      else
+         shard.ioDone.wait(guard);
+   }
+
+   if (bFound) {
+      if ((rc = Access(shard, slot, hint)))
+         return (rc);
+
+      future.slot = slot;
+      future.bStarted = TRUE;
+
+      // Join the futures waiting for a read in flight
+      if (bufTable[slot].ioState == PF_PAGE_IO_READ) {
+         future.bPending = TRUE;
+         future.pNextWaiter = bufTable[slot].pWaiters;
+         bufTable[slot].pWaiters = &future;
+         return (0);
+      }
+
+      future.rc = bufTable[slot].ioRC;
+      guard.unlock();
+      if (pfnDone != NULL)
+         pfnDone(pageNum, future.rc, pArg);
+      return (0);
+   }
+
+#ifdef PF_STATS
+   PF_STAT_ADDONE(PF_PAGENOTFOUND);
+#endif
+
+   if (rc)
+      return (rc);
+   CountAccess(shard, fd, FALSE);
+
+#ifdef PF_STATS
+   PF_STAT_ADDONE(PF_READPAGE);
+#endif
+
+   if ((rc = shard.hashTable->Insert(fd, pageNum, slot)) ||
+         (rc = InitPageDesc(fd, pageNum, slot))) {
+      Unlink(shard, slot);
+      InsertFree(shard, slot);
+      return (rc);
+   }
+
+   PF_BufPageDesc &desc = bufTable[slot];
+   desc.ioState = PF_PAGE_IO_READ;
+   desc.ioRC = 0;
+   desc.pWaiters = &future;
+   desc.ioVec.iov_base = desc.pData;
+   desc.ioVec.iov_len = pageSize;
+   InitRequest(desc.ioReq, FALSE, fd, pageNum, &desc.ioVec, 1);
+   desc.ioReq.pfnDone = ReadDone;
+   desc.ioReq.pArg = this;
+
+   future.slot = slot;
+   future.bPending = TRUE;
+   future.bStarted = TRUE;
+
+   // The slot is pinned, so it stays ours without the latch
+   guard.unlock();
+
+   PF_IORequest *pReq = &desc.ioReq;
+   pIOEngine->Submit(&pReq, 1);
+
+   // Return ok
+   return (0);
+}
+
+//
+// WaitPage
+//
+// Desc: Wait for the page of a future started by GetPageAsync.  If its
+//       read failed, the pin of the future is dropped.
+// In:   future - the future
+// Out:  ppBuffer - set *ppBuffer to point to the page in the buffer
+// Ret:  the error of the read, or 0
+//
+RC PF_BufferMgr::WaitPage(PF_PageFuture &future, char **ppBuffer)
+{
+   PF_BufShard &shard = ShardOf(future.fd, future.pageNum);
+   unique_lock<mutex> guard(shard.latch);
+
+   while (future.bPending)
+      shard.ioDone.wait(guard);
+   future.bStarted = FALSE;
+
+   if (future.rc) {
+      ReleaseFailed(shard, future.slot);
+      return (future.rc);
+   }
+
+   *ppBuffer = bufTable[future.slot].pData;
+   return (0);
+}
+
+//
+// IsPageReady
+//
+// Desc: TRUE if WaitPage would not block for future
+//
+int PF_BufferMgr::IsPageReady(const PF_PageFuture &future)
+{
+   PF_BufShard &shard = ShardOf(future.fd, future.pageNum);
+   lock_guard<mutex> guard(shard.latch);
+
+   return (!future.bPending);
+}
+
+//
+// ReadAhead
+//
+// Desc: Called before a page of a file is asked for.  Once the file is
+//       read sequentially (PF_READAHEAD_MIN_RUN pages in a row, or
+//       SEQUENTIAL_HINT), read the pages that follow it asynchronously.
+//       The window starts at PF_READAHEAD_MIN pages and doubles each time
+//       the reader reaches the previous one, up to a quarter of the
+//       buffer (and PF_MAX_IOV).  Advisory: failures are ignored.
+// In:   fd - OS file descriptor of the file
+//       pageNum - the page about to be asked for
+//       numFilePages - # of pages in the file, not read beyond
+//       hint - hint of the client
+//
+// 顺序预读:按fd检测顺序访问,窗口翻倍增长,每个窗口一次异步向量读
+void PF_BufferMgr::ReadAhead(int fd, PageNum pageNum, PageNum numFilePages,
+      ClientHint hint)
+{
+   PageNum first;    // first page to read ahead
+   int     numRun;   // # of pages to read ahead
+
+   if (!bReadAheadOn)
+      return;
+
+   int maxWindow = numPages / 4;
+   if (maxWindow > PF_MAX_IOV)
+      maxWindow = PF_MAX_IOV;
+   if (maxWindow < 1)
+      maxWindow = 1;
+
+   {
+      lock_guard<mutex> guard(raLatch);
+      PF_ReadAhead &ra = raTable[(unsigned)fd % PF_READAHEAD_FILES];
+
+      if (ra.fd != fd) {
+         ra.fd = fd;
+         ra.lastPage = -1;
+         ra.seqRun = 0;
+         ra.raStart = ra.raEnd = ra.raMark = 0;
+         ra.window = 0;
+      }
+
+      // The same page again says nothing about the access pattern
+      if (pageNum == ra.lastPage)
+         return;
+
+      if (pageNum == ra.lastPage + 1)
+         ra.seqRun++;
+      else if (hint != SEQUENTIAL_HINT) {
+         ra.seqRun = 0;
+         ra.raStart = ra.raEnd = ra.raMark = 0;
+      }
+      ra.lastPage = pageNum;
+
+      if (hint != SEQUENTIAL_HINT && ra.seqRun < PF_READAHEAD_MIN_RUN)
+         return;
+
+      if (pageNum >= ra.raStart && pageNum < ra.raEnd) {
+         // Within the last window: read the next one once the reader
+         // gets to the first page of the last one
+         if (pageNum < ra.raMark)
+            return;
+         first = ra.raEnd;
+         ra.window *= 2;
+         if (ra.window > maxWindow)
+            ra.window = maxWindow;
+      }
+      else {
+         // A new sequential run
+         first = ra.raStart = pageNum;
+         ra.window = (PF_READAHEAD_MIN < maxWindow) ? PF_READAHEAD_MIN : maxWindow;
+      }
+
+      numRun = ra.window;
+      if (numRun > numFilePages - first)
+         numRun = numFilePages - first;
+      if (numRun <= 0)
+         return;
+      ra.raMark = first;
+      ra.raEnd = first + numRun;
+   }
+
+   Prefetch(fd, first, numRun);
+}
+
 //
 // MarkDirty
 //
@@ -359,8 +947,11 @@ RC PF_BufferMgr::MarkDirty(int fd, PageNum pageNum)
    WriteLog(psMessage);
 #endif
 
+   PF_BufShard &shard = ShardOf(fd, pageNum);
+   lock_guard<mutex> guard(shard.latch);
+
    // The page must be found and pinned in the buffer
-   if ((rc = hashTable.Find(fd, pageNum, slot))){
+   if ((rc = shard.hashTable->Find(fd, pageNum, slot))){
       if ((rc == PF_HASHNOTFOUND))
          return (PF_PAGENOTINBUF);
       else
@@ -371,11 +962,10 @@ RC PF_BufferMgr::MarkDirty(int fd, PageNum pageNum)
       return (PF_PAGEUNPINNED);
 
    // Mark this page dirty
-   bufTable[slot].bDirty = TRUE;
+   SetDirty(shard, slot, TRUE);
 
    // Make this page the most recently used page
-   if ((rc = Unlink(slot)) ||
-         (rc = LinkHead (slot)))
+   if ((rc = Touch(shard, slot, FALSE)))
       return (rc);
 
    // Return ok
@@ -398,8 +988,11 @@ RC PF_BufferMgr::UnpinPage(int fd, PageNum pageNum)
    RC  rc;       // return code
    int slot;     // buffer slot where page is located
 
+   PF_BufShard &shard = ShardOf(fd, pageNum);
+   lock_guard<mutex> guard(shard.latch);
+
    // The page must be found and pinned in the buffer
-   if ((rc = hashTable.Find(fd, pageNum, slot))){
+   if ((rc = shard.hashTable->Find(fd, pageNum, slot))){
       if ((rc == PF_HASHNOTFOUND))
          return (PF_PAGENOTINBUF);
       else
@@ -418,8 +1011,7 @@ RC PF_BufferMgr::UnpinPage(int fd, PageNum pageNum)
 
    // If unpinning the last pin, make it the most recently used page,为什么要这样
    if (--(bufTable[slot].pinCount) == 0) {
-      if ((rc = Unlink(slot)) ||
-            (rc = LinkHead (slot)))
+      if ((rc = Touch(shard, slot, FALSE)))
          return (rc);
    }
 
@@ -435,13 +1027,15 @@ RC PF_BufferMgr::UnpinPage(int fd, PageNum pageNum)
 //       A linear search of the buffer is performed.
 //       A better method is not needed because # of buffers are small.
 // In:   fd - file descriptor
+//       bSync - TRUE to end with an fdatasync of the file (SyncFiles)
 // Ret:  PF_PAGEPINNED or other PF return code
 //
 // 释放缓冲区中所有属于fd的页 => 更恰当地说是将文件的数据刷新到磁盘
 // 1.如果该page是pined的,则只需返回警告,不用释放
 // 2.如果该page是unpin的,但是是脏数据,则需要写回磁盘
 // 3.对所有释放后的缓冲区页,需要插入到free链表头部
-RC PF_BufferMgr::FlushPages(int fd)
+// 4.文件的页分散在各个分片中,逐个分片加锁处理
+RC PF_BufferMgr::FlushPages(int fd, int bSync)
 {
    RC rc, rcWarn = 0;  // return codes
 
@@ -452,52 +1046,77 @@ RC PF_BufferMgr::FlushPages(int fd)
 #endif
 
 #ifdef PF_STATS
-   pStatisticsMgr->Register(PF_FLUSHPAGES, STAT_ADDONE);
+   PF_STAT_ADDONE(PF_FLUSHPAGES);
 #endif
 
-   // Do a linear scan of the buffer to find pages belonging to the file
-   int slot = first;
-   while (slot != INVALID_SLOT) {
+   // Write the dirty unpinned pages of the file as one batch first,
+   // in page order
+   if ((rc = WriteDirty(fd, ALL_PAGES, TRUE)))
+      return (rc);
+
+   for (int s = 0; s < numShards; s++) {
+      PF_BufShard &shard = shards[s];
+      unique_lock<mutex> guard(shard.latch);
+
+      // Let the I/O in flight for the file (reads, victim and background
+      // writes) complete; the latch is then kept until the shard is done
+      for (int slot = FirstUsed(shard); slot != INVALID_SLOT; ) {
+         if (bufTable[slot].fd == fd && bufTable[slot].ioState != PF_PAGE_IO_NONE) {
+            shard.ioDone.wait(guard);
+            slot = FirstUsed(shard);      // the lists may have changed
+            continue;
+         }
+         slot = NextUsed(shard, slot);
+      }
 
-      int next = bufTable[slot].next;
+      // Do a linear scan of the buffer to find pages belonging to the file
+      int slot = FirstUsed(shard);
+      while (slot != INVALID_SLOT) {
 
-      // If the page belongs to the passed-in file descriptor
-      if (bufTable[slot].fd == fd) {
+         int next = NextUsed(shard, slot);
+
+         // If the page belongs to the passed-in file descriptor
+         if (bufTable[slot].fd == fd) {
 
 #ifdef PF_LOG
  sprintf (psMessage, "Page (%d) is in buffer manager.\n", bufTable[slot].pageNum);
  WriteLog(psMessage);
 #endif
-         // Ensure the page is not pinned
-         if (bufTable[slot].pinCount) {
-            rcWarn = PF_PAGEPINNED;
-         }
-         else {
-            // Write the page if dirty
-            if (bufTable[slot].bDirty) {
+            // Ensure the page is not pinned
+            if (bufTable[slot].pinCount) {
+               rcWarn = PF_PAGEPINNED;
+            }
+            else {
+               // Write the page if it was dirtied again during the batch
+               if (bufTable[slot].bDirty) {
 #ifdef PF_LOG
  sprintf (psMessage, "Page (%d) is dirty\n",bufTable[slot].pageNum);
  WriteLog(psMessage);
 #endif
-               if ((rc = WritePage(fd, bufTable[slot].pageNum, bufTable[slot].pData)))
+                  if ((rc = WritePage(fd, bufTable[slot].pageNum, bufTable[slot].pData)))
+                     return (rc);
+                  SetDirty(shard, slot, FALSE);
+               }
+
+               // Remove page from the hash table and add the slot to the free list
+               if ((rc = shard.hashTable->Delete(fd, bufTable[slot].pageNum)) ||
+                     (rc = Unlink(shard, slot)) ||
+                     (rc = InsertFree(shard, slot)))
                   return (rc);
-               bufTable[slot].bDirty = FALSE;
             }
-
-            // Remove page from the hash table and add the slot to the free list
-            if ((rc = hashTable.Delete(fd, bufTable[slot].pageNum)) ||
-                  (rc = Unlink(slot)) ||
-                  (rc = InsertFree(slot)))
-               return (rc);
          }
+         slot = next;
       }
-      slot = next;
    }
 
 #ifdef PF_LOG
    WriteLog("All necessary pages flushed.\n");
 #endif
 
+   // Make the pages durable
+   if (bSync && (rc = SyncFiles(&fd, 1)))
+      return (rc);
+
    // Return warning or ok
    return (rcWarn);
 }
@@ -507,14 +1126,17 @@ RC PF_BufferMgr::FlushPages(int fd)
 //
 // Desc: If a page is dirty then force the page from the buffer pool
 //       onto disk.  The page will not be forced out of the buffer pool.
+//       The dirty pages are written in page order, adjacent ones with a
+//       single request (see WriteDirty).
 // In:   The page number, a default value of ALL_PAGES will be used if
 //       the client doesn't provide a value.  This will force all pages.
+//       bSync - TRUE to end with an fdatasync of the file (SyncFiles)
 // Ret:  Standard PF errors
 //
 // 将缓冲区中(fd,pageNum)对应的页强制写回磁盘
 // 1.如果该页是dirty的,则写回磁盘.否则不需要
 // 2.无论是否写回磁盘,都不需要释放内存缓冲区!!!
-RC PF_BufferMgr::ForcePages(int fd, PageNum pageNum)
+RC PF_BufferMgr::ForcePages(int fd, PageNum pageNum, int bSync)
 {
    RC rc;  // return codes
 
@@ -524,38 +1146,119 @@ RC PF_BufferMgr::ForcePages(int fd, PageNum pageNum)
    WriteLog(psMessage);
 #endif
 
-   // Do a linear scan of the buffer to find the page for the file
-   int slot = first;
-   while (slot != INVALID_SLOT) {
+   // I don't care if the pages are pinned or not, just write them if
+   // they are dirty
+   if ((rc = WriteDirty(fd, pageNum, FALSE)))
+      return (rc);
+
+   // Make the pages durable
+   if (bSync && (rc = SyncFiles(&fd, 1)))
+      return (rc);
 
-      int next = bufTable[slot].next;
+   return 0;
+}
 
-      // If the page belongs to the passed-in file descriptor
-      if (bufTable[slot].fd == fd &&
-            (pageNum==ALL_PAGES || bufTable[slot].pageNum == pageNum)) {
 
-#ifdef PF_LOG
- sprintf (psMessage, "Page (%d) is in buffer pool.\n", bufTable[slot].pageNum);
- WriteLog(psMessage);
-#endif
-         // I don't care if the page is pinned or not, just write it if
-         // it is dirty.
-         if (bufTable[slot].bDirty) {
-#ifdef PF_LOG
-sprintf (psMessage, "Page (%d) is dirty\n",bufTable[slot].pageNum);
-WriteLog(psMessage);
+//
+// NoteWrite
+//
+// Desc: Remember that fd was written to since its last fdatasync.  Called
+//       once the write has completed.
+//
+void PF_BufferMgr::NoteWrite(int fd)
+{
+   lock_guard<mutex> guard(syncLatch);
+   unsyncedFds.insert(fd);
+}
+
+//
+// SyncFiles
+//
+// Desc: Make what was written to the files durable.  Only the files
+//       written since their last sync are synced, each once however often
+//       it is listed, and their fdatasync calls are submitted to the I/O
+//       engine as one batch so that they proceed together.  A file is
+//       taken off the unsynced set before its sync starts, so a write
+//       completing meanwhile puts it back.
+// In:   fds - OS file descriptors of the files
+//       numFds - # of files
+// Ret:  PF_UNIX if an fdatasync failed (the file stays unsynced), or 0
+//
+// 组提交:只对自上次同步后写过的文件调用fdatasync,所有文件一次提交
+RC PF_BufferMgr::SyncFiles(const int fds[], int numFds)
+{
+   PF_IORequest *reqs = new PF_IORequest[numFds];
+   PF_IORequest **pReqs = new PF_IORequest*[numFds];
+   int numSyncs = 0;
+   RC rc = 0;
+
+   {
+      lock_guard<mutex> guard(syncLatch);
+      for (int i = 0; i < numFds; i++) {
+         if (!unsyncedFds.erase(fds[i]))
+            continue;                     // clean, or listed twice
+         PF_IORequest &req = reqs[numSyncs];
+         InitRequest(req, FALSE, fds[i], 0, NULL, 0);
+         req.offset = 0;
+         req.bSync = TRUE;
+         pReqs[numSyncs++] = &req;
+      }
+   }
+
+#ifdef PF_STATS
+   PF_STAT_ADDVALUE(PF_SYNCSKIPPED, numFds - numSyncs);
 #endif
-            if ((rc = WritePage(fd, bufTable[slot].pageNum, bufTable[slot].pData)))
-               return (rc);
-            bufTable[slot].bDirty = FALSE;
+
+   if (numSyncs > 0) {
+      chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+      pIOEngine->Submit(pReqs, numSyncs);
+      for (int i = 0; i < numSyncs; i++) {
+         if (pIOEngine->Wait(reqs[i])) {
+            NoteWrite(reqs[i].fd);
+            rc = PF_UNIX;
          }
       }
-      slot = next;
+
+#ifdef PF_STATS
+      long usec = chrono::duration_cast<chrono::microseconds>(
+         chrono::steady_clock::now() - start).count();
+      PF_STAT_ADDVALUE(PF_SYNC, numSyncs);
+      PF_STAT_ADDVALUE(PF_SYNCUSEC, usec);
+#endif
    }
 
-   return 0;
+   delete [] pReqs;
+   delete [] reqs;
+   return (rc);
 }
 
+//
+// ForgetFile
+//
+// Desc: Forget about a file being closed, whose descriptor may be reused
+//
+void PF_BufferMgr::ForgetFile(int fd)
+{
+   {
+      lock_guard<mutex> guard(syncLatch);
+      unsyncedFds.erase(fd);
+   }
+
+   {
+      lock_guard<mutex> guard(raLatch);
+      PF_ReadAhead &ra = raTable[(unsigned)fd % PF_READAHEAD_FILES];
+      if (ra.fd == fd)
+         ra.fd = -1;
+   }
+
+   // The next file given the descriptor starts counting afresh
+   if (fd >= 0 && fd < PF_ACCESS_FDS)
+      for (int s = 0; s < numShards; s++) {
+         lock_guard<mutex> guard(shards[s].latch);
+         shards[s].fileHits[fd] = shards[s].fileMisses[fd] = 0;
+      }
+}
 
 //
 // PrintBuffer
@@ -569,24 +1272,34 @@ WriteLog(psMessage);
 RC PF_BufferMgr::PrintBuffer()
 {
    cout << "Buffer contains " << numPages << " pages of size "
-      << pageSize <<".\n";
+      << pageSize <<" in " << numShards << " shard(s).\n";
    cout << "Contents in order from most recently used to "
       << "least recently used.\n";
 
    // 这里只打印使用了的缓冲区(used链表)
-   int slot, next;
-   slot = first;
-   while (slot != INVALID_SLOT) {
-      next = bufTable[slot].next;
-      cout << slot << " :: \n";
-      cout << "  fd = " << bufTable[slot].fd << "\n";
-      cout << "  pageNum = " << bufTable[slot].pageNum << "\n";
-      cout << "  bDirty = " << bufTable[slot].bDirty << "\n";
-      cout << "  pinCount = " << bufTable[slot].pinCount << "\n";
-      slot = next;
+   int bEmpty = TRUE;
+   for (int s = 0; s < numShards; s++) {
+      PF_BufShard &shard = shards[s];
+      lock_guard<mutex> guard(shard.latch);
+
+      if (numShards > 1 && FirstUsed(shard) != INVALID_SLOT)
+         cout << "Shard " << s << " ::\n";
+
+      int slot, next;
+      slot = FirstUsed(shard);
+      while (slot != INVALID_SLOT) {
+         next = NextUsed(shard, slot);
+         cout << slot << " :: \n";
+         cout << "  fd = " << bufTable[slot].fd << "\n";
+         cout << "  pageNum = " << bufTable[slot].pageNum << "\n";
+         cout << "  bDirty = " << bufTable[slot].bDirty << "\n";
+         cout << "  pinCount = " << bufTable[slot].pinCount << "\n";
+         slot = next;
+         bEmpty = FALSE;
+      }
    }
 
-   if (first==INVALID_SLOT)
+   if (bEmpty)
       cout << "Buffer is empty!\n";
    else
       cout << "All remaining slots are free.\n";
@@ -594,33 +1307,208 @@ RC PF_BufferMgr::PrintBuffer()
    return 0;
 }
 
-
 //
-// ClearBuffer
+// PF_FileSnapshot
 //
-// Desc: Remove all entries from the buffer manager.
-//       This routine will be called via the system command and is only
-//       really useful if the user wants to run some performance
-//       comparison starting with an clean buffer.
-// In:   Nothing
-// Out:  Nothing
-// Ret:  Will return an error if a page is pinned and the Clear routine
-//       is called.
-// 释放缓冲区中的所有page,将其加入free链表(如果有哪怕一页pin在内存中,也得返回错误)
-RC PF_BufferMgr::ClearBuffer()
+// Desc: Constructor - no frames, no GetPages
+//
+PF_FileSnapshot::PF_FileSnapshot()
 {
-   RC rc;
+   fd = -1;
+   numResident = numPinned = numDirty = numIO = 0;
+   for (int i = 0; i < PF_AGE_CLASSES; i++)
+      ageHist[i] = 0;
+   numHits = numMisses = 0;
+}
+
+//
+// HitRatio
+//
+// Ret:  share of the GetPages that found their page, 0 if there were none
+//
+double PF_FileSnapshot::HitRatio() const
+{
+   if (numHits + numMisses == 0)
+      return (0.0);
+   return ((double)numHits / (double)(numHits + numMisses));
+}
+
+//
+// SnapshotShard
+//
+// Desc: Internal.  Count the frames of a shard and its GetPages.  The
+//       pages are walked from the coldest, the order in which the policy
+//       looks for victims (roughly, under CLOCK: the hand and the
+//       reference bits are not taken into account), so a frame's rank
+//       gives its age class.  Only the latch of this shard is held.
+// In:   fd - the file to count, or PF_ALL_FILES
+// Out:  total, files, numFree - added to
+//
+// 逐个分片加latch统计,不会让整个缓冲区停下来
+void PF_BufferMgr::SnapshotShard(PF_BufShard &shard, int fd,
+      PF_FileSnapshot &total, map<int, PF_FileSnapshot> &files, int &numFree)
+{
+   lock_guard<mutex> guard(shard.latch);
+
+   int numUsed = 0;
+   for (int slot = LastUsed(shard); slot != INVALID_SLOT; slot = PrevUsed(shard, slot))
+      numUsed++;
+   numFree += (shard.hi - shard.lo) - numUsed;
+
+   int rank = 0;
+   for (int slot = LastUsed(shard); slot != INVALID_SLOT;
+         slot = PrevUsed(shard, slot), rank++) {
+      const PF_BufPageDesc &desc = bufTable[slot];
+      if (fd != PF_ALL_FILES && desc.fd != fd)
+         continue;
+
+      int age = PF_AGE_CLASSES - 1 - rank * PF_AGE_CLASSES / numUsed;
+      PF_FileSnapshot *pCounts[2] = { &total, &files[desc.fd] };
+      for (int i = 0; i < 2; i++) {
+         pCounts[i]->numResident++;
+         pCounts[i]->numPinned += (desc.pinCount > 0);
+         pCounts[i]->numDirty += (desc.bDirty != FALSE);
+         pCounts[i]->numIO += (desc.ioState != PF_PAGE_IO_NONE);
+         pCounts[i]->ageHist[age]++;
+      }
+   }
+
+   if (fd == PF_ALL_FILES) {
+      total.numHits += shard.numHits;
+      total.numMisses += shard.numMisses;
+      for (int f = 0; f < PF_ACCESS_FDS; f++)
+         if (shard.fileHits[f] || shard.fileMisses[f]) {
+            files[f].numHits += shard.fileHits[f];
+            files[f].numMisses += shard.fileMisses[f];
+         }
+   }
+   else if (fd >= 0 && fd < PF_ACCESS_FDS) {
+      total.numHits += shard.fileHits[fd];
+      total.numMisses += shard.fileMisses[fd];
+   }
+}
+
+//
+// GetSnapshot
+//
+// Desc: Take a snapshot of the buffer pool, one shard at a time
+// In:   maxFiles - room in files (none if files is NULL)
+// Out:  snapshot - the pool and its totals; numFiles may exceed maxFiles
+//       files - the first maxFiles files, in descriptor order
+// Ret:  PF return code
+//
+RC PF_BufferMgr::GetSnapshot(PF_BufferSnapshot &snapshot,
+      PF_FileSnapshot files[], int maxFiles)
+{
+   map<int, PF_FileSnapshot> byFd;
+
+   if (files == NULL)
+      maxFiles = 0;
+
+   snapshot.total = PF_FileSnapshot();
+   snapshot.numFree = 0;
+   for (int s = 0; s < numShards; s++)
+      SnapshotShard(shards[s], PF_ALL_FILES, snapshot.total, byFd,
+            snapshot.numFree);
+
+   snapshot.numPages = numPages;
+   snapshot.numShards = numShards;
+   snapshot.numFiles = (int)byFd.size();
+
+   int i = 0;
+   for (map<int, PF_FileSnapshot>::iterator it = byFd.begin();
+         it != byFd.end() && i < maxFiles; ++it, i++) {
+      files[i] = it->second;
+      files[i].fd = it->first;
+   }
+
+   return (0);
+}
+
+//
+// GetFileSnapshot
+//
+// Desc: Take a snapshot of the frames and GetPages of one file
+//
+RC PF_BufferMgr::GetFileSnapshot(int fd, PF_FileSnapshot &snapshot)
+{
+   map<int, PF_FileSnapshot> byFd;
+   int numFree = 0;
+
+   snapshot = PF_FileSnapshot();
+   for (int s = 0; s < numShards; s++)
+      SnapshotShard(shards[s], fd, snapshot, byFd, numFree);
+   snapshot.fd = fd;
+
+   return (0);
+}
+
+//
+// ResetAccessCounts
+//
+// Desc: Restart the hit and miss counts of every shard
+//
+void PF_BufferMgr::ResetAccessCounts()
+{
+   for (int s = 0; s < numShards; s++) {
+      PF_BufShard &shard = shards[s];
+      lock_guard<mutex> guard(shard.latch);
+      shard.numHits = shard.numMisses = 0;
+      memset(shard.fileHits, 0, PF_ACCESS_FDS * sizeof(long long));
+      memset(shard.fileMisses, 0, PF_ACCESS_FDS * sizeof(long long));
+   }
+}
+
+
+//
+// ClearBuffer
+//
+// Desc: Remove all entries from the buffer manager.
+//       This routine will be called via the system command and is only
+//       really useful if the user wants to run some performance
+//       comparison starting with an clean buffer.
+// In:   Nothing
+// Out:  Nothing
+// Ret:  Will return an error if a page is pinned and the Clear routine
+//       is called.
+// 释放缓冲区中的所有page,将其加入free链表(如果有哪怕一页pin在内存中,也得返回错误)
+RC PF_BufferMgr::ClearBuffer()
+{
+   RC rc;
+
+   for (int s = 0; s < numShards; s++) {
+      PF_BufShard &shard = shards[s];
+      lock_guard<mutex> guard(shard.latch);
+      if ((rc = ClearShard(shard)))
+         return (rc);
+   }
+
+   return 0;
+}
+
+//
+// ClearShard
+//
+// Desc: Internal.  Remove the unpinned pages of a shard from the buffer
+// In:   shard - the shard (latched by the caller)
+// Ret:  PF return code
+//
+RC PF_BufferMgr::ClearShard(PF_BufShard &shard)
+{
+   RC rc;
 
    int slot, next;
-   slot = first;
+   slot = FirstUsed(shard);
    while (slot != INVALID_SLOT) {
-      next = bufTable[slot].next;
-      if (bufTable[slot].pinCount == 0)
-         if ((rc = hashTable.Delete(bufTable[slot].fd,
+      next = NextUsed(shard, slot);
+      if (bufTable[slot].pinCount == 0) {
+         SetDirty(shard, slot, FALSE);
+         if ((rc = shard.hashTable->Delete(bufTable[slot].fd,
                bufTable[slot].pageNum)) ||
-            (rc = Unlink(slot)) ||
-            (rc = InsertFree(slot)))
+            (rc = Unlink(shard, slot)) ||
+            (rc = InsertFree(shard, slot)))
          return (rc);
+      }
       slot = next;
    }
 
@@ -635,95 +1523,56 @@ RC PF_BufferMgr::ClearBuffer()
 // In:   The new buffer size
 // Out:  Nothing
 // Ret:  0 for success or,
-//       Some other PF error (probably PF_NOBUF)
+//       PF_TOOSMALL if there would be less than one page per shard,
+//       PF_PAGEPINNED if some page could not be cleared out of the buffer
 //
-// Notes: This method attempts to copy all the old pages which I am
-// unable to kick out of the old buffer manager into the new buffer
-// manager.  This obviously cannot always be successfull!
+// Notes: Pinned pages are referenced by pointers handed out to clients,
+// so they cannot be moved to a new buffer table.  The resize is refused
+// while any page remains pinned.  The shards are not replaced: threads
+// may be blocked on their latches, which must outlive the resize.
 //
 // 调整缓冲区大小
-// 1.动态分配iNewSize大小的缓冲区
-// 2.将旧缓冲区中的数据拷贝到新缓冲区,并重新组织used和free链表
-// 3.释放旧缓冲区
+// 1.先清空旧缓冲区(脏页此前已由调用者写回)
+// 2.若仍有page被pin住,则无法迁移(客户端持有指向旧缓冲区的指针),返回警告
+// 3.重建bufTable,原地重建各分片(latch不释放,hash表按新大小重建);缓冲区页不移动,只追加或释放arena
 RC PF_BufferMgr::ResizeBuffer(int iNewSize)
 {
-   int i;
    RC rc;
 
-   // First try and clear out the old buffer!
-   ClearBuffer();
+   if (iNewSize < numShards)
+      return (PF_TOOSMALL);
 
-   // Allocate memory for a new buffer table
-   PF_BufPageDesc *pNewBufTable = new PF_BufPageDesc[iNewSize];
+   // Keep the background writer out of the shards
+   lock_guard<mutex> bgGuard(bgLatch);
 
-   // Initialize the new buffer table and allocate memory for buffer
-   // pages.  Initially, the free list contains all pages
-   for (i = 0; i < iNewSize; i++) {
-      if ((pNewBufTable[i].pData = new char[pageSize]) == NULL) {
-         cerr << "Not enough memory for buffer\n";
-         exit(1);
-      }
+   // Take every latch (in shard order) while the tables are rebuilt
+   for (int s = 0; s < numShards; s++)
+      shards[s].latch.lock();
 
-      memset ((void *)pNewBufTable[i].pData, 0, pageSize);
+   // First try and clear out the old buffer!  Under the latches, so
+   // that no page comes back in between
+   rc = 0;
+   int bPinned = FALSE;
+   for (int s = 0; s < numShards && !rc; s++)
+      if (!(rc = ClearShard(shards[s])) && FirstUsed(shards[s]) != INVALID_SLOT)
+         bPinned = TRUE;
 
-      pNewBufTable[i].prev = i - 1;
-      pNewBufTable[i].next = i + 1;
+   if (rc || bPinned) {
+      for (int s = numShards - 1; s >= 0; s--)
+         shards[s].latch.unlock();
+      return (rc ? rc : PF_PAGEPINNED);
    }
-   pNewBufTable[0].prev = pNewBufTable[iNewSize - 1].next = INVALID_SLOT;
-
-   // Now we must remember the old first and last slots and (of course)
-   // the buffer table itself.  Then we use insert methods to insert
-   // each of the entries into the new buffertable
-   int oldFirst = first;
-   PF_BufPageDesc *pOldBufTable = bufTable;
-
-   // Setup the new number of pages,  first, last and free
-   numPages = iNewSize;
-   first = last = INVALID_SLOT;
-   free = 0;
-
-   // Setup the new buffer table
-   bufTable = pNewBufTable;
-
-   // We must first remove from the hashtable any possible entries
-   int slot, next, newSlot;
-   slot = oldFirst;
-   while (slot != INVALID_SLOT) {
-      next = pOldBufTable[slot].next;
-
-      // Must remove the entry from the hashtable from the
-      if ((rc=hashTable.Delete(pOldBufTable[slot].fd, pOldBufTable[slot].pageNum)))
-         return (rc);
-      slot = next;
-   }
-
-   // Now we traverse through the old buffer table and copy any old
-   // entries into the new one
-   slot = oldFirst;
-   while (slot != INVALID_SLOT) {
-
-      next = pOldBufTable[slot].next;
-      // Allocate a new slot for the old page
-      if ((rc = InternalAlloc(newSlot)))
-         return (rc);
-
-      // Insert the page into the hash table,
-      // and initialize the page description entry
-      if ((rc = hashTable.Insert(pOldBufTable[slot].fd,
-            pOldBufTable[slot].pageNum, newSlot)) ||
-            (rc = InitPageDesc(pOldBufTable[slot].fd,
-            pOldBufTable[slot].pageNum, newSlot)))
-         return (rc);
 
-      // Put the slot back on the free list before returning the error
-      Unlink(newSlot);
-      InsertFree(newSlot);
-
-      slot = next;
-   }
+   // The frames stay where they are: growing maps one more arena and
+   // shrinking unmaps what is past the new size.  The shards are rebuilt
+   // in place, with the same number of them, so a page maps to the same
+   // shard and a thread waiting for a latch finds it again afterwards.
+   delete [] bufTable;
+   InitShards(iNewSize, numShards);
+   ShrinkArenas(iNewSize);
 
-   // Finally, delete the old buffer table
-   delete [] pOldBufTable;
+   for (int s = numShards - 1; s >= 0; s--)
+      shards[s].latch.unlock();
 
    return 0;
 }
@@ -733,14 +1582,15 @@ RC PF_BufferMgr::ResizeBuffer(int iNewSize)
 // InsertFree
 //
 // Desc: Internal.  Insert a slot at the head of the free list
-// In:   slot - slot number to insert
+// In:   shard - shard owning the slot (latched by the caller)
+//       slot - slot number to insert
 // Ret:  PF return code
 //
 // 将slot对应的缓冲区页插入到free链表的头部
-RC PF_BufferMgr::InsertFree(int slot)
+RC PF_BufferMgr::InsertFree(PF_BufShard &shard, int slot)
 {
-   bufTable[slot].next = free;
-   free = slot;
+   bufTable[slot].next = shard.free;
+   shard.free = slot;
 
    // Return ok
    return (0);
@@ -751,26 +1601,90 @@ RC PF_BufferMgr::InsertFree(int slot)
 //
 // Desc: Internal.  Insert a slot at the head of the used list, making
 //       it the most-recently used slot.
-// In:   slot - slot number to insert
+// In:   shard - shard owning the slot (latched by the caller)
+//       slot - slot number to insert
 // Ret:  PF return code
 //
 // 将slot对应的page放置到缓冲区used链表的开头 
 // 这个结点对应MRU(最近最常使用) <=> 链表尾部就是LRU(最近最少使用)
-RC PF_BufferMgr::LinkHead(int slot)
+RC PF_BufferMgr::LinkHead(PF_BufShard &shard, int slot)
 {
+   bufTable[slot].bProbation = FALSE;
+
    // Set next and prev pointers of slot entry
-   bufTable[slot].next = first;
+   bufTable[slot].next = shard.first;
    bufTable[slot].prev = INVALID_SLOT;
 
    // If list isn't empty, point old first back to slot
-   if (first != INVALID_SLOT)
-      bufTable[first].prev = slot;
+   if (shard.first != INVALID_SLOT)
+      bufTable[shard.first].prev = slot;
 
-   first = slot;
+   shard.first = slot;
 
    // if list was empty, set last to slot
-   if (last == INVALID_SLOT)
-      last = first;
+   if (shard.last == INVALID_SLOT)
+      shard.last = shard.first;
+
+   // Return ok
+   return (0);
+}
+
+//
+// LinkTail
+//
+// Desc: Internal.  Insert a slot at the tail of the used list, making
+//       it the least-recently used slot.
+// In:   shard - shard owning the slot (latched by the caller)
+//       slot - slot number to insert
+// Ret:  PF return code
+//
+// 放到链表尾部(LRU端),即下一个被置换的页
+RC PF_BufferMgr::LinkTail(PF_BufShard &shard, int slot)
+{
+   bufTable[slot].bProbation = FALSE;
+
+   // Set next and prev pointers of slot entry
+   bufTable[slot].next = INVALID_SLOT;
+   bufTable[slot].prev = shard.last;
+
+   // If list isn't empty, point old last forward to slot
+   if (shard.last != INVALID_SLOT)
+      bufTable[shard.last].next = slot;
+
+   shard.last = slot;
+
+   // if list was empty, set first to slot
+   if (shard.first == INVALID_SLOT)
+      shard.first = shard.last;
+
+   // Return ok
+   return (0);
+}
+
+//
+// LinkProbation
+//
+// Desc: Internal.  Insert a slot at the head of the 2Q probationary
+//       list (A1).  The list is a FIFO: pages leave it from the tail,
+//       either as victims or when a second access promotes them.
+// In:   shard - shard owning the slot (latched by the caller)
+//       slot - slot number to insert
+// Ret:  PF return code
+//
+RC PF_BufferMgr::LinkProbation(PF_BufShard &shard, int slot)
+{
+   bufTable[slot].bProbation = TRUE;
+   bufTable[slot].next = shard.a1First;
+   bufTable[slot].prev = INVALID_SLOT;
+
+   if (shard.a1First != INVALID_SLOT)
+      bufTable[shard.a1First].prev = slot;
+
+   shard.a1First = slot;
+
+   if (shard.a1Last == INVALID_SLOT)
+      shard.a1Last = shard.a1First;
+   shard.a1Len++;
 
    // Return ok
    return (0);
@@ -779,16 +1693,26 @@ RC PF_BufferMgr::LinkHead(int slot)
 //
 // Unlink
 //
-// Desc: Internal.  Unlink the slot from the used list.  Assume that
+// Desc: Internal.  Unlink the slot from the used list (or from the
+//       probationary list if the slot is on it).  Assume that
 //       slot is valid.  Set prev and next pointers to INVALID_SLOT.
 //       The caller is responsible to either place the unlinked page into
 //       the free list or the used list.
-// In:   slot - slot number to unlink
+// In:   shard - shard owning the slot (latched by the caller)
+//       slot - slot number to unlink
 // Ret:  PF return code
 //
 // 断开slot对应的page在used链表中的链接
-RC PF_BufferMgr::Unlink(int slot)
+RC PF_BufferMgr::Unlink(PF_BufShard &shard, int slot)
 {
+   int &first = bufTable[slot].bProbation ? shard.a1First : shard.first;
+   int &last  = bufTable[slot].bProbation ? shard.a1Last  : shard.last;
+
+   if (bufTable[slot].bProbation) {
+      bufTable[slot].bProbation = FALSE;
+      shard.a1Len--;
+   }
+
    // If slot is at head of list, set first to next element
    if (first == slot)
       first = bufTable[slot].next;
@@ -820,55 +1744,275 @@ RC PF_BufferMgr::Unlink(int slot)
 //       If there is something on the free list, then use it.
 //       Otherwise, choose a victim to replace.  If a victim cannot be
 //       chosen (because all the pages are pinned), then return an error.
+//       A dirty victim is written without the latch and not allocated.
+// In:   shard - shard to allocate from, latched by the caller through
+//       guard
+//       hint - access hint of the page that will occupy the slot
 // Out:  slot - set to newly-allocated slot
-// Ret:  PF_NOBUF if all pages are pinned, other PF return code otherwise
+// Ret:  PF_NOBUF if all pages are pinned, PF_ALLOCAGAIN if a victim was
+//       written and nothing allocated, other PF return code otherwise
 //
 // 获取一个可用缓冲区块,返回其slot
 // 1.如果free链表不为空,直接获取free链表头对应缓冲区块
-// 2.否则,在used链表中,根据LRU选择一个unpin的页被置换,然后将脏数据写回磁盘
+// 2.否则,根据置换策略(ChooseVictim)选择一个unpin的页被置换,然后将脏数据写回磁盘
 // 3.如果所有页都pin在内存中,返回错误
 // 注:获取的缓冲区页需要放置到used链表头部
-RC PF_BufferMgr::InternalAlloc(int &slot)
+RC PF_BufferMgr::InternalAlloc(PF_BufShard &shard, unique_lock<mutex> &guard,
+      int &slot, ClientHint hint)
 {
    RC  rc;       // return code
 
    // If the free list is not empty, choose a slot from the free list
-   if (free != INVALID_SLOT) {
-      slot = free;
-      free = bufTable[slot].next;
+   if (shard.free != INVALID_SLOT) {
+      slot = shard.free;
+      shard.free = bufTable[slot].next;
    }
    else {
 
-      // Choose the least-recently used page that is unpinned
-      for (slot = last; slot != INVALID_SLOT; slot = bufTable[slot].prev) {
-         if (bufTable[slot].pinCount == 0)
-            break;
-      }
-
+      // Let the replacement policy choose an unpinned page
       // Return error if all buffers were pinned
-      if (slot == INVALID_SLOT)
-         return (PF_NOBUF);
+      if ((rc = ChooseVictim(shard, slot, hint)))
+         return (rc);
 
-      // Write out the page if it is dirty,走到这里,说明slot是被置换的页,需要向磁盘写回脏数据
+      // Write out the page if it is dirty, without the latch (WriteSlots).
+      // Meanwhile the page may be pinned or changed again, and the page
+      // the caller wants may be read by another thread, so the caller
+      // starts over.
+      // 脏页写回期间释放latch,写完后由调用者重新查找
       if (bufTable[slot].bDirty) {
-         if ((rc = WritePage(bufTable[slot].fd, bufTable[slot].pageNum,bufTable[slot].pData)))
+         if ((rc = WriteSlots(shard, guard, &slot, 1)))
             return (rc);
-         bufTable[slot].bDirty = FALSE;
+         return (PF_ALLOCAGAIN);
       }
 
       // Remove page from the hash table and slot from the used buffer list
-      if ((rc = hashTable.Delete(bufTable[slot].fd, bufTable[slot].pageNum)) || (rc = Unlink(slot)))
+      if ((rc = shard.hashTable->Delete(bufTable[slot].fd, bufTable[slot].pageNum)) || (rc = Unlink(shard, slot)))
          return (rc);
    }
 
-   // Link slot at the head of the used list
-   if ((rc = LinkHead(slot)))
+   // Link slot where the replacement policy wants new pages
+   if ((rc = Admit(shard, slot, hint)))
       return (rc);
 
    // Return ok
    return (0);
 }
 
+//
+// FirstUsed, NextUsed
+//
+// Desc: Internal.  Iterate over every page of the shard: the used list
+//       from MRU to LRU, then the 2Q probationary list from newest to
+//       oldest.  NextUsed may be called before the slot is unlinked.
+// Ret:  slot, or INVALID_SLOT at the end
+//
+int PF_BufferMgr::FirstUsed(const PF_BufShard &shard) const
+{
+   return (shard.first != INVALID_SLOT) ? shard.first : shard.a1First;
+}
+
+int PF_BufferMgr::NextUsed(const PF_BufShard &shard, int slot) const
+{
+   int next = bufTable[slot].next;
+   if (next == INVALID_SLOT && !bufTable[slot].bProbation)
+      next = shard.a1First;
+   return (next);
+}
+
+//
+// LastUsed, PrevUsed
+//
+// Desc: Internal.  Iterate over every page of the shard the other way:
+//       the 2Q probationary list from oldest to newest, then the used
+//       list from LRU to MRU.  This is about the order in which
+//       ChooseVictim takes its victims.
+// Ret:  slot, or INVALID_SLOT at the end
+//
+int PF_BufferMgr::LastUsed(const PF_BufShard &shard) const
+{
+   return (shard.a1Last != INVALID_SLOT) ? shard.a1Last : shard.last;
+}
+
+int PF_BufferMgr::PrevUsed(const PF_BufShard &shard, int slot) const
+{
+   int prev = bufTable[slot].prev;
+   if (prev == INVALID_SLOT && bufTable[slot].bProbation)
+      prev = shard.last;
+   return (prev);
+}
+
+//
+// Admit
+//
+// Desc: Internal.  Link a newly allocated slot into the shard.
+//       LRU and CLOCK put it at the head of the used list; CLOCK also
+//       sets the reference bit unless the page comes from a scan.
+//       LRU puts a page of a scan (SEQUENTIAL_HINT, as read-ahead does)
+//       at the tail instead, so that it is the next victim rather than
+//       the working set; Access admits it again once it is asked for.
+//       2Q puts it on the probationary list.
+// In:   shard - shard owning the slot (latched by the caller)
+//       slot - the new slot
+//       hint - access hint of the page
+// Ret:  PF return code
+//
+// 2Q: 新页先进入A1(FIFO),再次被访问才升入Am(LRU),顺序扫描的页只经过A1
+RC PF_BufferMgr::Admit(PF_BufShard &shard, int slot, ClientHint hint)
+{
+   RC rc;
+
+   bufTable[slot].hint = hint;
+
+   if (policy == PF_REPLACE_2Q)
+      rc = LinkProbation(shard, slot);
+   else if (policy == PF_REPLACE_LRU && hint == SEQUENTIAL_HINT)
+      rc = LinkTail(shard, slot);
+   else
+      rc = LinkHead(shard, slot);
+   bufTable[slot].bRef = (hint != SEQUENTIAL_HINT);
+
+   return (rc);
+}
+
+//
+// Touch
+//
+// Desc: Internal.  Record an access to a resident page.  The hint of the
+//       last GetPage is in the page descriptor.
+//       LRU moves the page to the head of the used list (MRU), unless
+//       it is read by a scan: such pages stay at the cold end.
+//       CLOCK only sets the reference bit, leaving the list alone; pages
+//       read by a scan do not get it.
+//       2Q moves a page of the main list to its head.  A page on the
+//       probationary list is promoted to the main list on a second
+//       GetPage that is not part of a scan; otherwise it stays put.
+// In:   shard - shard owning the slot (latched by the caller)
+//       slot - slot of the page accessed
+//       bAccess - TRUE for a GetPage, FALSE for MarkDirty or UnpinPage
+// Ret:  PF return code
+//
+RC PF_BufferMgr::Touch(PF_BufShard &shard, int slot, int bAccess)
+{
+   RC rc;
+
+   switch (policy) {
+   case PF_REPLACE_CLOCK:
+      if (bufTable[slot].hint != SEQUENTIAL_HINT)
+         bufTable[slot].bRef = TRUE;
+      break;
+
+   case PF_REPLACE_2Q:
+      if (bufTable[slot].bProbation &&
+            (!bAccess || bufTable[slot].hint == SEQUENTIAL_HINT))
+         break;
+      if ((rc = Unlink(shard, slot)) || (rc = LinkHead(shard, slot)))
+         return (rc);
+      break;
+
+   case PF_REPLACE_LRU:
+   default:
+      if (bufTable[slot].hint == SEQUENTIAL_HINT)
+         break;
+      if ((rc = Unlink(shard, slot)) || (rc = LinkHead(shard, slot)))
+         return (rc);
+      break;
+   }
+
+   // Return ok
+   return (0);
+}
+
+//
+// ChooseVictim
+//
+// Desc: Internal.  Choose an unpinned page of the shard to replace.
+//       Only called when the free list of the shard is empty, so every
+//       slot of the shard holds a page.
+//       LRU takes the least-recently used unpinned page.  For a scan or
+//       read-ahead (SEQUENTIAL_HINT) it passes over the pages read ahead
+//       and not asked for yet, so that a window of read-ahead does not
+//       evict the one the reader is in, unless nothing else is left.
+//       CLOCK sweeps the hand over [lo,hi): a page with its reference bit
+//       set gets a second chance (the bit is cleared), the first
+//       unpinned page without it is the victim.  Two full turns without
+//       a victim mean that every page is pinned.
+//       2Q takes the oldest unpinned page of the probationary list while
+//       that list holds more than a quarter of the shard, else the LRU
+//       unpinned page of the main list; either list is the fallback.
+// In:   shard - shard to search (latched by the caller)
+//       hint - hint of the page the slot is for
+// Out:  slot - the victim
+// Ret:  PF_NOBUF if all pages are pinned
+//
+RC PF_BufferMgr::ChooseVictim(PF_BufShard &shard, int &slot, ClientHint hint)
+{
+   switch (policy) {
+   case PF_REPLACE_CLOCK: {
+      int numSlots = shard.hi - shard.lo;
+      for (int i = 0; i < 2 * numSlots; i++) {
+         slot = shard.hand;
+         if (++shard.hand == shard.hi)
+            shard.hand = shard.lo;
+
+         if (bufTable[slot].pinCount > 0)
+            continue;
+         if (bufTable[slot].bRef) {
+            bufTable[slot].bRef = FALSE;
+            continue;
+         }
+         return (0);
+      }
+      slot = INVALID_SLOT;
+      break;
+   }
+
+   case PF_REPLACE_2Q: {
+      int kIn = (shard.hi - shard.lo) / 4;
+      if (kIn < 1)
+         kIn = 1;
+      if (shard.a1Len > kIn || (slot = LastUnpinned(shard.last)) == INVALID_SLOT)
+         slot = LastUnpinned(shard.a1Last);
+      if (slot == INVALID_SLOT)
+         slot = LastUnpinned(shard.last);
+      break;
+   }
+
+   case PF_REPLACE_LRU:
+   default:
+      // Choose the least-recently used page that is unpinned
+      slot = LastUnpinned(shard.last);
+      if (hint == SEQUENTIAL_HINT) {
+         int ahead = slot;
+         while (slot != INVALID_SLOT && bufTable[slot].bReadAhead)
+            slot = LastUnpinned(bufTable[slot].prev);
+         if (slot == INVALID_SLOT)
+            slot = ahead;
+      }
+      break;
+   }
+
+   if (slot == INVALID_SLOT)
+      return (PF_NOBUF);
+
+   // Return ok
+   return (0);
+}
+
+//
+// LastUnpinned
+//
+// Desc: Internal.  Walk a list backwards from slot to the first page
+//       that is not pinned.
+// In:   slot - tail of the list
+// Ret:  slot of the page, or INVALID_SLOT
+//
+int PF_BufferMgr::LastUnpinned(int slot) const
+{
+   while (slot != INVALID_SLOT && bufTable[slot].pinCount > 0)
+      slot = bufTable[slot].prev;
+   return (slot);
+}
+
 //
 // ReadPage
 //
@@ -885,69 +2029,861 @@ RC PF_BufferMgr::InternalAlloc(int &slot)
 // 即 => |PF_FileHdr | page0 | page1 | page2 | .....| pagen |
 RC PF_BufferMgr::ReadPage(int fd, PageNum pageNum, char *dest)
 {
+   return (ReadPages(fd, pageNum, 1, &dest));
+}
+
+//
+// WritePage
+//
+// Desc: Write a page to disk
+//
+// In:   fd - OS file descriptor
+//       pageNum - number of page to write
+//       dest - pointer to buffer containing page contents
+// Ret:  PF return code
+//
+// 将缓冲区中source处的一页写到(fd,pageNum)对应的文件块中!!
+RC PF_BufferMgr::WritePage(int fd, PageNum pageNum, char *source)
+{
+   return (WritePages(fd, pageNum, 1, &source));
+}
+
+//
+// ReadPages
+//
+// Desc: Read a run of adjacent pages from disk with one preadv per
+//       PF_MAX_IOV pages.  preadv leaves the shared file offset alone,
+//       so other threads may do I/O on the same descriptor at the same
+//       time.
+// In:   fd - OS file descriptor
+//       pageNum - number of the first page to read
+//       numRun - number of pages in the run
+//       dests - buffers in which to read the pages, one per page
+// Out:  dests - buffers contain the page contents
+// Ret:  PF_INCOMPLETEREAD if the run goes past the end of the file,
+//       other PF return code otherwise
+//
+// 连续的多个页只需一次系统调用(preadv)
+RC PF_BufferMgr::ReadPages(int fd, PageNum pageNum, int numRun, char *dests[])
+{
+   RC rc;
+   struct iovec iov[PF_MAX_IOV];
+   PF_IORequest req;
 
 #ifdef PF_LOG
    char psMessage[100];
-   sprintf (psMessage, "Reading (%d,%d).\n", fd, pageNum);
+   sprintf (psMessage, "Reading (%d,%d) x %d.\n", fd, pageNum, numRun);
    WriteLog(psMessage);
 #endif
 
 #ifdef PF_STATS
-   pStatisticsMgr->Register(PF_READPAGE, STAT_ADDONE);
+   PF_STAT_ADDVALUE(PF_READPAGE, numRun);
 #endif
 
-   // seek to the appropriate place (cast to long for PC's)
-   long offset = pageNum * (long)pageSize + PF_FILE_HDR_SIZE;
-   if (lseek(fd, offset, L_SET) < 0)
-      return (PF_UNIX);
-
-   // Read the data
-   int numBytes = read(fd, dest, pageSize);
-   if (numBytes < 0)
-      return (PF_UNIX);
-   else if (numBytes != pageSize)
-      return (PF_INCOMPLETEREAD);
-   else
-      return (0);
+   for (int done = 0; done < numRun; done += PF_MAX_IOV) {
+      int n = min(numRun - done, PF_MAX_IOV);
+      for (int i = 0; i < n; i++) {
+         iov[i].iov_base = dests[done + i];
+         iov[i].iov_len = pageSize;
+      }
+
+      InitRequest(req, FALSE, fd, pageNum + done, iov, n);
+#ifdef PF_STATS
+      long long startNs = pStatisticsMgr->IsTiming() ? StatisticsMgr::Now() : 0;
+#endif
+      rc = PF_IOEngine::Transfer(req);
+#ifdef PF_STATS
+      if (startNs)
+         pStatisticsMgr->AddLatency(fd, STAT_LAT_READPAGE,
+               StatisticsMgr::Now() - startNs);
+#endif
+      if (rc)
+         return (rc);
+   }
+
+   return (0);
 }
 
 //
-// WritePage
-//
-// Desc: Write a page to disk
+// WritePages
 //
+// Desc: Write a run of adjacent pages to disk with one pwritev per
+//       PF_MAX_IOV pages.
 // In:   fd - OS file descriptor
-//       pageNum - number of page to write
-//       dest - pointer to buffer containing page contents
+//       pageNum - number of the first page to write
+//       numRun - number of pages in the run
+//       sources - buffers containing the page contents, one per page
 // Ret:  PF return code
 //
-// 将缓冲区中source处的一页写到(fd,pageNum)对应的文件块中!!
-RC PF_BufferMgr::WritePage(int fd, PageNum pageNum, char *source)
+RC PF_BufferMgr::WritePages(int fd, PageNum pageNum, int numRun, char *sources[])
 {
+   RC rc;
+   struct iovec iov[PF_MAX_IOV];
+   PF_IORequest req;
 
 #ifdef PF_LOG
    char psMessage[100];
-   sprintf (psMessage, "Writing (%d,%d).\n", fd, pageNum);
+   sprintf (psMessage, "Writing (%d,%d) x %d.\n", fd, pageNum, numRun);
    WriteLog(psMessage);
 #endif
 
 #ifdef PF_STATS
-   pStatisticsMgr->Register(PF_WRITEPAGE, STAT_ADDONE);
+   PF_STAT_ADDVALUE(PF_WRITEPAGE, numRun);
+#endif
+
+   for (int done = 0; done < numRun; done += PF_MAX_IOV) {
+      int n = min(numRun - done, PF_MAX_IOV);
+      for (int i = 0; i < n; i++) {
+         iov[i].iov_base = sources[done + i];
+         iov[i].iov_len = pageSize;
+      }
+
+      InitRequest(req, TRUE, fd, pageNum + done, iov, n);
+#ifdef PF_STATS
+      long long startNs = pStatisticsMgr->IsTiming() ? StatisticsMgr::Now() : 0;
+#endif
+      rc = PF_IOEngine::Transfer(req);
+#ifdef PF_STATS
+      if (startNs)
+         pStatisticsMgr->AddLatency(fd, STAT_LAT_WRITEPAGE,
+               StatisticsMgr::Now() - startNs);
+#endif
+      NoteWrite(fd);
+      if (rc)
+         return (rc);
+   }
+
+   return (0);
+}
+
+//
+// InitRequest
+//
+// Desc: Internal.  Set up an I/O request for numRun adjacent pages of a
+//       file, the first one being pageNum.  The request has no callback.
+// In:   bWrite - TRUE for a write
+//       iov - one buffer of pageSize bytes per page
+//
+void PF_BufferMgr::InitRequest(PF_IORequest &req, int bWrite, int fd,
+      PageNum pageNum, struct iovec *iov, int numRun)
+{
+   req.bWrite = bWrite;
+   req.bSync = FALSE;
+   req.fd = fd;
+   req.offset = pageNum * (long)pageSize + PF_FILE_HDR_SIZE;
+   req.iov = iov;
+   req.iovcnt = numRun;
+   req.rc = 0;
+   req.bDone = FALSE;
+   req.pfnDone = NULL;
+   req.pArg = NULL;
+   req.pNext = NULL;
+   req.startNs = 0;
+}
+
+//
+// ReadDone
+//
+// Desc: Internal.  Completion callback of the read started by
+//       GetPageAsync; the request is the ioReq of the page descriptor.
+//
+void PF_BufferMgr::ReadDone(PF_IORequest *pReq)
+{
+   PF_BufferMgr *pBufferMgr = (PF_BufferMgr *)pReq->pArg;
+   PF_BufPageDesc *pDesc = (PF_BufPageDesc *)
+      ((char *)pReq - offsetof(PF_BufPageDesc, ioReq));
+
+   pBufferMgr->FinishRead((int)(pDesc - pBufferMgr->bufTable), pReq->rc);
+}
+
+//
+// Access
+//
+// Desc: Internal.  Pin the resident page of slot for GetPage or
+//       GetPageAsync and record the access.  The first access to a page
+//       brought in by read-ahead stands for the miss it saved: it is
+//       counted as not found and the page is placed as a new page.
+// In:   shard - shard holding slot, latched by the caller
+//       hint - hint of the client
+// Ret:  PF return code
+//
+RC PF_BufferMgr::Access(PF_BufShard &shard, int slot, ClientHint hint)
+{
+   RC rc;
+
+   bufTable[slot].pinCount++;
+
+   if (bufTable[slot].bReadAhead) {
+      bufTable[slot].bReadAhead = FALSE;
+      CountAccess(shard, bufTable[slot].fd, FALSE);
+#ifdef PF_STATS
+      PF_STAT_ADDONE(PF_PAGENOTFOUND);
+#endif
+      if ((rc = Unlink(shard, slot)) ||
+            (rc = Admit(shard, slot, hint)))
+         return (rc);
+      return (0);
+   }
+
+   CountAccess(shard, bufTable[slot].fd, TRUE);
+#ifdef PF_STATS
+   PF_STAT_ADDONE(PF_PAGEFOUND);
 #endif
+   bufTable[slot].hint = hint;
+   return (Touch(shard, slot, TRUE));
+}
 
-   // seek to the appropriate place (cast to long for PC's)
-   long offset = pageNum * (long)pageSize + PF_FILE_HDR_SIZE;
-   if (lseek(fd, offset, L_SET) < 0)
-      return (PF_UNIX);
-
-   // Read the data
-   int numBytes = write(fd, source, pageSize);
-   if (numBytes < 0)
-      return (PF_UNIX);
-   else if (numBytes != pageSize)
-      return (PF_INCOMPLETEWRITE);
+//
+// CountAccess
+//
+// Desc: Internal.  Count a GetPage of file fd as a hit or a miss, for
+//       the snapshots.  The shard is latched by the caller, so the counts
+//       need no atomics and stay in the shard's cache lines.
+//
+void PF_BufferMgr::CountAccess(PF_BufShard &shard, int fd, int bHit)
+{
+   if (bHit)
+      shard.numHits++;
    else
+      shard.numMisses++;
+
+   if (fd >= 0 && fd < PF_ACCESS_FDS) {
+      if (bHit)
+         shard.fileHits[fd]++;
+      else
+         shard.fileMisses[fd]++;
+   }
+}
+
+//
+// Prefetch
+//
+// Desc: Internal.  Read numRun pages of a file from pageNum on with one
+//       asynchronous request (see StartRun).
+// Ret:  # of pages being read
+//
+int PF_BufferMgr::Prefetch(int fd, PageNum pageNum, int numRun)
+{
+   PF_ReadAheadRun *pRun = StartRun(fd, pageNum, numRun);
+
+   if (pRun == NULL)
       return (0);
+
+   // The run is freed once read, maybe before Submit returns
+   int n = pRun->req.iovcnt;
+   PF_IORequest *pReq = &pRun->req;
+   pIOEngine->Submit(&pReq, 1);
+   return (n);
+}
+
+//
+// StartRun
+//
+// Desc: Internal.  Set up the read of numRun pages of a file from pageNum
+//       on as one request, for the caller to submit.  Stops before the
+//       first page that is in the buffer already or that no slot can be
+//       found for.  Each page is in the hash table, marked
+//       PF_PAGE_IO_READ, and keeps a pin until its read completes
+//       (ReadAheadDone).
+// Ret:  the run, NULL if not even its first page could be taken
+//
+PF_ReadAheadRun *PF_BufferMgr::StartRun(int fd, PageNum pageNum, int numRun)
+{
+   PF_ReadAheadRun *pRun = new PF_ReadAheadRun;
+   int n;      // # of pages taken so far
+   int slot;
+
+   for (n = 0; n < numRun; n++) {
+      PF_BufShard &shard = ShardOf(fd, pageNum + n);
+      unique_lock<mutex> guard(shard.latch);
+
+      // Look again after writing a dirty victim
+      RC rc;
+      do {
+         if (shard.hashTable->Find(fd, pageNum + n, slot) != PF_HASHNOTFOUND)
+            rc = PF_PAGEINBUF;
+         else
+            rc = InternalAlloc(shard, guard, slot, SEQUENTIAL_HINT);
+      } while (rc == PF_ALLOCAGAIN);
+      if (rc)
+         break;
+
+      if (shard.hashTable->Insert(fd, pageNum + n, slot) ||
+            InitPageDesc(fd, pageNum + n, slot)) {
+         Unlink(shard, slot);
+         InsertFree(shard, slot);
+         break;
+      }
+
+      PF_BufPageDesc &desc = bufTable[slot];
+      desc.bReadAhead = TRUE;
+      desc.ioState = PF_PAGE_IO_READ;
+      desc.ioRC = 0;
+      desc.pWaiters = NULL;
+      pRun->iov[n].iov_base = desc.pData;
+      pRun->iov[n].iov_len = pageSize;
+      pRun->slots[n] = slot;
+
+#ifdef PF_STATS
+      PF_STAT_ADDONE(PF_READPAGE);
+      PF_STAT_ADDONE(PF_READAHEAD);
+#endif
+   }
+
+   if (n == 0) {
+      delete pRun;
+      return (NULL);
+   }
+
+   pRun->pBufferMgr = this;
+   InitRequest(pRun->req, FALSE, fd, pageNum, pRun->iov, n);
+   pRun->req.pfnDone = ReadAheadDone;
+   pRun->req.pArg = pRun;
+   return (pRun);
+}
+
+//
+// WarmUp
+//
+// Desc: Read pages of a file ahead, without waiting for them: each run of
+//       adjacent pages (up to PF_MAX_IOV) is one vectored read, and the
+//       reads are submitted PF_WARMUP_BATCH at a time.  Pages already in
+//       the buffer are skipped.  The pages are taken as read-ahead pages
+//       are (SEQUENTIAL_HINT, see Admit): at the LRU end under LRU, on
+//       probation under 2Q, without the reference bit under CLOCK.  Their
+//       first GetPage counts as the miss it saved and admits them again
+//       with the hint of the client (see Access).
+// In:   fd - OS file descriptor of the file
+//       pages - the pages, in increasing order
+//       numWarmPages - # of pages
+// Ret:  # of pages being read
+//
+// 预热:按页号排序后相邻的页合并为一次向量读,多个读请求一次提交
+int PF_BufferMgr::WarmUp(int fd, const PageNum pages[], int numWarmPages)
+{
+   PF_IORequest *reqs[PF_WARMUP_BATCH];
+   int numReqs = 0;
+   int numRead = 0;
+
+   for (int i = 0; i < numWarmPages; ) {
+      int numRun = 1;
+      while (i + numRun < numWarmPages && numRun < PF_MAX_IOV &&
+            pages[i + numRun] == pages[i] + numRun)
+         numRun++;
+
+      // A run stops before a page it cannot take: skip that page
+      PF_ReadAheadRun *pRun = StartRun(fd, pages[i], numRun);
+      int n = (pRun == NULL) ? 0 : pRun->req.iovcnt;
+      i += (n < numRun) ? n + 1 : n;
+      numRead += n;
+
+      if (pRun != NULL)
+         reqs[numReqs++] = &pRun->req;
+      if (numReqs == PF_WARMUP_BATCH || (i >= numWarmPages && numReqs > 0)) {
+         pIOEngine->Submit(reqs, numReqs);
+         numReqs = 0;
+      }
+   }
+
+   return (numRead);
+}
+
+//
+// GetResident
+//
+// Desc: List the pages of a file in the buffer, with their rank in the
+//       replacement order of their shard, one shard at a time.  Pages
+//       read ahead and never asked for are left out: they say nothing
+//       about what the file needs.
+// In:   fd - OS file descriptor of the file
+// Out:  resident - its pages
+//
+void PF_BufferMgr::GetResident(int fd, vector<PF_ResidentPage> &resident)
+{
+   resident.clear();
+
+   for (int s = 0; s < numShards; s++) {
+      PF_BufShard &shard = shards[s];
+      lock_guard<mutex> guard(shard.latch);
+
+      int numUsed = 0;
+      for (int slot = LastUsed(shard); slot != INVALID_SLOT; slot = PrevUsed(shard, slot))
+         numUsed++;
+
+      int rank = 0;
+      for (int slot = LastUsed(shard); slot != INVALID_SLOT;
+            slot = PrevUsed(shard, slot), rank++) {
+         const PF_BufPageDesc &desc = bufTable[slot];
+         if (desc.fd != fd || desc.bReadAhead)
+            continue;
+
+         PF_ResidentPage page;
+         page.fd = fd;
+         page.pageNum = desc.pageNum;
+         page.rank = (double)(numUsed - 1 - rank) / numUsed;
+         resident.push_back(page);
+      }
+   }
+}
+
+//
+// ReadAheadDone
+//
+// Desc: Internal.  Completion callback of a read started by Prefetch
+//
+void PF_BufferMgr::ReadAheadDone(PF_IORequest *pReq)
+{
+   PF_ReadAheadRun *pRun = (PF_ReadAheadRun *)pReq->pArg;
+
+   for (int i = 0; i < pReq->iovcnt; i++)
+      pRun->pBufferMgr->FinishRead(pRun->slots[i], pReq->rc, TRUE);
+   delete pRun;
+}
+
+//
+// FinishRead
+//
+// Desc: Internal.  Mark the page of slot read (or failed with rc), wake
+//       the GetPage calls waiting for it, then run the callbacks of the
+//       futures and make them ready one after the other.  A future is
+//       only touched before it is ready: its owner may free it right
+//       after.
+// In:   slot - the page just read
+//       rc - result of the read
+//       bReadAhead - TRUE if the read was a read-ahead, which holds a
+//       pin on the page until now
+//
+void PF_BufferMgr::FinishRead(int slot, RC rc, int bReadAhead)
+{
+   PF_BufPageDesc &desc = bufTable[slot];
+   PF_BufShard &shard = ShardOf(desc.fd, desc.pageNum);
+   PF_PageFuture *pFuture;
+
+   {
+      lock_guard<mutex> guard(shard.latch);
+      desc.ioState = PF_PAGE_IO_NONE;
+      desc.ioRC = rc;
+      pFuture = desc.pWaiters;
+      desc.pWaiters = NULL;
+
+      // Drop the pin read-ahead held during the read
+      if (bReadAhead) {
+         if (rc)
+            ReleaseFailed(shard, slot);
+         else
+            desc.pinCount--;
+      }
+   }
+   shard.ioDone.notify_all();
+
+   while (pFuture != NULL) {
+      PF_PageFuture *pNext = pFuture->pNextWaiter;
+      if (pFuture->pfnDone != NULL)
+         pFuture->pfnDone(pFuture->pageNum, rc, pFuture->pArg);
+      {
+         lock_guard<mutex> guard(shard.latch);
+         pFuture->rc = rc;
+         pFuture->bPending = FALSE;
+      }
+      shard.ioDone.notify_all();
+      pFuture = pNext;
+   }
+}
+
+//
+// WriteSlots
+//
+// Desc: Internal.  Write pages of a shard as one batch of requests to the
+//       I/O engine (see StartWrite and WriteRuns).  The latch is released
+//       for the I/O.
+// In:   shard - the shard, latched by the caller through guard
+//       slots - dirty pages of the shard with no I/O in progress
+//       numSlots - # of slots
+// Ret:  the first error of the writes, or 0
+//
+// 批量提交写请求,等待期间不持有latch
+RC PF_BufferMgr::WriteSlots(PF_BufShard &shard, unique_lock<mutex> &guard,
+      int slots[], int numSlots)
+{
+   RC *rcs = new RC[numSlots];
+
+   for (int i = 0; i < numSlots; i++)
+      StartWrite(shard, slots[i]);
+
+   guard.unlock();
+   RC rc = WriteRuns(slots, numSlots, rcs);
+   guard.lock();
+
+   for (int i = 0; i < numSlots; i++)
+      EndWrite(shard, slots[i], rcs[i]);
+   shard.ioDone.notify_all();
+
+   delete [] rcs;
+   return (rc);
+}
+
+//
+// WriteDirty
+//
+// Desc: Internal.  Write the dirty pages of a file, gathered from every
+//       shard, as one batch: sorted by page number, with each run of
+//       adjacent pages in one request.  No latch is held during the
+//       writes.  A page already being written by another thread (the
+//       background writer, a concurrent flush or force) is clean in the
+//       buffer but not yet on disk: its write is waited for, and the page
+//       is written again if it was changed meanwhile.  When this returns,
+//       every page that was dirty on entry has reached the file.
+// In:   fd - file descriptor
+//       pageNum - the page to write, or ALL_PAGES
+//       bUnpinnedOnly - TRUE to leave the pinned pages alone
+// Ret:  the first error of the writes, or 0
+//
+// 收集文件在所有分片中的脏页,按页号排序,相邻页合并成一次pwritev
+RC PF_BufferMgr::WriteDirty(int fd, PageNum pageNum, int bUnpinnedOnly)
+{
+   // A single page lives in exactly one shard
+   int sFirst = (pageNum == ALL_PAGES) ? 0 : (int)(&ShardOf(fd, pageNum) - shards);
+   int sEnd   = (pageNum == ALL_PAGES) ? numShards : sFirst + 1;
+
+   vector<int> slots;
+   vector<int> shardEnd(numShards);      // end of each shard's slots
+   RC rc = 0;
+
+   for (int bBusy = TRUE; bBusy && !rc; ) {
+      slots.clear();
+      bBusy = FALSE;
+
+      // Wait for the writes of other threads first.  No write of ours is
+      // started yet, so two threads waiting here cannot wait on each other.
+      for (int s = sFirst; s < sEnd; s++) {
+         PF_BufShard &shard = shards[s];
+         unique_lock<mutex> guard(shard.latch);
+         while (IsWriting(shard, fd, pageNum))
+            shard.ioDone.wait(guard);
+      }
+
+      for (int s = sFirst; s < sEnd; s++) {
+         PF_BufShard &shard = shards[s];
+         lock_guard<mutex> guard(shard.latch);
+
+         // A single page is looked up, a whole file walks the shard
+         int slot = FirstOfFile(shard, fd, pageNum);
+         for (; slot != INVALID_SLOT; slot = NextOfFile(shard, pageNum, slot)) {
+            PF_BufPageDesc &desc = bufTable[slot];
+            if (desc.fd != fd || (bUnpinnedOnly && desc.pinCount > 0))
+               continue;
+            // Started by another thread since the wait: another round
+            if (desc.ioState == PF_PAGE_IO_WRITE)
+               bBusy = TRUE;
+            else if (desc.bDirty && desc.ioState == PF_PAGE_IO_NONE) {
+               StartWrite(shard, slot);
+               slots.push_back(slot);
+            }
+         }
+         shardEnd[s] = (int)slots.size();
+      }
+
+      if (!slots.empty()) {
+         vector<RC> rcs(slots.size());
+         rc = WriteRuns(&slots[0], (int)slots.size(), &rcs[0]);
+
+         for (int s = sFirst, i = 0; s < sEnd; s++) {
+            PF_BufShard &shard = shards[s];
+            lock_guard<mutex> guard(shard.latch);
+            for (; i < shardEnd[s]; i++)
+               EndWrite(shard, slots[i], rcs[i]);
+            shard.ioDone.notify_all();
+         }
+      }
+   }
+
+   return (rc);
+}
+
+//
+// FirstOfFile, NextOfFile
+//
+// Desc: Internal.  Iterate over the slots that may hold pages of a file
+//       in a shard: the one slot of pageNum, found in the hash table, or
+//       every used slot for ALL_PAGES (the caller checks the fd)
+// In:   shard - the shard (latched by the caller)
+// Ret:  a slot, or INVALID_SLOT at the end
+//
+int PF_BufferMgr::FirstOfFile(const PF_BufShard &shard, int fd, PageNum pageNum) const
+{
+   int slot;
+
+   if (pageNum == ALL_PAGES)
+      return (FirstUsed(shard));
+   if (shard.hashTable->Find(fd, pageNum, slot))
+      return (INVALID_SLOT);
+   return (slot);
+}
+
+int PF_BufferMgr::NextOfFile(const PF_BufShard &shard, PageNum pageNum,
+                             int slot) const
+{
+   return ((pageNum == ALL_PAGES) ? NextUsed(shard, slot) : INVALID_SLOT);
+}
+
+//
+// IsWriting
+//
+// Desc: Internal.  Whether a page of a file is being written
+// In:   shard - the shard to look in (latched by the caller)
+//       fd - file descriptor
+//       pageNum - the page, or ALL_PAGES for any page of the file
+// Ret:  TRUE or FALSE
+//
+int PF_BufferMgr::IsWriting(const PF_BufShard &shard, int fd, PageNum pageNum) const
+{
+   int slot = FirstOfFile(shard, fd, pageNum);
+   for (; slot != INVALID_SLOT; slot = NextOfFile(shard, pageNum, slot)) {
+      const PF_BufPageDesc &desc = bufTable[slot];
+      if (desc.fd == fd && desc.ioState == PF_PAGE_IO_WRITE)
+         return (TRUE);
+   }
+   return (FALSE);
+}
+
+//
+// StartWrite, EndWrite
+//
+// Desc: Internal.  Around the write of a page without the latch.  While
+//       it is written the page is pinned, so it stays in its slot, counted
+//       in numWriting and marked clean, so that a MarkDirty in the
+//       meantime is not lost; a page that could not be written is marked
+//       dirty again.  The caller signals ioDone after EndWrite.
+// In:   shard - shard owning the slot (latched by the caller)
+//       rc - result of the write
+//
+void PF_BufferMgr::StartWrite(PF_BufShard &shard, int slot)
+{
+   bufTable[slot].pinCount++;
+   SetDirty(shard, slot, FALSE);
+   bufTable[slot].ioState = PF_PAGE_IO_WRITE;
+   shard.numWriting++;
+
+#ifdef PF_STATS
+   PF_STAT_ADDONE(PF_WRITEPAGE);
+#endif
+}
+
+void PF_BufferMgr::EndWrite(PF_BufShard &shard, int slot, RC rc)
+{
+   bufTable[slot].pinCount--;
+   bufTable[slot].ioState = PF_PAGE_IO_NONE;
+   shard.numWriting--;
+   if (rc)
+      SetDirty(shard, slot, TRUE);
+}
+
+//
+// PF_PageOrder - orders indexes into an array of slots by the file and
+//                page number of their pages
+//
+struct PF_PageOrder {
+   const PF_BufPageDesc *bufTable;
+   const int            *slots;
+
+   bool operator()(int a, int b) const {
+      const PF_BufPageDesc &da = bufTable[slots[a]];
+      const PF_BufPageDesc &db = bufTable[slots[b]];
+      return (da.fd != db.fd) ? da.fd < db.fd : da.pageNum < db.pageNum;
+   }
+};
+
+//
+// WriteRuns
+//
+// Desc: Internal.  Write pages pinned by StartWrite, without any latch.
+//       The pages are sorted by file and page number, and every run of
+//       adjacent pages (at most PF_MAX_IOV) becomes one vectored request;
+//       all the requests are submitted to the I/O engine at once.
+// In:   slots - the pages
+//       numSlots - # of pages
+// Out:  rcs - rcs[i] is the result of the write of slots[i]
+// Ret:  the first error of the writes, or 0
+//
+// 按(fd,pageNum)排序后合并相邻页,一个run一个请求
+RC PF_BufferMgr::WriteRuns(int slots[], int numSlots, RC rcs[])
+{
+   RC rc = 0;
+
+   // Sort the pages; their descriptors do not change while pinned
+   int *order = new int[numSlots];
+   for (int i = 0; i < numSlots; i++)
+      order[i] = i;
+   PF_PageOrder byPage = { bufTable, slots };
+   sort(order, order + numSlots, byPage);
+
+   // One request per run of adjacent pages
+   struct iovec *iov = new struct iovec[numSlots];
+   PF_IORequest *reqs = new PF_IORequest[numSlots];
+   PF_IORequest **pReqs = new PF_IORequest*[numSlots];
+   int *runStart = new int[numSlots + 1];
+   int numRuns = 0;
+
+   for (int i = 0; i < numSlots; i++) {
+      const PF_BufPageDesc &desc = bufTable[slots[order[i]]];
+      iov[i].iov_base = desc.pData;
+      iov[i].iov_len = pageSize;
+
+      if (i > 0) {
+         const PF_BufPageDesc &prev = bufTable[slots[order[i - 1]]];
+         if (desc.fd == prev.fd && desc.pageNum == prev.pageNum + 1 &&
+               i - runStart[numRuns - 1] < PF_MAX_IOV)
+            continue;
+      }
+      runStart[numRuns++] = i;
+   }
+   runStart[numRuns] = numSlots;
+
+   for (int r = 0; r < numRuns; r++) {
+      int first = runStart[r];
+      const PF_BufPageDesc &desc = bufTable[slots[order[first]]];
+      InitRequest(reqs[r], TRUE, desc.fd, desc.pageNum, iov + first,
+            runStart[r + 1] - first);
+      pReqs[r] = &reqs[r];
+
+#ifdef PF_STATS
+      if (runStart[r + 1] - first > 1)
+         PF_STAT_ADDONE(PF_COALESCEDIO);
+#endif
+   }
+
+   pIOEngine->Submit(pReqs, numRuns);
+
+   for (int r = 0; r < numRuns; r++) {
+      RC rcReq = pIOEngine->Wait(reqs[r]);
+      NoteWrite(reqs[r].fd);
+      if (rcReq && !rc)
+         rc = rcReq;
+      for (int i = runStart[r]; i < runStart[r + 1]; i++)
+         rcs[order[i]] = rcReq;
+   }
+
+   delete [] runStart;
+   delete [] pReqs;
+   delete [] reqs;
+   delete [] iov;
+   delete [] order;
+   return (rc);
+}
+
+//
+// SetDirty
+//
+// Desc: Internal.  Mark a page clean or dirty, keeping the count of
+//       dirty pages of its shard
+// In:   shard - shard owning the slot (latched by the caller)
+//
+void PF_BufferMgr::SetDirty(PF_BufShard &shard, int slot, int bDirty)
+{
+   if (bufTable[slot].bDirty != bDirty)
+      shard.numDirty += bDirty ? 1 : -1;
+   bufTable[slot].bDirty = bDirty;
+}
+
+//
+// BgWriter
+//
+// Desc: Internal.  Body of the background writer thread.  Every
+//       PF_BGWRITER_INTERVAL milliseconds it hands the shards, in turn,
+//       the pages it may write in a round (bgMaxRate per second), until
+//       the destructor stops it.  A round holds bgLatch, which keeps
+//       ResizeBuffer from replacing the shards under it.
+//
+// 后台写线程:每轮最多写bgMaxRate*间隔页,从冷端开始
+void PF_BufferMgr::BgWriter()
+{
+   int budget = bgMaxRate * PF_BGWRITER_INTERVAL / 1000;
+   if (budget < 1)
+      budget = 1;
+
+   unique_lock<mutex> bgGuard(bgLatch);
+   for (int start = 0; !bBgStop; start++) {
+      int left = budget;
+      for (int i = 0; i < numShards && left > 0; i++)
+         left -= BgWriteShard(shards[(start + i) % numShards], left);
+
+      bgWake.wait_for(bgGuard, chrono::milliseconds(PF_BGWRITER_INTERVAL));
+   }
+}
+
+//
+// BgWriteShard
+//
+// Desc: Internal.  One round of the background writer over a shard.
+//       Walking from the coldest page, it writes the dirty unpinned pages
+//       among the coldest 1/PF_BGWRITER_COLD of the frames, then more of
+//       them while the shard has more than bgDirtyPct dirty pages per
+//       hundred frames.  The pages are written as one batch by
+//       WriteSlots.
+// In:   shard - the shard, not latched
+//       budget - pages that may be written
+// Ret:  # of pages written
+//
+int PF_BufferMgr::BgWriteShard(PF_BufShard &shard, int budget)
+{
+   unique_lock<mutex> guard(shard.latch);
+
+   int numFrames = shard.hi - shard.lo;
+   int numCold = max(1, numFrames / PF_BGWRITER_COLD);
+   int numExcess = shard.numDirty - numFrames * bgDirtyPct / 100;
+
+   if (shard.numDirty == 0)
+      return (0);
+
+   int *slots = new int[min(budget, numFrames)];
+   int numSlots = 0;
+   int pos = 0;
+   for (int slot = LastUsed(shard);
+         slot != INVALID_SLOT && numSlots < budget &&
+         (pos < numCold || numSlots < numExcess);
+         slot = PrevUsed(shard, slot), pos++) {
+      PF_BufPageDesc &desc = bufTable[slot];
+      if (desc.bDirty && desc.pinCount == 0 && desc.fd != MEMORY_FD)
+         slots[numSlots++] = slot;
+   }
+
+   // A page that could not be written stays dirty for the next round
+   if (numSlots)
+      WriteSlots(shard, guard, slots, numSlots);
+
+#ifdef PF_STATS
+   for (int i = 0; i < numSlots; i++)
+      PF_STAT_ADDONE(PF_BGWRITE);
+#endif
+
+   delete [] slots;
+   return (numSlots);
+}
+
+//
+// ReleaseFailed
+//
+// Desc: Internal.  Drop one pin on a page whose read failed.
+//       The last pin takes the page out of the buffer, so the next
+//       GetPage reads it again.
+// In:   shard - shard owning the slot (latched by the caller)
+// Ret:  PF return code
+//
+RC PF_BufferMgr::ReleaseFailed(PF_BufShard &shard, int slot)
+{
+   RC rc;
+
+   if (--(bufTable[slot].pinCount) > 0)
+      return (0);
+
+   bufTable[slot].ioRC = 0;
+   if ((rc = shard.hashTable->Delete(bufTable[slot].fd, bufTable[slot].pageNum)) ||
+         (rc = Unlink(shard, slot)) ||
+         (rc = InsertFree(shard, slot)))
+      return (rc);
+
+   // Return ok
+   return (0);
 }
 
 //
@@ -967,6 +2903,7 @@ RC PF_BufferMgr::InitPageDesc(int fd, PageNum pageNum, int slot)
    bufTable[slot].pageNum  = pageNum;
    bufTable[slot].bDirty   = FALSE;
    bufTable[slot].pinCount = 1;
+   bufTable[slot].bReadAhead = FALSE;
 
    // Return ok
    return (0);
@@ -976,8 +2913,6 @@ RC PF_BufferMgr::InitPageDesc(int fd, PageNum pageNum, int slot)
 // Methods for manipulating raw memory buffers
 //------------------------------------------------------------------------------
 
-#define MEMORY_FD -1                // 这是一个表示内存的文件描述符
-
 //
 // GetBlockSize
 //
@@ -1001,33 +2936,45 @@ RC PF_BufferMgr::GetBlockSize(int &length) const
 // user.
 //
 // 从缓冲区中分配一个可用的缓冲区页(调用InternalAlloc()),返回该缓冲区的指针
-// 注意下面页号的计算方式??
+// 页号直接取slot编号(在整个缓冲区内唯一),从而ShardOf能找回所在分片
 RC PF_BufferMgr::AllocateBlock(char *&buffer)
 {
-   RC rc = OK_RC;
+   RC rc = PF_NOBUF;
 
-   // Get an empty slot from the buffer pool
+   // Get an empty slot from the buffer pool, trying the shards round robin
    int slot;
-   if ((rc = InternalAlloc(slot)) != OK_RC)
-      return rc;
+   int start = nextBlockShard++;
+   for (int i = 0; i < numShards; i++) {
+      PF_BufShard &shard = shards[(start + i) % numShards];
+      unique_lock<mutex> guard(shard.latch);
+
+      while ((rc = InternalAlloc(shard, guard, slot)) == PF_ALLOCAGAIN ||
+            (rc == PF_NOBUF && shard.numWriting > 0))
+         if (rc == PF_NOBUF)
+            shard.ioDone.wait(guard);
+      if (rc != OK_RC)
+         continue;
+
+      // Artificial page number (just needs to be unique for hash table)
+      PageNum pageNum = slot;
+
+      // Insert the page into the hash table, and initialize the page description entry
+      if ((rc = shard.hashTable->Insert(MEMORY_FD, pageNum, slot)) != OK_RC ||
+            (rc = InitPageDesc(MEMORY_FD, pageNum, slot)) != OK_RC) {
+         // Put the slot back on the free list before returning the error
+         Unlink(shard, slot);
+         InsertFree(shard, slot);
+         return rc;
+      }
 
-   // Create artificial page number (just needs to be unique for hash table)
-   PageNum pageNum = bufTable[slot].pData - (char*)0;
+      // Return pointer to buffer
+      buffer = bufTable[slot].pData;
 
-   // Insert the page into the hash table, and initialize the page description entry
-   if ((rc = hashTable.Insert(MEMORY_FD, pageNum, slot) != OK_RC) ||
-         (rc = InitPageDesc(MEMORY_FD, pageNum, slot)) != OK_RC) {
-      // Put the slot back on the free list before returning the error
-      Unlink(slot);
-      InsertFree(slot);
-      return rc;
+      // Return success code
+      return OK_RC;
    }
 
-   // Return pointer to buffer
-   buffer = bufTable[slot].pData;
-
-   // Return success code
-   return OK_RC;
+   return rc;
 }
 
 //
@@ -1037,5 +2984,19 @@ RC PF_BufferMgr::AllocateBlock(char *&buffer)
 // unpin buffer对应的缓冲区页内容!
 RC PF_BufferMgr::DisposeBlock(char* buffer)
 {
-   return UnpinPage(MEMORY_FD, buffer - (char*)0);
+   // The frames never move, so no latch is needed to find the slot
+   // holding buffer: it follows from the offset in its arena
+   for (PF_Arena *pArena = arenas; pArena != NULL; pArena = pArena->next) {
+      size_t offset = (size_t)(buffer - pArena->base);
+      if (buffer < pArena->base ||
+            offset >= (size_t)pArena->numSlots * pageSize)
+         continue;
+
+      int slot = pArena->firstSlot + (int)(offset / pageSize);
+      if (offset % pageSize || slot >= numPages)
+         break;
+      return UnpinPage(MEMORY_FD, slot);
+   }
+
+   return (PF_PAGENOTINBUF);
 }
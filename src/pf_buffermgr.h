@@ -10,13 +10,57 @@
 // 1998: Allow chunks from the buffer manager to not be associated with
 // a particular file.  Allows students to use main memory chunks that
 // are associated with (and limited by) the buffer.
+// The buffer may be split into several shards, each with its own latch,
+// hash table and LRU list, so that threads touching different pages do
+// not serialize on one lock.
+// The replacement policy is chosen at construction: LRU (the used list
+// is reordered on every hit), CLOCK (a hit only sets a reference bit
+// and the victim search sweeps a hand over the frames of the shard) or
+// 2Q (new pages wait in a probationary FIFO and only move to the main
+// LRU list when they are referenced again, so one scan cannot flush the
+// working set).
+// The frames live in page-aligned arenas mapped with mmap, so that the
+// address of a frame is base + (slot - firstSlot) * pageSize; growing the
+// buffer maps one more arena and never moves existing frames.
+// Asynchronous reads (GetPageAsync) and the batched writes of FlushPages
+// and ForcePages go through a PF_IOEngine.  A page being read is in the
+// hash table and pinned, but marked PF_PAGE_IO_READ until the read
+// completes; GetPage waits on the shard's ioDone for such pages.  No
+// latch is held while waiting for the engine, nor during the read of a
+// GetPage miss or the write of a dirty victim: the page is pinned and
+// marked first, and the latch taken again after the I/O.
+// Read-ahead: GetThisPage tells the buffer manager about every page it
+// asks for; once a file is read sequentially (or with SEQUENTIAL_HINT)
+// the next window of pages is read with one asynchronous vectored read,
+// a window ahead of the reader.
+// Background writer: an optional thread that writes dirty unpinned pages
+// from the cold end of the replacement lists, so that a miss seldom has
+// to write its victim first.  It keeps the coldest frames of every shard
+// clean and the dirty pages under a share of the buffer, at a bounded
+// number of pages per second.
+// Durability: the files written since their last fdatasync are remembered
+// (NoteWrite), so that SyncFiles only syncs those, all at once.
+// Snapshots: every shard counts the hits and misses of its GetPages under
+// its latch; GetSnapshot walks the shards one after the other, from the
+// coldest frame, and adds up the frames and counts per file.
+// Warm-up: WarmUp reads a list of pages ahead in sorted runs, the way
+// read-ahead does, and GetResident lists the pages of a file to be read
+// back after a restart (see PF_WarmList).
 //
 
 #ifndef PF_BUFFERMGR_H
 #define PF_BUFFERMGR_H
 
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <condition_variable>
+#include <set>
+#include <map>
+#include <vector>
 #include "pf_internal.h"
 #include "pf_hashtable.h"
+#include "pf_ioengine.h"
 
 // INVALID_SLOT is used within the PF_BufferMgr class which tracks a list
 // of PF_BufPageDesc.  Inside the PF_BufPageDesc are integer "pointers" to
@@ -24,6 +68,16 @@
 // next.
 #define INVALID_SLOT  (-1)
 
+// I/O in progress on a buffer page (PF_BufPageDesc::ioState)
+#define PF_PAGE_IO_NONE    0        // none
+#define PF_PAGE_IO_READ    1        // being read, contents not valid yet
+#define PF_PAGE_IO_WRITE   2        // being written by a batch
+
+// Internal return code of InternalAlloc: the latch was released to write
+// a dirty victim, so the caller must look its page up again.  It never
+// leaves the buffer manager.
+#define PF_ALLOCAGAIN      (PF_LASTERROR - 1)
+
 /*************************************************************************************
  *                                  缓冲区管理器声明
  * 1.缓冲区的组织方式:
@@ -36,6 +90,10 @@
  *      即RM_FileHdr页号为0, 而PF_FileHdr没有页号
  * 4.理解使用hashtable的目的:
  *     => 能根据(fd,pageNum)快速找到page在缓冲区中的所有信息(通过slot查找PF_BufPageDesc项)
+ * 5.分片(shard):
+ *     => bufTable按slot区间切分为numShards个分片,(fd,pageNum)经hash固定落到某一分片;
+ *        每个分片有自己的latch、hashtable、used/free链表,置换也只在分片内部进行
+ *     => numShards为1时,行为与原来完全相同(整个缓冲区一个LRU链表)
  * ***********************************************************************************/
 
 
@@ -47,9 +105,79 @@ struct PF_BufPageDesc {
     int        next;        // next in the linked list of buffer pages,使用bufTable下标表示
     int        prev;        // prev in the linked list of buffer pages,使用bufTable下标表示
     int        bDirty;      // TRUE if page is dirty
+    int        bRef;        // CLOCK reference bit, set on every access
+    int        bProbation;  // TRUE if on the 2Q probationary list
+    ClientHint hint;        // hint given with the last GetPage
     short int  pinCount;    // pin count
     PageNum    pageNum;     // page number for this page
     int        fd;          // OS file descriptor of this page
+    int        bReadAhead;  // read ahead and not asked for yet
+    int        ioState;     // PF_PAGE_IO_NONE, _READ or _WRITE
+    RC         ioRC;        // error of the last asynchronous read, if any
+    PF_PageFuture *pWaiters;// futures waiting for the read
+    PF_IORequest ioReq;     // request of the asynchronous I/O
+    struct iovec ioVec;     // the frame, for ioReq
+};
+
+//
+// PF_BufShard - an independently latched partition of the buffer pool
+// 分片只管理bufTable中[lo,hi)区间的slot;latch保护下面所有成员以及这些slot的描述项
+struct PF_BufShard {
+    std::mutex     latch;       // protects the shard and its page descs
+    PF_HashTable   *hashTable;  // (fd,pageNum) -> slot for pages of the shard
+    int            first;       // MRU page slot
+    int            last;        // LRU page slot
+    int            a1First;     // 2Q probationary list, newest page
+    int            a1Last;      // 2Q probationary list, oldest page
+    int            a1Len;       // # of pages on the probationary list
+    int            free;        // head of free list
+    int            hand;        // CLOCK hand, a slot in [lo,hi)
+    int            lo;          // first slot owned by the shard
+    int            hi;          // one past the last slot owned by the shard
+    int            numDirty;    // # of dirty pages of the shard
+    int            numWriting;  // # of pages pinned by StartWrite
+    long long      numHits;     // GetPages of the shard that found
+    long long      numMisses;   //   their page and that read it
+    long long      *fileHits;   // the same per file, PF_ACCESS_FDS of
+    long long      *fileMisses; //   each, by descriptor
+    std::condition_variable ioDone;  // an asynchronous I/O completed
+};
+
+//
+// PF_Arena - one contiguous mapping holding the frames of slots
+//            [firstSlot, firstSlot + numSlots)
+//
+struct PF_Arena {
+    char           *base;       // address of the frame of firstSlot
+    size_t         length;      // bytes mapped at base
+    int            firstSlot;   // first slot backed by the arena
+    int            numSlots;    // # of frames in the arena
+    PF_Arena       *next;       // next arena (higher slots) or NULL
+};
+
+//
+// PF_ReadAhead - sequential access detection for one file
+// [raStart, raEnd)是已预读的区间,读者到达raMark(最近一个窗口的首页)时预读下一个窗口
+struct PF_ReadAhead {
+    int            fd;          // file tracked, -1 if none
+    PageNum        lastPage;    // page of the last GetPage
+    int            seqRun;      // # of GetPages of the page after the last
+    PageNum        raStart;     // pages [raStart, raEnd) have been read
+    PageNum        raEnd;       //   ahead since the reader became sequential
+    PageNum        raMark;      // first page of the last window
+    int            window;      // size of the last window
+};
+
+class PF_BufferMgr;
+
+//
+// PF_ReadAheadRun - the vectored read of one read-ahead window
+//
+struct PF_ReadAheadRun {
+    PF_BufferMgr   *pBufferMgr; // buffer manager of the pages
+    PF_IORequest   req;         // one request for all the pages
+    struct iovec   iov[PF_MAX_IOV];  // their frames
+    int            slots[PF_MAX_IOV];// their slots
 };
 
 //
@@ -58,22 +186,44 @@ struct PF_BufPageDesc {
 class PF_BufferMgr {
 public:
 
-    PF_BufferMgr     (int numPages);             // Constructor - allocate
-                                                  // numPages buffer pages
+    // Constructor - allocate config.numPages buffer pages split over
+    // config.numShards shards
+    PF_BufferMgr     (const PF_BufferConfig &config);
     ~PF_BufferMgr    ();                         // Destructor
 
     // Read pageNum into buffer, point *ppBuffer to location
     RC  GetPage      (int fd, PageNum pageNum, char **ppBuffer,
-                      int bMultiplePins = TRUE);
+                      int bMultiplePins = TRUE,
+                      ClientHint hint = NO_HINT);
     // Allocate a new page in the buffer, point *ppBuffer to its location
     RC  AllocatePage (int fd, PageNum pageNum, char **ppBuffer);
 
+    // Pin pageNum and start reading it if it is not in the buffer;
+    // WaitPage then points *ppBuffer to it
+    RC  GetPageAsync (int fd, PageNum pageNum, PF_PageFuture &future,
+                      ClientHint hint = NO_HINT,
+                      PF_PageCallback pfnDone = NULL, void *pArg = NULL);
+    RC  WaitPage     (PF_PageFuture &future, char **ppBuffer);
+    int IsPageReady  (const PF_PageFuture &future);
+
+    // Note that pageNum of a file of numFilePages pages is about to be
+    // read, and read ahead if the file is read sequentially (advisory)
+    void ReadAhead   (int fd, PageNum pageNum, PageNum numFilePages,
+                      ClientHint hint = NO_HINT);
+
     RC  MarkDirty    (int fd, PageNum pageNum);  // Mark page dirty
     RC  UnpinPage    (int fd, PageNum pageNum);  // Unpin page from the buffer
-    RC  FlushPages   (int fd);                   // Flush pages for file
+    // Flush pages for file; fdatasync it after if bSync
+    RC  FlushPages   (int fd, int bSync = FALSE);
 
     // Force a page to the disk, but do not remove from the buffer pool
-    RC ForcePages    (int fd, PageNum pageNum);
+    RC ForcePages    (int fd, PageNum pageNum, int bSync = FALSE);
+
+    // Note that the file was written to, and fdatasync the files of fds
+    // written since their last sync, as one batch; forget a closed file
+    void NoteWrite   (int fd);
+    RC  SyncFiles    (const int fds[], int numFds);
+    void ForgetFile  (int fd);
 
 
     // Remove all entries from the Buffer Manager.
@@ -81,6 +231,19 @@ public:
     // Display all entries in the buffer
     RC PrintBuffer   ();
 
+    // Frames and GetPage counts per file (the first maxFiles by fd) and
+    // in total, or of the file fd alone
+    RC GetSnapshot   (PF_BufferSnapshot &snapshot,
+                      PF_FileSnapshot files[], int maxFiles);
+    RC GetFileSnapshot (int fd, PF_FileSnapshot &snapshot);
+    // Restart the hit and miss counts
+    void ResetAccessCounts ();
+
+    // Read sorted pages of a file ahead in batches (buffer warm-up), and
+    // list the pages of a file in the buffer with their rank
+    int  WarmUp      (int fd, const PageNum pages[], int numWarmPages);
+    void GetResident (int fd, std::vector<PF_ResidentPage> &resident);
+
     // Attempts to resize the buffer to the new size
     RC ResizeBuffer  (int iNewSize);
 
@@ -98,27 +261,130 @@ public:
     RC DisposeBlock  (char *buffer);
 
 private:
-    RC  InsertFree   (int slot);                 // Insert slot at head of free
-    RC  LinkHead     (int slot);                 // Insert slot at head of used
-    RC  Unlink       (int slot);                 // Unlink slot
-    RC  InternalAlloc(int &slot);                // Get a slot to use
+    // Shard that (fd,pageNum) is mapped to
+    PF_BufShard &ShardOf (int fd, PageNum pageNum) const;
+
+    // (Re)build bufTable and the shards for numPages pages; a resize
+    // rebuilds the shards in place
+    void InitShards  (int numPages, int numShards);
+    void FreeShards  ();
+    // Remove the unpinned pages of a shard (ClearBuffer, ResizeBuffer)
+    RC  ClearShard   (PF_BufShard &shard);
+
+    // Map arenas until numPages frames exist / unmap frames past numPages
+    void GrowArenas  (int numPages);
+    void ShrinkArenas(int numPages);
+    char *FrameOf    (int slot) const;               // Frame of a slot
+
+    RC  InsertFree   (PF_BufShard &shard, int slot); // Insert slot at head of free
+    RC  LinkHead     (PF_BufShard &shard, int slot); // Insert slot at head of used
+    RC  LinkTail     (PF_BufShard &shard, int slot); // Insert slot at tail of used
+    RC  LinkProbation(PF_BufShard &shard, int slot); // Insert slot at head of 2Q A1
+    RC  Unlink       (PF_BufShard &shard, int slot); // Unlink slot
+    RC  InternalAlloc(PF_BufShard &shard,            // Get a slot to use
+                      std::unique_lock<std::mutex> &guard, int &slot,
+                      ClientHint hint = NO_HINT);
+
+    // Iterate over all pages of a shard (used list, then probationary list)
+    int FirstUsed    (const PF_BufShard &shard) const;
+    int NextUsed     (const PF_BufShard &shard, int slot) const;
+
+    // Replacement policy hooks
+    RC  Admit        (PF_BufShard &shard, int slot,  // Link a new page
+                      ClientHint hint);
+    RC  Touch        (PF_BufShard &shard, int slot,  // Record an access
+                      int bAccess);
+    RC  ChooseVictim (PF_BufShard &shard, int &slot, // Pick an unpinned page
+                      ClientHint hint);
+    int LastUnpinned (int slot) const;               // Walk a list backwards
+
+    // Iterate over all pages of a shard from the coldest (the order in
+    // which the policy looks for victims, roughly)
+    int LastUsed     (const PF_BufShard &shard) const;
+    int PrevUsed     (const PF_BufShard &shard, int slot) const;
+    RC  Access       (PF_BufShard &shard, int slot,  // GetPage of a resident
+                      ClientHint hint);              // page
+    // Count a GetPage of a file as a hit or a miss
+    void CountAccess (PF_BufShard &shard, int fd, int bHit);
+    // Add the frames and counts of a shard (of the file fd, or of all if
+    // fd is PF_ALL_FILES) to total and, by fd, to files
+    void SnapshotShard (PF_BufShard &shard, int fd, PF_FileSnapshot &total,
+                        std::map<int, PF_FileSnapshot> &files, int &numFree);
+
+    // Read pages [pageNum, pageNum + numRun) ahead, stopping at the first
+    // one already in the buffer; the same without submitting the read;
+    // completion of that read
+    int  Prefetch    (int fd, PageNum pageNum, int numRun);
+    PF_ReadAheadRun *StartRun (int fd, PageNum pageNum, int numRun);
+    static void ReadAheadDone (PF_IORequest *pReq);
 
     // Read a page
     RC  ReadPage     (int fd, PageNum pageNum, char *dest);
 
     // Write a page
     RC  WritePage    (int fd, PageNum pageNum, char *source);
+    // Read / write numRun adjacent pages starting at pageNum
+    RC  ReadPages    (int fd, PageNum pageNum, int numRun, char *dests[]);
+    RC  WritePages   (int fd, PageNum pageNum, int numRun, char *sources[]);
+
+    // Set up a request for numRun adjacent pages starting at pageNum
+    void InitRequest (PF_IORequest &req, int bWrite, int fd,
+                      PageNum pageNum, struct iovec *iov, int numRun);
+    // Completion of an asynchronous read (on an I/O thread)
+    static void ReadDone (PF_IORequest *pReq);
+    void FinishRead  (int slot, RC rc, int bReadAhead = FALSE);
+    // Write dirty pages of a shard as one batch, without the latch
+    RC  WriteSlots   (PF_BufShard &shard, std::unique_lock<std::mutex> &guard,
+                      int slots[], int numSlots);
+    // Write the dirty pages of a file (pageNum or ALL_PAGES) in page order
+    RC  WriteDirty   (int fd, PageNum pageNum, int bUnpinnedOnly);
+    // Whether a page of a file (pageNum or ALL_PAGES) is being written
+    int IsWriting    (const PF_BufShard &shard, int fd, PageNum pageNum) const;
+    // The slot of pageNum, or all used slots for ALL_PAGES, of a shard
+    int FirstOfFile  (const PF_BufShard &shard, int fd, PageNum pageNum) const;
+    int NextOfFile   (const PF_BufShard &shard, PageNum pageNum, int slot) const;
+    // Pin a dirty page for a write, and release it after
+    void StartWrite  (PF_BufShard &shard, int slot);
+    void EndWrite    (PF_BufShard &shard, int slot, RC rc);
+    // Write pinned pages sorted by file and page, adjacent pages with one
+    // request; rcs gets the result of each page
+    RC  WriteRuns    (int slots[], int numSlots, RC rcs[]);
+    // Mark a page of shard clean or dirty
+    void SetDirty    (PF_BufShard &shard, int slot, int bDirty);
+    // Background writer thread body, and one shard of one of its rounds
+    void BgWriter    ();
+    int  BgWriteShard(PF_BufShard &shard, int budget);
+    // Drop a pin on a page whose read failed, freeing it with the last
+    RC  ReleaseFailed(PF_BufShard &shard, int slot);
 
     // Init the page desc entry
     RC  InitPageDesc (int fd, PageNum pageNum, int slot);
 
     PF_BufPageDesc *bufTable;                     // info on buffer pages => 是数组,PF_BUFFER_SIZE个
-    PF_HashTable   hashTable;                     // Hash table object
-    int            numPages;                      // # of pages in the buffer
+    PF_BufShard    *shards;                       // numShards shards over bufTable
+    int            numShards;                     // # of shards
+    PF_ReplacePolicy policy;                      // page replacement policy
+    std::atomic<int> numPages;                    // # of pages in the buffer
+                                                  // (read without latches)
+    int            hashSize;                      // pages the hash tables are sized for
+    int            bHugePages;                    // madvise arenas for huge pages
+    PF_Arena       *arenas;                       // frames, in slot order
     int            pageSize;                      // Size of pages in the buffer => 通常4096
-    int            first;                         // MRU page slot => first、last都是对应used链表
-    int            last;                          // LRU page slot
-    int            free;                          // head of free list => 空闲链表
+    std::atomic<int> nextBlockShard;              // round robin shard for AllocateBlock
+    PF_IOEngine    *pIOEngine;                    // asynchronous page I/O
+    int            bReadAheadOn;                  // read-ahead enabled
+    std::mutex     raLatch;                       // protects raTable
+    PF_ReadAhead   raTable[PF_READAHEAD_FILES];   // files read sequentially
+    int            bgDirtyPct;                    // background writer target
+    int            bgMaxRate;                     //   and rate (pages/s)
+    std::mutex     bgLatch;                       // held by a writer round;
+                                                  // protects bBgStop
+    std::condition_variable bgWake;               // signals bBgStop
+    int            bBgStop;                       // writer must exit
+    std::thread    bgWriter;                      // the writer, if started
+    std::mutex     syncLatch;                     // protects unsyncedFds
+    std::set<int>  unsyncedFds;                   // files written since their
+                                                  // last fdatasync
 };
 
 #endif
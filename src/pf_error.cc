@@ -31,6 +31,8 @@ static char *PF_WarnMsg[] = {
   (char*)"page already unpinned",
   (char*)"end of file",
   (char*)"attempting to resize the buffer too small",
+  (char*)"file is open read-only (mapped)",
+  (char*)"file has as many pages as its bitmap can hold",
   (char*)"invalid filename"
 };
 
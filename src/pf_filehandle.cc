@@ -7,9 +7,21 @@
 
 #include <unistd.h>
 #include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <cstdint>
+#include <cerrno>
+#include <fcntl.h>
 #include "pf_internal.h"
 #include "pf_buffermgr.h"
 
+#ifdef PF_STATS
+#include "statistics.h"
+
+// This is defined within pf_buffermgr.cc
+extern StatisticsMgr *pStatisticsMgr;
+#endif
+
 /**************************************************************************************
  *                               文件处理器
  * 作用:与一个打开文件相关联(见PF_Manager::OpenFile),从而处理该文件中的pages(通过PF_PageHandle)
@@ -28,8 +40,95 @@
  * 7.FlushPages()、ForcePages(fd,pgNum)的区别:
  *    a.前者是将文件的所有页写回磁盘,且会释放缓冲区
  *    b.后者是将文件中指定的页写回磁盘,且不用释放缓冲区
+ * 8.PF_CREATE_BITMAP创建的文件用文件头中的位图(PF_PageMap)记录哪些页在用,
+ *   不再通过空闲页串成链表;分配、遍历时查位图即可,不必读入空闲页
  * ************************************************************************************/
 
+// The bitmap follows PF_FileHdr in the header block
+static_assert(sizeof(PF_FileHdr) <= PF_BITMAP_OFFSET,
+      "PF_FileHdr overlaps the free-page bitmap");
+
+//
+// IsUsed
+//
+// Desc: TRUE if the bitmap has page pageNum in use
+//
+static inline int IsUsed(const PF_PageMap *pPageMap, PageNum pageNum)
+{
+   return ((pPageMap->words[pageNum >> 6] >> (pageNum & 63)) & 1);
+}
+
+//
+// SetUsed
+//
+// Desc: Set or clear the bit of page pageNum
+//
+static inline void SetUsed(PF_PageMap *pPageMap, PageNum pageNum, int bUsed)
+{
+   uint64_t bit = (uint64_t)1 << (pageNum & 63);
+
+   if (bUsed)
+      pPageMap->words[pageNum >> 6] |= bit;
+   else
+      pPageMap->words[pageNum >> 6] &= ~bit;
+}
+
+//
+// NextUsed
+//
+// Desc: The first page in use after current (dir 1) or before it (dir
+//       -1), a word of 64 pages at a time
+// In:   current - may be -1 or numPages
+//       numPages - # of pages of the file
+// Ret:  the page number, or -1 if there is none
+//
+static PageNum NextUsed(const PF_PageMap *pPageMap, PageNum current,
+      PageNum numPages, int dir)
+{
+   PageNum start = current + dir;
+   if (start < 0 || start >= numPages)
+      return (-1);
+
+   int w = start >> 6;
+   uint64_t word;
+
+   if (dir > 0) {
+      word = pPageMap->words[w] & (~(uint64_t)0 << (start & 63));
+      while (word == 0) {
+         if (++w * 64 >= numPages)
+            return (-1);
+         word = pPageMap->words[w];
+      }
+      PageNum pageNum = w * 64 + __builtin_ctzll(word);
+      return (pageNum < numPages ? pageNum : -1);
+   }
+
+   word = pPageMap->words[w] & (~(uint64_t)0 >> (63 - (start & 63)));
+   while (word == 0) {
+      if (--w < 0)
+         return (-1);
+      word = pPageMap->words[w];
+   }
+   return (w * 64 + 63 - __builtin_clzll(word));
+}
+
+//
+// FirstFree
+//
+// Desc: The lowest page of the file that is not in use
+// Ret:  the page number, or -1 if all numPages pages are used
+//
+static PageNum FirstFree(const PF_PageMap *pPageMap, PageNum numPages)
+{
+   for (int w = 0; w * 64 < numPages; w++) {
+      uint64_t word = ~pPageMap->words[w];
+      if (word != 0) {
+         PageNum pageNum = w * 64 + __builtin_ctzll(word);
+         return (pageNum < numPages ? pageNum : -1);
+      }
+   }
+   return (-1);
+}
 
 
 
@@ -52,6 +151,11 @@ PF_FileHandle::PF_FileHandle()
    // Initialize local variables
    bFileOpen = FALSE;
    pBufferMgr = NULL;
+   bDirectIO = FALSE;
+   pMap = NULL;
+   pPageMap = NULL;
+   extentPages = 0;
+   extentEnd = 0;
 }
 
 //
@@ -80,6 +184,11 @@ PF_FileHandle::PF_FileHandle(const PF_FileHandle &fileHandle)
    this->bFileOpen   = fileHandle.bFileOpen;
    this->bHdrChanged = fileHandle.bHdrChanged;
    this->unixfd      = fileHandle.unixfd;
+   this->bDirectIO   = fileHandle.bDirectIO;
+   this->pMap        = fileHandle.pMap;
+   this->pPageMap    = fileHandle.pPageMap;
+   this->extentPages = fileHandle.extentPages;
+   this->extentEnd   = fileHandle.extentEnd;
 }
 
 //
@@ -102,6 +211,11 @@ PF_FileHandle& PF_FileHandle::operator= (const PF_FileHandle &fileHandle)
       this->bFileOpen   = fileHandle.bFileOpen;
       this->bHdrChanged = fileHandle.bHdrChanged;
       this->unixfd      = fileHandle.unixfd;
+      this->bDirectIO   = fileHandle.bDirectIO;
+      this->pMap        = fileHandle.pMap;
+      this->pPageMap    = fileHandle.pPageMap;
+      this->extentPages = fileHandle.extentPages;
+      this->extentEnd   = fileHandle.extentEnd;
    }
 
    // Return a reference to this
@@ -124,6 +238,39 @@ RC PF_FileHandle::GetFirstPage(PF_PageHandle &pageHandle) const
    return (GetNextPage((PageNum)-1, pageHandle));
 }
 
+//
+// GetPageAsync
+//
+// Desc: Start getting a specific page without waiting for the disk.  The
+//       page is pinned right away; future.Wait blocks until it has been
+//       read and then sets a page handle to it, like GetThisPage.
+// In:   pageNum - number of the page to get
+//       hint - SEQUENTIAL_HINT if the page is read as part of a scan
+//       pfnDone, pArg - optional callback, run when the page is in the
+//       buffer (on an I/O thread, or before returning on a buffer hit)
+// Out:  future - to be waited for
+// Ret:  PF return code
+//
+// 异步获取页:立即返回,真正的读请求由I/O引擎完成,之后通过future.Wait()取得页
+RC PF_FileHandle::GetPageAsync(PageNum pageNum, PF_PageFuture &future,
+      ClientHint hint, PF_PageCallback pfnDone, void *pArg) const
+{
+   // File must be open
+   if (!bFileOpen)
+      return (PF_CLOSEDFILE);
+
+   // Validate page number
+   if (!IsValidPageNum(pageNum))
+      return (PF_INVALIDPAGE);
+
+   // The pages of a mapped file are not read through the buffer
+   if (pMap != NULL)
+      return (PF_READONLY);
+
+   return (pBufferMgr->GetPageAsync(unixfd, pageNum, future, hint,
+         pfnDone, pArg));
+}
+
 //
 // GetLastPage
 //
@@ -165,6 +312,18 @@ RC PF_FileHandle::GetNextPage(PageNum current, PF_PageHandle &pageHandle) const
    if (current != -1 &&  !IsValidPageNum(current))
       return (PF_INVALIDPAGE);
 
+   // A forward scan of a mapped file prefetches the pages ahead of it
+   if (pMap != NULL && current + 1 < hdr.numPages)
+      AdviseScan(current + 1, 1);
+
+   // The bitmap skips the free pages without reading them
+   if (pPageMap != NULL) {
+      while ((current = NextUsed(pPageMap, current, hdr.numPages, 1)) >= 0)
+         if ((rc = GetThisPage(current, pageHandle)) != PF_INVALIDPAGE)
+            return (rc);
+      return (PF_EOF);
+   }
+
    // Scan the file until a valid used page is found
    for (current++; current < hdr.numPages; current++) {
 
@@ -206,6 +365,17 @@ RC PF_FileHandle::GetPrevPage(PageNum current, PF_PageHandle &pageHandle) const
    if (current != hdr.numPages &&  !IsValidPageNum(current))
       return (PF_INVALIDPAGE);
 
+   // So does a backward scan, the pages before it
+   if (pMap != NULL && current > 0)
+      AdviseScan(current - 1, -1);
+
+   if (pPageMap != NULL) {
+      while ((current = NextUsed(pPageMap, current, hdr.numPages, -1)) >= 0)
+         if ((rc = GetThisPage(current, pageHandle)) != PF_INVALIDPAGE)
+            return (rc);
+      return (PF_EOF);
+   }
+
    // Scan the file until a valid used page is found
    for (current--; current >= 0; current--) {
 
@@ -228,6 +398,7 @@ RC PF_FileHandle::GetPrevPage(PageNum current, PF_PageHandle &pageHandle) const
 // Desc: Get a specific page in a file
 //       The file handle must refer to an open file
 // In:   pageNum - the number of the page to get
+//       hint - SEQUENTIAL_HINT if the page is accessed as part of a scan
 // Out:  pageHandle - becomes a handle to the this page of the file
 //                    this function modifies local var's in pageHandle
 //       The referenced page is pinned in the buffer pool.
@@ -236,7 +407,8 @@ RC PF_FileHandle::GetPrevPage(PageNum current, PF_PageHandle &pageHandle) const
 // 读取指定的页号的page到内存缓冲区(调用pBufferMgr->GetPage(fd,pgNum,pBuf)); 
 // 同时将此page与一个PF_PageHandle对象绑定 
 // 会自动pin到内存中,需要手动unpin
-RC PF_FileHandle::GetThisPage(PageNum pageNum, PF_PageHandle &pageHandle) const
+RC PF_FileHandle::GetThisPage(PageNum pageNum, PF_PageHandle &pageHandle,
+      ClientHint hint) const
 {
    int  rc;               // return code
    char *pPageBuf;        // address of page in buffer pool
@@ -249,11 +421,24 @@ RC PF_FileHandle::GetThisPage(PageNum pageNum, PF_PageHandle &pageHandle) const
    if (!IsValidPageNum(pageNum))
       return (PF_INVALIDPAGE);
 
+   // A free page is known without reading it if the file has a bitmap
+   if (pPageMap != NULL && !IsUsed(pPageMap, pageNum))
+      return (PF_INVALIDPAGE);
+
+   // A mapped file hands out the page in place
+   if (pMap != NULL) {
+      if (hint == SEQUENTIAL_HINT)
+         AdviseScan(pageNum, 1);
+      return (GetMappedPage(pageNum, pageHandle));
+   }
+
    // Get this page from the buffer manager(GetPage())
    // => 1.如果本来在缓冲区中,则增加pinCount
    //    2.如果不在缓冲区,则读取并pin到缓冲区
    //    3.如果缓冲区已满,需要置换
-   if ((rc = pBufferMgr->GetPage(unixfd, pageNum, &pPageBuf)))
+   // A sequential reader gets the following pages read ahead
+   pBufferMgr->ReadAhead(unixfd, pageNum, hdr.numPages, hint);
+   if ((rc = pBufferMgr->GetPage(unixfd, pageNum, &pPageBuf, TRUE, hint)))
       return (rc);
 
    // If the page is valid, then set pageHandle to this page and return ok
@@ -290,44 +475,154 @@ RC PF_FileHandle::GetThisPage(PageNum pageNum, PF_PageHandle &pageHandle) const
 // 同时将新的page与pageHandle绑定;
 // 会将新的页pin内存缓冲区,之后需要手动unpin
 RC PF_FileHandle::AllocatePage(PF_PageHandle &pageHandle)
+{
+   return (AllocatePages(1, &pageHandle));
+}
+
+//
+// AllocatePages
+//
+// Desc: Allocate numAlloc pages in the file at once.  Pages on the free
+//       list are taken first; the rest are new pages at the end of the
+//       file, for which disk space is reserved a whole extent at a time
+//       (Preallocate) and the header is updated once.  If a page cannot
+//       be had (the buffer is full of pinned pages, say), the pages
+//       taken so far are disposed of again.
+//       In a file with a bitmap, the lowest free pages are taken first,
+//       and they are not read: their old contents are zeroed anyway.
+//       The file handle must refer to an open file
+// In:   numAlloc - # of pages to allocate
+// Out:  pageHandles - the numAlloc new pages, pinned and zeroed
+// Ret:  PF return code
+//
+// 批量分配:先用空闲链表中的页,其余在文件末尾一次性分配,文件头只更新一次
+RC PF_FileHandle::AllocatePages(int numAlloc, PF_PageHandle pageHandles[])
 {
    int     rc;               // return code
-   int     pageNum;          // new-page number
+   int     numDone = 0;      // pages allocated so far
+   int     numFree = 0;      //   of which from the free list
    char    *pPageBuf;        // address of page in buffer pool
 
    // File must be open
    if (!bFileOpen)
       return (PF_CLOSEDFILE);
 
-   // If the free list isn't empty... => 1.文件中尚有空闲页
-   if (hdr.firstFree != PF_PAGE_LIST_END) {
-      pageNum = hdr.firstFree;
+   // A mapped file is read-only
+   if (pMap != NULL)
+      return (PF_READONLY);
+
+   // Free pages of the bitmap get a frame without being read
+   // 位图中的空闲页:直接分配缓冲区页,不必从磁盘读入
+   while (pPageMap != NULL && numDone < numAlloc) {
+      PageNum pageNum = FirstFree(pPageMap, hdr.numPages);
+      if (pageNum < 0)
+         break;
+
+      rc = pBufferMgr->AllocatePage(unixfd, pageNum, &pPageBuf);
+      if (rc == PF_PAGEINBUF)
+         rc = pBufferMgr->GetPage(unixfd, pageNum, &pPageBuf);
+      if (rc)
+         goto err;
+
+      SetUsed(pPageMap, pageNum, TRUE);
+      bHdrChanged = TRUE;
+      pageHandles[numDone++].pageNum = pageNum;
+      numFree++;
+
+      if ((rc = InitNewPage(pageNum, pPageBuf, pageHandles[numDone - 1])))
+         goto err;
+   }
+
+   // While the free list isn't empty... => 1.文件中尚有空闲页
+   while (numDone < numAlloc && hdr.firstFree != PF_PAGE_LIST_END) {
+      PageNum pageNum = hdr.firstFree;
 
       // Get the first free page into the buffer
       if ((rc = pBufferMgr->GetPage(unixfd,pageNum,&pPageBuf)))
-         return (rc);
+         goto err;
 
       // Set the first free page to the next page on the free list
       hdr.firstFree = ((PF_PageHdr*)pPageBuf)->nextFree;
+      bHdrChanged = TRUE;
+      pageHandles[numDone++].pageNum = pageNum;
+      numFree++;
+
+      if ((rc = InitNewPage(pageNum, pPageBuf, pageHandles[numDone - 1])))
+         goto err;
    }
-   else {                          // => 2.文件没有空闲页
 
-      // The free list is empty...
-      pageNum = hdr.numPages;           // 取最大编号,它是新分配页的编号
+   // The rest are new pages: pages numPages.. of the file => 2.文件末尾的新页
+   if (numDone < numAlloc) {
+      PageNum first = hdr.numPages;
+
+      // The bitmap has room for so many pages
+      if (pPageMap != NULL && first + numAlloc - numDone > PF_BITMAP_PAGES) {
+         rc = PF_FILEFULL;
+         goto err;
+      }
+
+      if ((rc = Preallocate(first + numAlloc - numDone)))
+         goto err;
+
+      for (; numDone < numAlloc; numDone++) {
+         PageNum pageNum = first + numDone - numFree;
+
+         // Allocate a new page in the file
+         if ((rc = pBufferMgr->AllocatePage(unixfd,pageNum,&pPageBuf))) {
+            hdr.numPages = pageNum;
+            bHdrChanged = TRUE;
+            goto err;
+         }
+
+         // The page is valid from now on
+         ((PF_PageHdr *)pPageBuf)->nextFree = PF_PAGE_USED;
+         if (pPageMap != NULL)
+            SetUsed(pPageMap, pageNum, TRUE);
+         pageHandles[numDone].pageNum = pageNum;
+         pageHandles[numDone].pPageData = pPageBuf + sizeof(PF_PageHdr);
+      }
+
+      // Increment the number of pages for this file, once
+      hdr.numPages = first + numAlloc - numFree;
+      bHdrChanged = TRUE;
+
+      for (int i = numFree; i < numAlloc; i++) {
+         PageNum pageNum = pageHandles[i].pageNum;
+         if ((rc = InitNewPage(pageNum,
+               pageHandles[i].pPageData - sizeof(PF_PageHdr), pageHandles[i])))
+            goto err;
+      }
+   }
 
-      // Allocate a new page in the file
-      if ((rc = pBufferMgr->AllocatePage(unixfd,pageNum,&pPageBuf)))
-         return (rc);
+   // Return ok
+   return (0);
 
-      // Increment the number of pages for this file
-      hdr.numPages++;
+err:
+   // Put the pages taken back on the free list
+   for (int i = 0; i < numDone; i++) {
+      UnpinPage(pageHandles[i].pageNum);
+      DisposePage(pageHandles[i].pageNum);
    }
+   return (rc);
+}
 
-   // Mark the header as changed
-   bHdrChanged = TRUE;
+//
+// InitNewPage
+//
+// Desc: Internal.  Set up a page just taken by AllocatePages: mark it
+//       used, zero it, mark it dirty and set pageHandle to it
+// In:   pageNum - the page, pinned
+//       pPageBuf - its frame, page header first
+// Out:  pageHandle - refers to the page
+// Ret:  PF return code
+//
+RC PF_FileHandle::InitNewPage(PageNum pageNum, char *pPageBuf,
+      PF_PageHandle &pageHandle)
+{
+   int rc;
 
    // Mark this page as used => 这个空闲页被使用了!
-   ((PF_PageHdr *)pPageBuf)->nextFree = PF_PAGE_USED;  
+   ((PF_PageHdr *)pPageBuf)->nextFree = PF_PAGE_USED;
 
    // Zero out the page data
    memset(pPageBuf + sizeof(PF_PageHdr), 0, PF_PAGE_SIZE);
@@ -339,8 +634,48 @@ RC PF_FileHandle::AllocatePage(PF_PageHandle &pageHandle)
    // Set the pageHandle local variables
    pageHandle.pageNum = pageNum;
    pageHandle.pPageData = pPageBuf + sizeof(PF_PageHdr);
+   return (0);
+}
 
-   // Return ok
+//
+// Preallocate
+//
+// Desc: Internal.  Make sure disk space is reserved for the pages below
+//       endPage, so that a growing file gets it in extents of extentPages
+//       pages (aligned on multiples of extentPages) rather than block by
+//       block as its pages are first written.  The file size does not
+//       change (FALLOC_FL_KEEP_SIZE): the pages past hdr.numPages are not
+//       part of the file until allocated.  A file system without
+//       fallocate simply gets no extents.
+// In:   endPage - one past the last page about to be allocated
+// Ret:  PF_UNIX if the disk is full, 0 otherwise
+//
+// 按extent预留磁盘空间,避免文件以4KB为单位增长产生碎片
+RC PF_FileHandle::Preallocate(PageNum endPage)
+{
+   if (extentPages <= 1 || endPage <= extentEnd)
+      return (0);
+
+   PageNum newEnd = (endPage + extentPages - 1) / extentPages * extentPages;
+   long pageSize = PF_PAGE_SIZE + sizeof(PF_PageHdr);
+
+#ifdef FALLOC_FL_KEEP_SIZE
+   if (fallocate(unixfd, FALLOC_FL_KEEP_SIZE,
+         PF_FILE_HDR_SIZE + (off_t)extentEnd * pageSize,
+         (off_t)(newEnd - extentEnd) * pageSize) < 0) {
+      if (errno == ENOSPC)
+         return (PF_UNIX);
+
+      // Not supported here: do without
+      extentPages = 0;
+      return (0);
+   }
+#ifdef PF_STATS
+   pStatisticsMgr->Add(STAT_PF_EXTENT, newEnd - extentEnd);
+#endif
+#endif
+
+   extentEnd = newEnd;
    return (0);
 }
 
@@ -356,7 +691,7 @@ RC PF_FileHandle::AllocatePage(PF_PageHandle &pageHandle)
 //
 // 释放当前文件中pageNum对应的page(磁盘、缓冲区都要释放!); 
 // 必须先向将其从缓冲区中unpin,然后才能释放;
-// 释放后将其加入文件的空闲链表;
+// 释放后将其加入文件的空闲链表(有位图的文件则清除其位);
 //  为什么需要释放page? => 应该是从数据库删除数据的情况
 RC PF_FileHandle::DisposePage(PageNum pageNum)
 {
@@ -371,6 +706,14 @@ RC PF_FileHandle::DisposePage(PageNum pageNum)
    if (!IsValidPageNum(pageNum))
       return (PF_INVALIDPAGE);
 
+   // A mapped file is read-only
+   if (pMap != NULL)
+      return (PF_READONLY);
+
+   // The bitmap knows a free page without reading it
+   if (pPageMap != NULL && !IsUsed(pPageMap, pageNum))
+      return (PF_PAGEFREE);
+
    // Get the page (but don't re-pin it if it's already pinned)
    if ((rc = pBufferMgr->GetPage(unixfd,pageNum,&pPageBuf,FALSE)))
       return (rc);
@@ -386,9 +729,16 @@ RC PF_FileHandle::DisposePage(PageNum pageNum)
       return (PF_PAGEFREE);
    }
 
-   // Put this page onto the free list
-   ((PF_PageHdr *)pPageBuf)->nextFree = hdr.firstFree;
-   hdr.firstFree = pageNum;
+   // Put this page onto the free list, or clear its bit: the page
+   // itself is marked free either way, for GetThisPage
+   if (pPageMap != NULL) {
+      ((PF_PageHdr *)pPageBuf)->nextFree = PF_PAGE_LIST_END;
+      SetUsed(pPageMap, pageNum, FALSE);
+   }
+   else {
+      ((PF_PageHdr *)pPageBuf)->nextFree = hdr.firstFree;
+      hdr.firstFree = pageNum;
+   }
    bHdrChanged = TRUE;
 
    // Mark the page dirty because we changed the next pointer
@@ -423,6 +773,10 @@ RC PF_FileHandle::MarkDirty(PageNum pageNum) const
    if (!IsValidPageNum(pageNum))
       return (PF_INVALIDPAGE);
 
+   // A mapped file is read-only
+   if (pMap != NULL)
+      return (PF_READONLY);
+
    // Tell the buffer manager to mark the page dirty
    return (pBufferMgr->MarkDirty(unixfd, pageNum));
 }
@@ -449,6 +803,17 @@ RC PF_FileHandle::UnpinPage(PageNum pageNum) const
    if (!IsValidPageNum(pageNum))
       return (PF_INVALIDPAGE);
 
+   // The pin of a mapped page is only a count
+   if (pMap != NULL) {
+      std::atomic<int> &pinCount = pMap->pinCounts[pageNum];
+      int numPins = pinCount.load();
+      do {
+         if (numPins == 0)
+            return (PF_PAGEUNPINNED);
+      } while (!pinCount.compare_exchange_weak(numPins, numPins - 1));
+      return (0);
+   }
+
    // Tell the buffer manager to unpin the page
    return (pBufferMgr->UnpinPage(unixfd, pageNum));
 }
@@ -457,32 +822,34 @@ RC PF_FileHandle::UnpinPage(PageNum pageNum) const
 // FlushPages
 //
 // Desc: Flush all dirty unpinned pages from the buffer manager for this file
-// In:   Nothing
+// In:   bSync - TRUE to fdatasync the file once the pages are written
 // Ret:  PF_PAGEFIXED warning from buffer manager if pages are pinned or
 //       other PF error
 //
 // 释放文件的所有缓冲区页、以及将文件头写入磁盘文件 => 更恰当地说是将文件的数据刷新到磁盘
 // 由于文件头PF_FileHdr不算在page里面,它不会缓存在redbase的缓冲区中
 // 所以需要手动将其写入磁盘!!!
-RC PF_FileHandle::FlushPages() const
+RC PF_FileHandle::FlushPages(int bSync) const
 {
    // File must be open
    if (!bFileOpen)
       return (PF_CLOSEDFILE);
 
+   // Nothing of a mapped file is buffered, but its pages may be pinned
+   if (pMap != NULL) {
+      for (PageNum i = 0; i < hdr.numPages; i++)
+         if (pMap->pinCounts[i].load() > 0)
+            return (PF_PAGEPINNED);
+      return (0);
+   }
+
    // If the file header has changed, write it back to the file
    if (bHdrChanged) {
 
-      // First seek to the appropriate place
-      if (lseek(unixfd, 0, L_SET) < 0)
-         return (PF_UNIX);
-
       // Write header
-      int numBytes = write(unixfd,(char *)&hdr,sizeof(PF_FileHdr));
-      if (numBytes < 0)
-         return (PF_UNIX);
-      if (numBytes != sizeof(PF_FileHdr))
-         return (PF_HDRWRITE);
+      RC rc;
+      if ((rc = WriteHdr()))
+         return (rc);
 
       // This function is declared const, but we need to change the
       // bHdrChanged variable.  Cast away the constness
@@ -491,7 +858,7 @@ RC PF_FileHandle::FlushPages() const
    }
 
    // Tell Buffer Manager to flush pages
-   return (pBufferMgr->FlushPages(unixfd));
+   return (pBufferMgr->FlushPages(unixfd, bSync));
 }
 
 //
@@ -501,31 +868,30 @@ RC PF_FileHandle::FlushPages() const
 //       onto disk.  The page will not be forced out of the buffer pool.
 // In:   The page number, a default value of ALL_PAGES will be used if
 //       the client doesn't provide a value.  This will force all pages.
+//       bSync - TRUE to fdatasync the file once the pages are written
 // Ret:  Standard PF errors
 //
 //
 // 将缓冲区中的page(如果脏的话)写回磁盘,然后取消脏位标志;
 // 注意同样需要手动写回文件头; 
 // 默认当前页所有page 
-RC PF_FileHandle::ForcePages(PageNum pageNum) const
+RC PF_FileHandle::ForcePages(PageNum pageNum, int bSync) const
 {
    // File must be open
    if (!bFileOpen)
       return (PF_CLOSEDFILE);
 
+   // A mapped file is never written
+   if (pMap != NULL)
+      return (0);
+
    // If the file header has changed, write it back to the file
    if (bHdrChanged) {    /* 说明是脏数据 */
 
-      // First seek to the appropriate place
-      if (lseek(unixfd, 0, L_SET) < 0)    /*SEEK_SET表示将文件偏移量设置为__offset(此处为0)*/
-         return (PF_UNIX);
-
       // Write header
-      int numBytes = write(unixfd,(char *)&hdr,sizeof(PF_FileHdr));
-      if (numBytes < 0)
-         return (PF_UNIX);
-      if (numBytes != sizeof(PF_FileHdr))
-         return (PF_HDRWRITE);
+      RC rc;
+      if ((rc = WriteHdr()))
+         return (rc);
 
       // This function is declared const, but we need to change the
       // bHdrChanged variable.  Cast away the constness
@@ -534,7 +900,22 @@ RC PF_FileHandle::ForcePages(PageNum pageNum) const
    }
 
    // Tell Buffer Manager to Force the page
-   return (pBufferMgr->ForcePages(unixfd, pageNum));
+   return (pBufferMgr->ForcePages(unixfd, pageNum, bSync));
+}
+
+//
+// Sync
+//
+// Desc: Make every change made to the file through the PF layer durable.
+//       The header and the dirty pages are written, then the file is
+//       synced with fdatasync, unless nothing was written to it since
+//       its last sync.
+// Ret:  Standard PF errors
+//
+// 持久化:写回文件头和所有脏页,自上次同步后有写入时才fdatasync
+RC PF_FileHandle::Sync() const
+{
+   return (ForcePages(ALL_PAGES, TRUE));
 }
 
 
@@ -553,3 +934,241 @@ int PF_FileHandle::IsValidPageNum(PageNum pageNum) const
          pageNum < hdr.numPages);
 }
 
+//
+// IsDirectIO
+//
+// Desc: Tell whether the pages of the file bypass the OS page cache
+// Ret:  TRUE if the file is open with O_DIRECT
+//
+int PF_FileHandle::IsDirectIO() const
+{
+   return (bFileOpen && bDirectIO);
+}
+
+//
+// IsMapped
+//
+// Desc: Tell whether the pages of the file are read from a mapping
+// Ret:  TRUE if the file is open with PF_OPEN_MMAP
+//
+int PF_FileHandle::IsMapped() const
+{
+   return (bFileOpen && pMap != NULL);
+}
+
+//
+// HasBitmap
+//
+// Desc: Tell how the free pages of the file are found
+// Ret:  TRUE if the file has a free-page bitmap (PF_CREATE_BITMAP)
+//
+int PF_FileHandle::HasBitmap() const
+{
+   return (bFileOpen && pPageMap != NULL);
+}
+
+//
+// GetSnapshot
+//
+// Desc: Frames of the file in the buffer pool and hits of its GetPages.
+//       The pages of a mapped file are not in the pool.
+// Out:  snapshot - see PF_Manager::GetSnapshot
+// Ret:  PF_CLOSEDFILE or 0
+//
+RC PF_FileHandle::GetSnapshot(PF_FileSnapshot &snapshot) const
+{
+   if (!bFileOpen)
+      return (PF_CLOSEDFILE);
+
+   if (pMap != NULL) {
+      snapshot = PF_FileSnapshot();
+      snapshot.fd = unixfd;
+      return (0);
+   }
+
+   return (pBufferMgr->GetFileSnapshot(unixfd, snapshot));
+}
+
+//
+// MapFile
+//
+// Desc: Map the header and the hdr.numPages pages of the file read-only.
+//       The header must have been read.
+// Ret:  PF_UNIX (errno is set), or PF_INCOMPLETEREAD if the file is
+//       shorter than its header says
+//
+// 只读映射整个文件;每页一个pin计数
+RC PF_FileHandle::MapFile()
+{
+   struct stat fileStat;
+   size_t length = PF_FILE_HDR_SIZE +
+      (size_t)hdr.numPages * (PF_PAGE_SIZE + sizeof(PF_PageHdr));
+
+   if (fstat(unixfd, &fileStat) < 0)
+      return (PF_UNIX);
+
+   // Touching the mapping past the end of the file would raise SIGBUS
+   if ((size_t)fileStat.st_size < length)
+      return (PF_INCOMPLETEREAD);
+
+   void *pData = mmap(NULL, length, PROT_READ, MAP_SHARED, unixfd, 0);
+   if (pData == MAP_FAILED)
+      return (PF_UNIX);
+
+   pMap = new PF_FileMap;
+   pMap->pData = (char *)pData;
+   pMap->length = length;
+   pMap->pinCounts = new std::atomic<int>[hdr.numPages + 1]();
+   pMap->scanDir.store(0);
+   pMap->nextAdvice.store(0);
+   return (0);
+}
+
+//
+// UnmapFile
+//
+// Desc: Unmap the file mapped by MapFile
+//
+void PF_FileHandle::UnmapFile()
+{
+   if (pMap == NULL)
+      return;
+
+   munmap(pMap->pData, pMap->length);
+   delete [] pMap->pinCounts;
+   delete pMap;
+   pMap = NULL;
+}
+
+//
+// GetMappedPage
+//
+// Desc: Pin a page of a mapped file and set pageHandle to it, in place
+// In:   pageNum - a valid page number
+// Out:  pageHandle - refers to the page in the mapping
+// Ret:  PF_INVALIDPAGE if the page is free, or 0
+//
+RC PF_FileHandle::GetMappedPage(PageNum pageNum, PF_PageHandle &pageHandle) const
+{
+   char *pPageBuf = pMap->pData + PF_FILE_HDR_SIZE +
+      (size_t)pageNum * (PF_PAGE_SIZE + sizeof(PF_PageHdr));
+
+   // Only pages in use can be handed out
+   if (((PF_PageHdr*)pPageBuf)->nextFree != PF_PAGE_USED)
+      return (PF_INVALIDPAGE);
+
+   pMap->pinCounts[pageNum]++;
+
+   pageHandle.pageNum = pageNum;
+   pageHandle.pPageData = pPageBuf + sizeof(PF_PageHdr);
+   return (0);
+}
+
+//
+// AdviseScan
+//
+// Desc: Drive the kernel readahead of a mapped file from the scans.  When
+//       the direction changes the whole mapping is advised
+//       MADV_SEQUENTIAL (forward) or MADV_NORMAL (backward, which the
+//       kernel does not read ahead by itself); then the PF_MMAP_WINDOW
+//       pages in front of the scan are advised MADV_WILLNEED, again each
+//       time the scan is half way through them.  Advisory: failures are
+//       ignored.
+// In:   pageNum - the page the scan is at
+//       dir - 1 for a forward scan, -1 for a backward one
+//
+// 根据扫描方向调用madvise:正向SEQUENTIAL,反向NORMAL;再对扫描前方的窗口WILLNEED
+void PF_FileHandle::AdviseScan(PageNum pageNum, int dir) const
+{
+   // Most calls are inside the window already advised
+   if (pMap->scanDir.load() == dir &&
+         (pageNum - pMap->nextAdvice.load()) * dir < 0)
+      return;
+
+   std::lock_guard<std::mutex> guard(pMap->latch);
+
+   if (pMap->scanDir.load() != dir) {
+      madvise(pMap->pData, pMap->length,
+            dir > 0 ? MADV_SEQUENTIAL : MADV_NORMAL);
+      pMap->scanDir.store(dir);
+   }
+   else if ((pageNum - pMap->nextAdvice.load()) * dir < 0)
+      return;                        // advised by another thread meanwhile
+
+   // Pages [first, last) lie in front of the scan
+   PageNum first = pageNum, last = pageNum + 1;
+   if (dir > 0)
+      last = (pageNum + PF_MMAP_WINDOW < hdr.numPages) ?
+         pageNum + PF_MMAP_WINDOW : hdr.numPages;
+   else
+      first = (pageNum - PF_MMAP_WINDOW + 1 > 0) ?
+         pageNum - PF_MMAP_WINDOW + 1 : 0;
+
+   // madvise wants an address aligned to the OS page
+   size_t pageSize = PF_PAGE_SIZE + sizeof(PF_PageHdr);
+   uintptr_t start = (uintptr_t)pMap->pData + PF_FILE_HDR_SIZE + first * pageSize;
+   uintptr_t end = (uintptr_t)pMap->pData + PF_FILE_HDR_SIZE + last * pageSize;
+   start &= ~(uintptr_t)(sysconf(_SC_PAGESIZE) - 1);
+   madvise((void *)start, end - start, MADV_WILLNEED);
+
+   pMap->nextAdvice.store(pageNum + dir * PF_MMAP_WINDOW / 2);
+}
+
+//
+// ReadHdr
+//
+// Desc: Read the file header from the start of the file.  The whole
+//       PF_FILE_HDR_SIZE block is read into an aligned buffer, which is
+//       what O_DIRECT requires.  The free-page bitmap of a file that has
+//       one is kept in pPageMap, allocated here.
+// Ret:  PF_UNIX (errno is set) or PF_HDRREAD on error
+//
+RC PF_FileHandle::ReadHdr()
+{
+   alignas(PF_IO_ALIGN) char hdrBuf[PF_FILE_HDR_SIZE];
+
+   int numBytes = pread(unixfd, hdrBuf, PF_FILE_HDR_SIZE, 0);
+   if (numBytes < 0)
+      return (PF_UNIX);
+   if (numBytes != PF_FILE_HDR_SIZE)
+      return (PF_HDRREAD);
+
+   memcpy(&hdr, hdrBuf, sizeof(PF_FileHdr));
+
+   // A format this code does not know is not a PF file for it
+   if (hdr.format == PF_FORMAT_FREELIST)
+      return (0);
+   if (hdr.format != PF_FORMAT_BITMAP || hdr.numPages > PF_BITMAP_PAGES)
+      return (PF_HDRREAD);
+
+   if (pPageMap == NULL)
+      pPageMap = new PF_PageMap;
+   memcpy(pPageMap->words, hdrBuf + PF_BITMAP_OFFSET, sizeof(pPageMap->words));
+   return (0);
+}
+
+//
+// WriteHdr
+//
+// Desc: Write the file header block to the start of the file, padded
+//       with zeros to PF_FILE_HDR_SIZE as CreateFile does, or followed by
+//       the free-page bitmap.
+// Ret:  PF_UNIX or PF_HDRWRITE on error
+//
+RC PF_FileHandle::WriteHdr() const
+{
+   alignas(PF_IO_ALIGN) char hdrBuf[PF_FILE_HDR_SIZE];
+
+   memset(hdrBuf, 0, PF_FILE_HDR_SIZE);
+   memcpy(hdrBuf, &hdr, sizeof(PF_FileHdr));
+   if (pPageMap != NULL)
+      memcpy(hdrBuf + PF_BITMAP_OFFSET, pPageMap->words, sizeof(pPageMap->words));
+
+   int numBytes = pwrite(unixfd, hdrBuf, PF_FILE_HDR_SIZE, 0);
+   if (numBytes < 0)
+      return (PF_UNIX);
+   pBufferMgr->NoteWrite(unixfd);
+   if (numBytes != PF_FILE_HDR_SIZE)
+      return (PF_HDRWRITE);
+   return (0);
+}
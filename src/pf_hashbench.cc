@@ -0,0 +1,185 @@
+//
+// File:        pf_hashbench.cc
+// Description: Micro-benchmark of the buffer manager page table
+//
+// Compares PF_HashTable (open addressing, sized to the pool) against the
+// chained table it replaced (PF_HASH_TBL_SIZE buckets, one heap node per
+// entry, hash (fd + pageNum) % numBuckets), which is reproduced below as
+// ChainedHashTable.  The workload is the one the buffer manager puts on
+// the table: a pool of numPages frames holding pages of a few files, a
+// Find for every page access, and a Delete of a FIFO victim plus an
+// Insert for every miss.
+//
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <chrono>
+#include "pf_internal.h"
+#include "pf_hashtable.h"
+
+using namespace std;
+
+//
+// Defines
+//
+#define NUM_FILES     4           // distinct file descriptors
+#define NUM_OPS       500000      // page accesses per run
+
+//
+// ChainedHashTable - the original PF_HashTable
+//
+class ChainedHashTable {
+public:
+   ChainedHashTable(int _numBuckets) : numBuckets(_numBuckets) {
+      hashTable = new Entry*[numBuckets];
+      for (int i = 0; i < numBuckets; i++)
+         hashTable[i] = NULL;
+   }
+   ~ChainedHashTable() {
+      for (int i = 0; i < numBuckets; i++)
+         for (Entry *entry = hashTable[i]; entry != NULL; ) {
+            Entry *next = entry->next;
+            delete entry;
+            entry = next;
+         }
+      delete[] hashTable;
+   }
+   RC Find(int fd, PageNum pageNum, int &slot) {
+      for (Entry *entry = hashTable[Hash(fd, pageNum)]; entry; entry = entry->next)
+         if (entry->fd == fd && entry->pageNum == pageNum) {
+            slot = entry->slot;
+            return (0);
+         }
+      return (PF_HASHNOTFOUND);
+   }
+   RC Insert(int fd, PageNum pageNum, int slot) {
+      int bucket = Hash(fd, pageNum);
+      Entry *entry;
+      for (entry = hashTable[bucket]; entry; entry = entry->next)
+         if (entry->fd == fd && entry->pageNum == pageNum)
+            return (PF_HASHPAGEEXIST);
+      entry = new Entry;
+      entry->fd = fd;
+      entry->pageNum = pageNum;
+      entry->slot = slot;
+      entry->next = hashTable[bucket];
+      entry->prev = NULL;
+      if (hashTable[bucket] != NULL)
+         hashTable[bucket]->prev = entry;
+      hashTable[bucket] = entry;
+      return (0);
+   }
+   RC Delete(int fd, PageNum pageNum) {
+      int bucket = Hash(fd, pageNum);
+      Entry *entry;
+      for (entry = hashTable[bucket]; entry; entry = entry->next)
+         if (entry->fd == fd && entry->pageNum == pageNum)
+            break;
+      if (entry == NULL)
+         return (PF_HASHNOTFOUND);
+      if (entry == hashTable[bucket])
+         hashTable[bucket] = entry->next;
+      if (entry->prev != NULL)
+         entry->prev->next = entry->next;
+      if (entry->next != NULL)
+         entry->next->prev = entry->prev;
+      delete entry;
+      return (0);
+   }
+
+private:
+   struct Entry {
+      Entry *next, *prev;
+      int fd;
+      PageNum pageNum;
+      int slot;
+   };
+   int Hash(int fd, PageNum pageNum) const {
+      return ((unsigned int)(fd + pageNum) % numBuckets);
+   }
+   int numBuckets;
+   Entry **hashTable;
+};
+
+//
+// Run
+//
+// Desc: Drive table with NUM_OPS accesses to pages drawn from a file set
+//       four times larger than the pool.
+// Ret:  nanoseconds per access
+//
+template <class Table>
+double Run(Table &table, int numPages, long &misses)
+{
+   int *fds = new int[numPages];
+   PageNum *pages = new PageNum[numPages];
+   int next = 0, used = 0, slot;
+   unsigned int seed = 1;
+
+   misses = 0;
+   chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+   for (int i = 0; i < NUM_OPS; i++) {
+      int fd = 3 + rand_r(&seed) % NUM_FILES;
+      PageNum pageNum = rand_r(&seed) % numPages;
+
+      if (table.Find(fd, pageNum, slot) == 0)
+         continue;
+
+      misses++;
+      if (used == numPages) {
+         if (table.Delete(fds[next], pages[next])) {
+            cout << "Delete failed\n";
+            exit(1);
+         }
+      }
+      else
+         used++;
+      if (table.Insert(fd, pageNum, next)) {
+         cout << "Insert failed\n";
+         exit(1);
+      }
+      fds[next] = fd;
+      pages[next] = pageNum;
+      next = (next + 1) % numPages;
+   }
+
+   double seconds = chrono::duration<double>(
+         chrono::steady_clock::now() - start).count();
+
+   delete[] fds;
+   delete[] pages;
+   return (seconds * 1e9 / NUM_OPS);
+}
+
+int main()
+{
+   int sizes[] = { PF_BUFFER_SIZE, 1024, 16384 };
+
+   cout << "********************\n";
+   cout << "PF hash table benchmark, " << NUM_OPS << " accesses per run.\n";
+
+   for (unsigned int i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+      long missesChained, missesOpen;
+      double nsChained, nsOpen;
+      {
+         ChainedHashTable chained(PF_HASH_TBL_SIZE);
+         nsChained = Run(chained, sizes[i], missesChained);
+      }
+      {
+         PF_HashTable open(sizes[i]);
+         nsOpen = Run(open, sizes[i], missesOpen);
+      }
+      if (missesChained != missesOpen) {
+         cout << "The tables disagree!\n";
+         return (1);
+      }
+
+      printf("%6d pages: chained %7.1f ns/access, open addressing %5.1f ns/access\n",
+            sizes[i], nsChained, nsOpen);
+   }
+
+   cout << "********************\n\n";
+   return (0);
+}
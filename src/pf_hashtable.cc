@@ -12,46 +12,55 @@
 // PF_HashTable
 //
 // Desc: Constructor for PF_HashTable object, which allows search, insert,
-//       and delete of hash table entries.
-// In:   numBuckets - number of hash table buckets
+//       and delete of hash table entries.  The capacity is the smallest
+//       power of two at least twice numEntries, so that the table stays
+//       at most half full while it holds numEntries pages.
+// In:   numEntries - expected number of entries (e.g. the buffer size)
 //
-// 初始化带桶的hash表
-PF_HashTable::PF_HashTable(int _numBuckets)
+// 按预计的页数分配一个连续数组,负载因子不超过1/2
+PF_HashTable::PF_HashTable(int numEntries)
 {
-  // Initialize numBuckets local variable from parameter
-  this->numBuckets = _numBuckets;
+  capacity = 8;
+  while (capacity < 2 * numEntries)
+    capacity <<= 1;
+  mask = capacity - 1;
+  numUsed = 0;
 
   // Allocate memory for hash table
-  hashTable = new PF_HashEntry* [numBuckets];
+  hashTable = new PF_HashEntry[capacity];
 
-  // Initialize all buckets to empty
-  for (int i = 0; i < numBuckets; i++)
-    hashTable[i] = NULL;
+  // Initialize all entries to empty
+  for (int i = 0; i < capacity; i++)
+    hashTable[i].slot = PF_HASH_EMPTY;
 }
 
 //
 // ~PF_HashTable
 //
-// Desc: Destructor => 注意需要释放内存
+// Desc: Destructor
 //
 PF_HashTable::~PF_HashTable()
 {
-  // Clear out all buckets
-  for (int i = 0; i < numBuckets; i++) {
-
-    // Delete all entries in the bucket
-    PF_HashEntry *entry = hashTable[i];
-    while (entry != NULL) {
-      PF_HashEntry *next = entry->next;
-      delete entry;
-      entry = next;
-    }
-  }
-
-  // Finally delete the hash table
   delete[] hashTable;
 }
 
+//
+// Probe
+//
+// Desc: Internal.  Walk the probe run starting at the home position of
+//       (fd,pageNum) until the entry or an empty position is found.
+// Ret:  index of the entry, or -1 if it is not in the table
+//
+int PF_HashTable::Probe(int fd, PageNum pageNum) const
+{
+  for (int i = Hash(fd, pageNum); ; i = (i + 1) & mask) {
+    if (hashTable[i].slot == PF_HASH_EMPTY)
+      return (-1);
+    if (hashTable[i].fd == fd && hashTable[i].pageNum == pageNum)
+      return (i);
+  }
+}
+
 //
 // Find
 //
@@ -61,66 +70,52 @@ PF_HashTable::~PF_HashTable()
 // Out:  slot - set to slot associated with fd and pageNum
 // Ret:  PF return code
 // 作用:查找(fd,pageNum)这个页占用的缓冲区编号slot
-// 实现:1.通过hash函数,找到(fd,pageNum)映射的bucket
-//      2.在bucket中遍历,找到该页,于是得到slot
+// 实现:从hash位置开始线性探测,遇到空位即说明不存在
 RC PF_HashTable::Find(int fd, PageNum pageNum, int &slot)
 {
-  // Get which bucket it should be in
-  int bucket = Hash(fd, pageNum);			/*桶号*/
-
-  /*为什么能<0 ??*/	
-  if (bucket<0)
-     return (PF_HASHNOTFOUND);
-
-  // Go through the linked list of this bucket
-  for (PF_HashEntry *entry = hashTable[bucket];entry != NULL;entry = entry->next) {
-		if(entry->fd == fd && entry->pageNum == pageNum) {
-			// Found it
-			slot = entry->slot;
-			return (0);
-      }
-  }
+  int i = Probe(fd, pageNum);
 
   // Didn't find it
-  return (PF_HASHNOTFOUND);
+  if (i < 0)
+    return (PF_HASHNOTFOUND);
+
+  // Found it
+  slot = hashTable[i].slot;
+  return (0);
 }
 
 //
 // Insert
 //
-// Desc: Insert a hash table entry
+// Desc: Insert a hash table entry.  The table doubles when it would
+//       become more than half full.
 // In:   fd - file descriptor
 //       pagenum - page number
-//       slot - slot associated with fd and pageNum
+//       slot - slot associated with fd and pageNum (must be >= 0)
 // Ret:  PF return code
 //
 // 将(fd,pageNum)对应的页(且该页在编号为slot的缓冲区)信息,插入hashtable
-// 头插法,即节点插在bucket的最前面
+// 放在探测序列上的第一个空位
 RC PF_HashTable::Insert(int fd, PageNum pageNum, int slot)
 {
-  // Get which bucket it should be in
-  int bucket = Hash(fd, pageNum);
-
-  // Check entry doesn't already exist in the bucket
-  PF_HashEntry *entry;
-  for (entry = hashTable[bucket];entry != NULL;entry = entry->next) {
-    if (entry->fd == fd && entry->pageNum == pageNum)
-      return (PF_HASHPAGEEXIST);
-  }
+  RC rc;
 
-  // Allocate memory for new hash entry
-  if ((entry = new PF_HashEntry) == NULL)
-    return (PF_NOMEM);
+  // Check entry doesn't already exist in the table
+  if (Probe(fd, pageNum) >= 0)
+    return (PF_HASHPAGEEXIST);
+
+  // Keep the load factor at or below 1/2
+  if (2 * (numUsed + 1) > capacity && (rc = Grow()))
+    return (rc);
 
-  // Insert entry at head of list for this bucket => 见代码可知是头插法
-  entry->fd = fd;
-  entry->pageNum = pageNum;
-  entry->slot = slot;
-  entry->next = hashTable[bucket];
-  entry->prev = NULL;
-  if (hashTable[bucket] != NULL)
-    hashTable[bucket]->prev = entry;
-  hashTable[bucket] = entry;
+  int i = Hash(fd, pageNum);
+  while (hashTable[i].slot != PF_HASH_EMPTY)
+    i = (i + 1) & mask;
+
+  hashTable[i].fd = fd;
+  hashTable[i].pageNum = pageNum;
+  hashTable[i].slot = slot;
+  numUsed++;
 
   // Return ok
   return (0);
@@ -129,41 +124,73 @@ RC PF_HashTable::Insert(int fd, PageNum pageNum, int slot)
 //
 // Delete
 //
-// Desc: Delete a hash table entry
+// Desc: Delete a hash table entry.  The entries after it in the probe run
+//       that could live in the freed position are shifted back, so no
+//       tombstone is left and lookups stay short.
 // In:   fd - file descriptor
 //       pagenum - page number
 // Ret:  PF return code
 //
-// 删除(fd,pageNum)在hashtable中对应的节点
+// 删除(fd,pageNum)在hashtable中对应的项,并把后续探测序列中的项前移
 RC PF_HashTable::Delete(int fd, PageNum pageNum)
 {
-  // Get which bucket it should be in
-  int bucket = Hash(fd, pageNum);
-
-  // Find the entry is in this bucket
-  PF_HashEntry *entry;
-  for (entry = hashTable[bucket];
-       entry != NULL;
-       entry = entry->next) {
-    if (entry->fd == fd && entry->pageNum == pageNum)
-      break;
-  }
-
   // Did we find hash entry?
-  if (entry == NULL)
+  int hole = Probe(fd, pageNum);
+  if (hole < 0)
     return (PF_HASHNOTFOUND);
 
-  // Remove this entry
-  if (entry == hashTable[bucket])
-    hashTable[bucket] = entry->next;
-  if (entry->prev != NULL)
-    entry->prev->next = entry->next;
-  if (entry->next != NULL)
-    entry->next->prev = entry->prev;
-  delete entry;
+  for (int j = (hole + 1) & mask; hashTable[j].slot != PF_HASH_EMPTY;
+       j = (j + 1) & mask) {
+
+    // The entry at j may move to hole unless its home lies in (hole, j]
+    int home = Hash(hashTable[j].fd, hashTable[j].pageNum);
+    if (((j - home) & mask) >= ((j - hole) & mask)) {
+      hashTable[hole] = hashTable[j];
+      hole = j;
+    }
+  }
+
+  hashTable[hole].slot = PF_HASH_EMPTY;
+  numUsed--;
 
-  // Return ook
+  // Return ok
   return (0);
 }
 
+//
+// Grow
+//
+// Desc: Internal.  Double the capacity and re-insert every entry.  Only
+//       happens when more pages are inserted than the table was sized
+//       for; the buffer manager sizes its tables to the pool.
+// Ret:  PF_NOMEM if the new array cannot be allocated
+//
+RC PF_HashTable::Grow()
+{
+  PF_HashEntry *oldTable = hashTable;
+  int oldCapacity = capacity;
+
+  if ((hashTable = new PF_HashEntry[2 * oldCapacity]) == NULL) {
+    hashTable = oldTable;
+    return (PF_NOMEM);
+  }
+  capacity = 2 * oldCapacity;
+  mask = capacity - 1;
+
+  for (int i = 0; i < capacity; i++)
+    hashTable[i].slot = PF_HASH_EMPTY;
+
+  for (int i = 0; i < oldCapacity; i++) {
+    if (oldTable[i].slot == PF_HASH_EMPTY)
+      continue;
+    int j = Hash(oldTable[i].fd, oldTable[i].pageNum);
+    while (hashTable[j].slot != PF_HASH_EMPTY)
+      j = (j + 1) & mask;
+    hashTable[j] = oldTable[i];
+  }
 
+  delete[] oldTable;
+
+  // Return ok
+  return (0);
+}
@@ -4,6 +4,11 @@
 // Authors:     Hugo Rivero (rivero@cs.stanford.edu)
 //              Dallan Quass (quass@cs.stanford.edu)
 //
+// The table uses open addressing with linear probing: all entries live in
+// one array, so Insert and Delete never allocate and a lookup usually
+// touches a single cache line.  Deletion shifts the following entries of
+// the probe run back instead of leaving tombstones.
+//
 
 #ifndef PF_HASHTABLE_H
 #define PF_HASHTABLE_H
@@ -11,22 +16,23 @@
 #include "pf_internal.h"
 
 //
-// HashEntry - Hash table bucket entries 
-//=> hashtable的一个bucket对应一个双向链表,PF_HashEntry是一个链表项
+// HashEntry - Hash table entries
+//=> hashtable数组中的一项,slot为PF_HASH_EMPTY表示空位
 struct PF_HashEntry {
-    PF_HashEntry *next;   // next hash table element or NULL
-    PF_HashEntry *prev;   // prev hash table element or NULL
     int          fd;      // file descriptor
     PageNum      pageNum; // page number
     int          slot;    // slot of this page in the buffer,它在缓冲区中的编号
 };
 
+#define PF_HASH_EMPTY  (-1)   // slot value of an unused entry
+
 //
 // PF_HashTable - allow search, insertion, and deletion of hash table entries
 //
 class PF_HashTable {
 public:
-    PF_HashTable (int numBuckets);           // Constructor
+    PF_HashTable (int numEntries);           // Constructor, sized for
+                                             // numEntries pages
     ~PF_HashTable();                         // Destructor
     RC  Find     (int fd, PageNum pageNum, int &slot);
                                              // Set slot to the hash table
@@ -36,14 +42,26 @@ public:
     RC  Delete   (int fd, PageNum pageNum);  // Delete a hash table entry
 
 private:
-    // Hash function:(fd + pageNum) % numBuckets
+    // Hash function: 64-bit finalizer (murmur3 fmix64) over (fd,pageNum)
+    // 原来的(fd + pageNum) % numBuckets 会让不同文件的相同页号挤在一起
     int Hash (int fd, PageNum pageNum) const {
-         return ((fd + pageNum) % numBuckets); 
-    }   
+         unsigned long long h = ((unsigned long long)(unsigned int)fd << 32) |
+                                (unsigned int)pageNum;
+         h ^= h >> 33;
+         h *= 0xFF51AFD7ED558CCDULL;
+         h ^= h >> 33;
+         h *= 0xC4CEB9FE1A85EC53ULL;
+         h ^= h >> 33;
+         return ((int)(h & mask));
+    }
 
+    int Probe (int fd, PageNum pageNum) const;   // Index of entry or -1
+    RC  Grow  ();                                // Double the capacity
 
-    int numBuckets;                               // Number of hash table buckets
-    PF_HashEntry **hashTable;                     // Hash table => 看做一个数组,输出每一项是一个双向链表
+    int capacity;                                 // # of entries, a power of 2
+    int mask;                                     // capacity - 1
+    int numUsed;                                  // # of entries in use
+    PF_HashEntry *hashTable;                      // Hash table => 一个连续数组
 };
 
 #endif
@@ -11,24 +11,94 @@
 
 #include <cstdlib>
 #include <cstring>
+#include <cstdint>
+#include <atomic>
+#include <mutex>
 #include "pf.h"
 
 //
 // Constants and defines
 //
-const int PF_BUFFER_SIZE = 40;     // Number of pages in the buffer
-const int PF_HASH_TBL_SIZE = 20;   // Size of hash table => hashtable的bucket数
+const int PF_HASH_TBL_SIZE = 20;   // Initial # of entries of a standalone hash table
+const int PF_HUGE_PAGE_SIZE = 2 * 1024 * 1024;  // Arena alignment for huge pages
+const int PF_IO_ALIGN = 4096;      // Alignment of O_DIRECT buffers and offsets
 
 #define CREATION_MASK      0600    // r/w privileges to owner only
 #define PF_PAGE_LIST_END  -1       // end of list of free pages
 #define PF_PAGE_USED      -2       // page is being used
 
-// L_SET is used to indicate the "whence" argument of the lseek call
-// defined in "/usr/include/unistd.h".  A value of 0 indicates to
-// move to the absolute location specified.
-#ifndef L_SET
-#define L_SET              0
-#endif
+// PF_FileHdr::format: free pages chained through their PF_PageHdr, or
+// found in a bitmap after PF_FileHdr in the header block (PF_PageMap)
+#define PF_FORMAT_FREELIST 0
+#define PF_FORMAT_BITMAP   1
+
+// Pages are read and written with pread/pwrite (preadv/pwritev for runs
+// of adjacent pages), never with lseek: a run longer than PF_MAX_IOV
+// pages takes several calls.
+#define PF_MAX_IOV         64
+
+// Asynchronous page I/O (see PF_IOEngine): io_uring submission queue
+// entries, and threads of the pool used when io_uring is unavailable
+#define PF_IO_QUEUE_DEPTH  256
+#define PF_IO_NUM_THREADS  4
+
+// Read-ahead (see PF_BufferMgr::ReadAhead): consecutive GetPages that
+// make a file sequential without SEQUENTIAL_HINT, the first window, and
+// the # of files tracked at once.  Windows double up to a quarter of the
+// buffer, and never exceed PF_MAX_IOV pages (one vectored read).
+#define PF_READAHEAD_MIN_RUN  2
+#define PF_READAHEAD_MIN      4
+#define PF_READAHEAD_FILES    16
+
+// Background writer (see PF_BufferMgr::BgWriter): period of its rounds in
+// milliseconds, and the defaults of PF_BufferConfig: dirty pages allowed
+// per hundred frames and pages written per second at most.  The coldest
+// 1/PF_BGWRITER_COLD of every shard is kept clean whatever the ratio.
+#define PF_BGWRITER_INTERVAL  20
+#define PF_BGWRITER_DIRTY     10
+#define PF_BGWRITER_RATE      2000
+#define PF_BGWRITER_COLD      8
+
+// Memory-mapped files (see PF_FileHandle::AdviseScan): pages a scan of a
+// mapped file asks the kernel to prefetch (MADV_WILLNEED) at once; the
+// next window is asked for once the scan is half way through it.
+#define PF_MMAP_WINDOW        64
+
+// Buffer snapshots (see PF_BufferMgr::GetSnapshot): the hits and misses
+// of files with a descriptor below this are counted per file, the others
+// only in the totals
+#define PF_ACCESS_FDS         256
+
+// Extents (see PF_FileHandle::Preallocate): default # of pages of disk
+// space reserved at once when a file grows
+#define PF_EXTENT_PAGES       64
+
+// Warm-up (see PF_WarmList): the page list is read back in requests of
+// up to PF_MAX_IOV adjacent pages, submitted PF_WARMUP_BATCH at a time
+#define PF_WARMUP_BATCH       32
+
+//
+// PF_FileMap: a file opened with PF_OPEN_MMAP
+// 只读映射整个文件,页直接指向映射区(零拷贝);pin只是每页的计数,供UnpinPage和CloseFile检查
+//
+struct PF_FileMap {
+   char              *pData;      // the mapping, file header first
+   size_t            length;      // bytes mapped
+   std::atomic<int>  *pinCounts;  // pins of every page
+   std::mutex        latch;       // serializes the madvise calls
+   std::atomic<int>  scanDir;     // direction of the last scan, 0 if none
+   std::atomic<int>  nextAdvice;  // page at which to prefetch again
+};
+
+//
+// PF_ResidentPage: a page in the buffer pool and its place in the
+// replacement order of its shard, as a fraction of the pages of the shard
+//
+struct PF_ResidentPage {
+   int               fd;          // OS file descriptor
+   PageNum           pageNum;     // page number
+   double            rank;        // 0: touched last .. 1: next victim
+};
 
 //
 // PF_PageHdr: Header structure for pages
@@ -45,4 +115,20 @@ struct PF_PageHdr {
 // Justify the file header to the length of one page
 const int PF_FILE_HDR_SIZE = PF_PAGE_SIZE + sizeof(PF_PageHdr); /*文件头信息大小 => 4096Byte*/
 
+// The free-page bitmap fills the header block from PF_BITMAP_OFFSET on,
+// which bounds the pages of a file created with PF_CREATE_BITMAP
+const int PF_BITMAP_OFFSET = 16;
+const int PF_BITMAP_WORDS = (PF_FILE_HDR_SIZE - PF_BITMAP_OFFSET) / sizeof(uint64_t);
+const int PF_BITMAP_PAGES = PF_BITMAP_WORDS * 64;   /* 32640 => 127.5MB */
+
+//
+// PF_PageMap: the free-page bitmap of an open file, read and written with
+// the file header
+// 位图随文件头一起读入内存,分配空闲页和遍历已用页都不必读盘上的空闲页
+//
+struct PF_PageMap {
+   uint64_t          words[PF_BITMAP_WORDS];   // bit p % 64 of word p / 64
+                                               // is set while page p is used
+};
+
 #endif
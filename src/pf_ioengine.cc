@@ -0,0 +1,489 @@
+//
+// File:        pf_ioengine.cc
+// Description: PF_IOEngine class implementation
+//
+// io_uring is used through its system calls: io_uring_setup creates the
+// rings, which are mapped into the process; a submission is an entry
+// written at the tail of the submission ring followed by io_uring_enter,
+// and the reaper thread blocks in io_uring_enter until completions show
+// up at the tail of the completion ring.  The ring indices are shared
+// with the kernel, hence the acquire/release accesses.
+//
+
+#include <cerrno>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <algorithm>
+#include "pf_ioengine.h"
+
+#ifdef PF_STATS
+#include "statistics.h"
+
+// This is defined within pf_buffermgr.cc
+extern StatisticsMgr *pStatisticsMgr;
+#endif
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>) && defined(__NR_io_uring_setup)
+#include <linux/io_uring.h>
+#define PF_HAVE_IO_URING
+#endif
+#endif
+
+using namespace std;
+
+//
+// PF_IOEngine
+//
+// Desc: Constructor - set up io_uring, or start numThreads workers if it
+//       is not wanted or not available
+// In:   backend - PF_IO_AUTO or PF_IO_THREADS
+//       numThreads - size of the thread pool (at least 1)
+//
+// 优先使用io_uring;内核不支持时退化为线程池,每个线程做阻塞的preadv/pwritev
+PF_IOEngine::PF_IOEngine(PF_IOBackend backend, int numThreads)
+{
+   numInFlight = 0;
+   bStop = FALSE;
+   pQueueHead = pQueueTail = NULL;
+   workers = NULL;
+   numWorkers = 0;
+   ringFd = -1;
+
+   if (backend == PF_IO_AUTO && SetupUring() == 0) {
+      reaper = thread(&PF_IOEngine::ReapUring, this);
+      return;
+   }
+
+   numWorkers = max(numThreads, 1);
+   workers = new thread[numWorkers];
+   for (int i = 0; i < numWorkers; i++)
+      workers[i] = thread(&PF_IOEngine::Work, this);
+}
+
+//
+// ~PF_IOEngine
+//
+// Desc: Destructor - wait for every submitted request to complete, then
+//       stop the I/O threads
+//
+PF_IOEngine::~PF_IOEngine()
+{
+   {
+      unique_lock<mutex> guard(latch);
+      while (numInFlight > 0)
+         cond.wait(guard);
+      bStop = TRUE;
+   }
+   cond.notify_all();
+
+#ifdef PF_HAVE_IO_URING
+   if (ringFd >= 0) {
+      // A no-op with user_data 0 tells the reaper to exit
+      PF_IORequest *pStop = NULL;
+      SubmitUring(&pStop, 1);
+      reaper.join();
+      CloseUring();
+   }
+#endif
+
+   for (int i = 0; i < numWorkers; i++)
+      workers[i].join();
+   delete [] workers;
+}
+
+//
+// Transfer
+//
+// Desc: Do a request in the calling thread with preadv/pwritev, which
+//       leave the shared file offset alone.  A short transfer continues
+//       where it stopped.  A sync request calls fdatasync.
+// In:   req - the request
+//       numDone - bytes of the request already transferred
+// Ret:  PF_INCOMPLETEREAD / PF_INCOMPLETEWRITE if the file ends first,
+//       PF_UNIX on a system call error, 0 otherwise
+//
+RC PF_IOEngine::Transfer(PF_IORequest &req, long numDone)
+{
+   struct iovec iov[PF_MAX_IOV];
+   int iovcnt = 0;
+   long offset = req.offset + numDone;
+
+   if (req.bSync) {
+      while (fdatasync(req.fd) < 0)
+         if (errno != EINTR)
+            return (PF_UNIX);
+      return (0);
+   }
+
+   // Copy the part of the buffers not transferred yet
+   for (int i = 0; i < req.iovcnt; i++) {
+      if (numDone >= (long)req.iov[i].iov_len) {
+         numDone -= req.iov[i].iov_len;
+         continue;
+      }
+      iov[iovcnt].iov_base = (char *)req.iov[i].iov_base + numDone;
+      iov[iovcnt].iov_len = req.iov[i].iov_len - numDone;
+      numDone = 0;
+      iovcnt++;
+   }
+
+   struct iovec *pIov = iov;
+   while (iovcnt > 0) {
+      long numBytes = req.bWrite ? pwritev(req.fd, pIov, iovcnt, offset)
+                                 : preadv(req.fd, pIov, iovcnt, offset);
+      if (numBytes < 0) {
+         if (errno == EINTR)
+            continue;
+         return (PF_UNIX);
+      }
+
+      // A regular file only returns nothing at its end
+      if (numBytes == 0)
+         return (req.bWrite ? PF_INCOMPLETEWRITE : PF_INCOMPLETEREAD);
+
+      offset += numBytes;
+      while (iovcnt > 0 && numBytes >= (long)pIov->iov_len) {
+         numBytes -= pIov->iov_len;
+         pIov++;
+         iovcnt--;
+      }
+      if (iovcnt > 0) {
+         pIov->iov_base = (char *)pIov->iov_base + numBytes;
+         pIov->iov_len -= numBytes;
+      }
+   }
+
+   return (0);
+}
+
+//
+// Submit
+//
+// Desc: Queue requests for the I/O threads.  With io_uring the whole
+//       batch is handed to the kernel by one io_uring_enter.
+// In:   reqs - the requests; they must stay allocated until completion
+//       numReqs - # of requests
+// Ret:  PF return code of the submission (the requests carry their own)
+//
+RC PF_IOEngine::Submit(PF_IORequest *reqs[], int numReqs)
+{
+#ifdef PF_STATS
+   long long startNs = pStatisticsMgr->IsTiming() ? StatisticsMgr::Now() : 0;
+#else
+   long long startNs = 0;
+#endif
+   for (int i = 0; i < numReqs; i++) {
+      reqs[i]->bDone = FALSE;
+      reqs[i]->rc = 0;
+      reqs[i]->startNs = startNs;
+   }
+
+#ifdef PF_HAVE_IO_URING
+   if (ringFd >= 0)
+      return (SubmitUring(reqs, numReqs));
+#endif
+
+   {
+      lock_guard<mutex> guard(latch);
+      for (int i = 0; i < numReqs; i++) {
+         reqs[i]->pNext = NULL;
+         if (pQueueTail != NULL)
+            pQueueTail->pNext = reqs[i];
+         else
+            pQueueHead = reqs[i];
+         pQueueTail = reqs[i];
+      }
+      numInFlight += numReqs;
+   }
+   cond.notify_all();
+
+   return (0);
+}
+
+//
+// Wait
+//
+// Desc: Block until req has completed.  Only for requests without a
+//       completion callback.
+// Ret:  the return code of the request
+//
+RC PF_IOEngine::Wait(PF_IORequest &req)
+{
+   unique_lock<mutex> guard(latch);
+   while (!req.bDone)
+      cond.wait(guard);
+   return (req.rc);
+}
+
+//
+// Complete
+//
+// Desc: Internal.  Record the result of a request and run its callback
+//       or wake its waiters.  Called by the I/O threads without the latch.
+//
+void PF_IOEngine::Complete(PF_IORequest *pReq, RC rc)
+{
+   // The callback may recycle the request, do not look at it afterwards
+   void (*pfnDone)(PF_IORequest *pReq) = pReq->pfnDone;
+
+#ifdef PF_STATS
+   // The time from submission to completion, queueing included
+   if (pReq->startNs && !pReq->bSync)
+      pStatisticsMgr->AddLatency(pReq->fd, pReq->bWrite ?
+            STAT_LAT_WRITEPAGE : STAT_LAT_READPAGE,
+            StatisticsMgr::Now() - pReq->startNs);
+#endif
+
+   pReq->rc = rc;
+   if (pfnDone != NULL)
+      pfnDone(pReq);
+
+   {
+      lock_guard<mutex> guard(latch);
+      if (pfnDone == NULL)
+         pReq->bDone = TRUE;
+      numInFlight--;
+   }
+   cond.notify_all();
+}
+
+//
+// Work
+//
+// Desc: Internal.  Body of a thread pool worker: take requests off the
+//       queue and do them until the engine stops.
+//
+void PF_IOEngine::Work()
+{
+   for (;;) {
+      PF_IORequest *pReq;
+      {
+         unique_lock<mutex> guard(latch);
+         while (pQueueHead == NULL && !bStop)
+            cond.wait(guard);
+         if (pQueueHead == NULL)
+            return;
+         pReq = pQueueHead;
+         if ((pQueueHead = pReq->pNext) == NULL)
+            pQueueTail = NULL;
+      }
+      Complete(pReq, Transfer(*pReq));
+   }
+}
+
+#ifdef PF_HAVE_IO_URING
+
+//
+// SetupUring
+//
+// Desc: Internal.  Create an io_uring instance and map its rings
+// Ret:  0, or -1 if the kernel does not provide io_uring
+//
+int PF_IOEngine::SetupUring()
+{
+   struct io_uring_params params;
+   memset(&params, 0, sizeof(params));
+
+   if ((ringFd = (int)syscall(__NR_io_uring_setup, PF_IO_QUEUE_DEPTH, &params)) < 0)
+      return (ringFd = -1);
+
+   sqEntries = params.sq_entries;
+   sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+   cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+   if (params.features & IORING_FEAT_SINGLE_MMAP)
+      sqRingSize = cqRingSize = max(sqRingSize, cqRingSize);
+
+   pSqRing = mmap(NULL, sqRingSize, PROT_READ | PROT_WRITE,
+         MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+   pCqRing = pSqRing;
+   if (pSqRing != MAP_FAILED && !(params.features & IORING_FEAT_SINGLE_MMAP))
+      pCqRing = mmap(NULL, cqRingSize, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING);
+   pSqes = mmap(NULL, params.sq_entries * sizeof(struct io_uring_sqe),
+         PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd,
+         IORING_OFF_SQES);
+
+   if (pSqRing == MAP_FAILED || pCqRing == MAP_FAILED || pSqes == MAP_FAILED) {
+      CloseUring();
+      return (ringFd = -1);
+   }
+
+   char *pSq = (char *)pSqRing, *pCq = (char *)pCqRing;
+   pSqHead  = (unsigned *)(pSq + params.sq_off.head);
+   pSqTail  = (unsigned *)(pSq + params.sq_off.tail);
+   pSqMask  = (unsigned *)(pSq + params.sq_off.ring_mask);
+   pSqArray = (unsigned *)(pSq + params.sq_off.array);
+   pCqHead  = (unsigned *)(pCq + params.cq_off.head);
+   pCqTail  = (unsigned *)(pCq + params.cq_off.tail);
+   pCqMask  = (unsigned *)(pCq + params.cq_off.ring_mask);
+   pCqes    = pCq + params.cq_off.cqes;
+
+   return (0);
+}
+
+//
+// CloseUring
+//
+// Desc: Internal.  Unmap the rings and close the io_uring instance
+//
+void PF_IOEngine::CloseUring()
+{
+   if (pSqes != MAP_FAILED)
+      munmap(pSqes, sqEntries * sizeof(struct io_uring_sqe));
+   if (pCqRing != MAP_FAILED && pCqRing != pSqRing)
+      munmap(pCqRing, cqRingSize);
+   if (pSqRing != MAP_FAILED)
+      munmap(pSqRing, sqRingSize);
+   close(ringFd);
+   ringFd = -1;
+}
+
+//
+// SubmitUring
+//
+// Desc: Internal.  Write one submission entry per request and enter them
+//       with one system call, entering again what the kernel did not
+//       take.  No more than sqEntries requests are in flight, so the
+//       completion ring (twice as large) cannot overflow.  If entering
+//       fails, the entries not taken are removed from the ring, and they
+//       and the requests not written yet are completed with PF_UNIX, so
+//       that Wait and the callbacks see the error.  A NULL request
+//       submits the no-op that stops the reaper.
+// Ret:  PF_UNIX if some requests could not be submitted, 0 otherwise
+//
+RC PF_IOEngine::SubmitUring(PF_IORequest *reqs[], int numReqs)
+{
+   unique_lock<mutex> guard(latch);
+   unsigned toSubmit = 0;
+   int i;
+
+   for (i = 0; i <= numReqs; i++) {
+
+      // Enter what is queued before waiting for room, and at the end
+      if (toSubmit > 0 && (i == numReqs || numInFlight >= (int)sqEntries)) {
+         while (toSubmit > 0) {
+            int n = syscall(__NR_io_uring_enter, ringFd, toSubmit, 0, 0, NULL, 0);
+            if (n > 0)
+               toSubmit -= n;
+            else if (n == 0 ||
+                  (errno != EINTR && errno != EAGAIN && errno != EBUSY))
+               break;
+         }
+         if (toSubmit > 0)
+            break;
+      }
+      if (i == numReqs)
+         return (0);
+
+      // The stop no-op does not count, the reaper exits on it
+      PF_IORequest *pReq = reqs[i];
+      while (pReq != NULL && numInFlight >= (int)sqEntries)
+         cond.wait(guard);
+
+      unsigned tail = *pSqTail;
+      unsigned index = tail & *pSqMask;
+      struct io_uring_sqe *pSqe = (struct io_uring_sqe *)pSqes + index;
+      memset(pSqe, 0, sizeof(*pSqe));
+      if (pReq == NULL)
+         pSqe->opcode = IORING_OP_NOP;
+      else {
+         pSqe->opcode = pReq->bSync ? IORING_OP_FSYNC :
+                        pReq->bWrite ? IORING_OP_WRITEV : IORING_OP_READV;
+         if (pReq->bSync)
+            pSqe->fsync_flags = IORING_FSYNC_DATASYNC;
+         pSqe->fd = pReq->fd;
+         pSqe->off = pReq->offset;
+         pSqe->addr = (unsigned long)pReq->iov;
+         pSqe->len = pReq->iovcnt;
+         numInFlight++;
+      }
+      pSqe->user_data = (unsigned long)pReq;
+      pSqArray[index] = index;
+      __atomic_store_n(pSqTail, tail + 1, __ATOMIC_RELEASE);
+      toSubmit++;
+   }
+
+   // Entering failed: the kernel only takes entries while entering, so
+   // the last toSubmit entries are still ours to take back.  Those
+   // requests, and the ones after them, fail.
+   __atomic_store_n(pSqTail, *pSqTail - toSubmit, __ATOMIC_RELEASE);
+   int first = i - (int)toSubmit;
+   for (int j = i; j < numReqs; j++)
+      if (reqs[j] != NULL)
+         numInFlight++;
+   guard.unlock();
+
+   for (int j = first; j < numReqs; j++)
+      if (reqs[j] != NULL)
+         Complete(reqs[j], PF_UNIX);
+
+   return (PF_UNIX);
+}
+
+//
+// ReapUring
+//
+// Desc: Internal.  Body of the reaper thread: wait for completions and
+//       finish their requests until the stop no-op completes.  A short
+//       transfer is finished synchronously here.
+//
+void PF_IOEngine::ReapUring()
+{
+   for (;;) {
+      unsigned head = *pCqHead;
+      unsigned tail = __atomic_load_n(pCqTail, __ATOMIC_ACQUIRE);
+
+      if (head == tail) {
+         syscall(__NR_io_uring_enter, ringFd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+         continue;
+      }
+
+      for (; head != tail; head++) {
+         struct io_uring_cqe *pCqe = (struct io_uring_cqe *)pCqes + (head & *pCqMask);
+         PF_IORequest *pReq = (PF_IORequest *)(unsigned long)pCqe->user_data;
+         int res = pCqe->res;
+         __atomic_store_n(pCqHead, head + 1, __ATOMIC_RELEASE);
+
+         if (pReq == NULL)
+            return;
+
+         long length = 0;
+         for (int i = 0; i < pReq->iovcnt; i++)
+            length += pReq->iov[i].iov_len;
+
+         RC rc = 0;
+         if (res < 0) {
+            errno = -res;
+            rc = PF_UNIX;
+         }
+         else if (res < length)
+            rc = Transfer(*pReq, res);
+         Complete(pReq, rc);
+      }
+   }
+}
+
+#else
+
+// Without io_uring headers the thread pool is always used
+int PF_IOEngine::SetupUring()
+{
+   return (-1);
+}
+
+void PF_IOEngine::CloseUring()
+{
+}
+
+RC PF_IOEngine::SubmitUring(PF_IORequest *reqs[], int numReqs)
+{
+   return (PF_UNIX);
+}
+
+void PF_IOEngine::ReapUring()
+{
+}
+
+#endif
@@ -0,0 +1,108 @@
+//
+// File:        pf_ioengine.h
+// Description: PF_IOEngine class interface
+//
+// The I/O engine moves pages between the buffer frames and the files.
+// A request either reads or writes adjacent bytes of a file, or makes the
+// file durable with fdatasync.
+// Transfer does one request synchronously in the calling thread; Submit
+// queues a batch of requests and returns at once, and each request is
+// completed later by an I/O thread, which either calls the completion
+// callback of the request or wakes the threads blocked in Wait.
+//
+// Two backends implement Submit:
+//  - io_uring, driven with the raw system calls (no liburing needed):
+//    the whole batch costs one io_uring_enter, and a reaper thread
+//    collects the completions;
+//  - a pool of threads doing blocking preadv/pwritev, used when the
+//    kernel has no io_uring (or PF_IO_THREADS is configured).
+//
+
+#ifndef PF_IOENGINE_H
+#define PF_IOENGINE_H
+
+#include <sys/uio.h>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include "pf_internal.h"
+
+//
+// PF_IORequest - one read or write of adjacent bytes of a file
+// 请求由调用者分配,在完成之前不能释放
+struct PF_IORequest {
+    int          bWrite;      // TRUE to write, FALSE to read
+    int          bSync;       // TRUE to fdatasync fd instead (offset and
+                              // buffers unused)
+    int          fd;          // OS file descriptor
+    long         offset;      // file offset of the first byte
+    struct iovec *iov;        // buffers, at most PF_MAX_IOV of them
+    int          iovcnt;      // # of buffers
+    RC           rc;          // result, valid once the request completed
+    int          bDone;       // set on completion if pfnDone is NULL
+    void         (*pfnDone)(PF_IORequest *pReq);  // completion callback,
+                                                  // run on an I/O thread
+    void         *pArg;       // for use by pfnDone
+    long long    startNs;     // submission time, for the latency statistics
+    PF_IORequest *pNext;      // engine queue link
+};
+
+//
+// PF_IOEngine - synchronous and asynchronous page I/O
+//
+class PF_IOEngine {
+public:
+    // Constructor - use io_uring unless backend is PF_IO_THREADS or the
+    // kernel lacks it; numThreads workers run the thread pool backend
+    PF_IOEngine      (PF_IOBackend backend, int numThreads);
+    ~PF_IOEngine     ();                       // Destructor, drains requests
+
+    // Do the request (but its first numDone bytes) in the calling thread
+    static RC Transfer (PF_IORequest &req, long numDone = 0);
+
+    // Queue numReqs requests; each one is completed exactly once by an
+    // I/O thread
+    RC  Submit       (PF_IORequest *reqs[], int numReqs);
+    // Block until a request without pfnDone has completed
+    RC  Wait         (PF_IORequest &req);
+
+    int IsUring      () const { return (ringFd >= 0); }
+
+private:
+    void Complete    (PF_IORequest *pReq, RC rc);  // Finish a request
+
+    // io_uring backend
+    int  SetupUring  ();                       // Map the rings
+    void CloseUring  ();
+    RC   SubmitUring (PF_IORequest *reqs[], int numReqs);
+    void ReapUring   ();                       // Reaper thread body
+
+    // Thread pool backend
+    void Work        ();                       // Worker thread body
+
+    std::mutex     latch;              // protects the members below
+    std::condition_variable cond;      // signals completions, queue changes
+    int            numInFlight;        // requests submitted but not completed
+    int            bStop;              // destructor called
+
+    // Thread pool: FIFO of requests waiting for a worker
+    PF_IORequest   *pQueueHead;
+    PF_IORequest   *pQueueTail;
+    std::thread    *workers;
+    int            numWorkers;
+
+    // io_uring: the rings shared with the kernel
+    int            ringFd;             // -1 if io_uring is not used
+    unsigned       sqEntries;
+    void           *pSqRing;           // submission ring mapping
+    size_t         sqRingSize;
+    void           *pCqRing;           // completion ring mapping
+    size_t         cqRingSize;
+    void           *pSqes;             // submission queue entries
+    unsigned       *pSqHead, *pSqTail, *pSqMask, *pSqArray;
+    unsigned       *pCqHead, *pCqTail, *pCqMask;
+    void           *pCqes;
+    std::thread    reaper;
+};
+
+#endif
@@ -8,10 +8,19 @@
 #include <cstdio>
 #include <unistd.h>
 #include <fcntl.h>
+#include <cerrno>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include "pf_internal.h"
 #include "pf_buffermgr.h"
+#include "pf_warmup.h"
+
+#ifdef PF_STATS
+#include "statistics.h"
+
+// This is defined within pf_buffermgr.cc
+extern StatisticsMgr *pStatisticsMgr;
+#endif
 
 
 /*********************************************************************************************
@@ -25,6 +34,81 @@
  *    5.如何理解scratch page(AllocateBlock()与之相关) ??? 
  *    6.注意文件描述符是对进程而言的概念,一个文件可以打开多次,对应不同文件描述符
  * *******************************************************************************************/
+//
+// PF_BufferConfig
+//
+// Desc: Constructor - a pool of numPages frames whose hash tables are
+//       sized for exactly that many pages
+//
+PF_BufferConfig::PF_BufferConfig(int _numPages, int _numShards,
+      PF_ReplacePolicy _policy)
+{
+   numPages  = _numPages;
+   hashSize  = _numPages;
+   numShards = _numShards;
+   policy    = _policy;
+   bHugePages = FALSE;
+   ioBackend = PF_IO_AUTO;
+   bReadAhead = TRUE;
+   bBgWriter = FALSE;
+   bgDirtyPct = PF_BGWRITER_DIRTY;
+   bgMaxRate = PF_BGWRITER_RATE;
+   extentPages = PF_EXTENT_PAGES;
+   bFreeBitmap = FALSE;
+   psWarmFile = NULL;
+}
+
+//
+// ReadEnv
+//
+// Desc: Let the deployment size the pool without recompiling.
+//       REDBASE_PF_BUFFER_SIZE sets numPages (and hashSize, unless
+//       REDBASE_PF_HASH_SIZE is also set).  Values that are not positive
+//       integers are ignored.  REDBASE_PF_HUGE_PAGES sets bHugePages.
+//       REDBASE_PF_IO=threads keeps asynchronous I/O off io_uring.
+//       REDBASE_PF_READAHEAD=0 turns read-ahead off.
+//       REDBASE_PF_BGWRITER=1 starts the background writer.
+//       REDBASE_PF_EXTENT sets extentPages (0 turns extents off).
+//       REDBASE_PF_BITMAP=1 creates files with a free-page bitmap.
+//       REDBASE_PF_WARMUP names the warm-up list (empty: none).
+//
+// 从环境变量读取缓冲区大小和hash表大小
+void PF_BufferConfig::ReadEnv()
+{
+   const char *psValue;
+   int value;
+
+   if ((psValue = getenv("REDBASE_PF_BUFFER_SIZE")) != NULL &&
+         (value = atoi(psValue)) > 0)
+      numPages = hashSize = value;
+
+   if ((psValue = getenv("REDBASE_PF_HASH_SIZE")) != NULL &&
+         (value = atoi(psValue)) > 0)
+      hashSize = value;
+
+   if ((psValue = getenv("REDBASE_PF_HUGE_PAGES")) != NULL)
+      bHugePages = (atoi(psValue) != 0);
+
+   if ((psValue = getenv("REDBASE_PF_IO")) != NULL)
+      ioBackend = strcmp(psValue, "threads") ? PF_IO_AUTO : PF_IO_THREADS;
+
+   if ((psValue = getenv("REDBASE_PF_READAHEAD")) != NULL)
+      bReadAhead = (atoi(psValue) != 0);
+
+   if ((psValue = getenv("REDBASE_PF_BGWRITER")) != NULL)
+      bBgWriter = (atoi(psValue) != 0);
+
+   if ((psValue = getenv("REDBASE_PF_EXTENT")) != NULL &&
+         (value = atoi(psValue)) >= 0)
+      extentPages = value;
+
+   if ((psValue = getenv("REDBASE_PF_BITMAP")) != NULL)
+      bFreeBitmap = (atoi(psValue) != 0);
+
+   if ((psValue = getenv("REDBASE_PF_WARMUP")) != NULL)
+      psWarmFile = (*psValue != '\0') ? psValue : NULL;
+}
+
 //
 // PF_Manager
 //
@@ -32,12 +116,58 @@
 //       Handles creation, deletion, opening and closing of files.
 //       It is associated with a PF_BufferMgr that manages the page
 //       buffer and executes the page replacement policies.
+//       The pool has PF_BUFFER_SIZE frames unless the environment
+//       overrides it (see PF_BufferConfig::ReadEnv).
+// In:   numShards - number of latched shards the buffer is split into
+//       policy - page replacement policy of the buffer
 //
 // 构造函数,动态分配PF_BufferMgr对象
-PF_Manager::PF_Manager()
+PF_Manager::PF_Manager(int numShards, PF_ReplacePolicy policy)
 {
+   PF_BufferConfig config(PF_BUFFER_SIZE, numShards, policy);
+   config.ReadEnv();
+
+   // Create Buffer Manager
+   pBufferMgr = new PF_BufferMgr(config);
+   extentPages = config.extentPages;
+   bFreeBitmap = config.bFreeBitmap;
+   InitWarmList(config);
+}
+
+//
+// PF_Manager
+//
+// Desc: Constructor - as above, with the pool sized by config.  A pool
+//       of less than one page falls back to PF_BUFFER_SIZE.
+// In:   config - buffer pool configuration
+//
+PF_Manager::PF_Manager(const PF_BufferConfig &config)
+{
+   PF_BufferConfig checked = config;
+   if (checked.numPages < 1)
+      checked.numPages = PF_BUFFER_SIZE;
+
    // Create Buffer Manager
-   pBufferMgr = new PF_BufferMgr(PF_BUFFER_SIZE);
+   pBufferMgr = new PF_BufferMgr(checked);
+   extentPages = checked.extentPages;
+   bFreeBitmap = checked.bFreeBitmap;
+   InitWarmList(checked);
+}
+
+//
+// InitWarmList
+//
+// Desc: Internal.  Read the warm-up list of the last run, if config names
+//       one.  The list holds as many pages as the buffer has frames.
+//
+void PF_Manager::InitWarmList(const PF_BufferConfig &config)
+{
+   pWarmList = NULL;
+   if (config.psWarmFile == NULL)
+      return;
+
+   pWarmList = new PF_WarmList(config.psWarmFile, config.numPages);
+   pWarmList->Load();
 }
 
 //
@@ -46,10 +176,25 @@ PF_Manager::PF_Manager()
 // Desc: Destructor - intended to be called once at end of program
 //       Destroys the buffer manager.
 //       All files are expected to be closed when this method is called.
+//       With a warm-up list, the pages of the files closed (and of those
+//       still open) are saved for the next run first.
 //
 // 析构函数,需要释放pBufferMgr
 PF_Manager::~PF_Manager()
 {
+   if (pWarmList != NULL) {
+      std::vector<int> fds;
+      std::vector<PF_ResidentPage> resident;
+
+      pWarmList->OpenFds(fds);
+      for (int i = 0; i < (int)fds.size(); i++) {
+         pBufferMgr->GetResident(fds[i], resident);
+         pWarmList->RecordFile(fds[i], resident);
+      }
+      pWarmList->Save();
+      delete pWarmList;
+   }
+
    // Destroy the buffer manager objects
    delete pBufferMgr;
 }
@@ -59,6 +204,10 @@ PF_Manager::~PF_Manager()
 //
 // Desc: Create a new PF file named fileName
 // In:   fileName - name of file to create
+//       flags - PF_CREATE_BITMAP to find the free pages of the file in a
+//               bitmap in its header rather than in a list threaded
+//               through the free pages (the default of the PF_Manager if
+//               its configuration says bFreeBitmap)
 // Ret:  PF return code
 //
 /******************************************************************
@@ -67,7 +216,7 @@ PF_Manager::~PF_Manager()
  *    数减一;否则删除这个文件(注意这里的引用计数并非打开该文件的进程数)
  * .创建文件时,只写了PF文件头,并没有往文件写更多的数据
  * ****************************************************************/
-RC PF_Manager::CreateFile (const char *fileName)
+RC PF_Manager::CreateFile (const char *fileName, int flags)
 {
    int fd;		// unix file descriptor
    int numBytes;		// return code form write syscall
@@ -91,10 +240,12 @@ RC PF_Manager::CreateFile (const char *fileName)
    PF_FileHdr *hdr = (PF_FileHdr*)hdrBuf;     /*文件头信息*/
    hdr->firstFree = PF_PAGE_LIST_END;
    hdr->numPages = 0;
+   hdr->format = ((flags & PF_CREATE_BITMAP) || bFreeBitmap) ?
+      PF_FORMAT_BITMAP : PF_FORMAT_FREELIST;       /*位图为空:没有页*/
 
    // Write header to file
    /* 将头信息写入文件 */
-   if((numBytes = write(fd, hdrBuf, PF_FILE_HDR_SIZE))
+   if((numBytes = pwrite(fd, hdrBuf, PF_FILE_HDR_SIZE, 0))
          != PF_FILE_HDR_SIZE) {
 
       // Error while writing: close and remove file
@@ -145,6 +296,15 @@ RC PF_Manager::DestroyFile (const char *fileName)
 //       of a file is for writing, problems may occur because some writes may
 //       not be seen by a reader of another instance of the file.
 // In:   fileName - name of file to open
+//       flags - PF_OPEN_DIRECT to bypass the OS page cache.  If the file
+//               system does not support O_DIRECT (open or the first read
+//               fails with EINVAL) the file is quietly opened without it;
+//               fileHandle.IsDirectIO() tells which mode was used.
+//               PF_OPEN_MMAP to open the file read-only and map it: the
+//               pages are handed out in place, without the buffer pool,
+//               and their pins only count.  Pages, header and free list
+//               cannot be changed (PF_READONLY).  PF_OPEN_DIRECT is
+//               ignored then.
 // Out:  fileHandle - refer to the open file
 //                    this function modifies local var's in fileHandle
 //       to point to the file data in the file table, and to point to the
@@ -154,7 +314,8 @@ RC PF_Manager::DestroyFile (const char *fileName)
 // 使用open系统调用打开一个已通过CreateFile创建的文件; 
 // 然后将这个打开的文件与PF_FileHandle对象关联! 
 // 注意文件描述符是对进程而言的概念,一个文件可以打开多次,对应不同文件描述符
-RC PF_Manager::OpenFile (const char *fileName, PF_FileHandle &fileHandle)
+RC PF_Manager::OpenFile (const char *fileName, PF_FileHandle &fileHandle,
+      int flags)
 {
    int rc;                   // return code
 
@@ -162,8 +323,37 @@ RC PF_Manager::OpenFile (const char *fileName, PF_FileHandle &fileHandle)
    if (fileHandle.bFileOpen)
       return (PF_FILEOPEN);
 
-   // Open the file
-   if ((fileHandle.unixfd = open(fileName,
+   fileHandle.bDirectIO = FALSE;
+   fileHandle.pMap = NULL;
+   fileHandle.pPageMap = NULL;
+
+   // A mapped file is opened read-only and its pages mapped after the
+   // header is read
+   // 只读映射模式:页直接来自mmap区域,不经过缓冲区
+   if (flags & PF_OPEN_MMAP) {
+      if ((fileHandle.unixfd = open(fileName,
+#ifdef PC
+            O_BINARY |
+#endif
+            O_RDONLY)) < 0)
+         return (PF_UNIX);
+      if ((rc = fileHandle.ReadHdr()) ||
+            (rc = fileHandle.MapFile()))
+         goto err;
+      goto opened;
+   }
+
+   // Open the file, with O_DIRECT if asked and supported
+#ifdef O_DIRECT
+   if (flags & PF_OPEN_DIRECT) {
+      fileHandle.unixfd = open(fileName, O_RDWR | O_DIRECT);
+      if (fileHandle.unixfd >= 0)
+         fileHandle.bDirectIO = TRUE;
+      else if (errno != EINVAL)
+         return (PF_UNIX);
+   }
+#endif
+   if (!fileHandle.bDirectIO && (fileHandle.unixfd = open(fileName,
 #ifdef PC
          O_BINARY |
 #endif
@@ -171,17 +361,42 @@ RC PF_Manager::OpenFile (const char *fileName, PF_FileHandle &fileHandle)
       return (PF_UNIX);
 
    // Read the file header  /*读取PF层文件头信息*/
-   {
-      int numBytes = read(fileHandle.unixfd, (char *)&fileHandle.hdr,sizeof(PF_FileHdr));
-      if (numBytes != sizeof(PF_FileHdr)) {
-         rc = (numBytes < 0) ? PF_UNIX : PF_HDRREAD;
-         goto err;
-      }
+   // 文件系统可能接受O_DIRECT的open却拒绝对齐读写,此时退回普通I/O
+   if ((rc = fileHandle.ReadHdr()) == PF_UNIX && errno == EINVAL &&
+         fileHandle.bDirectIO) {
+#ifdef O_DIRECT
+      fcntl(fileHandle.unixfd, F_SETFL,
+            fcntl(fileHandle.unixfd, F_GETFL) & ~O_DIRECT);
+#endif
+      fileHandle.bDirectIO = FALSE;
+      rc = fileHandle.ReadHdr();
    }
+   if (rc)
+      goto err;
 
+opened:
    // Set file header to be not changed
    fileHandle.bHdrChanged = FALSE;
 
+   // Space is reserved past the last page from the first growth on
+   fileHandle.extentPages = extentPages;
+   fileHandle.extentEnd = fileHandle.hdr.numPages;
+
+   // Start reading the pages the file had in the buffer last time
+   // 预热:异步读入上次运行时该文件驻留在缓冲区的页
+   if (pWarmList != NULL && fileHandle.pMap == NULL) {
+      std::vector<PageNum> pages;
+      pWarmList->OpenFile(fileHandle.unixfd, fileName,
+            fileHandle.hdr.numPages, pages);
+      if (!pages.empty())
+         pBufferMgr->WarmUp(fileHandle.unixfd, &pages[0], (int)pages.size());
+   }
+
+#ifdef PF_STATS
+   // The latencies of the file are recorded under its name
+   pStatisticsMgr->OpenFile(fileHandle.unixfd, fileName);
+#endif
+
    // Set local variables in file handle object to refer to open file
    fileHandle.pBufferMgr = pBufferMgr;
    fileHandle.bFileOpen = TRUE;
@@ -191,6 +406,8 @@ RC PF_Manager::OpenFile (const char *fileName, PF_FileHandle &fileHandle)
 
 err:
    // Close file
+   delete fileHandle.pPageMap;
+   fileHandle.pPageMap = NULL;
    close(fileHandle.unixfd);
    fileHandle.bFileOpen = FALSE;
 
@@ -206,12 +423,13 @@ err:
 //       Also, flush all pages for the file from the page buffer
 //       It is an error to close a file with pages still fixed in the buffer.
 // In:   fileHandle - handle of file to close
+//       bSync - TRUE to make the file durable (fdatasync) before closing
 // Out:  fileHandle - no longer refers to an open file
 //                    this function modifies local var's in fileHandle
 // Ret:  PF return code
 //
 //关闭已打开文件,将文件所有页的缓冲区释放,将脏数据写回磁盘(FlushPages())  
-RC PF_Manager::CloseFile(PF_FileHandle &fileHandle)
+RC PF_Manager::CloseFile(PF_FileHandle &fileHandle, int bSync)
 {
    RC rc;
 
@@ -219,11 +437,27 @@ RC PF_Manager::CloseFile(PF_FileHandle &fileHandle)
    if (!fileHandle.bFileOpen)
       return (PF_CLOSEDFILE);
 
+   // Note the pages of the file for the next run before they go
+   if (pWarmList != NULL) {
+      std::vector<PF_ResidentPage> resident;
+      pBufferMgr->GetResident(fileHandle.unixfd, resident);
+      pWarmList->RecordFile(fileHandle.unixfd, resident);
+   }
+
    // Flush all buffers for this file and write out the header
-   if ((rc = fileHandle.FlushPages()))
+   if ((rc = fileHandle.FlushPages(bSync)))
       return (rc);
 
-   // Close the file
+   // Close the file; its descriptor may be reused by the next one
+   pBufferMgr->ForgetFile(fileHandle.unixfd);
+   if (pWarmList != NULL)
+      pWarmList->CloseFile(fileHandle.unixfd);
+#ifdef PF_STATS
+   pStatisticsMgr->CloseFile(fileHandle.unixfd);
+#endif
+   fileHandle.UnmapFile();
+   delete fileHandle.pPageMap;
+   fileHandle.pPageMap = NULL;
    if (close(fileHandle.unixfd) < 0)
       return (PF_UNIX);
    fileHandle.bFileOpen = FALSE;
@@ -235,6 +469,37 @@ RC PF_Manager::CloseFile(PF_FileHandle &fileHandle)
    return 0;
 }
 
+//
+// SyncFiles
+//
+// Desc: Group commit.  Write the headers and dirty pages of several open
+//       files, then make them durable with one batch of fdatasync calls,
+//       one per file written since its last sync (see
+//       PF_BufferMgr::SyncFiles).  The syncs proceed together instead of
+//       one after the other.
+// In:   fileHandles - the files; a file may be listed more than once
+//       numFiles - # of handles
+// Ret:  PF_CLOSEDFILE if a file is not open, other PF return code
+//
+// 组提交:先写回各文件的脏页,再一次性提交所有需要的fdatasync
+RC PF_Manager::SyncFiles(PF_FileHandle *const fileHandles[], int numFiles)
+{
+   RC rc;
+   int *fds = new int[numFiles];
+
+   for (int i = 0; i < numFiles; i++) {
+      if ((rc = fileHandles[i]->ForcePages())) {
+         delete [] fds;
+         return (rc);
+      }
+      fds[i] = fileHandles[i]->unixfd;
+   }
+
+   rc = pBufferMgr->SyncFiles(fds, numFiles);
+   delete [] fds;
+   return (rc);
+}
+
 //
 // ClearBuffer
 //
@@ -268,6 +533,36 @@ RC PF_Manager::PrintBuffer()
    return pBufferMgr->PrintBuffer();
 }
 
+//
+// GetSnapshot
+//
+// Desc: Snapshot of the buffer pool, for monitoring.  Cheap enough to be
+//       taken every few seconds: each shard is latched in turn, for a walk
+//       over its frames.
+// In:   maxFiles - room in files
+// Out:  snapshot - the pool and its totals
+//       files - the first maxFiles files with frames or GetPages, by
+//       descriptor (snapshot.numFiles tells how many there are)
+// Ret:  Returns the result of PF_BufferMgr::GetSnapshot
+//
+RC PF_Manager::GetSnapshot(PF_BufferSnapshot &snapshot,
+      PF_FileSnapshot files[], int maxFiles)
+{
+   return pBufferMgr->GetSnapshot(snapshot, files, maxFiles);
+}
+
+//
+// ResetAccessCounts
+//
+// Desc: Restart the hit and miss counts of the snapshots
+// Ret:  0
+//
+RC PF_Manager::ResetAccessCounts()
+{
+   pBufferMgr->ResetAccessCounts();
+   return 0;
+}
+
 //
 // ResizeBuffer
 //
@@ -0,0 +1,89 @@
+//
+// File:        pf_pagefuture.cc
+// Description: PF_PageFuture class implementation
+//
+
+#include "pf_internal.h"
+#include "pf_buffermgr.h"
+
+//
+// PF_PageFuture
+//
+// Desc: Default constructor for a page future object.  It must be passed
+//       to PF_FileHandle::GetPageAsync before it can be waited for.
+//
+PF_PageFuture::PF_PageFuture()
+{
+   pBufferMgr = NULL;
+   fd = -1;
+   pageNum = -1;
+   slot = -1;
+   rc = 0;
+   bStarted = FALSE;
+   bPending = FALSE;
+   pfnDone = NULL;
+   pArg = NULL;
+   pNextWaiter = NULL;
+}
+
+//
+// ~PF_PageFuture
+//
+// Desc: Destroy the future.  If the client started a read and never
+//       waited for it, wait now and unpin the page, since the buffer
+//       manager still links to the future.
+//
+PF_PageFuture::~PF_PageFuture()
+{
+   PF_PageHandle pageHandle;
+
+   if (bStarted && Wait(pageHandle) == 0)
+      pBufferMgr->UnpinPage(fd, pageNum);
+}
+
+//
+// IsReady
+//
+// Desc: Poll the future
+// Ret:  TRUE if Wait would return without blocking (or was never started)
+//
+int PF_PageFuture::IsReady() const
+{
+   if (!bStarted)
+      return (TRUE);
+   return (pBufferMgr->IsPageReady(*this));
+}
+
+//
+// Wait
+//
+// Desc: Wait for the page read by GetPageAsync and set pageHandle to it,
+//       as GetThisPage would.  The page stays pinned until the client
+//       unpins it; on error it is not pinned.
+// Out:  pageHandle - refers to the page
+// Ret:  PF_PAGENOTINBUF if no read was started, PF_INVALIDPAGE if the
+//       page is free, the error of the read, or 0
+//
+RC PF_PageFuture::Wait(PF_PageHandle &pageHandle)
+{
+   RC   rc;               // return code
+   char *pPageBuf;        // address of page in buffer pool
+
+   if (!bStarted)
+      return (PF_PAGENOTINBUF);
+
+   if ((rc = pBufferMgr->WaitPage(*this, &pPageBuf)))
+      return (rc);
+
+   // Only pages in use can be handed out
+   if (((PF_PageHdr*)pPageBuf)->nextFree == PF_PAGE_USED) {
+      pageHandle.pageNum = pageNum;
+      pageHandle.pPageData = pPageBuf + sizeof(PF_PageHdr);
+      return (0);
+   }
+
+   if ((rc = pBufferMgr->UnpinPage(fd, pageNum)))
+      return (rc);
+
+   return (PF_INVALIDPAGE);
+}
@@ -0,0 +1,236 @@
+//
+// File:        pf_statbench.cc
+// Description: Micro-benchmark of the statistics on the GetPage path
+//
+// Times GetThisPage + UnpinPage on pages that are in the buffer, which is
+// where the statistics cost the most relative to the work done, with the
+// fixed counters on, with them off (StatisticsMgr::Enable), with the
+// latencies of the accesses timed as well (EnableLatencies), and with the
+// linked-list Register behind a mutex that every page access used to
+// make (reproduced by registering the same two updates under keys the
+// fixed counters do not know).  The same is then measured with several
+// threads at once.  Built without PF_STATS only the bare cost is shown.
+//
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <unistd.h>
+#include "pf.h"
+#include "pf_testutil.h"
+#include "pf_internal.h"
+
+using namespace std;
+
+#ifdef PF_STATS
+#include "statistics.h"
+
+// This is defined within pf_buffermgr.cc
+extern StatisticsMgr *pStatisticsMgr;
+#endif
+
+//
+// Defines
+//
+#define FILE1         "file1"
+#define NUM_PAGES     PF_BUFFER_SIZE  // pages in the test file
+#define NUM_OPS       1000000         // page accesses per run
+#define NUM_THREADS   4               // threads of the concurrent runs
+
+//
+// Ways of counting the page accesses
+//
+enum StatMode {
+   STATS_OFF,                         // counters disabled
+   STATS_FIXED,                       // fixed, lock free counters
+   STATS_TIMED,                       // the counters and the latencies
+   STATS_LIST                         // linked list under a mutex
+};
+
+static mutex listLatch;               // the latch the list used to need
+
+//
+// Per-thread state
+//
+struct Worker {
+   PF_FileHandle *pFileHandle;        // file shared by the threads
+   int           first;               // page the thread starts at
+   StatMode      mode;                // how the accesses are counted
+   RC            rc;                  // result of the thread
+};
+
+RC Access(PF_FileHandle &fh, int first, StatMode mode);
+void WorkerMain(Worker *w);
+double Run(PF_FileHandle &fh, int numThreads, StatMode mode);
+
+//
+// Access
+//
+// Desc: Get and unpin NUM_OPS pages, going round the file from first
+//
+RC Access(PF_FileHandle &fh, int first, StatMode mode)
+{
+   PF_PageHandle ph;
+   RC rc;
+
+   for (int i = 0; i < NUM_OPS; i++) {
+      PageNum pageNum = (first + i) % NUM_PAGES;
+      if ((rc = fh.GetThisPage(pageNum, ph)) ||
+            (rc = fh.UnpinPage(pageNum)))
+         return (rc);
+
+#ifdef PF_STATS
+      // GETPAGE and PAGEFOUND, as the hit used to register them
+      if (mode == STATS_LIST) {
+         lock_guard<mutex> guard(listLatch);
+         pStatisticsMgr->Register("LIST_GETPAGE", STAT_ADDONE);
+         pStatisticsMgr->Register("LIST_PAGEFOUND", STAT_ADDONE);
+      }
+#endif
+   }
+
+   return (0);
+}
+
+//
+// WorkerMain
+//
+// Desc: Body of a thread of Run
+//
+void WorkerMain(Worker *w)
+{
+   w->rc = Access(*w->pFileHandle, w->first, w->mode);
+}
+
+//
+// Run
+//
+// Desc: Time numThreads threads accessing the pages at once
+// Ret:  nanoseconds per access
+//
+double Run(PF_FileHandle &fh, int numThreads, StatMode mode)
+{
+   thread threads[NUM_THREADS];
+   Worker workers[NUM_THREADS];
+
+#ifdef PF_STATS
+   pStatisticsMgr->Enable(mode == STATS_FIXED || mode == STATS_TIMED);
+   pStatisticsMgr->EnableLatencies(mode == STATS_TIMED);
+   if (mode == STATS_LIST) {
+      // The list held the other PF keys ahead of these two
+      const char *psKeys[] = { "LIST_READPAGE", "LIST_WRITEPAGE",
+         "LIST_FLUSHPAGES", "LIST_READAHEAD", "LIST_PAGENOTFOUND" };
+      for (unsigned int i = 0; i < sizeof(psKeys) / sizeof(psKeys[0]); i++)
+         pStatisticsMgr->Register(psKeys[i], STAT_ADDONE);
+   }
+#endif
+
+   chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+   for (int t = 0; t < numThreads; t++) {
+      workers[t].pFileHandle = &fh;
+      workers[t].first = t * NUM_PAGES / NUM_THREADS;
+      workers[t].mode = mode;
+      threads[t] = thread(WorkerMain, &workers[t]);
+   }
+   for (int t = 0; t < numThreads; t++)
+      threads[t].join();
+
+   double seconds = chrono::duration<double>(
+         chrono::steady_clock::now() - start).count();
+
+   for (int t = 0; t < numThreads; t++)
+      if (workers[t].rc) {
+         PF_PrintError(workers[t].rc);
+         exit(1);
+      }
+
+#ifdef PF_STATS
+   pStatisticsMgr->Enable(TRUE);
+   pStatisticsMgr->EnableLatencies(TRUE);
+#endif
+
+   return (seconds * 1e9 / ((double)NUM_OPS * numThreads));
+}
+
+int main()
+{
+   RC rc;
+
+   cout << "********************\n";
+   cout << "PF statistics benchmark, " << NUM_OPS
+      << " buffer hits per thread.\n";
+
+   if ((rc = CreateTestFile(FILE1, NUM_PAGES))) {
+      PF_PrintError(rc);
+      return (1);
+   }
+
+   {
+      // Room to spare, so that no shard misses whatever the hash
+      PF_BufferConfig config(4 * NUM_PAGES, NUM_THREADS);
+      config.bReadAhead = FALSE;
+      PF_Manager pfm(config);
+      PF_FileHandle fh;
+
+      if ((rc = pfm.OpenFile(FILE1, fh))) {
+         PF_PrintError(rc);
+         return (1);
+      }
+
+      int numThreads[] = { 1, NUM_THREADS };
+      for (unsigned int i = 0; i < sizeof(numThreads) / sizeof(numThreads[0]); i++) {
+         double nsOff = Run(fh, numThreads[i], STATS_OFF);
+#ifdef PF_STATS
+         double nsFixed = Run(fh, numThreads[i], STATS_FIXED);
+         double nsTimed = Run(fh, numThreads[i], STATS_TIMED);
+         double nsList = Run(fh, numThreads[i], STATS_LIST);
+         printf("%d thread(s): stats off %6.1f ns/access, fixed counters %6.1f,"
+               " latencies %6.1f, linked list %6.1f\n", numThreads[i],
+               nsOff, nsFixed, nsTimed, nsList);
+#else
+         printf("%d thread(s): %6.1f ns/access (built without PF_STATS)\n",
+               numThreads[i], nsOff);
+#endif
+      }
+
+#ifdef PF_STATS
+      // The fixed counters saw every access they were on for (two runs
+      // in four), and all but the first reads of the pages were hits
+      int *piGP = pStatisticsMgr->Get(PF_GETPAGE);
+      int *piPNF = pStatisticsMgr->Get(PF_PAGENOTFOUND);
+      long expected = (long)NUM_OPS * 2 * (1 + NUM_THREADS);
+      if (piGP == NULL || *piGP != expected ||
+            (piPNF != NULL && *piPNF > NUM_PAGES)) {
+         cout << "GETPAGE is " << (piGP ? *piGP : 0) << ", not "
+            << expected << "\n";
+         return (1);
+      }
+      delete piGP;
+      delete piPNF;
+
+      // and the timed runs timed every hit
+      StatHistData hits;
+      pStatisticsMgr->GetLatency(FILE1, STAT_LAT_GETHIT, hits);
+      if (hits.lCount != expected / 2) {
+         cout << "GETHIT latencies: " << hits.lCount << ", not "
+            << expected / 2 << "\n";
+         return (1);
+      }
+      printf("Hit latency, timed runs: p50 %lld ns, p99 %lld, p999 %lld\n",
+            hits.Percentile(0.50), hits.Percentile(0.99), hits.Percentile(0.999));
+#endif
+
+      if ((rc = pfm.CloseFile(fh))) {
+         PF_PrintError(rc);
+         return (1);
+      }
+   }
+
+   unlink(FILE1);
+   cout << "********************\n\n";
+   return (0);
+}
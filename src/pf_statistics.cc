@@ -21,43 +21,74 @@ using namespace std;
 // This is defined within pf_buffermgr.cc
 extern StatisticsMgr *pStatisticsMgr;
 
-void PF_Statistics()
+//
+// PrintStat
+//
+// Print the 64-bit value of a statistic, or None if it was never counted
+//
+static void PrintStat(const char *psKey)
 {
-   // First get all the statistics, must remember to delete memory returned
-   int *piGP = pStatisticsMgr->Get(PF_GETPAGE);
-   int *piPF = pStatisticsMgr->Get(PF_PAGEFOUND);
-   int *piPNF = pStatisticsMgr->Get(PF_PAGENOTFOUND);
-   int *piRP = pStatisticsMgr->Get(PF_READPAGE);
-   int *piWP = pStatisticsMgr->Get(PF_WRITEPAGE);
-   int *piFP = pStatisticsMgr->Get(PF_FLUSHPAGES);
+   long long lValue;
 
+   if (pStatisticsMgr->GetValue(psKey, lValue) == 0)
+      cout << lValue;
+   else
+      cout << "None";
+}
+
+void PF_Statistics()
+{
    cout << "PF Layer Statistics\n";
    cout << "-------------------\n";
 
    cout << "Total number of calls to GetPage Routine: ";
-   if (piGP) cout << *piGP; else cout << "None";
+   PrintStat(PF_GETPAGE);
    cout << "\n  Number found: ";
-   if (piPF) cout << *piPF; else cout << "None";
+   PrintStat(PF_PAGEFOUND);
    cout << "\n  Number not found: ";
-   if (piPNF) cout << *piPNF; else cout << "None";
+   PrintStat(PF_PAGENOTFOUND);
    cout << "\n-------------------\n";
 
-   cout << "Number of read requests: ";
-   if (piRP) cout << *piRP; else cout << "None";
-   cout << "\nNumber of write requests: ";
-   if (piWP) cout << *piWP; else cout << "None";
+   cout << "Number of pages read: ";
+   PrintStat(PF_READPAGE);
+   cout << "\n  Pages read ahead: ";
+   PrintStat(PF_READAHEAD);
+   cout << "\nNumber of pages written: ";
+   PrintStat(PF_WRITEPAGE);
+   cout << "\n  Pages written in the background: ";
+   PrintStat(PF_BGWRITE);
+   cout << "\n  Writes of adjacent pages coalesced: ";
+   PrintStat(PF_COALESCEDIO);
    cout << "\n-------------------\n";
    cout << "Number of flushes: ";
-   if (piFP) cout << *piFP; else cout << "None";
+   PrintStat(PF_FLUSHPAGES);
+   cout << "\nNumber of fdatasync calls: ";
+   PrintStat(PF_SYNC);
+   cout << "\n  Syncs skipped (nothing written): ";
+   PrintStat(PF_SYNCSKIPPED);
+   cout << "\n  Microseconds spent syncing: ";
+   PrintStat(PF_SYNCUSEC);
+   cout << "\nPages preallocated in extents: ";
+   PrintStat(PF_EXTENT);
    cout << "\n-------------------\n";
 
-   // Must delete the memory returned from StatisticsMgr::Get
-   delete piGP;
-   delete piPF;
-   delete piPNF;
-   delete piRP;
-   delete piWP;
-   delete piFP;
+   // Latencies over all the files, in nanoseconds
+   // 各操作延迟的分位数(所有文件合计);按文件的明细见StatisticsMgr::Dump
+   const char *psNames[STAT_NUM_LATENCIES] = { "ReadPage", "WritePage",
+      "GetPage hit", "GetPage miss" };
+   cout << "Latencies (ns)          count       p50       p99      p999       max\n";
+   for (int i = 0; i < STAT_NUM_LATENCIES; i++) {
+      StatHistData data;
+      pStatisticsMgr->GetLatency(NULL, (Stat_Latency)i, data);
+      cout.width(14);
+      cout << left << psNames[i] << right;
+      cout.width(14); cout << data.lCount;
+      cout.width(10); cout << data.Percentile(0.50);
+      cout.width(10); cout << data.Percentile(0.99);
+      cout.width(10); cout << data.Percentile(0.999);
+      cout.width(10); cout << data.lMax << "\n";
+   }
+   cout << "-------------------\n";
 }
 
 #endif
@@ -0,0 +1,200 @@
+//
+// File:        pf_test10.cc
+// Description: Test of the coalesced writes of FlushPages and ForcePages
+//
+// Pages spread over several shards are dirtied in a scrambled order and
+// forced to disk.  The writes must be sorted and merged: one request per
+// PF_MAX_IOV adjacent pages.  A file with every other page dirty cannot be
+// merged at all.  The files are read back with another buffer manager.
+//
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <cstring>
+#include <unistd.h>
+#include "pf.h"
+#include "pf_testutil.h"
+#include "pf_internal.h"
+
+using namespace std;
+
+//
+// Defines
+//
+#define FILE1         "file1"
+#define NUM_PAGES     (2 * PF_MAX_IOV + 8)  // pages in the test file
+#define NUM_SHARDS    4                     // shards of the buffer
+#define STEP          37                    // scrambles the page order
+
+RC DirtyPages(int stride, int delta, int &numMerged, int &numWritten);
+RC CheckPages(int stride, int delta);
+
+//
+// DirtyPages
+//
+// Desc: Create FILE1 with NUM_PAGES pages holding their number, then add
+//       delta to every stride-th page, visiting the pages out of order,
+//       and force the file with one fdatasync
+// Out:  numMerged - coalesced writes of the force
+//       numWritten - pages written by the force
+//
+RC DirtyPages(int stride, int delta, int &numMerged, int &numWritten)
+{
+   PF_BufferConfig config(2 * NUM_PAGES, NUM_SHARDS);
+   config.bReadAhead = FALSE;
+   PF_Manager pfm(config);
+   PF_FileHandle fh;
+   PF_PageHandle ph;
+   RC rc;
+   char *pData;
+   PageNum pageNum;
+   int value;
+
+   unlink(FILE1);
+   if ((rc = pfm.CreateFile(FILE1)) ||
+         (rc = pfm.OpenFile(FILE1, fh)))
+      return (rc);
+
+   for (int i = 0; i < NUM_PAGES; i++) {
+      if ((rc = fh.AllocatePage(ph)) ||
+            (rc = ph.GetData(pData)) ||
+            (rc = ph.GetPageNum(pageNum)))
+         return (rc);
+
+      memcpy(pData, &pageNum, sizeof(pageNum));
+
+      if ((rc = fh.MarkDirty(pageNum)) ||
+            (rc = fh.UnpinPage(pageNum)))
+         return (rc);
+   }
+   if ((rc = fh.ForcePages()))
+      return (rc);
+
+   // STEP is prime to NUM_PAGES, so every page is visited once
+   for (int i = 0; i < NUM_PAGES; i++) {
+      pageNum = (i * STEP) % NUM_PAGES;
+      if (pageNum % stride)
+         continue;
+
+      if ((rc = fh.GetThisPage(pageNum, ph)) ||
+            (rc = ph.GetData(pData)))
+         return (rc);
+
+      memcpy(&value, pData, sizeof(value));
+      value += delta;
+      memcpy(pData, &value, sizeof(value));
+
+      if ((rc = fh.MarkDirty(pageNum)) ||
+            (rc = fh.UnpinPage(pageNum)))
+         return (rc);
+   }
+
+   long long mergedBefore = GetStat(PF_COALESCEDIO);
+   long long writtenBefore = GetStat(PF_WRITEPAGE);
+   if ((rc = fh.ForcePages(ALL_PAGES, TRUE)))
+      return (rc);
+   numMerged = GetStat(PF_COALESCEDIO) - mergedBefore;
+   numWritten = GetStat(PF_WRITEPAGE) - writtenBefore;
+
+   return (pfm.CloseFile(fh));
+}
+
+//
+// CheckPages
+//
+// Desc: Check that every stride-th page holds its number plus delta and
+//       the others their number
+//
+RC CheckPages(int stride, int delta)
+{
+   PF_Manager pfm;
+   PF_FileHandle fh;
+   PF_PageHandle ph;
+   RC rc;
+   char *pData;
+   int value;
+
+   if ((rc = pfm.OpenFile(FILE1, fh)))
+      return (rc);
+
+   for (int i = 0; i < NUM_PAGES; i++) {
+      if ((rc = fh.GetThisPage(i, ph)) ||
+            (rc = ph.GetData(pData)))
+         return (rc);
+
+      memcpy(&value, pData, sizeof(value));
+      if (value != i + (i % stride ? 0 : delta)) {
+         cout << "page " << i << " holds " << value << "\n";
+         exit(1);
+      }
+
+      if ((rc = fh.UnpinPage(i)))
+         return (rc);
+   }
+
+   return (pfm.CloseFile(fh));
+}
+
+RC TestPF()
+{
+   RC rc;
+   int numMerged, numWritten;
+
+   cout << "Forcing " << NUM_PAGES << " dirty pages: ";
+   if ((rc = DirtyPages(1, 1, numMerged, numWritten)) ||
+         (rc = CheckPages(1, 1)))
+      return (rc);
+   cout << numMerged << " coalesced writes\n";
+
+#ifdef PF_STATS
+   if (numWritten != NUM_PAGES ||
+         numMerged != (NUM_PAGES + PF_MAX_IOV - 1) / PF_MAX_IOV) {
+      cout << "the writes were not merged\n";
+      exit(1);
+   }
+#endif
+
+   cout << "Forcing every other page: ";
+   if ((rc = DirtyPages(2, 2, numMerged, numWritten)) ||
+         (rc = CheckPages(2, 2)))
+      return (rc);
+   cout << numMerged << " coalesced writes\n";
+
+#ifdef PF_STATS
+   if (numWritten != NUM_PAGES / 2 || numMerged != 0) {
+      cout << "pages that are not adjacent were merged\n";
+      exit(1);
+   }
+#endif
+
+   return (0);
+}
+
+int main()
+{
+   RC rc;
+
+   // Write out initial starting message
+   cerr.flush();
+   cout.flush();
+   cout << "********************\n";
+   cout << "Starting PF coalesced write test.\n";
+   cout.flush();
+
+   // Delete files from last time
+   unlink(FILE1);
+
+   if ((rc = TestPF())) {
+      PF_PrintError(rc);
+      return (1);
+   }
+
+   unlink(FILE1);
+
+   // Write ending message and exit
+   cout << "Ending PF coalesced write test.\n";
+   cout << "********************\n\n";
+
+   return (0);
+}
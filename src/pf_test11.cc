@@ -0,0 +1,300 @@
+//
+// File:        pf_test11.cc
+// Description: Test of the durability API (Sync, SyncFiles, CloseFile)
+//
+// Three files are opened, two of them are changed, and the group commit
+// of all three (one of them listed twice) must issue exactly two
+// fdatasync calls; committing again issues none.  A single file synced
+// after a change, and closed with bSync, costs one call each.  The sync
+// requests are checked with each I/O backend.  Last, pages are changed
+// and forced with bSync over and over while the background writer is
+// cleaning the same pages, and every force must have put the changes in
+// the file, also those of pages the writer was writing at the time.
+//
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <cstring>
+#include <unistd.h>
+#include <fcntl.h>
+#include "pf.h"
+#include "pf_testutil.h"
+#include "pf_internal.h"
+
+using namespace std;
+
+//
+// Defines
+//
+#define NUM_FILES     3
+#define NUM_PAGES     10                    // pages in each test file
+#define NUM_FORCES    200                   // forces with the writer running
+
+const char *psFiles[NUM_FILES] = { "file1", "file2", "file3" };
+
+RC CreateFiles(PF_Manager &pfm);
+RC ChangePage(PF_FileHandle &fh, PageNum pageNum);
+RC ExpectSyncs(const char *psWhat, long long syncsBefore, int numSyncs);
+RC TestSync(PF_IOBackend backend, const char *psName);
+RC TestForce();
+int ReadOnDisk(int fd, PageNum pageNum);
+
+//
+// CreateFiles
+//
+// Desc: Create the files with NUM_PAGES pages each
+//
+RC CreateFiles(PF_Manager &pfm)
+{
+   PF_FileHandle fh;
+   PF_PageHandle ph;
+   RC rc;
+   PageNum pageNum;
+
+   for (int f = 0; f < NUM_FILES; f++) {
+      unlink(psFiles[f]);
+      if ((rc = pfm.CreateFile(psFiles[f])) ||
+            (rc = pfm.OpenFile(psFiles[f], fh)))
+         return (rc);
+
+      for (int i = 0; i < NUM_PAGES; i++) {
+         if ((rc = fh.AllocatePage(ph)) ||
+               (rc = ph.GetPageNum(pageNum)) ||
+               (rc = fh.MarkDirty(pageNum)) ||
+               (rc = fh.UnpinPage(pageNum)))
+            return (rc);
+      }
+
+      if ((rc = pfm.CloseFile(fh)))
+         return (rc);
+   }
+
+   return (0);
+}
+
+//
+// ChangePage
+//
+// Desc: Add one to the first int of a page
+//
+RC ChangePage(PF_FileHandle &fh, PageNum pageNum)
+{
+   PF_PageHandle ph;
+   RC rc;
+   char *pData;
+
+   if ((rc = fh.GetThisPage(pageNum, ph)) ||
+         (rc = ph.GetData(pData)))
+      return (rc);
+
+   (*(int *)pData)++;
+
+   if ((rc = fh.MarkDirty(pageNum)) ||
+         (rc = fh.UnpinPage(pageNum)))
+      return (rc);
+
+   return (0);
+}
+
+//
+// ExpectSyncs
+//
+// Desc: Check that numSyncs fdatasync calls were made since syncsBefore
+//
+RC ExpectSyncs(const char *psWhat, long long syncsBefore, int numSyncs)
+{
+#ifdef PF_STATS
+   int n = GetStat(PF_SYNC) - syncsBefore;
+   cout << "  " << psWhat << ": " << n << " fdatasync\n";
+   if (n != numSyncs) {
+      cout << "expected " << numSyncs << "\n";
+      exit(1);
+   }
+#endif
+   return (0);
+}
+
+//
+// TestSync
+//
+// Desc: Run the group commit, Sync and CloseFile checks
+//
+RC TestSync(PF_IOBackend backend, const char *psName)
+{
+   PF_BufferConfig config;
+   config.ioBackend = backend;
+   PF_Manager pfm(config);
+   PF_FileHandle fh[NUM_FILES];
+   RC rc;
+   long long before;
+
+   cout << "Syncing through " << psName << ":\n";
+
+   if ((rc = CreateFiles(pfm)))
+      return (rc);
+
+   for (int f = 0; f < NUM_FILES; f++)
+      if ((rc = pfm.OpenFile(psFiles[f], fh[f])))
+         return (rc);
+
+   // The first two files change, the third is listed but clean
+   PF_FileHandle *group[] = { &fh[0], &fh[1], &fh[2], &fh[0] };
+   if ((rc = ChangePage(fh[0], 3)) ||
+         (rc = ChangePage(fh[1], 7)))
+      return (rc);
+
+   before = GetStat(PF_SYNC);
+   if ((rc = pfm.SyncFiles(group, 4)) ||
+         (rc = ExpectSyncs("group commit", before, 2)))
+      return (rc);
+
+   before = GetStat(PF_SYNC);
+   if ((rc = pfm.SyncFiles(group, 4)) ||
+         (rc = ExpectSyncs("group commit, nothing changed", before, 0)))
+      return (rc);
+
+   before = GetStat(PF_SYNC);
+   if ((rc = ChangePage(fh[2], 0)) ||
+         (rc = fh[2].Sync()) ||
+         (rc = fh[2].Sync()) ||
+         (rc = ExpectSyncs("file synced twice", before, 1)))
+      return (rc);
+
+   before = GetStat(PF_SYNC);
+   if ((rc = ChangePage(fh[1], 1)) ||
+         (rc = pfm.CloseFile(fh[1], TRUE)) ||
+         (rc = pfm.CloseFile(fh[0], TRUE)) ||
+         (rc = pfm.CloseFile(fh[2])) ||
+         (rc = ExpectSyncs("files closed", before, 1)))
+      return (rc);
+
+   // A closed file cannot be committed
+   if (pfm.SyncFiles(group, 1) != PF_CLOSEDFILE) {
+      cout << "a closed file was synced\n";
+      exit(1);
+   }
+
+   for (int f = 0; f < NUM_FILES; f++)
+      unlink(psFiles[f]);
+
+   return (0);
+}
+
+//
+// ReadOnDisk
+//
+// Desc: The first int of a page as it is in the file
+// In:   fd - the file, opened apart from the PF layer
+//
+int ReadOnDisk(int fd, PageNum pageNum)
+{
+   int value = -1;
+   long offset = PF_FILE_HDR_SIZE + pageNum * (long)PF_FILE_HDR_SIZE +
+      sizeof(PF_PageHdr);
+
+   if (pread(fd, &value, sizeof(value), offset) != sizeof(value)) {
+      cout << "cannot read page " << pageNum << " of the file\n";
+      exit(1);
+   }
+   return (value);
+}
+
+//
+// TestForce
+//
+// Desc: Change every page and force the file with bSync, NUM_FORCES
+//       times, with the background writer writing dirty pages as fast as
+//       it can.  After each force the file must hold every change.
+//
+RC TestForce()
+{
+   PF_BufferConfig config;
+   config.bBgWriter = TRUE;
+   config.bgDirtyPct = 0;
+   config.bReadAhead = FALSE;
+   PF_Manager pfm(config);
+   PF_FileHandle fh;
+   RC rc;
+
+   cout << "Forcing with the background writer running: ";
+
+   if ((rc = CreateFiles(pfm)) ||
+         (rc = pfm.OpenFile(psFiles[0], fh)))
+      return (rc);
+
+   int fd = open(psFiles[0], O_RDONLY);
+   if (fd < 0) {
+      cout << "cannot open " << psFiles[0] << "\n";
+      exit(1);
+   }
+
+   for (int n = 1; n <= NUM_FORCES; n++) {
+      for (int i = 0; i < NUM_PAGES; i++)
+         if ((rc = ChangePage(fh, i)))
+            return (rc);
+
+      // Alternate the single-page and the whole-file force
+      if (n % 2)
+         for (int i = 0; i < NUM_PAGES && !rc; i++)
+            rc = fh.ForcePages(i, TRUE);
+      else
+         rc = fh.ForcePages(ALL_PAGES, TRUE);
+      if (rc)
+         return (rc);
+
+      for (int i = 0; i < NUM_PAGES; i++) {
+         int value = ReadOnDisk(fd, i);
+         if (value != n) {
+            cout << "force " << n << ": page " << i << " holds " << value
+               << " in the file\n";
+            exit(1);
+         }
+      }
+   }
+
+   close(fd);
+   if ((rc = pfm.CloseFile(fh)))
+      return (rc);
+
+   for (int f = 0; f < NUM_FILES; f++)
+      unlink(psFiles[f]);
+
+   cout << "Pass\n";
+   return (0);
+}
+
+RC TestPF()
+{
+   RC rc;
+
+   if ((rc = TestSync(PF_IO_AUTO, "the default backend")) ||
+         (rc = TestSync(PF_IO_THREADS, "the thread pool")) ||
+         (rc = TestForce()))
+      return (rc);
+
+   return (0);
+}
+
+int main()
+{
+   RC rc;
+
+   // Write out initial starting message
+   cerr.flush();
+   cout.flush();
+   cout << "********************\n";
+   cout << "Starting PF durability test.\n";
+   cout.flush();
+
+   if ((rc = TestPF())) {
+      PF_PrintError(rc);
+      return (1);
+   }
+
+   // Write ending message and exit
+   cout << "Ending PF durability test.\n";
+   cout << "********************\n\n";
+
+   return (0);
+}
@@ -0,0 +1,303 @@
+//
+// File:        pf_test12.cc
+// Description: Test of the memory-mapped read-only mode (PF_OPEN_MMAP)
+//
+// A file is mapped through a buffer pool of two frames and scanned forward
+// with every page kept pinned, which the buffer could never hold: the
+// pages must come straight from the mapping, one after the other, without
+// a single GetPage.  The file is then scanned backward, the pins are
+// checked (double unpin, close with a page pinned), writes are refused,
+// and a change forced through an ordinary handle is seen in the mapping.
+//
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <cstring>
+#include <unistd.h>
+#include "pf.h"
+#include "pf_testutil.h"
+#include "pf_internal.h"
+
+using namespace std;
+
+//
+// Defines
+//
+#define FILE1         "file1"
+#define NUM_PAGES     (4 * PF_BUFFER_SIZE)  // pages in the test file
+#define FREE_STRIDE   10                    // every such page is disposed
+
+RC CreateHoledFile();
+RC ScanMapped(PF_FileHandle &fh);
+RC CheckRules(PF_FileHandle &fh);
+RC CheckShared(PF_Manager &pfm, PF_FileHandle &fh);
+RC TestMapped();
+
+//
+// CreateHoledFile
+//
+// Desc: Create FILE1 with NUM_PAGES pages holding their page number, and
+//       dispose of every FREE_STRIDE-th page
+//
+RC CreateHoledFile()
+{
+   PF_Manager pfm;
+   PF_FileHandle fh;
+   RC rc;
+
+   cout << "Creating file " << FILE1 << " with " << NUM_PAGES << " pages.\n";
+
+   if ((rc = CreateTestFile(pfm, FILE1, NUM_PAGES)) ||
+         (rc = pfm.OpenFile(FILE1, fh)))
+      return (rc);
+
+   for (int i = 0; i < NUM_PAGES; i += FREE_STRIDE)
+      if ((rc = fh.DisposePage(i)))
+         return (rc);
+
+   return (pfm.CloseFile(fh));
+}
+
+//
+// ScanMapped
+//
+// Desc: Scan the mapped file forward holding every page, then backward
+//
+RC ScanMapped(PF_FileHandle &fh)
+{
+   PF_PageHandle ph;
+   RC rc;
+   char *pData, *pPrev = NULL;
+   PageNum pageNum, prevNum = -1;
+   int value, numPages = 0;
+
+   cout << "Forward scan holding every page: ";
+
+   long long getsBefore = GetStat(PF_GETPAGE);
+
+   for (rc = fh.GetFirstPage(ph); rc == 0; rc = fh.GetNextPage(pageNum, ph)) {
+      if ((rc = ph.GetData(pData)) ||
+            (rc = ph.GetPageNum(pageNum)))
+         return (rc);
+
+      memcpy(&value, pData, sizeof(value));
+      if (value != pageNum || pageNum % FREE_STRIDE == 0) {
+         cout << "page " << pageNum << " holds " << value << "\n";
+         exit(1);
+      }
+
+      // The pages lie in the file's mapping, in file order
+      if (pPrev != NULL && pData - pPrev !=
+            (pageNum - prevNum) * (long)(PF_PAGE_SIZE + sizeof(PF_PageHdr))) {
+         cout << "page " << pageNum << " was copied\n";
+         exit(1);
+      }
+      pPrev = pData;
+      prevNum = pageNum;
+      numPages++;
+   }
+   if (rc != PF_EOF)
+      return (rc);
+
+   if (numPages != NUM_PAGES - NUM_PAGES / FREE_STRIDE) {
+      cout << "found " << numPages << " pages\n";
+      exit(1);
+   }
+#ifdef PF_STATS
+   if (GetStat(PF_GETPAGE) != getsBefore) {
+      cout << "the buffer was used\n";
+      exit(1);
+   }
+#endif
+   cout << numPages << " pages, Pass\n";
+
+   for (int i = 0; i < NUM_PAGES; i++)
+      if (i % FREE_STRIDE && (rc = fh.UnpinPage(i)))
+         return (rc);
+
+   cout << "Backward scan: ";
+
+   numPages = 0;
+   for (rc = fh.GetLastPage(ph); rc == 0; rc = fh.GetPrevPage(pageNum, ph)) {
+      if ((rc = ph.GetData(pData)) ||
+            (rc = ph.GetPageNum(pageNum)))
+         return (rc);
+
+      memcpy(&value, pData, sizeof(value));
+      if (value != pageNum) {
+         cout << "page " << pageNum << " holds " << value << "\n";
+         exit(1);
+      }
+
+      if ((rc = fh.UnpinPage(pageNum)))
+         return (rc);
+      numPages++;
+   }
+   if (rc != PF_EOF)
+      return (rc);
+
+   if (numPages != NUM_PAGES - NUM_PAGES / FREE_STRIDE) {
+      cout << "found " << numPages << " pages\n";
+      exit(1);
+   }
+   cout << numPages << " pages, Pass\n";
+
+   return (0);
+}
+
+//
+// CheckRules
+//
+// Desc: Pins of a mapped page count, and the file cannot be changed
+//
+RC CheckRules(PF_FileHandle &fh)
+{
+   PF_PageHandle ph, ph2;
+   RC rc;
+
+   cout << "Checking pins and writes: ";
+
+   if ((rc = fh.GetThisPage(1, ph)) ||
+         (rc = fh.GetThisPage(1, ph2)))
+      return (rc);
+
+   if (fh.MarkDirty(1) != PF_READONLY ||
+         fh.DisposePage(1) != PF_READONLY ||
+         fh.AllocatePage(ph2) != PF_READONLY) {
+      cout << "a mapped file was changed\n";
+      exit(1);
+   }
+
+   if (fh.GetThisPage(0, ph2) != PF_INVALIDPAGE) {
+      cout << "a free page was handed out\n";
+      exit(1);
+   }
+
+   if ((rc = fh.UnpinPage(1)))
+      return (rc);
+   if (fh.FlushPages() != PF_PAGEPINNED) {
+      cout << "a pinned page was not noticed\n";
+      exit(1);
+   }
+   if ((rc = fh.UnpinPage(1)))
+      return (rc);
+   if (fh.UnpinPage(1) != PF_PAGEUNPINNED) {
+      cout << "a page was unpinned twice\n";
+      exit(1);
+   }
+
+   cout << "Pass\n";
+   return (0);
+}
+
+//
+// CheckShared
+//
+// Desc: A page forced by an ordinary handle is seen through the mapping
+//
+RC CheckShared(PF_Manager &pfm, PF_FileHandle &fh)
+{
+   PF_FileHandle fh2;
+   PF_PageHandle ph;
+   RC rc;
+   char *pData;
+   int value = -1;
+
+   cout << "Checking a change forced meanwhile: ";
+
+   if ((rc = pfm.OpenFile(FILE1, fh2)) ||
+         (rc = fh2.GetThisPage(NUM_PAGES - 1, ph)) ||
+         (rc = ph.GetData(pData)))
+      return (rc);
+
+   memcpy(pData, &value, sizeof(value));
+
+   if ((rc = fh2.MarkDirty(NUM_PAGES - 1)) ||
+         (rc = fh2.UnpinPage(NUM_PAGES - 1)) ||
+         (rc = pfm.CloseFile(fh2)))
+      return (rc);
+
+   if ((rc = fh.GetThisPage(NUM_PAGES - 1, ph)) ||
+         (rc = ph.GetData(pData)))
+      return (rc);
+
+   memcpy(&value, pData, sizeof(value));
+   if (value != -1) {
+      cout << "the mapping holds " << value << "\n";
+      exit(1);
+   }
+
+   if ((rc = fh.UnpinPage(NUM_PAGES - 1)))
+      return (rc);
+
+   cout << "Pass\n";
+   return (0);
+}
+
+//
+// TestMapped
+//
+// Desc: Map FILE1 through a buffer of two frames and run the checks
+//
+RC TestMapped()
+{
+   PF_Manager pfm(PF_BufferConfig(2));
+   PF_FileHandle fh;
+   RC rc;
+
+   if ((rc = pfm.OpenFile(FILE1, fh, PF_OPEN_MMAP)))
+      return (rc);
+
+   if (!fh.IsMapped()) {
+      cout << "the file is not mapped\n";
+      exit(1);
+   }
+
+   if ((rc = ScanMapped(fh)) ||
+         (rc = CheckRules(fh)) ||
+         (rc = CheckShared(pfm, fh)) ||
+         (rc = pfm.CloseFile(fh)))
+      return (rc);
+
+   return (0);
+}
+
+RC TestPF()
+{
+   RC rc;
+
+   if ((rc = CreateHoledFile()) ||
+         (rc = TestMapped()))
+      return (rc);
+
+   return (0);
+}
+
+int main()
+{
+   RC rc;
+
+   // Write out initial starting message
+   cerr.flush();
+   cout.flush();
+   cout << "********************\n";
+   cout << "Starting PF memory-mapped file test.\n";
+   cout.flush();
+
+   // Delete files from last time
+   unlink(FILE1);
+
+   if ((rc = TestPF())) {
+      PF_PrintError(rc);
+      return (1);
+   }
+
+   unlink(FILE1);
+
+   // Write ending message and exit
+   cout << "Ending PF memory-mapped file test.\n";
+   cout << "********************\n\n";
+
+   return (0);
+}
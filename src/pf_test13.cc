@@ -0,0 +1,343 @@
+//
+// File:        pf_test13.cc
+// Description: Test of the latency histograms and 64-bit statistics
+//
+// The bucket bounds of the histograms are checked on values of every
+// size, and the percentiles of a known distribution.  Two files are then
+// read and written through a buffer manager: each file must have its own
+// ReadPage, WritePage and GetPage hit/miss latencies, which add up to the
+// totals, and the JSON and CSV dumps must name them.  Last, counters are
+// pushed beyond what an int holds.
+//
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <cstring>
+#include <climits>
+#include <unistd.h>
+#include "pf.h"
+#include "pf_testutil.h"
+#include "pf_internal.h"
+
+using namespace std;
+
+#ifdef PF_STATS
+#include "statistics.h"
+
+// This is defined within pf_buffermgr.cc
+extern StatisticsMgr *pStatisticsMgr;
+#endif
+
+//
+// Defines
+//
+#define FILE1         "file1"
+#define FILE2         "file2"
+#define NUM_PAGES     50                    // pages in each test file
+#define NUM_VALUES    10000                 // values of the distribution
+
+#ifdef PF_STATS
+
+RC ReadAll(PF_FileHandle &fh, int bDirty);
+void CheckBuckets();
+void CheckPercentiles();
+RC CheckFiles(PF_Manager &pfm);
+void CheckDump();
+void CheckWide();
+long long Count(const char *psName, Stat_Latency latency);
+
+//
+// Count
+//
+// Desc: # of latencies of an operation recorded for a file (NULL: all)
+//
+long long Count(const char *psName, Stat_Latency latency)
+{
+   StatHistData data;
+   if (pStatisticsMgr->GetLatency(psName, latency, data)) {
+      cout << "no latencies for " << psName << "\n";
+      exit(1);
+   }
+   return (data.lCount);
+}
+
+//
+// ReadAll
+//
+// Desc: Get and unpin every page of a file, dirtying them if asked
+//
+RC ReadAll(PF_FileHandle &fh, int bDirty)
+{
+   PF_PageHandle ph;
+   RC rc;
+
+   for (int i = 0; i < NUM_PAGES; i++) {
+      if ((rc = fh.GetThisPage(i, ph)) ||
+            (bDirty && (rc = fh.MarkDirty(i))) ||
+            (rc = fh.UnpinPage(i)))
+         return (rc);
+   }
+
+   return (0);
+}
+
+//
+// CheckBuckets
+//
+// Desc: Every value lies within the bounds of its bucket, and the buckets
+//       are no wider than a STAT_HIST_SUB-th of their start
+//
+void CheckBuckets()
+{
+   cout << "Checking the histogram buckets: ";
+
+   for (long long v = 0; v < LLONG_MAX / 3; v = v * 3 / 2 + 1) {
+      int b = StatHistogram::Bucket(v);
+      long long lStart = StatHistogram::BucketStart(b);
+      long long lEnd = StatHistogram::BucketStart(b + 1);
+      if (b < 0 || b >= STAT_HIST_BUCKETS || v < lStart || v >= lEnd ||
+            (lStart >= STAT_HIST_SUB && lEnd - lStart > lStart / STAT_HIST_SUB)) {
+         cout << v << " is in bucket " << b << " [" << lStart << ", "
+            << lEnd << ")\n";
+         exit(1);
+      }
+   }
+
+   cout << "Pass\n";
+}
+
+//
+// CheckPercentiles
+//
+// Desc: The percentiles of 1..NUM_VALUES are found within a bucket
+//
+void CheckPercentiles()
+{
+   StatHistogram hist;
+   StatHistData data;
+
+   cout << "Checking the percentiles: ";
+
+   for (int i = 1; i <= NUM_VALUES; i++)
+      hist.Record(i);
+   hist.Read(data);
+
+   double adFractions[] = { 0.50, 0.99, 0.999 };
+   long long lPrev = 0;
+   for (int i = 0; i < 3; i++) {
+      long long lExpected = (long long)(adFractions[i] * NUM_VALUES);
+      long long lValue = data.Percentile(adFractions[i]);
+      if (lValue < lPrev || lValue > data.lMax ||
+            llabs(lValue - lExpected) > lExpected / STAT_HIST_SUB) {
+         cout << "percentile " << adFractions[i] << " is " << lValue << "\n";
+         exit(1);
+      }
+      lPrev = lValue;
+   }
+
+   if (data.lCount != NUM_VALUES || data.lMax != NUM_VALUES ||
+         data.lSum != (long long)NUM_VALUES * (NUM_VALUES + 1) / 2) {
+      cout << "count " << data.lCount << ", max " << data.lMax << ", sum "
+         << data.lSum << "\n";
+      exit(1);
+   }
+
+   cout << "p50 " << data.Percentile(0.50) << ", p99 "
+      << data.Percentile(0.99) << ", p999 " << data.Percentile(0.999)
+      << ", Pass\n";
+}
+
+//
+// CheckFiles
+//
+// Desc: Read FILE1 twice (misses then hits) and dirty FILE2, and check
+//       the latencies recorded for each
+//
+RC CheckFiles(PF_Manager &pfm)
+{
+   PF_FileHandle fh1, fh2;
+   RC rc;
+
+   cout << "Checking the latencies of two files: ";
+
+   if ((rc = CreateTestFile(pfm, FILE1, NUM_PAGES)) ||
+         (rc = CreateTestFile(pfm, FILE2, NUM_PAGES)))
+      return (rc);
+
+   pStatisticsMgr->Reset();
+
+   if ((rc = pfm.OpenFile(FILE1, fh1)) ||
+         (rc = pfm.OpenFile(FILE2, fh2)) ||
+         (rc = ReadAll(fh1, FALSE)) ||
+         (rc = ReadAll(fh1, FALSE)) ||
+         (rc = ReadAll(fh2, TRUE)) ||
+         (rc = fh2.ForcePages()) ||
+         (rc = pfm.CloseFile(fh1)) ||
+         (rc = pfm.CloseFile(fh2)))
+      return (rc);
+
+   // The pages of FILE2 are adjacent: one write per PF_MAX_IOV of them
+   long long lWrites = (NUM_PAGES + PF_MAX_IOV - 1) / PF_MAX_IOV;
+   if (Count(FILE1, STAT_LAT_GETMISS) != NUM_PAGES ||
+         Count(FILE1, STAT_LAT_GETHIT) != NUM_PAGES ||
+         Count(FILE1, STAT_LAT_READPAGE) != NUM_PAGES ||
+         Count(FILE1, STAT_LAT_WRITEPAGE) != 0 ||
+         Count(FILE2, STAT_LAT_GETMISS) != NUM_PAGES ||
+         Count(FILE2, STAT_LAT_GETHIT) != 0 ||
+         Count(FILE2, STAT_LAT_WRITEPAGE) != lWrites) {
+      cout << "the latencies were not recorded per file\n";
+      exit(1);
+   }
+
+   for (int i = 0; i < STAT_NUM_LATENCIES; i++) {
+      Stat_Latency latency = (Stat_Latency)i;
+      if (Count(NULL, latency) != Count(FILE1, latency) + Count(FILE2, latency)) {
+         cout << "the totals do not add up\n";
+         exit(1);
+      }
+   }
+
+   // A miss reads the page, so it takes longer than the read alone
+   StatHistData miss, read;
+   pStatisticsMgr->GetLatency(FILE1, STAT_LAT_GETMISS, miss);
+   pStatisticsMgr->GetLatency(FILE1, STAT_LAT_READPAGE, read);
+   if (miss.lSum < read.lSum || miss.Percentile(0.50) > miss.Percentile(0.99) ||
+         miss.Percentile(0.99) > miss.Percentile(0.999) ||
+         miss.Percentile(0.999) > miss.lMax) {
+      cout << "the miss latencies are out of order\n";
+      exit(1);
+   }
+
+   StatHistData data;
+   if (pStatisticsMgr->GetLatency("nofile", STAT_LAT_READPAGE, data) !=
+         STAT_UNKNOWN_KEY) {
+      cout << "a file never opened has latencies\n";
+      exit(1);
+   }
+
+   cout << "Pass\n";
+   return (0);
+}
+
+//
+// CheckDump
+//
+// Desc: Both formats hold the counters and a summary per file
+//
+void CheckDump()
+{
+   ostringstream json, csv;
+
+   cout << "Checking the dumps: ";
+
+   pStatisticsMgr->Dump(json, STAT_FORMAT_JSON);
+   pStatisticsMgr->Dump(csv, STAT_FORMAT_CSV);
+
+   const char *psJson[] = { "\"counters\"", "\"GETPAGE\": ",
+      "\"latencies\"", "{\"file\": \"file1\", \"fd\": -1, \"op\": \"GETMISS\"",
+      "\"file\": \"file2\"", "\"file\": \"*\"", "\"p999_ns\"" };
+   const char *psCsv[] = { "file,fd,metric,count,sum_ns,max_ns,p50_ns,p99_ns,p999_ns\n",
+      ",,GETPAGE,", "\nfile1,-1,READPAGE,50,", "\nfile2,-1,WRITEPAGE,",
+      "\n*,-1,GETHIT,50," };
+
+   for (unsigned int i = 0; i < sizeof(psJson) / sizeof(psJson[0]); i++)
+      if (json.str().find(psJson[i]) == string::npos) {
+         cout << "no " << psJson[i] << " in\n" << json.str();
+         exit(1);
+      }
+   for (unsigned int i = 0; i < sizeof(psCsv) / sizeof(psCsv[0]); i++)
+      if (csv.str().find(psCsv[i]) == string::npos) {
+         cout << "no " << psCsv[i] << " in\n" << csv.str();
+         exit(1);
+      }
+
+   cout << "Pass\n";
+}
+
+//
+// CheckWide
+//
+// Desc: Counters go beyond INT_MAX, both fixed and registered ones
+//
+void CheckWide()
+{
+   long long lValue;
+   int iValue = INT_MAX;
+
+   cout << "Checking 64-bit counters: ";
+
+   pStatisticsMgr->Add(STAT_PF_SYNCUSEC, 3LL << 32);
+   pStatisticsMgr->Add(STAT_PF_SYNCUSEC, 1);
+   pStatisticsMgr->Register("WIDE", STAT_SETVALUE, &iValue);
+   pStatisticsMgr->Register("WIDE", STAT_ADDVALUE, &iValue);
+   pStatisticsMgr->Register("WIDE", STAT_ADDONE);
+
+   if (pStatisticsMgr->GetValue(PF_SYNCUSEC, lValue) ||
+         lValue != (3LL << 32) + 1) {
+      cout << "SYNCUSEC is " << lValue << "\n";
+      exit(1);
+   }
+   if (pStatisticsMgr->GetValue("WIDE", lValue) ||
+         lValue != 2LL * INT_MAX + 1) {
+      cout << "WIDE is " << lValue << "\n";
+      exit(1);
+   }
+
+   pStatisticsMgr->Reset(PF_SYNCUSEC);
+   pStatisticsMgr->Reset("WIDE");
+
+   cout << "Pass\n";
+}
+
+#endif
+
+RC TestPF()
+{
+#ifdef PF_STATS
+   // The statistics manager lives as long as the buffer manager
+   PF_BufferConfig config(4 * NUM_PAGES);
+   config.bReadAhead = FALSE;
+   PF_Manager pfm(config);
+   RC rc;
+
+   CheckBuckets();
+   CheckPercentiles();
+
+   if ((rc = CheckFiles(pfm)))
+      return (rc);
+
+   CheckDump();
+   CheckWide();
+#else
+   cout << "Built without PF_STATS, nothing to test\n";
+#endif
+   return (0);
+}
+
+int main()
+{
+   RC rc;
+
+   // Write out initial starting message
+   cerr.flush();
+   cout.flush();
+   cout << "********************\n";
+   cout << "Starting PF latency statistics test.\n";
+   cout.flush();
+
+   if ((rc = TestPF())) {
+      PF_PrintError(rc);
+      return (1);
+   }
+
+   unlink(FILE1);
+   unlink(FILE2);
+
+   // Write ending message and exit
+   cout << "Ending PF latency statistics test.\n";
+   cout << "********************\n\n";
+
+   return (0);
+}
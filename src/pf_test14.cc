@@ -0,0 +1,326 @@
+//
+// File:        pf_test14.cc
+// Description: Test of the buffer pool snapshots (PF_Manager::GetSnapshot)
+//
+// Two files are read through one LRU shard in a known order, some pages
+// are pinned or dirtied, and the snapshot must count the frames of each
+// file, their age classes, and the hits and misses of each file.  The
+// counts restart with ResetAccessCounts and when a descriptor is closed.
+// Last, snapshots are taken over and over while another thread reads
+// pages: the pool keeps going and every snapshot adds up.
+//
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <cstring>
+#include <thread>
+#include <atomic>
+#include <unistd.h>
+#include "pf.h"
+#include "pf_testutil.h"
+#include "pf_internal.h"
+
+using namespace std;
+
+//
+// Defines
+//
+#define FILE1         "file1"
+#define FILE2         "file2"
+#define NUM_PAGES     10                    // pages in each test file
+#define NUM_FRAMES    20                    // frames of the buffer
+#define NUM_SNAPSHOTS 2000                  // taken while a thread reads,
+#define MIN_READS     10000                 //   at least that many pages
+
+//
+// Reader thread of CheckConcurrent
+//
+struct Reader {
+   PF_FileHandle     *pFileHandle;          // file read
+   atomic<int>       *pbStop;               // set when the snapshots are done
+   RC                rc;                    // result of the thread
+   atomic<int>       numReads;              // pages read
+   atomic<int>       bDone;                 // set when the thread stops
+};
+
+RC GetPages(PF_FileHandle &fh, int first, int last, int bDirty);
+RC CheckCounts(PF_Manager &pfm, PF_FileHandle &fh1, PF_FileHandle &fh2);
+RC CheckReset(PF_Manager &pfm, PF_FileHandle &fh1, PF_FileHandle &fh2);
+void ReaderMain(Reader *r);
+RC CheckConcurrent();
+void Expect(const char *psWhat, long long value, long long expected);
+
+//
+// Expect
+//
+// Desc: Exit if a count is not as expected
+//
+void Expect(const char *psWhat, long long value, long long expected)
+{
+   if (value != expected) {
+      cout << psWhat << " is " << value << ", not " << expected << "\n";
+      exit(1);
+   }
+}
+
+//
+// GetPages
+//
+// Desc: Get and unpin pages [first, last] of a file, dirtying them if
+//       asked
+//
+RC GetPages(PF_FileHandle &fh, int first, int last, int bDirty)
+{
+   PF_PageHandle ph;
+   RC rc;
+
+   for (int i = first; i <= last; i++) {
+      if ((rc = fh.GetThisPage(i, ph)) ||
+            (bDirty && (rc = fh.MarkDirty(i))) ||
+            (rc = fh.UnpinPage(i)))
+         return (rc);
+   }
+
+   return (0);
+}
+
+//
+// CheckCounts
+//
+// Desc: Read FILE1 pages 0-9, FILE2 pages 0-3 (dirtied), FILE1 pages 0-4
+//       again, pin FILE1 page 9, and check the snapshot.  The LRU order is
+//       then, hottest first: 1/9 1/4..1/0 2/3..2/0 1/8..1/5.
+//
+RC CheckCounts(PF_Manager &pfm, PF_FileHandle &fh1, PF_FileHandle &fh2)
+{
+   PF_PageHandle ph;
+   PF_BufferSnapshot snapshot;
+   PF_FileSnapshot files[2], one;
+   RC rc;
+
+   cout << "Checking the snapshot of two files: ";
+
+   if ((rc = GetPages(fh1, 0, NUM_PAGES - 1, FALSE)) ||
+         (rc = GetPages(fh2, 0, 3, TRUE)) ||
+         (rc = GetPages(fh1, 0, 4, FALSE)) ||
+         (rc = fh1.GetThisPage(9, ph)) ||
+         (rc = pfm.GetSnapshot(snapshot, files, 2)))
+      return (rc);
+
+   Expect("numPages", snapshot.numPages, NUM_FRAMES);
+   Expect("numFree", snapshot.numFree, NUM_FRAMES - NUM_PAGES - 4);
+   Expect("numFiles", snapshot.numFiles, 2);
+   Expect("total resident", snapshot.total.numResident, NUM_PAGES + 4);
+   Expect("total hits", snapshot.total.numHits, 6);
+   Expect("total misses", snapshot.total.numMisses, NUM_PAGES + 4);
+
+   // files[] is in descriptor order
+   if (files[0].fd >= files[1].fd) {
+      cout << "the files are not in descriptor order\n";
+      exit(1);
+   }
+   if ((rc = fh1.GetSnapshot(one)))
+      return (rc);
+   PF_FileSnapshot &f1 = files[files[0].fd == one.fd ? 0 : 1];
+   PF_FileSnapshot &f2 = files[files[0].fd == one.fd ? 1 : 0];
+
+   Expect("file1 resident", f1.numResident, NUM_PAGES);
+   Expect("file1 pinned", f1.numPinned, 1);
+   Expect("file1 dirty", f1.numDirty, 0);
+   Expect("file1 hits", f1.numHits, 6);
+   Expect("file1 misses", f1.numMisses, NUM_PAGES);
+   Expect("file2 resident", f2.numResident, 4);
+   Expect("file2 dirty", f2.numDirty, 4);
+   Expect("file2 hits", f2.numHits, 0);
+   Expect("file2 misses", f2.numMisses, 4);
+
+   // 1/9 was touched last; 1/4..1/0 follow, 1/5..1/8 are the coldest
+   // and FILE2 is in between
+   Expect("file1 hottest", f1.ageHist[0], 1);
+   Expect("file1 coldest", f1.ageHist[PF_AGE_CLASSES - 1], 2);
+   Expect("file2 hottest", f2.ageHist[0], 0);
+   Expect("file2 coldest", f2.ageHist[PF_AGE_CLASSES - 1], 0);
+   for (int f = 0; f < 2; f++) {
+      int sum = 0;
+      for (int i = 0; i < PF_AGE_CLASSES; i++)
+         sum += files[f].ageHist[i];
+      Expect("frames by age", sum, files[f].numResident);
+   }
+
+   // A snapshot of one file is the same
+   if ((rc = fh2.GetSnapshot(one)))
+      return (rc);
+   Expect("fd", one.fd, f2.fd);
+   Expect("file2 alone resident", one.numResident, f2.numResident);
+   Expect("file2 alone dirty", one.numDirty, f2.numDirty);
+   Expect("file2 alone misses", one.numMisses, f2.numMisses);
+
+   // Without room for the files, only the totals
+   PF_BufferSnapshot totals;
+   if ((rc = pfm.GetSnapshot(totals)))
+      return (rc);
+   Expect("numFiles", totals.numFiles, 2);
+   Expect("total pinned", totals.total.numPinned, 1);
+
+   if ((rc = fh1.UnpinPage(9)))
+      return (rc);
+
+   printf("file1 hit ratio %.2f, Pass\n", f1.HitRatio());
+   return (0);
+}
+
+//
+// CheckReset
+//
+// Desc: The counts restart on ResetAccessCounts, and for a descriptor
+//       when its file is closed; the frames are not affected
+//
+RC CheckReset(PF_Manager &pfm, PF_FileHandle &fh1, PF_FileHandle &fh2)
+{
+   PF_FileSnapshot one;
+   RC rc;
+
+   cout << "Checking the resets: ";
+
+   if ((rc = pfm.ResetAccessCounts()) ||
+         (rc = GetPages(fh2, 0, 1, FALSE)) ||
+         (rc = fh2.GetSnapshot(one)))
+      return (rc);
+   Expect("hits after reset", one.numHits, 2);
+   Expect("misses after reset", one.numMisses, 0);
+   Expect("frames after reset", one.numResident, 4);
+
+   // The descriptor of FILE1 is reused by the file opened next
+   if ((rc = pfm.CloseFile(fh1)) ||
+         (rc = pfm.OpenFile(FILE1, fh1)) ||
+         (rc = fh1.GetSnapshot(one)))
+      return (rc);
+   Expect("hits after reopening", one.numHits, 0);
+   Expect("frames after reopening", one.numResident, 0);
+
+   cout << "Pass\n";
+   return (0);
+}
+
+//
+// ReaderMain
+//
+// Desc: Body of the reader thread: read the pages round and round
+//
+void ReaderMain(Reader *r)
+{
+   while (!r->pbStop->load() && r->rc == 0) {
+      r->rc = GetPages(*r->pFileHandle, 0, NUM_PAGES - 1, r->numReads % 3 == 0);
+      r->numReads += NUM_PAGES;
+   }
+   r->bDone.store(TRUE);
+}
+
+//
+// CheckConcurrent
+//
+// Desc: Snapshots taken while a thread reads pages through two shards
+//
+RC CheckConcurrent()
+{
+   PF_BufferConfig config(NUM_PAGES / 2, 2);
+   config.bReadAhead = FALSE;
+   PF_Manager pfm(config);
+   PF_FileHandle fh;
+   RC rc;
+   atomic<int> bStop(FALSE);
+   Reader reader;
+
+   cout << "Taking snapshots while pages are read: ";
+
+   if ((rc = pfm.OpenFile(FILE1, fh)))
+      return (rc);
+
+   reader.pFileHandle = &fh;
+   reader.pbStop = &bStop;
+   reader.rc = 0;
+   reader.numReads.store(0);
+   reader.bDone.store(FALSE);
+   thread t(ReaderMain, &reader);
+
+   long long lastAccesses = 0;
+   // On one CPU the reader may only run when the snapshots yield to it
+   for (int i = 0; i < NUM_SNAPSHOTS ||
+         (reader.numReads.load() < MIN_READS && !reader.bDone.load()); i++) {
+      PF_BufferSnapshot snapshot;
+      PF_FileSnapshot file;
+      if ((rc = pfm.GetSnapshot(snapshot, &file, 1)))
+         break;
+
+      // Each shard is counted whole, so the frames add up
+      long long accesses = snapshot.total.numHits + snapshot.total.numMisses;
+      if (snapshot.total.numResident + snapshot.numFree != NUM_PAGES / 2 ||
+            snapshot.total.numResident > NUM_PAGES / 2 ||
+            accesses < lastAccesses ||
+            (snapshot.numFiles == 1 && file.numResident != snapshot.total.numResident)) {
+         cout << "snapshot " << i << " does not add up\n";
+         exit(1);
+      }
+      lastAccesses = accesses;
+      this_thread::yield();
+   }
+
+   bStop.store(TRUE);
+   t.join();
+   if (rc || (rc = reader.rc))
+      return (rc);
+
+   cout << reader.numReads.load() << " pages read meanwhile, Pass\n";
+   return (pfm.CloseFile(fh));
+}
+
+RC TestPF()
+{
+   PF_BufferConfig config(NUM_FRAMES);
+   config.bReadAhead = FALSE;
+   PF_Manager pfm(config);
+   PF_FileHandle fh1, fh2;
+   RC rc;
+
+   if ((rc = CreateTestFile(pfm, FILE1, NUM_PAGES)) ||
+         (rc = CreateTestFile(pfm, FILE2, NUM_PAGES)) ||
+         (rc = pfm.ClearBuffer()) ||
+         (rc = pfm.ResetAccessCounts()) ||
+         (rc = pfm.OpenFile(FILE1, fh1)) ||
+         (rc = pfm.OpenFile(FILE2, fh2)) ||
+         (rc = CheckCounts(pfm, fh1, fh2)) ||
+         (rc = CheckReset(pfm, fh1, fh2)) ||
+         (rc = pfm.CloseFile(fh1)) ||
+         (rc = pfm.CloseFile(fh2)) ||
+         (rc = CheckConcurrent()))
+      return (rc);
+
+   return (0);
+}
+
+int main()
+{
+   RC rc;
+
+   // Write out initial starting message
+   cerr.flush();
+   cout.flush();
+   cout << "********************\n";
+   cout << "Starting PF buffer snapshot test.\n";
+   cout.flush();
+
+   if ((rc = TestPF())) {
+      PF_PrintError(rc);
+      return (1);
+   }
+
+   unlink(FILE1);
+   unlink(FILE2);
+
+   // Write ending message and exit
+   cout << "Ending PF buffer snapshot test.\n";
+   cout << "********************\n\n";
+
+   return (0);
+}
@@ -0,0 +1,334 @@
+//
+// File:        pf_test15.cc
+// Description: Test of the buffer warm-up list (PF_BufferConfig::psWarmFile)
+//
+// A file is read through a small buffer, then the PF_Manager goes away:
+// the pages it held must be saved hottest first.  The next PF_Manager
+// must have them in the buffer as soon as the file is opened, and serve
+// every one of them without reading it again.  Lists of a bigger buffer,
+// of pages past the end of the file and in another format are checked
+// as well, and the list named by REDBASE_PF_WARMUP.
+//
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <cstring>
+#include <unistd.h>
+#include "pf.h"
+#include "pf_testutil.h"
+#include "pf_internal.h"
+
+using namespace std;
+
+//
+// Defines
+//
+#define FILE1         "file1"
+#define WARM_FILE     "file1.warm"
+#define NUM_PAGES     60                    // pages in the test file
+#define NUM_FRAMES    20                    // frames of the buffer
+#define HOT_FIRST     50                    // pages read again last
+#define HOT_LAST      54
+
+RC ReadPages(PF_FileHandle &fh, int first, int last);
+RC RunCold();
+RC RunWarm();
+RC CheckLists();
+RC CheckEnv();
+RC OpenResident(int numFrames, int &numResident);
+void ReadList(string lines[], int maxLines, int &numLines);
+
+//
+// ReadPages
+//
+// Desc: Get, check and unpin pages [first, last]
+//
+RC ReadPages(PF_FileHandle &fh, int first, int last)
+{
+   PF_PageHandle ph;
+   RC rc;
+   char *pData;
+   int value;
+
+   for (int i = first; i <= last; i++) {
+      if ((rc = fh.GetThisPage(i, ph)) ||
+            (rc = ph.GetData(pData)))
+         return (rc);
+
+      memcpy(&value, pData, sizeof(value));
+      if (value != i) {
+         cout << "page " << i << " holds " << value << "\n";
+         exit(1);
+      }
+
+      if ((rc = fh.UnpinPage(i)))
+         return (rc);
+   }
+
+   return (0);
+}
+
+//
+// ReadList
+//
+// Desc: Read the lines of WARM_FILE
+//
+void ReadList(string lines[], int maxLines, int &numLines)
+{
+   ifstream in(WARM_FILE);
+
+   numLines = 0;
+   while (numLines < maxLines && getline(in, lines[numLines]))
+      numLines++;
+}
+
+//
+// RunCold
+//
+// Desc: Read the whole file through NUM_FRAMES frames, then pages
+//       HOT_FIRST..HOT_LAST again; the list must hold the last NUM_FRAMES
+//       pages, HOT_LAST first
+//
+RC RunCold()
+{
+   RC rc;
+
+   cout << "Saving the resident pages: ";
+   unlink(WARM_FILE);
+
+   {
+      PF_BufferConfig config(NUM_FRAMES);
+      config.bReadAhead = FALSE;
+      config.psWarmFile = WARM_FILE;
+      PF_Manager pfm(config);
+      PF_FileHandle fh;
+
+      if ((rc = pfm.OpenFile(FILE1, fh)) ||
+            (rc = ReadPages(fh, 0, NUM_PAGES - 1)) ||
+            (rc = ReadPages(fh, HOT_FIRST, HOT_LAST)) ||
+            (rc = pfm.CloseFile(fh)))
+         return (rc);
+   }
+
+   string lines[NUM_PAGES];
+   int numLines;
+   ReadList(lines, NUM_PAGES, numLines);
+
+   if (numLines != NUM_FRAMES + 1 || lines[0] != "redbase-pf-warmup 1" ||
+         lines[1] != "54 " FILE1 || lines[HOT_LAST - HOT_FIRST + 2] != "59 " FILE1 ||
+         lines[NUM_FRAMES] != "40 " FILE1) {
+      cout << numLines << " lines, first " << lines[1] << ", last "
+         << lines[numLines - 1] << "\n";
+      exit(1);
+   }
+
+   cout << NUM_FRAMES << " pages, Pass\n";
+   return (0);
+}
+
+//
+// RunWarm
+//
+// Desc: The pages of the list are in the buffer once the file is opened,
+//       and reading them does not read anything more
+//
+RC RunWarm()
+{
+   PF_BufferConfig config(NUM_FRAMES);
+   config.bReadAhead = FALSE;
+   config.psWarmFile = WARM_FILE;
+   PF_Manager pfm(config);
+   PF_FileHandle fh;
+   PF_FileSnapshot snapshot;
+   RC rc;
+
+   cout << "Warming up on open: ";
+
+   long long readsBefore = GetStat(PF_READPAGE);
+
+   if ((rc = pfm.OpenFile(FILE1, fh)) ||
+         (rc = fh.GetSnapshot(snapshot)))
+      return (rc);
+
+   if (snapshot.numResident != NUM_FRAMES) {
+      cout << snapshot.numResident << " pages in the buffer\n";
+      exit(1);
+   }
+
+   if ((rc = ReadPages(fh, NUM_PAGES - NUM_FRAMES, NUM_PAGES - 1)) ||
+         (rc = pfm.ResetAccessCounts()) ||
+         (rc = ReadPages(fh, NUM_PAGES - NUM_FRAMES, NUM_PAGES - 1)) ||
+         (rc = fh.GetSnapshot(snapshot)))
+      return (rc);
+
+#ifdef PF_STATS
+   if (GetStat(PF_READPAGE) - readsBefore != NUM_FRAMES) {
+      cout << GetStat(PF_READPAGE) - readsBefore << " pages read\n";
+      exit(1);
+   }
+#endif
+   if (snapshot.numHits != NUM_FRAMES || snapshot.numMisses != 0) {
+      cout << snapshot.numHits << " hits and " << snapshot.numMisses
+         << " misses\n";
+      exit(1);
+   }
+
+   cout << "Pass\n";
+   return (pfm.CloseFile(fh));
+}
+
+//
+// OpenResident
+//
+// Desc: Open FILE1 with the list through a buffer of numFrames frames
+// Out:  numResident - pages of FILE1 in the buffer right after
+//
+RC OpenResident(int numFrames, int &numResident)
+{
+   PF_BufferConfig config(numFrames);
+   config.bReadAhead = FALSE;
+   config.psWarmFile = WARM_FILE;
+   PF_Manager pfm(config);
+   PF_FileHandle fh;
+   PF_FileSnapshot snapshot;
+   RC rc;
+
+   if ((rc = pfm.OpenFile(FILE1, fh)) ||
+         (rc = fh.GetSnapshot(snapshot)) ||
+         (rc = ReadPages(fh, 0, NUM_PAGES - 1)) ||
+         (rc = pfm.CloseFile(fh)))
+      return (rc);
+
+   numResident = snapshot.numResident;
+   return (0);
+}
+
+//
+// CheckLists
+//
+// Desc: A smaller buffer takes the hottest pages of the list; pages past
+//       the end of the file, other files and lines of another format are
+//       ignored
+//
+RC CheckLists()
+{
+   RC rc;
+   int numResident;
+
+   cout << "Checking other lists: ";
+
+   {
+      ofstream out(WARM_FILE);
+      out << "redbase-pf-warmup 1\n";
+      out << "1000 " FILE1 "\n";
+      out << "3 nofile\n";
+      out << "garbage\n";
+      for (int i = 0; i < NUM_FRAMES; i++)
+         out << i << " " FILE1 "\n";
+   }
+   if ((rc = OpenResident(NUM_FRAMES / 2, numResident)))
+      return (rc);
+   // The first two lines take room in the list, but not in the buffer
+   if (numResident != NUM_FRAMES / 2 - 2) {
+      cout << numResident << " pages from the list of a bigger buffer\n";
+      exit(1);
+   }
+
+   {
+      ofstream out(WARM_FILE);
+      out << "redbase-pf-warmup 0\n";
+      out << "1 " FILE1 "\n";
+   }
+   if ((rc = OpenResident(NUM_FRAMES, numResident)))
+      return (rc);
+   if (numResident != 0) {
+      cout << numResident << " pages from a list of another format\n";
+      exit(1);
+   }
+
+   cout << "Pass\n";
+   return (0);
+}
+
+//
+// CheckEnv
+//
+// Desc: REDBASE_PF_WARMUP names the list of the default PF_Manager
+//
+RC CheckEnv()
+{
+   RC rc;
+
+   cout << "Naming the list in the environment: ";
+
+   unlink(WARM_FILE);
+   setenv("REDBASE_PF_WARMUP", WARM_FILE, 1);
+   {
+      PF_Manager pfm;
+      PF_FileHandle fh;
+
+      if ((rc = pfm.OpenFile(FILE1, fh)) ||
+            (rc = ReadPages(fh, 0, 4)) ||
+            (rc = pfm.CloseFile(fh)))
+         return (rc);
+   }
+   unsetenv("REDBASE_PF_WARMUP");
+
+   string lines[NUM_PAGES];
+   int numLines;
+   ReadList(lines, NUM_PAGES, numLines);
+   if (numLines != 6 || lines[1] != "4 " FILE1) {
+      cout << numLines << " lines\n";
+      exit(1);
+   }
+
+   cout << "Pass\n";
+   return (0);
+}
+
+RC TestPF()
+{
+   RC rc;
+
+   if ((rc = CreateTestFile(FILE1, NUM_PAGES)) ||
+         (rc = RunCold()) ||
+         (rc = RunWarm()) ||
+         (rc = CheckLists()) ||
+         (rc = CheckEnv()))
+      return (rc);
+
+   return (0);
+}
+
+int main()
+{
+   RC rc;
+
+   // Write out initial starting message
+   cerr.flush();
+   cout.flush();
+   cout << "********************\n";
+   cout << "Starting PF buffer warm-up test.\n";
+   cout.flush();
+
+   // Delete files from last time
+   unlink(FILE1);
+   unlink(WARM_FILE);
+
+   if ((rc = TestPF())) {
+      PF_PrintError(rc);
+      return (1);
+   }
+
+   unlink(FILE1);
+   unlink(WARM_FILE);
+
+   // Write ending message and exit
+   cout << "Ending PF buffer warm-up test.\n";
+   cout << "********************\n\n";
+
+   return (0);
+}
@@ -0,0 +1,389 @@
+//
+// File:        pf_test16.cc
+// Description: Test of the extents and of PF_FileHandle::AllocatePages
+//
+// A file grown page by page must get its disk space a whole extent at a
+// time, without its size changing before the pages are written.  Pages
+// allocated in a batch must be numbered one after the other, pinned,
+// zeroed and counted in the header once; free pages are used first.  A
+// batch that does not fit in the buffer puts the pages it took back on
+// the free list.  Last, the file is read back after a restart.
+//
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <cstring>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "pf.h"
+#include "pf_internal.h"
+
+using namespace std;
+
+//
+// Defines
+//
+#define FILE1         "file1"
+#define EXTENT        16                    // pages of an extent
+#define NUM_SINGLE    20                    // pages allocated one by one
+#define NUM_BATCH     10                    // pages of a batch
+#define NUM_FRAMES    40                    // frames of the buffer
+
+RC CheckExtents(PF_FileHandle &fh);
+RC CheckBatch(PF_FileHandle &fh);
+RC CheckFreeFirst(PF_FileHandle &fh);
+RC CheckTooMany(PF_FileHandle &fh);
+RC CheckPages();
+RC Fill(PF_FileHandle &fh, PF_PageHandle pageHandles[], int numPages);
+long long Reserved();
+int NumPages(PF_FileHandle &fh);
+
+//
+// Reserved
+//
+// Desc: Bytes of disk space given to FILE1
+//
+long long Reserved()
+{
+   struct stat fileStat;
+
+   if (stat(FILE1, &fileStat) < 0) {
+      perror(FILE1);
+      exit(1);
+   }
+   return ((long long)fileStat.st_blocks * 512);
+}
+
+//
+// NumPages
+//
+// Desc: # of pages of the file, counted with GetNextPage
+//
+int NumPages(PF_FileHandle &fh)
+{
+   PF_PageHandle ph;
+   PageNum pageNum = -1;
+   int numPages = 0;
+   RC rc;
+
+   while ((rc = fh.GetNextPage(pageNum, ph)) == 0) {
+      ph.GetPageNum(pageNum);
+      fh.UnpinPage(pageNum);
+      numPages++;
+   }
+   if (rc != PF_EOF) {
+      PF_PrintError(rc);
+      exit(1);
+   }
+   return (numPages);
+}
+
+//
+// Fill
+//
+// Desc: Check that pages just allocated are zeroed, write their page
+//       number into them and unpin them
+//
+RC Fill(PF_FileHandle &fh, PF_PageHandle pageHandles[], int numPages)
+{
+   RC rc;
+   char *pData;
+   PageNum pageNum;
+
+   for (int i = 0; i < numPages; i++) {
+      if ((rc = pageHandles[i].GetData(pData)) ||
+            (rc = pageHandles[i].GetPageNum(pageNum)))
+         return (rc);
+
+      for (int j = 0; j < PF_PAGE_SIZE; j++)
+         if (pData[j] != 0) {
+            cout << "page " << pageNum << " is not zeroed\n";
+            exit(1);
+         }
+
+      memcpy(pData, &pageNum, sizeof(pageNum));
+      if ((rc = fh.MarkDirty(pageNum)) ||
+            (rc = fh.UnpinPage(pageNum)))
+         return (rc);
+   }
+
+   return (0);
+}
+
+//
+// CheckExtents
+//
+// Desc: Allocate NUM_SINGLE pages one at a time.  The first one reserves
+//       a whole extent, and page EXTENT the next one; nothing is written
+//       until the pages are flushed.
+//
+RC CheckExtents(PF_FileHandle &fh)
+{
+   PF_PageHandle ph;
+   RC rc;
+   long long pageSize = PF_PAGE_SIZE + sizeof(PF_PageHdr);
+
+   cout << "Allocating pages one by one: ";
+
+   long long before = Reserved();
+   for (int i = 0; i < NUM_SINGLE; i++) {
+      if ((rc = fh.AllocatePage(ph)) ||
+            (rc = Fill(fh, &ph, 1)))
+         return (rc);
+
+      long long reserved = Reserved() - before;
+      if (i == 0 && reserved < EXTENT * pageSize) {
+         cout << "no extents here (" << reserved << " bytes reserved), ";
+         break;
+      }
+      if (reserved < (i < EXTENT ? 1 : 2) * EXTENT * pageSize) {
+         cout << reserved << " bytes reserved for page " << i << "\n";
+         exit(1);
+      }
+   }
+
+   // The pages are in the buffer only: the file still ends at its header
+   struct stat fileStat;
+   stat(FILE1, &fileStat);
+   if (fileStat.st_size != PF_FILE_HDR_SIZE) {
+      cout << "the file has grown to " << fileStat.st_size << " bytes\n";
+      exit(1);
+   }
+
+   if ((rc = fh.FlushPages()))
+      return (rc);
+   stat(FILE1, &fileStat);
+   if (fileStat.st_size != PF_FILE_HDR_SIZE + NUM_SINGLE * pageSize) {
+      cout << "the file has " << fileStat.st_size << " bytes\n";
+      exit(1);
+   }
+
+   cout << "Pass\n";
+   return (0);
+}
+
+//
+// CheckBatch
+//
+// Desc: A batch gets the next NUM_BATCH page numbers, pinned and zeroed
+//
+RC CheckBatch(PF_FileHandle &fh)
+{
+   PF_PageHandle pageHandles[NUM_BATCH];
+   PageNum pageNum;
+   RC rc;
+
+   cout << "Allocating a batch: ";
+
+   if ((rc = fh.AllocatePages(NUM_BATCH, pageHandles)))
+      return (rc);
+
+   for (int i = 0; i < NUM_BATCH; i++) {
+      pageHandles[i].GetPageNum(pageNum);
+      if (pageNum != NUM_SINGLE + i) {
+         cout << "page " << i << " of the batch is " << pageNum << "\n";
+         exit(1);
+      }
+   }
+
+   // Every page is pinned once
+   PF_FileSnapshot snapshot;
+   if ((rc = fh.GetSnapshot(snapshot)))
+      return (rc);
+   if (snapshot.numPinned != NUM_BATCH) {
+      cout << snapshot.numPinned << " pages pinned\n";
+      exit(1);
+   }
+
+   if ((rc = Fill(fh, pageHandles, NUM_BATCH)))
+      return (rc);
+   if (NumPages(fh) != NUM_SINGLE + NUM_BATCH) {
+      cout << "the file does not have " << NUM_SINGLE + NUM_BATCH << " pages\n";
+      exit(1);
+   }
+
+   cout << "Pass\n";
+   return (0);
+}
+
+//
+// CheckFreeFirst
+//
+// Desc: Dispose of three pages; a batch of five takes them back (last
+//       disposed first), then two pages at the end
+//
+RC CheckFreeFirst(PF_FileHandle &fh)
+{
+   PF_PageHandle pageHandles[5];
+   PageNum expected[5] = { 7, 5, 3, NUM_SINGLE + NUM_BATCH,
+      NUM_SINGLE + NUM_BATCH + 1 };
+   PageNum pageNum;
+   RC rc;
+
+   cout << "Taking free pages first: ";
+
+   if ((rc = fh.DisposePage(3)) ||
+         (rc = fh.DisposePage(5)) ||
+         (rc = fh.DisposePage(7)) ||
+         (rc = fh.AllocatePages(5, pageHandles)))
+      return (rc);
+
+   for (int i = 0; i < 5; i++) {
+      pageHandles[i].GetPageNum(pageNum);
+      if (pageNum != expected[i]) {
+         cout << "page " << i << " of the batch is " << pageNum << "\n";
+         exit(1);
+      }
+   }
+
+   if ((rc = Fill(fh, pageHandles, 5)))
+      return (rc);
+
+   cout << "Pass\n";
+   return (0);
+}
+
+//
+// CheckTooMany
+//
+// Desc: A batch bigger than the buffer fails with PF_NOBUF; the pages it
+//       took are free afterwards, and nothing stays pinned
+//
+RC CheckTooMany(PF_FileHandle &fh)
+{
+   PF_PageHandle pageHandles[NUM_FRAMES + 1];
+   RC rc;
+
+   cout << "Allocating more pages than the buffer holds: ";
+
+   int before = NumPages(fh);
+   if ((rc = fh.DisposePage(1)) ||
+         (rc = fh.FlushPages()))
+      return (rc);
+
+   if ((rc = fh.AllocatePages(NUM_FRAMES + 1, pageHandles)) != PF_NOBUF) {
+      cout << "AllocatePages returned " << rc << "\n";
+      exit(1);
+   }
+
+   // No page is pinned: the flush finds nothing in the way
+   if ((rc = fh.FlushPages()))
+      return (rc);
+   if (NumPages(fh) != before - 1) {
+      cout << "the file has " << NumPages(fh) << " pages in use\n";
+      exit(1);
+   }
+
+   // The next allocation takes one of them back: page 1 and NUM_FRAMES - 1
+   // new pages fitted in the buffer before the last one failed
+   PF_PageHandle ph;
+   PageNum pageNum;
+   if ((rc = fh.AllocatePage(ph)) ||
+         (rc = ph.GetPageNum(pageNum)))
+      return (rc);
+   if (pageNum >= before + NUM_FRAMES - 1) {
+      cout << "page " << pageNum << " was not free\n";
+      exit(1);
+   }
+   if ((rc = fh.UnpinPage(pageNum)) ||
+         (rc = fh.DisposePage(pageNum)))
+      return (rc);
+
+   cout << "Pass\n";
+   return (0);
+}
+
+//
+// CheckPages
+//
+// Desc: After a restart, every page in use holds its number
+//
+RC CheckPages()
+{
+   PF_Manager pfm;
+   PF_FileHandle fh;
+   PF_PageHandle ph;
+   RC rc;
+   char *pData;
+   PageNum pageNum = -1;
+   int value, numPages = 0;
+
+   cout << "Checking pages: ";
+
+   if ((rc = pfm.OpenFile(FILE1, fh)))
+      return (rc);
+
+   while ((rc = fh.GetNextPage(pageNum, ph)) == 0) {
+      if ((rc = ph.GetData(pData)) ||
+            (rc = ph.GetPageNum(pageNum)))
+         return (rc);
+
+      memcpy(&value, pData, sizeof(value));
+      if (value != pageNum) {
+         cout << "page " << pageNum << " holds " << value << "\n";
+         exit(1);
+      }
+
+      if ((rc = fh.UnpinPage(pageNum)))
+         return (rc);
+      numPages++;
+   }
+   if (rc != PF_EOF)
+      return (rc);
+
+   cout << numPages << " pages, Pass\n";
+   return (pfm.CloseFile(fh));
+}
+
+RC TestPF()
+{
+   PF_BufferConfig config(NUM_FRAMES);
+   config.bReadAhead = FALSE;
+   config.extentPages = EXTENT;
+   RC rc;
+
+   {
+      PF_Manager pfm(config);
+      PF_FileHandle fh;
+
+      if ((rc = pfm.CreateFile(FILE1)) ||
+            (rc = pfm.OpenFile(FILE1, fh)) ||
+            (rc = CheckExtents(fh)) ||
+            (rc = CheckBatch(fh)) ||
+            (rc = CheckFreeFirst(fh)) ||
+            (rc = CheckTooMany(fh)) ||
+            (rc = pfm.CloseFile(fh)))
+         return (rc);
+   }
+
+   return (CheckPages());
+}
+
+int main()
+{
+   RC rc;
+
+   // Write out initial starting message
+   cerr.flush();
+   cout.flush();
+   cout << "********************\n";
+   cout << "Starting PF extent allocation test.\n";
+   cout.flush();
+
+   // Delete files from last time
+   unlink(FILE1);
+
+   if ((rc = TestPF())) {
+      PF_PrintError(rc);
+      return (1);
+   }
+
+   unlink(FILE1);
+
+   // Write ending message and exit
+   cout << "Ending PF extent allocation test.\n";
+   cout << "********************\n\n";
+
+   return (0);
+}
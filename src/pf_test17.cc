@@ -0,0 +1,376 @@
+//
+// File:        pf_test17.cc
+// Description: Test of the free-page bitmap (PF_CREATE_BITMAP)
+//
+// Two files get the same pages, three out of four of which are disposed
+// of: one with a bitmap, the other with the free list.  A scan of the
+// file with a bitmap must read the pages in use only, and allocations
+// must take its lowest free pages without reading them; the file with
+// the free list still reads every page.  The errors of the bitmap, its
+// page limit and the bitmap kept over a restart are checked as well.
+//
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <cstring>
+#include <unistd.h>
+#include "pf.h"
+#include "pf_testutil.h"
+#include "pf_internal.h"
+
+using namespace std;
+
+//
+// Defines
+//
+#define FILE1         "file1"               // with a bitmap
+#define FILE2         "file2"               // with the free list
+#define NUM_PAGES     200                   // pages allocated in each file
+#define KEEP_EVERY    4                     // one page in four is kept
+#define NUM_USED      (NUM_PAGES / KEEP_EVERY)
+#define NUM_BATCH     10                    // pages allocated again
+#define NUM_FRAMES    40                    // frames of the buffer
+
+RC CreateSparseFile(const char *psName, int flags);
+RC Scan(PF_FileHandle &fh, int dir, int &numPages);
+RC CheckScan(const char *psName, int numExpected);
+RC CheckMapped();
+RC CheckAllocate();
+RC CheckErrors();
+RC CheckDefault();
+
+//
+// CreateSparseFile
+//
+// Desc: Create a file of NUM_PAGES pages holding their page number, and
+//       dispose of all but one page in KEEP_EVERY
+//
+RC CreateSparseFile(const char *psName, int flags)
+{
+   PF_Manager pfm;
+   PF_FileHandle fh;
+   RC rc;
+
+   if ((rc = CreateTestFile(pfm, psName, NUM_PAGES, flags)) ||
+         (rc = pfm.OpenFile(psName, fh)))
+      return (rc);
+
+   for (int i = 0; i < NUM_PAGES; i++)
+      if (i % KEEP_EVERY != 0 && (rc = fh.DisposePage(i)))
+         return (rc);
+
+   return (pfm.CloseFile(fh));
+}
+
+//
+// Scan
+//
+// Desc: Get every page in use, forward (dir 1) or backward (dir -1), and
+//       check that it holds its page number
+// Out:  numPages - pages found
+//
+RC Scan(PF_FileHandle &fh, int dir, int &numPages)
+{
+   PF_PageHandle ph;
+   RC rc;
+   char *pData;
+   PageNum pageNum;
+   int value;
+
+   numPages = 0;
+   rc = (dir > 0) ? fh.GetFirstPage(ph) : fh.GetLastPage(ph);
+   while (rc == 0) {
+      if ((rc = ph.GetData(pData)) ||
+            (rc = ph.GetPageNum(pageNum)))
+         return (rc);
+
+      memcpy(&value, pData, sizeof(value));
+      if (value != pageNum) {
+         cout << "page " << pageNum << " holds " << value << "\n";
+         exit(1);
+      }
+
+      if ((rc = fh.UnpinPage(pageNum)))
+         return (rc);
+      numPages++;
+
+      rc = (dir > 0) ? fh.GetNextPage(pageNum, ph) :
+         fh.GetPrevPage(pageNum, ph);
+   }
+
+   return (rc == PF_EOF ? 0 : rc);
+}
+
+//
+// CheckScan
+//
+// Desc: Scan a file both ways through a cold buffer.  With a bitmap only
+//       the pages in use are read, and the free list reads them all.
+//
+RC CheckScan(const char *psName, int numExpected)
+{
+   PF_BufferConfig config(NUM_FRAMES);
+   config.bReadAhead = FALSE;
+   PF_Manager pfm(config);
+   PF_FileHandle fh;
+   RC rc;
+   int numForward, numBackward;
+
+   if ((rc = pfm.OpenFile(psName, fh)))
+      return (rc);
+
+   cout << "Scanning " << psName
+      << (fh.HasBitmap() ? " (bitmap): " : " (free list): ");
+
+   long long readsBefore = GetStat(PF_READPAGE);
+   if ((rc = Scan(fh, 1, numForward)))
+      return (rc);
+   int numReads = GetStat(PF_READPAGE) - readsBefore;
+
+   if ((rc = Scan(fh, -1, numBackward)))
+      return (rc);
+
+   if (numForward != numExpected || numBackward != numExpected) {
+      cout << numForward << " pages forward, " << numBackward
+         << " backward\n";
+      exit(1);
+   }
+#ifdef PF_STATS
+   if (fh.HasBitmap() && numReads != numExpected) {
+      cout << numReads << " pages read\n";
+      exit(1);
+   }
+#endif
+
+   cout << numForward << " pages, " << numReads << " read, Pass\n";
+   return (pfm.CloseFile(fh));
+}
+
+//
+// CheckMapped
+//
+// Desc: A mapped file finds its pages in the bitmap too
+//
+RC CheckMapped()
+{
+   PF_Manager pfm;
+   PF_FileHandle fh;
+   RC rc;
+   int numPages;
+
+   cout << "Scanning " FILE1 " mapped: ";
+
+   if ((rc = pfm.OpenFile(FILE1, fh, PF_OPEN_MMAP)) ||
+         (rc = Scan(fh, 1, numPages)))
+      return (rc);
+
+   if (!fh.HasBitmap() || numPages != NUM_USED) {
+      cout << numPages << " pages\n";
+      exit(1);
+   }
+
+   cout << "Pass\n";
+   return (pfm.CloseFile(fh));
+}
+
+//
+// CheckAllocate
+//
+// Desc: Allocate NUM_BATCH pages in each file through a cold buffer.  The
+//       bitmap hands out the lowest free pages, 1 2 3 5 6 7 9 ..., and
+//       reads none of them; the free list reads each page it takes.
+//
+RC CheckAllocate()
+{
+   PF_BufferConfig config(NUM_FRAMES);
+   config.bReadAhead = FALSE;
+   PF_Manager pfm(config);
+   const char *psNames[2] = { FILE1, FILE2 };
+   RC rc;
+
+   cout << "Allocating pages again: ";
+
+   for (int f = 0; f < 2; f++) {
+      PF_FileHandle fh;
+      PF_PageHandle pageHandles[NUM_BATCH];
+      PageNum pageNum, expected = 0;
+      char *pData;
+
+      if ((rc = pfm.OpenFile(psNames[f], fh)))
+         return (rc);
+
+      long long readsBefore = GetStat(PF_READPAGE);
+      if ((rc = fh.AllocatePages(NUM_BATCH, pageHandles)))
+         return (rc);
+      int numReads = GetStat(PF_READPAGE) - readsBefore;
+
+      for (int i = 0; i < NUM_BATCH; i++) {
+         if ((rc = pageHandles[i].GetPageNum(pageNum)) ||
+               (rc = pageHandles[i].GetData(pData)))
+            return (rc);
+
+         if (++expected % KEEP_EVERY == 0)
+            expected++;
+         if (fh.HasBitmap() && pageNum != expected) {
+            cout << "page " << i << " of the batch is " << pageNum << "\n";
+            exit(1);
+         }
+
+         memcpy(pData, &pageNum, sizeof(pageNum));
+         if ((rc = fh.MarkDirty(pageNum)) ||
+               (rc = fh.UnpinPage(pageNum)))
+            return (rc);
+      }
+
+#ifdef PF_STATS
+      if (fh.HasBitmap() && numReads != 0) {
+         cout << numReads << " pages read\n";
+         exit(1);
+      }
+#endif
+      cout << psNames[f] << " " << numReads << " read, ";
+
+      if ((rc = pfm.CloseFile(fh)))
+         return (rc);
+   }
+
+   cout << "Pass\n";
+   return (0);
+}
+
+//
+// CheckErrors
+//
+// Desc: Free pages are refused without being read, and a file with a
+//       bitmap cannot have more than PF_BITMAP_PAGES pages
+//
+RC CheckErrors()
+{
+   PF_Manager pfm;
+   PF_FileHandle fh;
+   PF_PageHandle ph;
+   RC rc;
+
+   cout << "Checking the errors: ";
+
+   if ((rc = pfm.OpenFile(FILE1, fh)))
+      return (rc);
+
+   long long readsBefore = GetStat(PF_READPAGE);
+   if ((rc = fh.DisposePage(KEEP_EVERY * NUM_BATCH - 1)) != PF_PAGEFREE ||
+         (rc = fh.GetThisPage(KEEP_EVERY * NUM_BATCH - 1, ph)) != PF_INVALIDPAGE) {
+      cout << "got " << rc << " for a free page\n";
+      exit(1);
+   }
+   if (GetStat(PF_READPAGE) != readsBefore) {
+      cout << "free pages were read\n";
+      exit(1);
+   }
+   if ((rc = pfm.CloseFile(fh)))
+      return (rc);
+
+   // An empty file has room for PF_BITMAP_PAGES pages, not one more
+   PF_PageHandle *pageHandles = new PF_PageHandle[PF_BITMAP_PAGES + 1];
+   unlink("file3");
+   if ((rc = pfm.CreateFile("file3", PF_CREATE_BITMAP)) ||
+         (rc = pfm.OpenFile("file3", fh)))
+      return (rc);
+   if ((rc = fh.AllocatePages(PF_BITMAP_PAGES + 1, pageHandles)) != PF_FILEFULL) {
+      cout << "AllocatePages returned " << rc << "\n";
+      exit(1);
+   }
+   delete [] pageHandles;
+
+   // Nothing was taken
+   if ((rc = fh.GetFirstPage(ph)) != PF_EOF) {
+      cout << "the file has pages\n";
+      exit(1);
+   }
+   if ((rc = pfm.CloseFile(fh)) ||
+         (rc = pfm.DestroyFile("file3")))
+      return (rc);
+
+   cout << "Pass\n";
+   return (0);
+}
+
+//
+// CheckDefault
+//
+// Desc: PF_BufferConfig::bFreeBitmap makes every new file one with a
+//       bitmap
+//
+RC CheckDefault()
+{
+   PF_BufferConfig config;
+   config.bFreeBitmap = TRUE;
+   PF_Manager pfm(config);
+   PF_FileHandle fh;
+   RC rc;
+
+   cout << "Creating files with a bitmap by default: ";
+
+   unlink("file3");
+   if ((rc = pfm.CreateFile("file3")) ||
+         (rc = pfm.OpenFile("file3", fh)))
+      return (rc);
+   if (!fh.HasBitmap()) {
+      cout << "the file has no bitmap\n";
+      exit(1);
+   }
+   if ((rc = pfm.CloseFile(fh)) ||
+         (rc = pfm.DestroyFile("file3")))
+      return (rc);
+
+   cout << "Pass\n";
+   return (0);
+}
+
+RC TestPF()
+{
+   RC rc;
+
+   if ((rc = CreateSparseFile(FILE1, PF_CREATE_BITMAP)) ||
+         (rc = CreateSparseFile(FILE2, 0)) ||
+         (rc = CheckScan(FILE1, NUM_USED)) ||
+         (rc = CheckScan(FILE2, NUM_USED)) ||
+         (rc = CheckMapped()) ||
+         (rc = CheckAllocate()) ||
+         (rc = CheckErrors()) ||
+         (rc = CheckDefault()))
+      return (rc);
+
+   // The bitmap was written with the header: after a restart
+   return (CheckScan(FILE1, NUM_USED + NUM_BATCH));
+}
+
+int main()
+{
+   RC rc;
+
+   // Write out initial starting message
+   cerr.flush();
+   cout.flush();
+   cout << "********************\n";
+   cout << "Starting PF free-page bitmap test.\n";
+   cout.flush();
+
+   // Delete files from last time
+   unlink(FILE1);
+   unlink(FILE2);
+
+   if ((rc = TestPF())) {
+      PF_PrintError(rc);
+      return (1);
+   }
+
+   unlink(FILE1);
+   unlink(FILE2);
+
+   // Write ending message and exit
+   cout << "Ending PF free-page bitmap test.\n";
+   cout << "********************\n\n";
+
+   return (0);
+}
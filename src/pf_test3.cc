@@ -30,6 +30,7 @@ using namespace std;
 //
 #define FILE1	"file1"
 #define FILE2	"file2"
+#define CONFIG_PAGES	1000	// pool size for TestConfig
 
 // Allocate a group of main memory pages from the buffer
 RC AllocateChunk(PF_Manager &pfm, int iBlocks, char *ptr[]);
@@ -41,6 +42,7 @@ RC VerifyChunks(int iBlocks, char *ptr[]);
 RC DisposeChunk(PF_Manager &pfm, int iBlocks, char *ptr[]);
 
 RC TestChunk();
+RC TestConfig();
 
 //
 // AllocateChunk
@@ -191,6 +193,53 @@ RC TestChunk()
    return 0;
 }
 
+//
+// TestConfig
+//
+// Desc: Size the pool with PF_BufferConfig (with a hash table sized far
+//       too small, on huge pages), fill it with chunks, then grow it with
+//       ResizeBuffer (which maps a second arena) and fill it again.
+//
+RC TestConfig()
+{
+   PF_BufferConfig config(CONFIG_PAGES);
+   config.hashSize = 10;
+   config.bHugePages = TRUE;
+   PF_Manager pfm(config);
+   RC rc;
+   static char *ptr[4 * CONFIG_PAGES + 1];
+
+   for (int size = CONFIG_PAGES; ; size *= 4) {
+      if ((rc = AllocateChunk(pfm, size, ptr)) ||
+            (rc = VerifyChunks(size, ptr))) {
+         cout << "FAILED!\a\a\n";
+         return rc;
+      }
+      cout << "Pass\n";
+
+      // The pool is full now
+      if ((rc = AllocateChunk(pfm, 1, ptr + size)) != PF_NOBUF) {
+         cout << "FAILED!\a\a\n";
+         return (rc ? rc : 1);
+      }
+      cout << "Pass\n";
+
+      if ((rc = DisposeChunk(pfm, size, ptr))) {
+         cout << "FAILED!\a\a\n";
+         return rc;
+      }
+      cout << "Pass\n";
+
+      if (size == 4 * CONFIG_PAGES)
+         break;
+      cout << "Resizing the buffer to " << 4 * size << " pages\n";
+      if ((rc = pfm.ResizeBuffer(4 * size)))
+         return rc;
+   }
+
+   return 0;
+}
+
 int main()
 {
    RC rc;
@@ -207,7 +256,8 @@ int main()
 #endif
 
    // Do tests
-   if ((rc = TestChunk())) {
+   if ((rc = TestChunk()) ||
+         (rc = TestConfig())) {
       PF_PrintError(rc);
       return (1);
    }
@@ -0,0 +1,307 @@
+//
+// File:        pf_test4.cc
+// Description: Multi-threaded stress test of the PF buffer manager
+//
+// Several threads share one PF_Manager and pin, check and unpin random
+// pages of a file at the same time.  Every thread also owns the pages
+// whose number is congruent to its id and increments a counter on them,
+// so that dirty pages are written back while other threads are causing
+// evictions.  The run is repeated with a single shard (one latch for the
+// whole buffer), with several shards, and with several shards under the
+// CLOCK replacement policy; the throughput of each run is printed and the
+// counters are verified against disk at the end.  Last, the threads only
+// read while the main thread resizes the buffer over and over, so that
+// resizes happen while threads wait on the latches of the shards.
+//
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <cstring>
+#include <unistd.h>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include "pf.h"
+#include "pf_testutil.h"
+#include "pf_internal.h"
+
+using namespace std;
+
+//
+// Defines
+//
+#define FILE1         "file1"
+#define NUM_PAGES     (4 * PF_BUFFER_SIZE)  // pages in the test file
+#define NUM_THREADS   4                     // worker threads
+#define NUM_SHARDS    4                     // shards for the sharded run
+#define ITERATIONS    20000                 // page accesses per thread
+
+//
+// Layout of the first bytes of every test page
+//
+struct TestPage {
+   PageNum pageNum;     // page number, never changes
+   int     counter;     // incremented by the owning thread
+};
+
+//
+// Per-thread state
+//
+struct Worker {
+   PF_FileHandle *pfh;                 // shared file handle
+   int           id;                   // thread id in [0, NUM_THREADS)
+   int           bReadOnly;            // TRUE to only check the pages
+   RC            rc;                   // first error seen by the thread
+   int           updates[NUM_PAGES];   // counter increments per page
+};
+
+RC RunThreads(int numShards, PF_ReplacePolicy policy, int counters[]);
+RC RunResize();
+RC VerifyCounters(int counters[]);
+void WorkerMain(Worker *w);
+void ResizeWorkerMain(Worker *w, std::atomic<int> *pNumDone);
+
+//
+// WorkerMain
+//
+// Desc: Body of a worker thread.  Uses rand_r so that every thread has
+//       its own random sequence.
+//
+void WorkerMain(Worker *w)
+{
+   PF_PageHandle ph;
+   char *pData;
+   unsigned int seed = 17 + w->id;
+   RC rc;
+
+   for (int i = 0; i < ITERATIONS; i++) {
+      PageNum pageNum = rand_r(&seed) % NUM_PAGES;
+
+      if ((rc = w->pfh->GetThisPage(pageNum, ph)) ||
+            (rc = ph.GetData(pData))) {
+         w->rc = rc;
+         return;
+      }
+
+      TestPage *page = (TestPage *)pData;
+      if (page->pageNum != pageNum) {
+         cout << "Thread " << w->id << ": page " << pageNum
+            << " holds page number " << page->pageNum << "\n";
+         exit(1);
+      }
+
+      // Only the owner writes to a page, so no other latch is needed
+      if (!w->bReadOnly && pageNum % NUM_THREADS == w->id) {
+         page->counter++;
+         w->updates[pageNum]++;
+         if ((rc = w->pfh->MarkDirty(pageNum))) {
+            w->rc = rc;
+            return;
+         }
+      }
+
+      if ((rc = w->pfh->UnpinPage(pageNum))) {
+         w->rc = rc;
+         return;
+      }
+   }
+}
+
+//
+// ResizeWorkerMain
+//
+// Desc: Body of a worker thread of RunResize: a worker, then one more in
+//       numDone
+//
+void ResizeWorkerMain(Worker *w, atomic<int> *pNumDone)
+{
+   WorkerMain(w);
+   (*pNumDone)++;
+}
+
+//
+// RunThreads
+//
+// Desc: Run NUM_THREADS workers over FILE1 with a buffer of numShards
+//       shards replacing pages by policy, print the throughput and add
+//       the updates to counters.
+//
+RC RunThreads(int numShards, PF_ReplacePolicy policy, int counters[])
+{
+   PF_Manager pfm(numShards, policy);
+   PF_FileHandle fh;
+   Worker workers[NUM_THREADS];
+   thread threads[NUM_THREADS];
+   RC rc;
+
+   if ((rc = pfm.OpenFile(FILE1, fh)))
+      return (rc);
+
+   cout << NUM_THREADS << " threads, " << numShards << " shard(s), "
+      << (policy == PF_REPLACE_CLOCK ? "CLOCK" : "LRU") << ": ";
+   cout.flush();
+
+   chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+   for (int t = 0; t < NUM_THREADS; t++) {
+      workers[t].pfh = &fh;
+      workers[t].id = t;
+      workers[t].bReadOnly = FALSE;
+      workers[t].rc = OK_RC;
+      memset(workers[t].updates, 0, sizeof(workers[t].updates));
+      threads[t] = thread(WorkerMain, &workers[t]);
+   }
+   for (int t = 0; t < NUM_THREADS; t++)
+      threads[t].join();
+
+   double seconds = chrono::duration<double>(
+         chrono::steady_clock::now() - start).count();
+   cout << (long)(NUM_THREADS * ITERATIONS / seconds) << " pins/sec\n";
+
+   for (int t = 0; t < NUM_THREADS; t++) {
+      if (workers[t].rc)
+         return (workers[t].rc);
+      for (int p = 0; p < NUM_PAGES; p++)
+         counters[p] += workers[t].updates[p];
+   }
+
+   return (pfm.CloseFile(fh));
+}
+
+//
+// RunResize
+//
+// Desc: Run NUM_THREADS read-only workers over FILE1 with a sharded
+//       buffer, while the main thread resizes it between PF_BUFFER_SIZE
+//       and twice that.  A resize is refused while a page is pinned.
+//
+RC RunResize()
+{
+   PF_Manager pfm(NUM_SHARDS, PF_REPLACE_LRU);
+   PF_FileHandle fh;
+   Worker workers[NUM_THREADS];
+   thread threads[NUM_THREADS];
+   atomic<int> numDone(0);
+   int numResized = 0;
+   RC rc;
+
+   if ((rc = pfm.OpenFile(FILE1, fh)))
+      return (rc);
+
+   cout << NUM_THREADS << " reading threads, buffer resized meanwhile: ";
+   cout.flush();
+
+   for (int t = 0; t < NUM_THREADS; t++) {
+      workers[t].pfh = &fh;
+      workers[t].id = t;
+      workers[t].bReadOnly = TRUE;
+      workers[t].rc = OK_RC;
+      threads[t] = thread(ResizeWorkerMain, &workers[t], &numDone);
+   }
+
+   for (int i = 0; numDone < NUM_THREADS; i++) {
+      rc = pfm.ResizeBuffer((i % 2) ? PF_BUFFER_SIZE : 2 * PF_BUFFER_SIZE);
+      if (rc == 0)
+         numResized++;
+      else if (rc != PF_PAGEPINNED)
+         break;
+      this_thread::yield();
+   }
+   for (int t = 0; t < NUM_THREADS; t++)
+      threads[t].join();
+   if (rc && rc != PF_PAGEPINNED)
+      return (rc);
+
+   cout << numResized << " resizes\n";
+
+   for (int t = 0; t < NUM_THREADS; t++)
+      if (workers[t].rc)
+         return (workers[t].rc);
+
+   return (pfm.CloseFile(fh));
+}
+
+//
+// VerifyCounters
+//
+// Desc: Read FILE1 back with a fresh buffer and compare the counters
+//
+RC VerifyCounters(int counters[])
+{
+   PF_Manager pfm;
+   PF_FileHandle fh;
+   PF_PageHandle ph;
+   RC rc;
+   char *pData;
+
+   cout << "Verifying page counters: ";
+
+   if ((rc = pfm.OpenFile(FILE1, fh)))
+      return (rc);
+
+   for (int i = 0; i < NUM_PAGES; i++) {
+      if ((rc = fh.GetThisPage(i, ph)) ||
+            (rc = ph.GetData(pData)))
+         return (rc);
+
+      TestPage *page = (TestPage *)pData;
+      if (page->pageNum != i || page->counter != counters[i]) {
+         cout << "page " << i << " has counter " << page->counter
+            << " (expected " << counters[i] << ")\n";
+         exit(1);
+      }
+
+      if ((rc = fh.UnpinPage(i)))
+         return (rc);
+   }
+   cout << "Correct!\n";
+
+   return (pfm.CloseFile(fh));
+}
+
+RC TestPF()
+{
+   RC rc;
+   int counters[NUM_PAGES];
+
+   memset(counters, 0, sizeof(counters));
+
+   if ((rc = CreateTestFile(FILE1, NUM_PAGES)) ||
+         (rc = RunThreads(1, PF_REPLACE_LRU, counters)) ||
+         (rc = RunThreads(NUM_SHARDS, PF_REPLACE_LRU, counters)) ||
+         (rc = RunThreads(NUM_SHARDS, PF_REPLACE_CLOCK, counters)) ||
+         (rc = RunResize()) ||
+         (rc = VerifyCounters(counters)))
+      return (rc);
+
+   return (0);
+}
+
+int main()
+{
+   RC rc;
+
+   // Write out initial starting message
+   cerr.flush();
+   cout.flush();
+   cout << "********************\n";
+   cout << "Starting PF multi-threaded test.\n";
+   cout.flush();
+
+   // Delete files from last time
+   unlink(FILE1);
+
+   if ((rc = TestPF())) {
+      PF_PrintError(rc);
+      return (1);
+   }
+
+   unlink(FILE1);
+
+   // Write ending message and exit
+   cout << "Ending PF multi-threaded test.\n";
+   cout << "********************\n\n";
+
+   return (0);
+}
@@ -0,0 +1,155 @@
+//
+// File:        pf_test5.cc
+// Description: Scan resistance test of the PF buffer replacement policies
+//
+// A small hot set of pages is read a few times, then the rest of a file
+// much larger than the buffer is read once with SEQUENTIAL_HINT, as a
+// relation scan would do.  Finally the hot set is read again and the
+// misses are counted.  LRU keeps the pages of the scan at the cold end of
+// its list and 2Q keeps them on its probationary list: neither may miss
+// at all.  CLOCK only withholds their reference bit, and loses the hot
+// set once its hand has swept it.
+//
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <cstring>
+#include <unistd.h>
+#include "pf.h"
+#include "pf_testutil.h"
+#include "pf_internal.h"
+
+using namespace std;
+
+//
+// Defines
+//
+#define FILE1         "file1"
+#define NUM_PAGES     (4 * PF_BUFFER_SIZE)  // pages in the test file
+#define HOT_PAGES     (PF_BUFFER_SIZE / 2)  // pages 0 .. HOT_PAGES-1 are hot
+#define HOT_ROUNDS    3                     // reads of the hot set
+
+RC ReadPages(PF_FileHandle &fh, int first, int last, ClientHint hint);
+RC RunPolicy(PF_ReplacePolicy policy, const char *psName, int &misses);
+
+//
+// ReadPages
+//
+// Desc: Pin, check and unpin pages [first, last) of the file
+//
+RC ReadPages(PF_FileHandle &fh, int first, int last, ClientHint hint)
+{
+   PF_PageHandle ph;
+   RC rc;
+   char *pData;
+
+   for (int i = first; i < last; i++) {
+      if ((rc = fh.GetThisPage(i, ph, hint)) ||
+            (rc = ph.GetData(pData)))
+         return (rc);
+
+      if (memcmp(pData, &i, sizeof(i))) {
+         cout << "Page " << i << " has wrong contents\n";
+         exit(1);
+      }
+
+      if ((rc = fh.UnpinPage(i)))
+         return (rc);
+   }
+
+   return (0);
+}
+
+//
+// RunPolicy
+//
+// Desc: Run the hot set / scan / hot set sequence with one shard
+//       replacing pages by policy.
+// Out:  misses - hot pages that had to be read again after the scan
+//
+RC RunPolicy(PF_ReplacePolicy policy, const char *psName, int &misses)
+{
+   PF_Manager pfm(1, policy);
+   PF_FileHandle fh;
+   RC rc;
+
+   misses = -1;
+
+   if ((rc = pfm.OpenFile(FILE1, fh)))
+      return (rc);
+
+   for (int r = 0; r < HOT_ROUNDS; r++)
+      if ((rc = ReadPages(fh, 0, HOT_PAGES, NO_HINT)))
+         return (rc);
+
+   if ((rc = ReadPages(fh, HOT_PAGES, NUM_PAGES, SEQUENTIAL_HINT)))
+      return (rc);
+
+   long long missedBefore = GetStat(PF_PAGENOTFOUND);
+
+   if ((rc = ReadPages(fh, 0, HOT_PAGES, NO_HINT)))
+      return (rc);
+
+#ifdef PF_STATS
+   misses = GetStat(PF_PAGENOTFOUND) - missedBefore;
+
+   cout << psName << ": " << misses << " of " << HOT_PAGES
+      << " hot pages missed after the scan\n";
+#endif
+
+   return (pfm.CloseFile(fh));
+}
+
+RC TestPF()
+{
+   RC rc;
+   int missesLRU, missesClock, misses2Q;
+
+   if ((rc = CreateTestFile(FILE1, NUM_PAGES)) ||
+         (rc = RunPolicy(PF_REPLACE_LRU, "LRU", missesLRU)) ||
+         (rc = RunPolicy(PF_REPLACE_CLOCK, "CLOCK", missesClock)) ||
+         (rc = RunPolicy(PF_REPLACE_2Q, "2Q", misses2Q)))
+      return (rc);
+
+#ifdef PF_STATS
+   if (missesLRU != 0) {
+      cout << "LRU lost hot pages to the scan!\n";
+      exit(1);
+   }
+   if (misses2Q != 0) {
+      cout << "2Q lost hot pages to the scan!\n";
+      exit(1);
+   }
+#endif
+
+   return (0);
+}
+
+int main()
+{
+   RC rc;
+
+   // Write out initial starting message
+   cerr.flush();
+   cout.flush();
+   cout << "********************\n";
+   cout << "Starting PF scan resistance test.\n";
+   cout.flush();
+
+   // Delete files from last time
+   unlink(FILE1);
+
+   if ((rc = TestPF())) {
+      PF_PrintError(rc);
+      return (1);
+   }
+
+   unlink(FILE1);
+
+   // Write ending message and exit
+   cout << "Ending PF scan resistance test.\n";
+   cout << "********************\n\n";
+
+   return (0);
+}
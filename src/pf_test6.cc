@@ -0,0 +1,162 @@
+//
+// File:        pf_test6.cc
+// Description: Test of the direct I/O (O_DIRECT) mode of PF files
+//
+// A file is written through a file handle opened with PF_OPEN_DIRECT,
+// read back and updated through a normal file handle, and read once more
+// with direct I/O, so that both modes see each other's pages and file
+// header.  The buffer is made smaller than the file so that pages are
+// really read from and written to disk.  On file systems without O_DIRECT
+// support OpenFile falls back to normal I/O and the test still passes.
+//
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <cstring>
+#include <unistd.h>
+#include "pf.h"
+#include "pf_internal.h"
+
+using namespace std;
+
+//
+// Defines
+//
+#define FILE1         "file1"
+#define NUM_PAGES     (3 * PF_BUFFER_SIZE)  // pages in the test file
+
+RC WritePages(PF_Manager &pfm, int flags);
+RC CheckPages(PF_Manager &pfm, int flags, int delta, int bUpdate);
+
+//
+// WritePages
+//
+// Desc: Create FILE1 and allocate NUM_PAGES pages holding their number
+//
+RC WritePages(PF_Manager &pfm, int flags)
+{
+   PF_FileHandle fh;
+   PF_PageHandle ph;
+   RC rc;
+   char *pData;
+   PageNum pageNum;
+
+   if ((rc = pfm.CreateFile(FILE1)) ||
+         (rc = pfm.OpenFile(FILE1, fh, flags)))
+      return (rc);
+
+   cout << "Writing " << NUM_PAGES << " pages, direct I/O "
+      << (fh.IsDirectIO() ? "on" : "off") << "\n";
+
+   for (int i = 0; i < NUM_PAGES; i++) {
+      if ((rc = fh.AllocatePage(ph)) ||
+            (rc = ph.GetData(pData)) ||
+            (rc = ph.GetPageNum(pageNum)))
+         return (rc);
+
+      memcpy(pData, &pageNum, sizeof(pageNum));
+
+      if ((rc = fh.MarkDirty(pageNum)) ||
+            (rc = fh.UnpinPage(pageNum)))
+         return (rc);
+   }
+
+   return (pfm.CloseFile(fh));
+}
+
+//
+// CheckPages
+//
+// Desc: Check that every page holds its number plus delta, and add one
+//       to it if bUpdate is set
+//
+RC CheckPages(PF_Manager &pfm, int flags, int delta, int bUpdate)
+{
+   PF_FileHandle fh;
+   PF_PageHandle ph;
+   RC rc;
+   char *pData;
+   PageNum pageNum;
+   int i, value;
+
+   if ((rc = pfm.OpenFile(FILE1, fh, flags)))
+      return (rc);
+
+   cout << "Checking pages, direct I/O "
+      << (fh.IsDirectIO() ? "on" : "off") << ": ";
+
+   for (i = 0, rc = fh.GetFirstPage(ph); rc == 0; i++, rc = fh.GetNextPage(pageNum, ph)) {
+      if ((rc = ph.GetData(pData)) ||
+            (rc = ph.GetPageNum(pageNum)))
+         return (rc);
+
+      memcpy(&value, pData, sizeof(value));
+      if (value != pageNum + delta) {
+         cout << "page " << pageNum << " holds " << value << "\n";
+         exit(1);
+      }
+
+      if (bUpdate) {
+         value++;
+         memcpy(pData, &value, sizeof(value));
+         if ((rc = fh.MarkDirty(pageNum)))
+            return (rc);
+      }
+
+      if ((rc = fh.UnpinPage(pageNum)))
+         return (rc);
+   }
+   if (rc != PF_EOF)
+      return (rc);
+
+   if (i != NUM_PAGES) {
+      cout << "found " << i << " pages\n";
+      exit(1);
+   }
+   cout << "Pass\n";
+
+   return (pfm.CloseFile(fh));
+}
+
+RC TestPF()
+{
+   PF_Manager pfm;
+   RC rc;
+
+   if ((rc = WritePages(pfm, PF_OPEN_DIRECT)) ||
+         (rc = CheckPages(pfm, 0, 0, TRUE)) ||
+         (rc = CheckPages(pfm, PF_OPEN_DIRECT, 1, TRUE)) ||
+         (rc = CheckPages(pfm, 0, 2, FALSE)))
+      return (rc);
+
+   return (0);
+}
+
+int main()
+{
+   RC rc;
+
+   // Write out initial starting message
+   cerr.flush();
+   cout.flush();
+   cout << "********************\n";
+   cout << "Starting PF direct I/O test.\n";
+   cout.flush();
+
+   // Delete files from last time
+   unlink(FILE1);
+
+   if ((rc = TestPF())) {
+      PF_PrintError(rc);
+      return (1);
+   }
+
+   unlink(FILE1);
+
+   // Write ending message and exit
+   cout << "Ending PF direct I/O test.\n";
+   cout << "********************\n\n";
+
+   return (0);
+}
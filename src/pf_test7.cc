@@ -0,0 +1,217 @@
+//
+// File:        pf_test7.cc
+// Description: Test of asynchronous page I/O (GetPageAsync)
+//
+// A file larger than the buffer is read through windows of futures, with
+// a callback counting the completed reads, then every page is updated and
+// written back by the batched FlushPages.  The reads are checked once
+// with each I/O backend (io_uring falls back to the thread pool when the
+// kernel lacks it).  Two futures on the same page, a GetThisPage on a
+// page being read and a future dropped without Wait are also exercised.
+//
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <cstring>
+#include <atomic>
+#include <unistd.h>
+#include "pf.h"
+#include "pf_testutil.h"
+#include "pf_internal.h"
+
+using namespace std;
+
+//
+// Defines
+//
+#define FILE1         "file1"
+#define NUM_PAGES     (3 * PF_BUFFER_SIZE)  // pages in the test file
+#define WINDOW        (PF_BUFFER_SIZE / 2)  // reads in flight at once
+
+RC CheckPages(PF_IOBackend backend, const char *psName, int delta);
+RC CheckSharing(int delta);
+void CountRead(PageNum pageNum, RC rc, void *pArg);
+
+//
+// CountRead
+//
+// Desc: Completion callback, counts the reads that succeeded
+//
+void CountRead(PageNum pageNum, RC rc, void *pArg)
+{
+   if (rc == 0)
+      (*(atomic<int> *)pArg)++;
+}
+
+//
+// CheckPages
+//
+// Desc: Read the file WINDOW pages at a time with GetPageAsync, check
+//       that every page holds its number plus delta, add one to it, and
+//       flush the file
+//
+RC CheckPages(PF_IOBackend backend, const char *psName, int delta)
+{
+   PF_BufferConfig config;
+   config.ioBackend = backend;
+   PF_Manager pfm(config);
+   PF_FileHandle fh;
+   PF_PageHandle ph;
+   PF_PageFuture futures[WINDOW];
+   atomic<int> numRead(0);
+   RC rc;
+   char *pData;
+   int value;
+
+   cout << "Checking pages through " << psName << ": ";
+
+   if ((rc = pfm.OpenFile(FILE1, fh)))
+      return (rc);
+
+   for (int first = 0; first < NUM_PAGES; first += WINDOW) {
+      int n = (NUM_PAGES - first < WINDOW) ? NUM_PAGES - first : WINDOW;
+
+      for (int i = 0; i < n; i++)
+         if ((rc = fh.GetPageAsync(first + i, futures[i], SEQUENTIAL_HINT,
+               CountRead, &numRead)))
+            return (rc);
+
+      for (int i = 0; i < n; i++) {
+         PageNum pageNum = first + i;
+         if ((rc = futures[i].Wait(ph)) ||
+               (rc = ph.GetData(pData)))
+            return (rc);
+
+         memcpy(&value, pData, sizeof(value));
+         if (value != pageNum + delta) {
+            cout << "page " << pageNum << " holds " << value << "\n";
+            exit(1);
+         }
+         value++;
+         memcpy(pData, &value, sizeof(value));
+
+         if ((rc = fh.MarkDirty(pageNum)) ||
+               (rc = fh.UnpinPage(pageNum)))
+            return (rc);
+      }
+   }
+
+   if (numRead != NUM_PAGES) {
+      cout << numRead << " callbacks for " << NUM_PAGES << " pages\n";
+      exit(1);
+   }
+   cout << "Pass\n";
+
+   // The dirty pages are written back as batches
+   return (pfm.CloseFile(fh));
+}
+
+//
+// CheckSharing
+//
+// Desc: Two futures and a GetThisPage on the same page, and a future
+//       destroyed without Wait, which must leave its page unpinned
+//
+RC CheckSharing(int delta)
+{
+   PF_Manager pfm;
+   PF_FileHandle fh;
+   PF_PageHandle ph1, ph2, ph3;
+   RC rc;
+   char *pData1, *pData2, *pData3;
+   PageNum pageNum = NUM_PAGES - 1;
+
+   cout << "Checking shared reads: ";
+
+   if ((rc = pfm.OpenFile(FILE1, fh)))
+      return (rc);
+
+   {
+      PF_PageFuture future1, future2, future3;
+      if ((rc = fh.GetPageAsync(pageNum, future1)) ||
+            (rc = fh.GetPageAsync(pageNum, future2)) ||
+            (rc = fh.GetThisPage(pageNum, ph3)) ||
+            (rc = future2.Wait(ph2)) ||
+            (rc = future1.Wait(ph1)) ||
+            (rc = ph1.GetData(pData1)) ||
+            (rc = ph2.GetData(pData2)) ||
+            (rc = ph3.GetData(pData3)))
+         return (rc);
+
+      int value = pageNum + delta;
+      if (pData1 != pData2 || pData1 != pData3 ||
+            memcmp(pData1, &value, sizeof(value))) {
+         cout << "the three pins disagree\n";
+         exit(1);
+      }
+
+      if (!future1.IsReady() || future2.Wait(ph2) != PF_PAGENOTINBUF) {
+         cout << "a waited future is still started\n";
+         exit(1);
+      }
+
+      // A started future cannot be reused before it is waited for
+      if ((rc = fh.GetPageAsync(0, future1)) ||
+            (rc = fh.GetPageAsync(1, future3)))
+         return (rc);
+      if (fh.GetPageAsync(1, future1) != PF_PAGEPINNED) {
+         cout << "a started future was reused\n";
+         exit(1);
+      }
+
+      for (int i = 0; i < 3; i++)
+         if ((rc = fh.UnpinPage(pageNum)))
+            return (rc);
+
+      // future1 and future3 are dropped here, unpinning pages 0 and 1
+   }
+
+   // Nothing may be left pinned
+   if ((rc = fh.FlushPages()))
+      return (rc);
+
+   cout << "Pass\n";
+   return (pfm.CloseFile(fh));
+}
+
+RC TestPF()
+{
+   RC rc;
+
+   if ((rc = CreateTestFile(FILE1, NUM_PAGES)) ||
+         (rc = CheckPages(PF_IO_AUTO, "the default backend", 0)) ||
+         (rc = CheckPages(PF_IO_THREADS, "the thread pool", 1)) ||
+         (rc = CheckSharing(2)))
+      return (rc);
+
+   return (0);
+}
+
+int main()
+{
+   RC rc;
+
+   // Write out initial starting message
+   cerr.flush();
+   cout.flush();
+   cout << "********************\n";
+   cout << "Starting PF asynchronous I/O test.\n";
+   cout.flush();
+
+   // Delete files from last time
+   unlink(FILE1);
+
+   if ((rc = TestPF())) {
+      PF_PrintError(rc);
+      return (1);
+   }
+
+   unlink(FILE1);
+
+   // Write ending message and exit
+   cout << "Ending PF asynchronous I/O test.\n";
+   cout << "********************\n\n";
+
+   return (0);
+}
@@ -0,0 +1,232 @@
+//
+// File:        pf_test8.cc
+// Description: Test of the sequential read-ahead of the PF buffer manager
+//
+// A file larger than the buffer is scanned with GetFirstPage/GetNextPage,
+// which must read most of its pages ahead, then read with a stride, which
+// must not read anything ahead.  Every page is still counted once as not
+// found, and read-ahead turned off in the configuration reads nothing
+// ahead.  Under LRU, a hot page must outlive a scan with SEQUENTIAL_HINT
+// several times the buffer: the pages read ahead and those of the scan
+// stay at the cold end.
+//
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <cstring>
+#include <unistd.h>
+#include "pf.h"
+#include "pf_testutil.h"
+#include "pf_internal.h"
+
+using namespace std;
+
+//
+// Defines
+//
+#define FILE1         "file1"
+#define NUM_PAGES     (4 * PF_BUFFER_SIZE)  // pages in the test file
+#define STRIDE        3                     // stride of the random reader
+#define HOT_PAGE      (NUM_PAGES - 1)       // page kept hot during a scan
+#define HOT_SCAN      (3 * PF_BUFFER_SIZE)  // pages scanned meanwhile
+
+RC ScanPages(int bReadAhead, int &numAhead, int &numMissed);
+RC StridePages(int &numAhead);
+RC KeepHotPage(int &numAhead, int &bKept);
+
+//
+// ScanPages
+//
+// Desc: Scan the whole file and check every page
+// Out:  numAhead - pages read ahead during the scan
+//       numMissed - pages counted as not found during the scan
+//
+RC ScanPages(int bReadAhead, int &numAhead, int &numMissed)
+{
+   PF_BufferConfig config;
+   config.bReadAhead = bReadAhead;
+   PF_Manager pfm(config);
+   PF_FileHandle fh;
+   PF_PageHandle ph;
+   RC rc;
+   char *pData;
+   PageNum pageNum;
+   int i, value;
+
+   if ((rc = pfm.OpenFile(FILE1, fh)))
+      return (rc);
+
+   long long aheadBefore = GetStat(PF_READAHEAD);
+   long long missedBefore = GetStat(PF_PAGENOTFOUND);
+
+   for (i = 0, rc = fh.GetFirstPage(ph); rc == 0; i++, rc = fh.GetNextPage(pageNum, ph)) {
+      if ((rc = ph.GetData(pData)) ||
+            (rc = ph.GetPageNum(pageNum)))
+         return (rc);
+
+      memcpy(&value, pData, sizeof(value));
+      if (value != pageNum) {
+         cout << "page " << pageNum << " holds " << value << "\n";
+         exit(1);
+      }
+
+      if ((rc = fh.UnpinPage(pageNum)))
+         return (rc);
+   }
+   if (rc != PF_EOF)
+      return (rc);
+
+   if (i != NUM_PAGES) {
+      cout << "found " << i << " pages\n";
+      exit(1);
+   }
+
+   numAhead = GetStat(PF_READAHEAD) - aheadBefore;
+   numMissed = GetStat(PF_PAGENOTFOUND) - missedBefore;
+
+   // Reads still in flight must not keep the file from closing
+   return (pfm.CloseFile(fh));
+}
+
+//
+// StridePages
+//
+// Desc: Read every STRIDE-th page of the file
+// Out:  numAhead - pages read ahead meanwhile
+//
+RC StridePages(int &numAhead)
+{
+   PF_Manager pfm;
+   PF_FileHandle fh;
+   PF_PageHandle ph;
+   RC rc;
+   char *pData;
+
+   if ((rc = pfm.OpenFile(FILE1, fh)))
+      return (rc);
+
+   long long aheadBefore = GetStat(PF_READAHEAD);
+
+   for (int i = 0; i < NUM_PAGES; i += STRIDE) {
+      if ((rc = fh.GetThisPage(i, ph)) ||
+            (rc = ph.GetData(pData)))
+         return (rc);
+
+      if (memcmp(pData, &i, sizeof(i))) {
+         cout << "Page " << i << " has wrong contents\n";
+         exit(1);
+      }
+
+      if ((rc = fh.UnpinPage(i)))
+         return (rc);
+   }
+
+   numAhead = GetStat(PF_READAHEAD) - aheadBefore;
+   return (pfm.CloseFile(fh));
+}
+
+//
+// KeepHotPage
+//
+// Desc: Under LRU, read a page and unpin it, then scan the first HOT_SCAN
+//       pages of the file with SEQUENTIAL_HINT and read the page again
+// Out:  numAhead - pages read ahead during the scan
+//       bKept - TRUE if the page was still in the buffer
+//
+RC KeepHotPage(int &numAhead, int &bKept)
+{
+   PF_Manager pfm(1, PF_REPLACE_LRU);
+   PF_FileHandle fh;
+   PF_PageHandle ph;
+   RC rc;
+
+   if ((rc = pfm.OpenFile(FILE1, fh)) ||
+         (rc = fh.GetThisPage(HOT_PAGE, ph)) ||
+         (rc = fh.UnpinPage(HOT_PAGE)))
+      return (rc);
+
+   long long aheadBefore = GetStat(PF_READAHEAD);
+
+   for (int i = 0; i < HOT_SCAN; i++) {
+      if ((rc = fh.GetThisPage(i, ph, SEQUENTIAL_HINT)) ||
+            (rc = fh.UnpinPage(i)))
+         return (rc);
+   }
+
+   numAhead = GetStat(PF_READAHEAD) - aheadBefore;
+   long long foundBefore = GetStat(PF_PAGEFOUND);
+
+   if ((rc = fh.GetThisPage(HOT_PAGE, ph)) ||
+         (rc = fh.UnpinPage(HOT_PAGE)))
+      return (rc);
+
+   bKept = (GetStat(PF_PAGEFOUND) == foundBefore + 1);
+   return (pfm.CloseFile(fh));
+}
+
+RC TestPF()
+{
+   RC rc;
+   int numAhead, numMissed, numStride, numOff, numMissedOff;
+   int numHotAhead, bHotKept;
+
+   if ((rc = CreateTestFile(FILE1, NUM_PAGES)) ||
+         (rc = ScanPages(TRUE, numAhead, numMissed)) ||
+         (rc = StridePages(numStride)) ||
+         (rc = ScanPages(FALSE, numOff, numMissedOff)) ||
+         (rc = KeepHotPage(numHotAhead, bHotKept)))
+      return (rc);
+
+#ifdef PF_STATS
+   cout << "Sequential scan: " << numAhead << " of " << NUM_PAGES
+      << " pages read ahead\n";
+   cout << "Strided reads: " << numStride << " pages read ahead\n";
+   cout << "Read-ahead off: " << numOff << " pages read ahead\n";
+   cout << "Scan of " << HOT_SCAN << " pages past a hot page: "
+      << numHotAhead << " pages read ahead\n";
+
+   if (numAhead < NUM_PAGES / 2 || numMissed != NUM_PAGES) {
+      cout << "the scan was not read ahead (" << numMissed << " misses)\n";
+      exit(1);
+   }
+   if (numStride != 0 || numOff != 0 || numMissedOff != NUM_PAGES) {
+      cout << "pages were read ahead for nothing\n";
+      exit(1);
+   }
+   if (numHotAhead == 0 || !bHotKept) {
+      cout << "the scan evicted the hot page\n";
+      exit(1);
+   }
+#endif
+
+   return (0);
+}
+
+int main()
+{
+   RC rc;
+
+   // Write out initial starting message
+   cerr.flush();
+   cout.flush();
+   cout << "********************\n";
+   cout << "Starting PF read-ahead test.\n";
+   cout.flush();
+
+   // Delete files from last time
+   unlink(FILE1);
+
+   if ((rc = TestPF())) {
+      PF_PrintError(rc);
+      return (1);
+   }
+
+   unlink(FILE1);
+
+   // Write ending message and exit
+   cout << "Ending PF read-ahead test.\n";
+   cout << "********************\n\n";
+
+   return (0);
+}
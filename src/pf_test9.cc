@@ -0,0 +1,195 @@
+//
+// File:        pf_test9.cc
+// Description: Test of the background writer of the PF buffer manager
+//
+// A buffer full of dirty pages is left alone for a while, then pages
+// that are not in the buffer are read.  With the background writer the
+// dirty pages are written meanwhile and the misses find clean victims;
+// without it every miss writes its victim first.  The file is checked
+// afterwards, and a writer running while the file is closed must not
+// make CloseFile fail.
+//
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <cstring>
+#include <unistd.h>
+#include "pf.h"
+#include "pf_testutil.h"
+#include "pf_internal.h"
+
+using namespace std;
+
+//
+// Defines
+//
+#define FILE1         "file1"
+#define NUM_PAGES     (2 * PF_BUFFER_SIZE)  // pages in the test file
+#define WAIT_MS       500                   // time given to the writer
+
+RC DirtyThenMiss(int bBgWriter, int delta, int &numForeground);
+RC CheckPages(int delta);
+
+//
+// DirtyThenMiss
+//
+// Desc: Add delta to the first PF_BUFFER_SIZE pages, give the writer
+//       time to write them, then read the other pages
+// Out:  numForeground - pages written by the reads of the other pages
+//
+RC DirtyThenMiss(int bBgWriter, int delta, int &numForeground)
+{
+   PF_BufferConfig config;
+   config.bBgWriter = bBgWriter;
+   config.bgDirtyPct = 0;
+   config.bReadAhead = FALSE;
+   PF_Manager pfm(config);
+   PF_FileHandle fh;
+   PF_PageHandle ph;
+   RC rc;
+   char *pData;
+   int value;
+
+   cout << "Background writer " << (bBgWriter ? "on" : "off") << ": ";
+
+   if ((rc = pfm.OpenFile(FILE1, fh)))
+      return (rc);
+
+   long long bgBefore = GetStat(PF_BGWRITE);
+
+   for (int i = 0; i < PF_BUFFER_SIZE; i++) {
+      if ((rc = fh.GetThisPage(i, ph)) ||
+            (rc = ph.GetData(pData)))
+         return (rc);
+
+      memcpy(&value, pData, sizeof(value));
+      value += delta;
+      memcpy(pData, &value, sizeof(value));
+
+      if ((rc = fh.MarkDirty(i)) ||
+            (rc = fh.UnpinPage(i)))
+         return (rc);
+   }
+
+   // Give the writer many rounds to clean the buffer
+   if (bBgWriter)
+      usleep(WAIT_MS * 1000);
+
+   long long writesBefore = GetStat(PF_WRITEPAGE);
+   for (int i = PF_BUFFER_SIZE; i < NUM_PAGES; i++) {
+      if ((rc = fh.GetThisPage(i, ph)) ||
+            (rc = fh.UnpinPage(i)))
+         return (rc);
+   }
+   numForeground = GetStat(PF_WRITEPAGE) - writesBefore;
+
+   cout << GetStat(PF_BGWRITE) - bgBefore << " pages written in the background, "
+      << numForeground << " by misses\n";
+
+   // Dirty the pages read last and close at once, while the writer may
+   // be writing them
+   for (int i = PF_BUFFER_SIZE; i < NUM_PAGES; i++) {
+      if ((rc = fh.GetThisPage(i, ph)) ||
+            (rc = ph.GetData(pData)))
+         return (rc);
+
+      memcpy(&value, pData, sizeof(value));
+      value += delta;
+      memcpy(pData, &value, sizeof(value));
+
+      if ((rc = fh.MarkDirty(i)) ||
+            (rc = fh.UnpinPage(i)))
+         return (rc);
+   }
+
+   return (pfm.CloseFile(fh));
+}
+
+//
+// CheckPages
+//
+// Desc: Check that every page holds its number plus delta
+//
+RC CheckPages(int delta)
+{
+   PF_Manager pfm;
+   PF_FileHandle fh;
+   PF_PageHandle ph;
+   RC rc;
+   char *pData;
+   int value;
+
+   cout << "Checking pages: ";
+
+   if ((rc = pfm.OpenFile(FILE1, fh)))
+      return (rc);
+
+   for (int i = 0; i < NUM_PAGES; i++) {
+      if ((rc = fh.GetThisPage(i, ph)) ||
+            (rc = ph.GetData(pData)))
+         return (rc);
+
+      memcpy(&value, pData, sizeof(value));
+      if (value != i + delta) {
+         cout << "page " << i << " holds " << value << "\n";
+         exit(1);
+      }
+
+      if ((rc = fh.UnpinPage(i)))
+         return (rc);
+   }
+
+   cout << "Pass\n";
+   return (pfm.CloseFile(fh));
+}
+
+RC TestPF()
+{
+   RC rc;
+   int numOn, numOff;
+
+   if ((rc = CreateTestFile(FILE1, NUM_PAGES)) ||
+         (rc = DirtyThenMiss(TRUE, 1, numOn)) ||
+         (rc = CheckPages(1)) ||
+         (rc = DirtyThenMiss(FALSE, 1, numOff)) ||
+         (rc = CheckPages(2)))
+      return (rc);
+
+#ifdef PF_STATS
+   if (numOn != 0 || numOff != PF_BUFFER_SIZE) {
+      cout << "the misses did not find clean victims\n";
+      exit(1);
+   }
+#endif
+
+   return (0);
+}
+
+int main()
+{
+   RC rc;
+
+   // Write out initial starting message
+   cerr.flush();
+   cout.flush();
+   cout << "********************\n";
+   cout << "Starting PF background writer test.\n";
+   cout.flush();
+
+   // Delete files from last time
+   unlink(FILE1);
+
+   if ((rc = TestPF())) {
+      PF_PrintError(rc);
+      return (1);
+   }
+
+   unlink(FILE1);
+
+   // Write ending message and exit
+   cout << "Ending PF background writer test.\n";
+   cout << "********************\n\n";
+
+   return (0);
+}
@@ -0,0 +1,74 @@
+//
+// File:        pf_testutil.cc
+// Description: Helpers shared by the PF testers and benchmarks
+//
+
+#include <cstring>
+#include <unistd.h>
+#include "pf_testutil.h"
+
+#ifdef PF_STATS
+// This is defined within pf_buffermgr.cc
+extern StatisticsMgr *pStatisticsMgr;
+#endif
+
+//
+// CreateTestFile
+//
+// Desc: Create a file of numPages pages holding their page number.  A
+//       file left over from an earlier run is removed first.
+// In:   pfm - manager to create the file with
+//       psName - name of the file
+//       numPages - # of pages
+//       flags - PF_CREATE_* flags of CreateFile
+// Ret:  PF return code
+//
+RC CreateTestFile(PF_Manager &pfm, const char *psName, int numPages,
+      int flags)
+{
+   PF_FileHandle fh;
+   PF_PageHandle ph;
+   RC rc;
+   char *pData;
+   PageNum pageNum;
+
+   unlink(psName);
+   if ((rc = pfm.CreateFile(psName, flags)) ||
+         (rc = pfm.OpenFile(psName, fh)))
+      return (rc);
+
+   for (int i = 0; i < numPages; i++) {
+      if ((rc = fh.AllocatePage(ph)) ||
+            (rc = ph.GetData(pData)) ||
+            (rc = ph.GetPageNum(pageNum)))
+         return (rc);
+
+      memcpy(pData, &pageNum, sizeof(pageNum));
+
+      if ((rc = fh.MarkDirty(pageNum)) ||
+            (rc = fh.UnpinPage(pageNum)))
+         return (rc);
+   }
+
+   return (pfm.CloseFile(fh));
+}
+
+RC CreateTestFile(const char *psName, int numPages, int flags)
+{
+   PF_Manager pfm;
+   return (CreateTestFile(pfm, psName, numPages, flags));
+}
+
+//
+// GetStat
+//
+// Desc: Current value of a statistic (all 64 bits), 0 without PF_STATS
+//
+long long GetStat(const char *psKey)
+{
+   long long value = 0;
+#ifdef PF_STATS
+   pStatisticsMgr->GetValue(psKey, value);    // 0 if never counted
+#endif
+   return (value);
+}
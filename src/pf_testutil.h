@@ -0,0 +1,22 @@
+//
+// File:        pf_testutil.h
+// Description: Helpers shared by the PF testers and benchmarks
+//
+
+#ifndef PF_TESTUTIL_H
+#define PF_TESTUTIL_H
+
+#include "pf.h"
+#include "statistics.h"           // names of the statistics
+
+// Create a file of numPages pages, each holding its page number in its
+// first bytes, and close it again; without a manager a fresh one is used.
+// flags are those of PF_Manager::CreateFile.
+RC CreateTestFile(PF_Manager &pfm, const char *psName, int numPages,
+                  int flags = 0);
+RC CreateTestFile(const char *psName, int numPages, int flags = 0);
+
+// Current value of a buffer manager statistic (64 bits), 0 without PF_STATS
+long long GetStat(const char *psKey);
+
+#endif
@@ -0,0 +1,213 @@
+//
+// File:        pf_warmup.cc
+// Description: PF_WarmList class implementation
+//
+// The list is a text file: a "redbase-pf-warmup 1" line, then one line
+// per page, hottest first, holding the page number and the file name
+// (the rest of the line, so names may contain blanks).  It is written to
+// a temporary file that is renamed over the old list, so a crash while
+// saving leaves the list of the run before.
+//
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include "pf_warmup.h"
+
+using namespace std;
+
+#define PF_WARMUP_MAGIC   "redbase-pf-warmup 1"
+
+//
+// ByRank
+//
+// Desc: Order of the saved pages: hottest first
+//
+static bool ByRank(const PF_WarmPage &a, const PF_WarmPage &b)
+{
+   return (a.rank < b.rank);
+}
+
+//
+// PF_WarmList
+//
+// Desc: Constructor - nothing is read until Load
+// In:   psPath - file the list is kept in
+//       maxPages - pages loaded and saved at most (the buffer size)
+//
+PF_WarmList::PF_WarmList(const char *psPath, int _maxPages)
+{
+   path = psPath;
+   maxPages = _maxPages;
+}
+
+//
+// ~PF_WarmList
+//
+// Desc: Destructor - the list is only written by Save
+//
+PF_WarmList::~PF_WarmList()
+{
+}
+
+//
+// Load
+//
+// Desc: Read the list of the last run, keeping the maxPages hottest
+//       pages.  A missing list, or one in another format, is an empty
+//       one: the buffer just starts cold.
+// Ret:  0
+//
+RC PF_WarmList::Load()
+{
+   lock_guard<mutex> guard(latch);
+   ifstream in(path.c_str());
+   string line;
+
+   lastRun.clear();
+   if (!in || !getline(in, line) || line != PF_WARMUP_MAGIC)
+      return (0);
+
+   int numPages = 0;
+   while (numPages < maxPages && getline(in, line)) {
+      istringstream fields(line);
+      PageNum pageNum;
+      string fileName;
+
+      if (!(fields >> pageNum) || pageNum < 0 || fields.get() != ' ' ||
+            !getline(fields, fileName) || fileName.empty())
+         continue;
+      lastRun[fileName].push_back(pageNum);
+      numPages++;
+   }
+
+   return (0);
+}
+
+//
+// Save
+//
+// Desc: Write the pages recorded in this run, hottest first, at most
+//       maxPages of them.  Pages recorded at different closes are ranked
+//       against each other by their place in the replacement order when
+//       they were recorded.
+// Ret:  PF_UNIX if the list cannot be written, 0 otherwise
+//
+// 先写临时文件再rename,保存一半时崩溃不会损坏上一次的列表
+RC PF_WarmList::Save()
+{
+   lock_guard<mutex> guard(latch);
+   string tmpPath = path + ".tmp";
+
+   stable_sort(pages.begin(), pages.end(), ByRank);
+
+   {
+      ofstream out(tmpPath.c_str(), ios::trunc);
+      out << PF_WARMUP_MAGIC << "\n";
+      for (int i = 0; i < (int)pages.size() && i < maxPages; i++)
+         out << pages[i].pageNum << " " << pages[i].fileName << "\n";
+      out.flush();
+      if (!out) {
+         remove(tmpPath.c_str());
+         return (PF_UNIX);
+      }
+   }
+
+   if (rename(tmpPath.c_str(), path.c_str()) < 0)
+      return (PF_UNIX);
+
+   return (0);
+}
+
+//
+// OpenFile
+//
+// Desc: Remember the name of file fd, and hand over the pages the last
+//       run had of the file, sorted so that adjacent pages are read
+//       together.  Pages beyond the end of the file are dropped.
+// In:   fd - descriptor the file was opened as
+//       fileName - name it was opened under
+//       numFilePages - # of pages in the file
+// Out:  pages - pages to read ahead (none after the first open)
+//
+void PF_WarmList::OpenFile(int fd, const char *fileName, PageNum numFilePages,
+      vector<PageNum> &pages)
+{
+   lock_guard<mutex> guard(latch);
+
+   pages.clear();
+   fileNames[fd] = fileName;
+
+   map<string, vector<PageNum> >::iterator it = lastRun.find(fileName);
+   if (it == lastRun.end())
+      return;
+
+   for (int i = 0; i < (int)it->second.size(); i++)
+      if (it->second[i] < numFilePages)
+         pages.push_back(it->second[i]);
+   lastRun.erase(it);
+
+   sort(pages.begin(), pages.end());
+   pages.erase(unique(pages.begin(), pages.end()), pages.end());
+}
+
+//
+// RecordFile
+//
+// Desc: Record the resident pages of file fd in place of those recorded
+//       for its name before (a file opened twice keeps the pages of the
+//       handle closed last)
+// In:   fd - descriptor of the file being closed
+//       resident - its pages in the buffer pool
+//
+void PF_WarmList::RecordFile(int fd, const vector<PF_ResidentPage> &resident)
+{
+   lock_guard<mutex> guard(latch);
+
+   map<int, string>::iterator it = fileNames.find(fd);
+   if (it == fileNames.end())
+      return;
+   const string &fileName = it->second;
+
+   int n = 0;
+   for (int i = 0; i < (int)pages.size(); i++)
+      if (pages[i].fileName != fileName)
+         pages[n++] = pages[i];
+   pages.resize(n);
+
+   for (int i = 0; i < (int)resident.size(); i++) {
+      PF_WarmPage page;
+      page.fileName = fileName;
+      page.pageNum = resident[i].pageNum;
+      page.rank = resident[i].rank;
+      pages.push_back(page);
+   }
+}
+
+//
+// CloseFile
+//
+// Desc: File fd is closed; the descriptor may be reused by the next file
+//
+void PF_WarmList::CloseFile(int fd)
+{
+   lock_guard<mutex> guard(latch);
+   fileNames.erase(fd);
+}
+
+//
+// OpenFds
+//
+// Desc: Descriptors of the files opened and not closed yet
+// Out:  fds - the descriptors
+//
+void PF_WarmList::OpenFds(vector<int> &fds)
+{
+   lock_guard<mutex> guard(latch);
+
+   fds.clear();
+   for (map<int, string>::iterator it = fileNames.begin();
+         it != fileNames.end(); ++it)
+      fds.push_back(it->first);
+}
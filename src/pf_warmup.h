@@ -0,0 +1,77 @@
+//
+// File:        pf_warmup.h
+// Description: PF_WarmList class interface
+//
+// The warm list carries the resident pages of the buffer pool over a
+// restart.  When a file is closed (its pages are about to leave the
+// buffer) the pages it has in the buffer are recorded with their rank in
+// the replacement order; when the PF_Manager goes away the recorded pages
+// of all the files are written out hottest first, one "pageNum fileName"
+// line each, at most as many as the buffer has frames.  The next
+// PF_Manager configured with the same list reads it back, and OpenFile
+// hands the pages of the file to the buffer manager to be read ahead.
+//
+// Files are known by the name given to OpenFile: a file opened under
+// another (relative) name is not warmed up.
+//
+
+#ifndef PF_WARMUP_H
+#define PF_WARMUP_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include "pf_internal.h"
+
+//
+// PF_WarmPage - a recorded page of the list
+//
+struct PF_WarmPage {
+    std::string    fileName;    // name the file was opened under
+    PageNum        pageNum;     // page number
+    double         rank;        // see PF_ResidentPage
+};
+
+//
+// PF_WarmList - the resident pages of the last run, and of this one
+//
+class PF_WarmList {
+public:
+    // Constructor - the list is kept in the file psPath and holds
+    // maxPages pages at most
+    PF_WarmList      (const char *psPath, int maxPages);
+    ~PF_WarmList     ();                         // Destructor
+
+    // Read the list of the last run (none is not an error)
+    RC  Load         ();
+    // Write the pages recorded in this run, hottest first
+    RC  Save         ();
+
+    // A file was opened as fd: pages of the last run to read ahead, in
+    // page order, below numFilePages.  Only the first open of a file
+    // gets them.
+    void OpenFile    (int fd, const char *fileName, PageNum numFilePages,
+                      std::vector<PageNum> &pages);
+    // File fd is being closed: its resident pages replace the ones
+    // recorded for its name so far.  Once it is closed, forget fd.
+    void RecordFile  (int fd, const std::vector<PF_ResidentPage> &resident);
+    void CloseFile   (int fd);
+
+    // Descriptors of the files open, for recording them at shutdown
+    void OpenFds     (std::vector<int> &fds);
+
+private:
+    std::mutex     latch;       // protects the members below
+    std::string    path;        // file the list is kept in
+    int            maxPages;    // pages saved at most
+    std::map<std::string, std::vector<PageNum> > lastRun;
+                                // pages of the last run not warmed up yet,
+                                // by file name, hottest first
+    std::map<int, std::string> fileNames;
+                                // names of the open files, by descriptor
+    std::vector<PF_WarmPage> pages;
+                                // pages recorded in this run
+};
+
+#endif
@@ -85,7 +85,9 @@ enum CompOp {
 // Pin Strategy Hint
 //
 enum ClientHint {
-    NO_HINT                                     // default value
+    NO_HINT,                                    // default value
+    SEQUENTIAL_HINT                             // pages are read once, in
+                                                // order (e.g. a full scan)
 };
 
 //
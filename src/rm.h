@@ -26,15 +26,19 @@
  *                                   记录管理(RM)的接口
  * 
  * 1.一个页的结构(RM层只有4092字节):
- *      |PF_PageHdr| RM_PageHdr |bitmap | slots ......|
+ *      |PF_PageHdr| RM_PageHdr |bitmap |(填充)| slots ......|
  * 
- * 2.RM_FileHdr独占文件RM层的第一个page(pagenum应该是1,前面还有PF_FileHdr)
- *   但RM_FileHdr中的numPages表示数据页的个数,不包括RM_FileHdr
+ * 2.RM_FileHdr独占文件的第一个page(PF页号为0,PF_FileHdr不算page),数据页为[1,numPages]
+ *   RM_FileHdr中的numPages表示数据页的个数,不包括RM_FileHdr
  * 3.pageNum、slotNum都采用从0开始计
  * **************************************************************************************************/
 
 #define RM_PAGE_LIST_END -1         /* 链表结束=>即文件中分配的page已用完 */
 #define RM_SLOT_ALL_USED  -2        /* (page中)已没有空闲slot */
+#define RM_HDR_PAGE       0         /* RM_FileHdr所在的page */
+#define RM_FIRST_PAGE     1         /* 第一个数据页 */
+#define RM_SLOT_ALIGN     4         /* slots区域的起始按4字节对齐(INT/FLOAT属性) */
+#define RM_BULK_PAGES     8         /* InsertRecs一次向PF层分配的新页数(同时pin住) */
 
 
 
@@ -94,6 +98,56 @@ private:
     bool isValid;       /* 当前记录是否可用(填充了有效数据) */
 };
 
+//
+// RM_RecordView: a record read in place.  Instead of copying the record
+// like RM_Record, the view keeps the page of the record pinned in the
+// buffer pool and points into it.  The pin is released by Release, by
+// handing the view another record, by moving it away, or when the view is
+// destroyed.  Views move but do not copy.  A view must be released before
+// its file is closed.
+//
+/* 零拷贝记录:引用缓冲区中pin住的页,不分配内存;析构/Release时unpin */
+class RM_RecordView {
+    friend class RM_FileHandle;
+    friend class RM_FileScan;
+public:
+    RM_RecordView ();
+    ~RM_RecordView();                               // Releases the pin
+
+    RM_RecordView (RM_RecordView &&view);           // Move constructor
+    RM_RecordView& operator=(RM_RecordView &&view); // Move assignment
+
+    // Set pData to the record in the buffer pool.  It is valid until the
+    // view is released.
+    RC GetData(const char *&pData) const;
+
+    // Return the RID associated with the record
+    RC GetRid (RID &rid) const;
+
+    /* 获取记录大小(字节数)*/
+    RC GetRecSize(int& recordSize) const;
+
+    /* 是否引用着一条记录 */
+    bool IsValid() const;
+
+    // Unpin the page of the record; the view refers to no record after
+    RC Release();
+
+private:
+    // Not copyable: a copy would have to pin the page again
+    RM_RecordView (const RM_RecordView &view);
+    RM_RecordView& operator=(const RM_RecordView &view);
+
+    /* 接管记录所在页的一个pin(页已由调用者pin住),先释放原来的记录 */
+    void Set(PF_FileHandle* pfFileHandle,const char* pRecordData,
+             const RID &recordId,int recordSize);
+
+    PF_FileHandle* pfFileHandle;    /* 记录所在页pin在这个文件中,NULL:没有记录 */
+    const char* pRecData;           /* 指向缓冲区页中的记录 */
+    RID rid;
+    int recSize;
+};
+
 //
 // RM_FileHandle: RM File interface => 对应PF层的一个文件,在RM层负责处理文件中的各记录!
 //
@@ -104,8 +158,18 @@ public:
 
     // Given a RID, return the record
     RC GetRec     (const RID &rid, RM_Record &rec) const;
+    // The same, in place: the page stays pinned until view is released
+    // (on error the view is released)
+    RC GetRec     (const RID &rid, RM_RecordView &view) const;
 
     RC InsertRec  (const char *pData, RID &rid);       // Insert a new record
+    // Insert count records stored one after the other at pData; rids[i]
+    // gets the RID of record i.  Each page is pinned once and filled as
+    // far as the batch goes, and new pages are allocated several at once.
+    // numInserted gets the number of records inserted.  On error the batch
+    // is inserted in part: records 0 to numInserted-1 are in the file with
+    // their RIDs in rids, the rest are not.
+    RC InsertRecs (const char *pData, int count, RID *rids, int &numInserted);
 
     RC DeleteRec  (const RID &rid);                    // Delete a record
     RC UpdateRec  (const RM_Record &rec);              // Update a record
@@ -126,6 +190,9 @@ public:
     /*自定义,传入PF_FileHandle,从而将这个RM_FileHandle绑定到对应的文件上*/
     RC Open(PF_FileHandle& pfFileHandle);
 
+    /*与Open对应,文件关闭后解除绑定*/
+    RC Close();
+
     /*判断文件是打开*/
     bool IsOpen();
 
@@ -144,27 +211,54 @@ public:
     /* 一个RM页内的数据可存储记录个数(slots) */
     RC GetPageSlots(int& numSlots) const;
 
+    /* 页的布局在Open时算好,热路径直接读取 */
+    int NumSlots() const { return numSlots; }          /*一页的槽数*/
+    int BMapBytes() const { return bmapBytes; }        /*位图字节数*/
+    int SlotsOffset() const { return slotsOffset; }    /*第一个slot相对页数据部分的偏移*/
+    int RecStride() const { return recStride; }        /*相邻slot的间距*/
+    /* 页数据部分pPageData中第slotNum个slot的数据 */
+    char* SlotPtr(char* pPageData,SlotNum slotNum) const {
+        return pPageData+slotsOffset+slotNum*recStride;
+    }
+
     /* 获取指定页(pageHandle)中某个slotNum对应的数据指针*/
     RC GetSlotData(PF_PageHandle pageHandle,SlotNum slotNum,char *&pRecData) const;
 
-    /*获取一个没有装满的page;如果没有,则需要给文件分配一个新的page*/
-    RC GetOneFreePage(PageNum& pageNum);
-
-    /*对于一个给定的页(pageHandle),在其中找一个空闲slot,返回slotNum*/
-    RC GetOneFreeSlot(PF_PageHandle pageHandle, SlotNum& slotNum);
+    /*pin住rid所在的页,并找到记录数据;出错时页已unpin*/
+    RC PinRec(const RID &rid, char *&pRecData) const;
 
 
 /********** 由于RM_FileHandle主要管理文件内的记录,而记录使用了位图=> 需要自定义位图相关操作 **********/
 //private:    
     /* 槽数为slots位图占用多少字节(向上取整)*/
     int GetBMapBytes(int slots) const;
+
+    /* 第一个slot在页中的偏移(页头+位图,按RM_SLOT_ALIGN对齐)*/
+    int GetSlotsOffset(int slots) const;
+
+    /* 由记录大小算出页的布局(numSlots等),Open时调用一次 */
+    RC ComputeLayout();
     
     /*对于指定的页(pPageData),检查其位图中slotNum对应的槽是否已占用*/
-    bool IsSlotUsed(char* pPageData,int slotNum);
+    bool IsSlotUsed(const char* pPageData,int slotNum) const;
+
+    /* 下面三个按64位字扫描位图,而不是一位一位地IsSlotUsed */
+    /* slotNum及其后第一个已占用/未占用的槽,没有时返回NumSlots() */
+    int NextUsedSlot(const char* pPageData,int slotNum) const;
+    int NextFreeSlot(const char* pPageData,int slotNum) const;
+    /* 位图中已占用的槽数(popcount),应等于numSlots-numFreeSlots */
+    int CountUsedSlots(const char* pPageData) const;
 
     /*对于指定的页(pPageData),将其第slotNum对应的槽标记为已经占用*/
     RC SetSlot(char* pPageData,int slotNum);
 
+    /*将从slotNum起的count个槽一起标记为已占用(整字节直接置0xFF)*/
+    RC SetSlots(char* pPageData,int slotNum,int count);
+
+    /*InsertRecs的两种情况:填满一个未满的页,或者初始化并填充一个新页*/
+    RC FillFreePage(PageNum pageNum,const char *&pData,int &count,RID *&rids);
+    RC FillNewPage(PF_PageHandle &pageHandle,const char *&pData,int &count,RID *&rids);
+
     /*对于指定的页(pPageData),将其第slotNum对应的槽标记为未使用; 随之修改页头*/
     RC ResetSlot(char* pPageData,int slotNum);
 
@@ -172,10 +266,17 @@ public:
     bool IsBMapFull(char* pPageData);
 
 private:
-    PF_FileHandle* pfFileHandle;    /* 已经存在的PF 层文件处理器的指针!! */ 
+    PF_FileHandle* pfFileHandle;    /* 已经存在的PF 层文件处理器的指针!! => 指向pfFile*/ 
+    PF_FileHandle pfFile;           /* Open时拷贝一份,RM_Manager::OpenFile中的PF_FileHandle是局部变量 */
     RM_FileHdr rmFileHdr;           /*RM层文件头,对于一个打开文件,将文件头保存在内存中更方便,从而不必每次都读取文件头*/
     bool bFileOpen;                 /* 文件是否打开 */
     bool bHdrChanged;               /*RM层文件头是否更改*/
+
+    /* 页的布局,只取决于记录大小 */
+    int numSlots;                   /*一页的槽数*/
+    int bmapBytes;                  /*位图字节数*/
+    int slotsOffset;                /*第一个slot相对页数据部分的偏移*/
+    int recStride;                  /*相邻slot的间距,即记录大小*/
 };
 
 //
@@ -195,11 +296,18 @@ public:
                   void       *value,
                   ClientHint pinHint = NO_HINT); // Initialize a file scan
     RC GetNextRec(RM_Record &rec);               // Get next matching record
+    // The same, in place: the page stays pinned until view is released
+    // or gets the next record (at RM_EOF the view is released)
+    RC GetNextRec(RM_RecordView &view);
     RC CloseScan ();                             // Close the scan
 
     /*数据库中某个rec的数据,对应属性值是否 与 value是否符合条件compOp*/
     bool IsMatch(char* attr);
 
+private:
+    /*找到下一条符合条件的记录,其所在页保持pin住*/
+    RC FindNextRec(char *&pRecData, RID &rid);
+
 /*自定义成员*/
 private:
     /*首先,传入的参数(条件/condition)是比较的基准,暂存下来*/
@@ -213,6 +321,8 @@ private:
 
 
     PageNum currPageNum;            /*扫描的当前元素所在page*/
+    PF_PageHandle pageHandle;       /*currPageNum的页,bPagePinned时由扫描pin着,跨页时才换*/
+    bool bPagePinned;
     SlotNum currSlotNum;            /*扫描的当前元素所在在slotNum,GetNextRec时从这个slot的后面开始比较*/
     bool bScanOpen;                  /*filescan是否打开*/
 
@@ -271,4 +381,5 @@ void RM_PrintError(RC rc);
 #define RM_NO_VALID_SLOT        (START_RM_WARN+1)       /*警告:该page中,slot已用完*/
 #define RM_SCAN_EOF             (START_RM_WARN+2)       /*filescan时已经遍历完成*/
 #define RM_EOF                  (START_RM_WARN+3)        /*扫描到文件的结尾了*/                  
+#define RM_REC_NOT_FOUND        (START_RM_WARN+4)       /*RID对应的slot中没有记录*/
 #endif
@@ -4,16 +4,22 @@
 // Authors:     Aditya Bhandari (adityasb@stanford.edu)
 //
 #include<cstring>
+#include<stdint.h>
 #include "rm.h"
 using namespace std;
 
 // Default constructor
 RM_FileHandle::RM_FileHandle() {
+    pfFileHandle=NULL;
     bFileOpen=false;                           
     bHdrChanged=false;
     rmFileHdr.numPages=0;
     rmFileHdr.firstFreePage=RM_PAGE_LIST_END;
     rmFileHdr.recordSize=-1;
+    numSlots=0;
+    bmapBytes=0;
+    slotsOffset=0;
+    recStride=0;
 }
 
 // Destructor
@@ -27,24 +33,43 @@ RC RM_FileHandle::Open(PF_FileHandle& pfFileHandle){
         return RM_FILE_ALREADY_OPEN;
     }
 
-    /* 1.初始化RM_FileHandle的成员pfFileHandle*/
-    this->pfFileHandle=&pfFileHandle;
+    /* 1.初始化RM_FileHandle的成员pfFileHandle; 传入的可能是局部变量,所以拷贝一份*/
+    this->pfFile=pfFileHandle;
+    this->pfFileHandle=&this->pfFile;
 
     /* 2.读取pfFileHandle对应文件中,RM层的头信息 => 用于初始化成员rmFileHdr*/
     /* 这个头信息是在RM_Manager中创建文件时,就已经写入! */
     PF_PageHandle pageHandle;
-    this->pfFileHandle->GetThisPage(1,pageHandle);  /*0:PF头; 1:RM头*/
+    RC rc=this->pfFileHandle->GetThisPage(RM_HDR_PAGE,pageHandle);  /*PF_FileHdr不算page,RM头是第0页*/
+    if(rc){
+        PF_PrintError(rc);
+        return RM_PF;
+    }
     char* pPageData;
     pageHandle.GetData(pPageData);
     memcpy(&rmFileHdr,pPageData,sizeof(RM_FileHdr));
+    this->pfFileHandle->UnpinPage(RM_HDR_PAGE);
 
-    /* 3.打开文件*/
+    /* 3.页的布局只取决于记录大小,算一次就够了*/
+    rc=ComputeLayout();
+    if(rc){
+        return rc;
+    }
+
+    /* 4.打开文件*/
     bFileOpen=true;
-    bHdrChanged=true;
+    bHdrChanged=false;
 
-    /* 4.unpin*/
-    this->pfFileHandle->UnpinPage(1);
+    return OK_RC;
+}
 
+/*与Open对应,文件关闭后解除绑定(文件头由RM_Manager::CloseFile写回)*/
+RC RM_FileHandle::Close(){
+    if(!bFileOpen){
+        return RM_FILE_NOT_OPEN;
+    }
+    bFileOpen=false;
+    bHdrChanged=false;
     return OK_RC;
 }
 
@@ -54,85 +79,238 @@ RC RM_FileHandle::GetRec(const RID &rid, RM_Record &rec) const {
         return RM_FILE_NOT_OPEN;
     }
 
+    /* 1.pin住rid所在的页,找到记录数据 */
+    char* pRecData;
+    RC rc=PinRec(rid,pRecData);
+    if(rc){
+        return rc;
+    }
+    rec.SetMembers(pRecData,rid,rmFileHdr.recordSize);  /*SetMembers会拷贝数据,而不是引用page在缓冲区中的数据*/
+    
+    /* 2.手动unpin数据页*/
+    PageNum pageNum; 
+    rid.GetPageNum(pageNum);
+    pfFileHandle->UnpinPage(pageNum);
+    return OK_RC;
+}
+
+// Given a RID, return the record in place (zero copy)
+/* 与上面相同,但不拷贝:view接管页的pin,直到view被释放 */
+RC RM_FileHandle::GetRec(const RID &rid, RM_RecordView &view) const {
+    if(!bFileOpen){
+        return RM_FILE_NOT_OPEN;
+    }
+
+    char* pRecData;
+    RC rc=PinRec(rid,pRecData);
+    if(rc){
+        view.Release();
+        return rc;
+    }
+    view.Set(pfFileHandle,pRecData,rid,rmFileHdr.recordSize);
+    return OK_RC;
+}
+
+/*pin住rid所在的页,并找到记录数据;页号、槽号不对或槽中没有记录时返回RM_REC_NOT_FOUND,出错时页已unpin*/
+RC RM_FileHandle::PinRec(const RID &rid, char *&pRecData) const {
     /*1.获取RID对应的pageNum 和 slotNum*/
     PageNum pageNum; 
     SlotNum slotNum;
     int rc;
     rc=rid.GetPageNum(pageNum);
-    if(rc<0) return rc;
+    if(rc) return rc;
     rc=rid.GetSlotNum(slotNum);
-    if(rc<0) return rc;
+    if(rc) return rc;
+
+    if(pageNum<RM_FIRST_PAGE || pageNum>rmFileHdr.numPages || slotNum<0 || slotNum>=numSlots){
+        return RM_REC_NOT_FOUND;
+    }
 
     /* 2.获取rid对应page的PF_PageHandle */
     PF_PageHandle pageHandle;
     rc=pfFileHandle->GetThisPage(pageNum,pageHandle);    /*需要手动unpin!!!*/
-    if(rc<0){
-        pfFileHandle->UnpinPage(pageNum);
+    if(rc){
         PF_PrintError(rc);
         return RM_PF;
     }
 
-    /* 3.根据pagehandle、slotNum获取记录数据*/
-    char* pRecData;
-    rc=GetSlotData(pageHandle,slotNum,pRecData);
-    if(rc<0){
+    /* 3.槽中必须有记录;根据pagehandle、slotNum获取记录数据*/
+    char* pPageData;
+    pageHandle.GetData(pPageData);
+    if(!IsSlotUsed(pPageData,slotNum)){
         pfFileHandle->UnpinPage(pageNum);
-        PF_PrintError(rc);
-        return RM_PF;
+        return RM_REC_NOT_FOUND;
     }
-    rec.SetMembers(pRecData,rid,rmFileHdr.recordSize);  /*SetMembers会拷贝数据,而不是引用page在缓冲区中的数据*/
-    
-    /* 4.手动unpin数据页*/
-    pfFileHandle->UnpinPage(pageNum);
+    pRecData=SlotPtr(pPageData,slotNum);
     return OK_RC;
 }
 
 // Insert a new record
+/* 单条插入就是只有一条记录的批量插入 */
 RC RM_FileHandle::InsertRec(const char *pData, RID &rid) {
+    int numInserted;
+    return InsertRecs(pData,1,&rid,numInserted);
+}
+
+// Insert count records at once
+/**
+ * 原来每插入一条记录:GetOneFreePage pin/unpin一次空闲页,InsertRec再pin/unpin一次,
+ * 逐位找空闲槽,MarkDirty一次.批量插入时:
+ *   1.先填空闲链表中的页,每页只pin一次,连续填到满(或记录用完)
+ *   2.空闲链表空了,就一次向PF层分配RM_BULK_PAGES个新页(AllocatePages),
+ *     新页的槽是连续的,记录整块拷贝,位图整字节置位
+ *   3.文件头只在内存中改,由RM_Manager::CloseFile写回
+ * 出错时已插入的记录留在文件中,numInserted是它们的条数
+ * */
+RC RM_FileHandle::InsertRecs(const char *pData, int count, RID *rids, int &numInserted) {
+    numInserted=0;
     if(!bFileOpen){
         return RM_FILE_NOT_OPEN;
     }
-    /* 1.获取一个未用完的page */
-    PageNum pageNum;
-    GetOneFreePage(pageNum);
-    PF_PageHandle pageHandle;
-    pfFileHandle->GetThisPage(pageNum,pageHandle);  /*要手动unpin*/
-
-    /* 2.在该page中找到一个可用的槽,获得slotNum*/
-    SlotNum slotNum;
-    GetOneFreeSlot(pageHandle,slotNum);
+    if(count<0 || (count>0 && (pData==NULL || rids==NULL))){
+        return RM_REC_NOT_VALID;
+    }
 
-    /* 3.将插入的记录数据写入缓冲区中page的slotNum对应的位置*/
-    char* pPageData;
-    pageHandle.GetData(pPageData);
-    int slots;
-    GetPageSlots(slots);
-    int bmapBytes=GetBMapBytes(slots);
-    char* pSlotData=pPageData + sizeof(RM_PageHdr) + bmapBytes + slotNum*rmFileHdr.recordSize;
-    memcpy(pSlotData,pData,rmFileHdr.recordSize);
+    RC rc=OK_RC;
+    int total=count;
+    /* 1.填满空闲链表中的页*/
+    while(count>0 && rmFileHdr.firstFreePage!=RM_PAGE_LIST_END){
+        rc=FillFreePage(rmFileHdr.firstFreePage,pData,count,rids);
+        if(rc){
+            numInserted=total-count;
+            return rc;
+        }
+    }
 
-    /* 4.修改位图,slotNum已被占用*/
-    SetSlot(pPageData,slotNum);
+    /* 2.剩下的记录放进新页,每次分配一批*/
+    while(count>0){
+        int numAlloc=(count+numSlots-1)/numSlots;
+        if(numAlloc>RM_BULK_PAGES){
+            numAlloc=RM_BULK_PAGES;
+        }
+        PF_PageHandle pageHandles[RM_BULK_PAGES];
+        rc=pfFileHandle->AllocatePages(numAlloc,pageHandles);   /*新页已pin住*/
+        if(rc){
+            PF_PrintError(rc);
+            return RM_PF;
+        }
+        for(int i=0;i<numAlloc;i++){
+            int numPages=rmFileHdr.numPages;
+            rc=FillNewPage(pageHandles[i],pData,count,rids);
+            if(rc){
+                /*没有计入numPages的页已分配但还没用,放回PF层;第i页已由FillNewPage unpin*/
+                int first=(rmFileHdr.numPages>numPages)?i+1:i;
+                for(int j=first;j<numAlloc;j++){
+                    PageNum pageNum;
+                    pageHandles[j].GetPageNum(pageNum);
+                    if(j>i){
+                        pfFileHandle->UnpinPage(pageNum);
+                    }
+                    pfFileHandle->DisposePage(pageNum);
+                }
+                numInserted=total-count;
+                return rc;
+            }
+        }
+    }
 
-    /* 5.构造返回的RID数据*/
-    rid.SetMembers(pageNum,slotNum);
+    numInserted=total;
+    return OK_RC;
+}
 
+/**
+ * 把记录填进空闲链表中的页pageNum,直到页满或记录用完;页满时从空闲链表中摘掉.
+ * pData、count、rids随之前移.页在修改前就MarkDirty,出错时页和记录都没有动
+ * */
+RC RM_FileHandle::FillFreePage(PageNum pageNum,const char *&pData,int &count,RID *&rids){
+    PF_PageHandle pageHandle;
+    RC rc=pfFileHandle->GetThisPage(pageNum,pageHandle);       /*一页只pin一次*/
+    if(rc){
+        PF_PrintError(rc);
+        return RM_PF;
+    }
+    if((rc=pfFileHandle->MarkDirty(pageNum))){
+        PF_PrintError(rc);
+        pfFileHandle->UnpinPage(pageNum);
+        return RM_PF;
+    }
+    char* pPageData;
+    pageHandle.GetData(pPageData);
+    RM_PageHdr* pageHdr=(RM_PageHdr*)pPageData;
+
+    for(int slot=NextFreeSlot(pPageData,0);count>0 && slot<numSlots;
+        slot=NextFreeSlot(pPageData,slot+1)){
+        memcpy(SlotPtr(pPageData,slot),pData,rmFileHdr.recordSize);
+        SetSlot(pPageData,slot);
+        rids->SetMembers(pageNum,slot);
+        pData+=rmFileHdr.recordSize;
+        rids++;
+        count--;
+    }
 
-    /*6.可能存在情况:插入记录后,page满 => 修改RM_FileHdr、RM_PageHdr*/
+    /*页满了 => 从空闲链表中摘掉*/
     if(IsBMapFull(pPageData)){
-        RM_PageHdr* pageHdr=(RM_PageHdr*)pPageData;
-        rmFileHdr.firstFreePage=pageHdr->nextFreePage;     /*修改文件头中的第一个空闲page*/
-        pageHdr->nextFreePage=RM_SLOT_ALL_USED;             /*表示page已满,nextFreePage已经没有意义了*/
+        rmFileHdr.firstFreePage=pageHdr->nextFreePage;
+        pageHdr->nextFreePage=RM_SLOT_ALL_USED;
         bHdrChanged=true;
     }
 
-    /* 7.page标记为dirty,因为修改了数据*/
-    pfFileHandle->MarkDirty(pageNum);
+    if((rc=pfFileHandle->UnpinPage(pageNum))){
+        PF_PrintError(rc);
+        return RM_PF;
+    }
+    return OK_RC;
+}
 
-    /* 8.unpin数据页*/
-    pfFileHandle->UnpinPage(pageNum);
+/**
+ * 初始化刚分配(已pin、已清零)的新页,并把记录从slot 0起连续填入;
+ * 没有填满的页成为空闲链表的头(这时链表一定是空的).新页在这里unpin,
+ * 出错时也一样;MarkDirty失败时页没有计入numPages
+ * */
+RC RM_FileHandle::FillNewPage(PF_PageHandle &pageHandle,const char *&pData,int &count,RID *&rids){
+    PageNum pageNum;
+    char* pPageData;
+    pageHandle.GetPageNum(pageNum);
+    pageHandle.GetData(pPageData);
 
+    RC rc;
+    if((rc=pfFileHandle->MarkDirty(pageNum))){
+        PF_PrintError(rc);
+        pfFileHandle->UnpinPage(pageNum);
+        return RM_PF;
+    }
+
+    RM_PageHdr rmPageHdr;
+    rmPageHdr.numSlots=numSlots;
+    rmPageHdr.numFreeSlots=numSlots;
+    rmPageHdr.nextFreePage=RM_PAGE_LIST_END;
+    memcpy(pPageData,&rmPageHdr,sizeof(RM_PageHdr));
+    memset(pPageData+sizeof(RM_PageHdr),0,bmapBytes);
+
+    /*slots是连续的,整块拷贝*/
+    int n=(count<numSlots)?count:numSlots;
+    memcpy(SlotPtr(pPageData,0),pData,n*rmFileHdr.recordSize);
+    SetSlots(pPageData,0,n);
+    for(int slot=0;slot<n;slot++){
+        rids[slot].SetMembers(pageNum,slot);
+    }
+    pData+=n*rmFileHdr.recordSize;
+    rids+=n;
+    count-=n;
+
+    rmFileHdr.numPages++;
+    if(!IsBMapFull(pPageData)){
+        rmFileHdr.firstFreePage=pageNum;
+    }
+    else{
+        ((RM_PageHdr*)pPageData)->nextFreePage=RM_SLOT_ALL_USED;
+    }
+    bHdrChanged=true;
 
+    if((rc=pfFileHandle->UnpinPage(pageNum))){
+        PF_PrintError(rc);
+        return RM_PF;
+    }
     return OK_RC;
 }
 
@@ -182,7 +360,10 @@ RC RM_FileHandle::UpdateRec(const RM_Record &rec) {
     }
 
     int recSize;
-    recSize=rec.GetRecSize(recSize);
+    RC rc=rec.GetRecSize(recSize);
+    if(rc){
+        return rc;
+    }
     if(rmFileHdr.recordSize!=recSize){
         return RM_REC_SIZE_ERR;
     }
@@ -269,21 +450,30 @@ RC RM_FileHandle::GetRmFileHdr(RM_FileHdr& rmFileHdr){
 
 /* 一个RM页内的数据可存储记录个数(slots) */
 RC RM_FileHandle::GetPageSlots(int& numSlots)const{
+    numSlots=this->numSlots;
+    return OK_RC;
+}
+
+/* 由记录大小算出页的布局:槽数、位图字节数、slots的偏移 */
+/* 原来GetPageSlots每次访问记录都要重新循环计算一遍,现在Open时算一次 */
+RC RM_FileHandle::ComputeLayout(){
     int bytes_valid=PF_PAGE_SIZE-sizeof(RM_PageHdr);        /*bitmap+slots的总字节数*/
-    if(bytes_valid<=rmFileHdr.recordSize){
-        return -1;
+    if(rmFileHdr.recordSize<=0 || bytes_valid<=rmFileHdr.recordSize){
+        return RM_REC_SIZE_ERR;
     }
 
     int slots=bytes_valid/rmFileHdr.recordSize+1;          /*这个计算肯定偏大,下面不断缩小到合适的大小*/
     
     while(true){
         int slotBytes=slots*rmFileHdr.recordSize;
-        int bmapBytes=GetBMapBytes(slots);
-        if(slotBytes+bmapBytes < bytes_valid)               /* 如果不能取等,页的末尾会有碎片!*/
+        if(GetSlotsOffset(slots)+slotBytes <= PF_PAGE_SIZE)  /*页头+位图(+对齐填充)+slots放得下*/
             break;
         slots--;
     }
     numSlots=slots;
+    bmapBytes=GetBMapBytes(slots);
+    slotsOffset=GetSlotsOffset(slots);
+    recStride=rmFileHdr.recordSize;
     return OK_RC;
 }
 
@@ -296,120 +486,105 @@ RC RM_FileHandle::GetSlotData(PF_PageHandle pageHandle,SlotNum slotNum,char *&pR
         return RM_PF;
     }
 
-    int totalSlots;
-    GetPageSlots(totalSlots);
-    int bmapBytes=GetBMapBytes(totalSlots);
-    pRecData = pPageData + sizeof(RM_PageHdr) + bmapBytes + slotNum*(rmFileHdr.recordSize);
+    pRecData = SlotPtr(pPageData,slotNum);
 
     return  OK_RC;
 }
 
-/*获取一个没有装满的page,返回其pageNum;如果没有,则需要给文件分配一个新的page*/
-RC RM_FileHandle::GetOneFreePage(PageNum& pageNum){
-    if(!bFileOpen){
-        return RM_FILE_NOT_OPEN;
-    }
-    
-
-    /* 1.如果文件中尚有未满的page*/
-    if(rmFileHdr.firstFreePage!=RM_PAGE_LIST_END){
-
-        /* 1.1 通过RM层文件头得到第一个未满的page*/
-        PF_PageHandle pageHandle;
-        PageNum freePage=rmFileHdr.firstFreePage;
-        pfFileHandle->GetThisPage(freePage,pageHandle);     /* 读取到内存缓冲区pin住 */
-        pageHandle.GetPageNum(pageNum);
-
-        /* 1.2 unpin该页数据*/
-        pfFileHandle->UnpinPage(freePage);
-        return OK_RC;
-    }
-
-    /**2.rmFileHdr.firstFreePage==RM_PAGE_LIST_END 或者 rmFileHdr.firstFreePage==0
-     *  => 已满或者完全未分配,需要新分配page */
-    else{
-        PF_PageHandle pageHandle;
-
-        /* 2.1分配一个新的page; 获取其pageNum; 获取其pPageData*/
-        char* pPageData;
-        pfFileHandle->AllocatePage(pageHandle);  /*AllocatePage会将数据pin到缓冲区*/
-        pageHandle.GetPageNum(pageNum);
-        pageHandle.GetData(pPageData);
-
-        /* 2.2 将RM层的页头信息写入page*/
-        RM_PageHdr rmPageHdr;
-        GetPageSlots(rmPageHdr.numSlots);
-        rmPageHdr.numFreeSlots=rmPageHdr.numSlots;
-        rmPageHdr.nextFreePage=RM_PAGE_LIST_END;            /*新分配的page,肯定是空闲链表的最后一块(而不是用slot已满标志)*/
-        //rmPageHdr.bitMap=new char[rmPageHdr.numSlots];
-        memcpy(pPageData,&rmPageHdr,sizeof(RM_PageHdr));
-
-
-        /* 2.3 将该页的位图信息写入(刚分配,全部初始化为0)*/
-        int bmapBytes=GetBMapBytes( rmPageHdr.numSlots);
-        memset(pPageData+sizeof(RM_PageHdr),0,bmapBytes);
-
-        /* 2.4 由于分配了新page,需要修改RM_FileHdr*/
-        rmFileHdr.firstFreePage=pageNum;
-        rmFileHdr.numPages++;
-        bHdrChanged=true;
+/************************************* ops for bitmap(RM页中,位图的操作) **************************************/
 
-        /* 2.5 由于修改了RM层页头,需要标记为dirty*/
-        pfFileHandle->MarkDirty(pageNum);
 
-        /* 2.7 unpin该页*/
-        pfFileHandle->UnpinPage(pageNum);
+/* 槽数为slots位图占用多少字节(向上取整)*/
+int RM_FileHandle::GetBMapBytes(int slots) const{
+    return (slots/8)+(slots%8!=0);
+}
 
-        return OK_RC;
-    }
+/* 第一个slot相对于页数据部分的偏移:页头+位图,向上按RM_SLOT_ALIGN对齐 */
+/* 页数据部分本身是对齐的,记录大小是RM_SLOT_ALIGN的倍数时,原地读取(RM_RecordView)的INT/FLOAT属性也是对齐的 */
+int RM_FileHandle::GetSlotsOffset(int slots) const{
+    int offset=sizeof(RM_PageHdr)+GetBMapBytes(slots);
+    return (offset+RM_SLOT_ALIGN-1)/RM_SLOT_ALIGN*RM_SLOT_ALIGN;
+}
 
-    return RM_UNEXPECTED_ERR;
+/*对于指定的页(pPageData),检查其位图中slotNum对应的槽是否已占用(slotNum从0算起)*/
+/*位图紧跟在RM_PageHdr之后*/
+bool RM_FileHandle::IsSlotUsed(const char* pPageData,int slotNum) const{
+    pPageData+=sizeof(RM_PageHdr);
+    char lastByte=*(pPageData+slotNum/8);       /*前提是slotNum从0开始计数!!*/
+    char mask=1<<(8-slotNum%8-1);
+    return mask&lastByte;
 }
 
-/*对于一个给定的页(pageHandle),在其中找一个空闲slot,返回slotNum(slotNum从0算起)*/
-RC RM_FileHandle::GetOneFreeSlot(PF_PageHandle pageHandle, SlotNum& slotNum){
-    /*1.获取page的数据部分*/
-    char* pPageData;
-    pageHandle.GetData(pPageData);
-    
-    /*2.读取page头信息*/
-    RM_PageHdr rmPageHdr;
-    memcpy(&rmPageHdr,pPageData,sizeof(RM_PageHdr));
+/**
+ * 取位图从第byteOff字节起的8个字节,超出位图的字节为0.
+ * 位图中slot 0是第0字节的最高位,所以按大端序拼成一个字:
+ * 字的最高位就是第byteOff*8个slot,用clz找第一个1
+ * */
+static inline uint64_t LoadBMapWord(const char* pBitMap,int byteOff,int bmapBytes){
+    uint64_t word=0;
+    int n=bmapBytes-byteOff;
+    memcpy(&word,pBitMap+byteOff,n<8?n:8);
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    word=__builtin_bswap64(word);
+#endif
+    return word;
+}
 
-    /*3.遍历位图,找到一个空闲slot*/
-    for(int i=0;i<rmPageHdr.numSlots;i++){
-        if(!IsSlotUsed(pPageData,i)){
-            slotNum=i;
-            return OK_RC;
+/*slotNum及其后第一个已占用的槽;没有时返回numSlots*/
+int RM_FileHandle::NextUsedSlot(const char* pPageData,int slotNum) const{
+    if(slotNum<numSlots && IsSlotUsed(pPageData,slotNum)){
+        return slotNum;                 /*满页上逐条扫描时最常见,不必拼字*/
+    }
+    const char* pBitMap=pPageData+sizeof(RM_PageHdr);
+    int byteOff=slotNum/8;
+    uint64_t word=LoadBMapWord(pBitMap,byteOff,bmapBytes) & (~0ULL>>(slotNum%8));  /*去掉slotNum之前的位*/
+    while(true){
+        if(word){
+            int slot=byteOff*8+__builtin_clzll(word);
+            return slot<numSlots?slot:numSlots;
+        }
+        byteOff+=8;
+        if(byteOff>=bmapBytes){
+            return numSlots;
         }
+        word=LoadBMapWord(pBitMap,byteOff,bmapBytes);
     }
-
-    slotNum=RM_SLOT_ALL_USED;
-    return OK_RC;
 }
 
-
-
-/************************************* ops for bitmap(RM页中,位图的操作) **************************************/
-
-
-/* 槽数为slots位图占用多少字节(向上取整)*/
-int RM_FileHandle::GetBMapBytes(int slots) const{
-    return (slots/8)+(slots%8!=0);
+/*slotNum及其后第一个未占用的槽;没有时返回numSlots(位图之外的位读作0,由numSlots截断)*/
+int RM_FileHandle::NextFreeSlot(const char* pPageData,int slotNum) const{
+    const char* pBitMap=pPageData+sizeof(RM_PageHdr);
+    int byteOff=slotNum/8;
+    uint64_t word=~LoadBMapWord(pBitMap,byteOff,bmapBytes) & (~0ULL>>(slotNum%8));
+    while(true){
+        if(word){
+            int slot=byteOff*8+__builtin_clzll(word);
+            return slot<numSlots?slot:numSlots;
+        }
+        byteOff+=8;
+        if(byteOff>=bmapBytes){
+            return numSlots;
+        }
+        word=~LoadBMapWord(pBitMap,byteOff,bmapBytes);
+    }
 }
 
-/*对于指定的页(pPageData),检查其位图中slotNum对应的槽是否已占用(slotNum从0算起)*/
-bool RM_FileHandle::IsSlotUsed(char* pPageData,int slotNum){
-    char lastByte=*(pPageData+slotNum/8);       /*前提是slotNum从0开始计数!!*/
-    char mask=1<<(8-slotNum%8-1);
-    return mask&lastByte;
+/*位图中已占用的槽数;最后一个字节中numSlots之后的位从不置1*/
+int RM_FileHandle::CountUsedSlots(const char* pPageData) const{
+    const char* pBitMap=pPageData+sizeof(RM_PageHdr);
+    int count=0;
+    for(int byteOff=0;byteOff<bmapBytes;byteOff+=8){
+        count+=__builtin_popcountll(LoadBMapWord(pBitMap,byteOff,bmapBytes));
+    }
+    return count;
 }
 
 /*对于指定的页(pPageData),将其位图中slotNum(从0算起)对应的槽标记为已经占用; 同时需要修改页头中numFreeSlots*/
 RC RM_FileHandle::SetSlot(char* pPageData,int slotNum){
-    char lastByte=*(pPageData+slotNum/8);
+    char* pBitMap=pPageData+sizeof(RM_PageHdr);
+    char lastByte=*(pBitMap+slotNum/8);
     char mask=1<<(8-slotNum%8 -1);
-   *(pPageData+slotNum/8)=lastByte | mask;
+   *(pBitMap+slotNum/8)=lastByte | mask;
 
     RM_PageHdr* rmPageHdr=(RM_PageHdr*)pPageData;
     rmPageHdr->numFreeSlots--;
@@ -417,12 +592,38 @@ RC RM_FileHandle::SetSlot(char* pPageData,int slotNum){
 }
 
 
+/*将从slotNum起的count个槽一起标记为已占用; 随之修改页头*/
+RC RM_FileHandle::SetSlots(char* pPageData,int slotNum,int count){
+    char* pBitMap=pPageData+sizeof(RM_PageHdr);
+    int slot=slotNum,end=slotNum+count;
+
+    /*开头不足一个字节的部分,和中间的整字节*/
+    while(slot<end && slot%8!=0){
+        pBitMap[slot/8]|=(char)(1<<(8-slot%8-1));
+        slot++;
+    }
+    if(end-slot>=8){
+        memset(pBitMap+slot/8,0xFF,(end-slot)/8);
+        slot+=(end-slot)/8*8;
+    }
+    /*结尾不足一个字节的部分*/
+    while(slot<end){
+        pBitMap[slot/8]|=(char)(1<<(8-slot%8-1));
+        slot++;
+    }
+
+    RM_PageHdr* rmPageHdr=(RM_PageHdr*)pPageData;
+    rmPageHdr->numFreeSlots-=count;
+    return OK_RC;
+}
+
 /*对于指定的页(pPageData),将其第slotNum对应的槽标记为未使用(0); 随之修改页头*/
 RC RM_FileHandle::ResetSlot(char* pPageData,int slotNum){
-    char lastByte=*(pPageData+slotNum/8);
+    char* pBitMap=pPageData+sizeof(RM_PageHdr);
+    char lastByte=*(pBitMap+slotNum/8);
     char mask=1<<(8-slotNum%8 -1);          /*除要置位的bit外全为0*/
     mask=~mask;                             /*除要置位的bit外全为1*/
-   *(pPageData+slotNum/8)=lastByte & mask;
+   *(pBitMap+slotNum/8)=lastByte & mask;
 
     RM_PageHdr* rmPageHdr=(RM_PageHdr*)pPageData;
     rmPageHdr->numFreeSlots++;
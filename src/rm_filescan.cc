@@ -10,11 +10,14 @@ using namespace std;
 // Default constructor
 RM_FileScan::RM_FileScan() {
     bScanOpen=false;
+    bPagePinned=false;
 }
 
 // Destructor
 RM_FileScan::~RM_FileScan() {
-
+    if(bScanOpen){
+        CloseScan();                    /*放掉扫描仍pin着的页*/
+    }
 }
 
 // Initialize a file scan
@@ -36,7 +39,7 @@ RC RM_FileScan::OpenScan(const RM_FileHandle &fileHandle, AttrType attrType, int
         && compOp!=GT_OP && compOp!=LE_OP && compOp!=GE_OP){
             return RM_SCAN_INVALID_OP;
     }
-    if(value==NULL){
+    if(value==NULL && compOp!=NO_OP){         /*NO_OP不比较,value可以为NULL*/
         return RM_SACAN_VAL_NULL;
     }
 
@@ -83,8 +86,9 @@ RC RM_FileScan::OpenScan(const RM_FileHandle &fileHandle, AttrType attrType, int
     // pfFileHandle->UnpinPage(pfHdrPgNum);
     // pfFileHandle->UnpinPage(rmHdrPgNum);
 
-    this->currPageNum=2;            /*0是PF_FileHdr、 1是RM_FileHdr => 个人暂时这么理解*/
+    this->currPageNum=RM_FIRST_PAGE;    /*PF_FileHdr不算page,第0页是RM_FileHdr,数据页从1开始*/
     this->currSlotNum=0;
+    this->bPagePinned=false;
     
     this->bScanOpen=true;
     return OK_RC;
@@ -92,6 +96,63 @@ RC RM_FileScan::OpenScan(const RM_FileHandle &fileHandle, AttrType attrType, int
 
 // Get next matching record
 RC RM_FileScan::GetNextRec(RM_Record &rec) {
+    char* pRecData;
+    RID rid;
+    RC rc=FindNextRec(pRecData,rid);
+    if(rc){
+        return rc;
+    }
+
+    RM_FileHdr rmFileHdr;
+    fileHandle->GetRmFileHdr(rmFileHdr);
+    rec.SetMembers(pRecData,rid,rmFileHdr.recordSize); /*直接从扫描pin着的页拷贝,不经GetRec再pin一次*/
+    return OK_RC;
+}
+
+// Get next matching record, in place (zero copy)
+/**
+ * 不拷贝记录:view自己持有记录所在页的一个pin,下一次GetNextRec或view释放时才unpin.
+ * view已经pin着同一页时沿用它的pin,所以一页只多pin一次
+ * */
+RC RM_FileScan::GetNextRec(RM_RecordView &view) {
+    char* pRecData;
+    RID rid;
+    RC rc=FindNextRec(pRecData,rid);
+    if(rc){
+        view.Release();                 /*扫描结束(或出错)时不再占着最后一页*/
+        return rc;
+    }
+
+    PF_FileHandle* pfFileHandle;
+    fileHandle->GetPpfFileHandle(pfFileHandle);
+    PageNum pageNum,viewPageNum;
+    rid.GetPageNum(pageNum);
+    if(view.pfFileHandle==pfFileHandle && view.rid.GetPageNum(viewPageNum)==OK_RC
+        && viewPageNum==pageNum){
+        view.pRecData=pRecData;         /*同一页:view的pin继续有效*/
+        view.rid=rid;
+        return OK_RC;
+    }
+
+    PF_PageHandle viewPage;
+    rc=pfFileHandle->GetThisPage(pageNum,viewPage,pinHint);   /*给view的pin,页已在缓冲区中*/
+    if(rc){
+        view.Release();
+        PF_PrintError(rc);
+        return RM_PF;
+    }
+    RM_FileHdr rmFileHdr;
+    fileHandle->GetRmFileHdr(rmFileHdr);
+    view.Set(pfFileHandle,pRecData,rid,rmFileHdr.recordSize);
+    return OK_RC;
+}
+
+/**
+ * 找到下一条符合条件的记录,返回其数据指针和rid.
+ * 扫描自己pin着当前页(pageHandle),跨页时才unpin旧页、pin新页,
+ * 所以一页只GetThisPage一次,而不是每条记录一次;扫描结束或CloseScan时unpin
+ * */
+RC RM_FileScan::FindNextRec(char *&pRecData, RID &rid) {
     if(!bScanOpen){
         return RM_SCAN_NOT_OPEN;
     }
@@ -101,36 +162,42 @@ RC RM_FileScan::GetNextRec(RM_Record &rec) {
     fileHandle->GetPpfFileHandle(pfFileHandle);
 
     /* 2.当前文件相关信息*/
-    int numPages=fileHandle->GetRmNumPages(numPages);
-    int totalPageNum=numPages+2;                       /*因为实际还有:PF_FileHdr和RM_FileHdr*/
-    int numSlots;
-    fileHandle->GetPageSlots(numSlots);                /*一个page能存储的页数*/
+    int numPages;
+    fileHandle->GetRmNumPages(numPages);               /*数据页为[RM_FIRST_PAGE,numPages]*/
+    int numSlots=fileHandle->NumSlots();               /*一个page能存储的记录数*/
 
     /* 3.查找记录*/
-    PF_PageHandle pageHandle;
     char* pPageData;
-    char* pRecData;
-    for(int page=currPageNum;page<totalPageNum;page++){
+    for(int page=currPageNum;page<=numPages;page++){
 
-        pfFileHandle->GetThisPage(page,pageHandle);         /*需要手动unpin*/
+        if(!bPagePinned){
+            RC rc=pfFileHandle->GetThisPage(page,pageHandle,pinHint); /*需要手动unpin; pinHint告知缓冲区是否为顺序扫描*/
+            if(rc){
+                PF_PrintError(rc);
+                return RM_PF;
+            }
+            bPagePinned=true;
+        }
         pageHandle.GetData(pPageData);
 
-        for(int slot=currSlotNum;slot<numSlots;slot++){
-            if(!fileHandle->IsSlotUsed(pPageData,slot))     /*未占用*/
-                continue;   
-            fileHandle->GetSlotData(pageHandle,slot,pRecData);
+        /*按字扫描位图,直接跳到下一个已占用的slot*/
+        for(int slot=fileHandle->NextUsedSlot(pPageData,currSlotNum);slot<numSlots;
+            slot=fileHandle->NextUsedSlot(pPageData,slot+1)){
+            pRecData=fileHandle->SlotPtr(pPageData,slot);
             char* attr=pRecData+attrOffset;
             if(IsMatch(attr)){                            /*符合查找条件*/
-                RID rid(page,slot);
-                fileHandle->GetRec(rid,rec);
-                if(slot+1==numSlots){currSlotNum=0; currPageNum++;}
-                else currSlotNum+=1;
-                pfFileHandle->UnpinPage(page);
+                rid.SetMembers(page,slot);
+                currSlotNum=slot+1;                       /*页仍pin住,下次从这里继续*/
                 return OK_RC;
             }    
         }
 
-        pfFileHandle->UnpinPage(page);
+        bPagePinned=false;
+        RC rc=pfFileHandle->UnpinPage(page);
+        if(rc){
+            PF_PrintError(rc);
+            return RM_PF;
+        }
         /* 当前页没有找到,查找下一页*/
         currPageNum++;                  /*要查找下一页,currPageNum随之增加*/
         currSlotNum=0;
@@ -145,6 +212,18 @@ RC RM_FileScan::CloseScan() {
         return RM_SCAN_NOT_OPEN;
     }
     bScanOpen=false;
+
+    /*扫描中途关闭时,当前页还pin着*/
+    if(bPagePinned){
+        bPagePinned=false;
+        PF_FileHandle* pfFileHandle;
+        fileHandle->GetPpfFileHandle(pfFileHandle);
+        RC rc=pfFileHandle->UnpinPage(currPageNum);
+        if(rc){
+            PF_PrintError(rc);
+            return RM_PF;
+        }
+    }
     return OK_RC;
 }
 
@@ -0,0 +1,187 @@
+//
+// File:        rm_loadbench.cc
+// Description: Benchmark of bulk loading an RM file
+//
+// Loads the same records into a new file with InsertRec, one record at
+// a time, and with InsertRecs in batches of several sizes, then counts
+// the records back with a scan.  InsertRecs pins each page once and
+// fills it as far as the batch goes, and takes new pages from the PF
+// layer RM_BULK_PAGES at a time, so the buffer manager is called once
+// per page instead of twice per record.
+//
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <cstring>
+#include <chrono>
+#include <unistd.h>
+#include "redbase.h"
+#include "pf.h"
+#include "rm.h"
+#include "pf_testutil.h"
+
+using namespace std;
+
+//
+// Defines
+//
+#define FILE1         "file1"
+#define NUM_RECS      200000          // records loaded
+
+//
+// Records of the test file
+//
+struct BenchRec {
+   int   num;
+   float r;
+   char  str[32];
+};
+
+RC Load(RM_Manager &rmm, int batch, RID rids[], const BenchRec recs[]);
+RC CountRecs(RM_Manager &rmm, int &numRecs);
+void Fail(RC rc);
+
+//
+// Fail
+//
+// Desc: Print the error of rc and exit
+//
+void Fail(RC rc)
+{
+   if (abs(rc) <= END_PF_WARN)
+      PF_PrintError(rc);
+   else
+      RM_PrintError(rc);
+   exit(1);
+}
+
+//
+// Load
+//
+// Desc: Load recs into a new FILE1, with InsertRec if batch is 0 and
+//       with InsertRecs of batch records otherwise
+//
+RC Load(RM_Manager &rmm, int batch, RID rids[], const BenchRec recs[])
+{
+   RM_FileHandle fh;
+   RC rc;
+
+   unlink(FILE1);
+   if ((rc = rmm.CreateFile(FILE1, sizeof(BenchRec))) ||
+         (rc = rmm.OpenFile(FILE1, fh)))
+      return (rc);
+
+   if (batch == 0) {
+      for (int i = 0; i < NUM_RECS; i++)
+         if ((rc = fh.InsertRec((const char *)&recs[i], rids[i])))
+            return (rc);
+   }
+   else {
+      for (int i = 0; i < NUM_RECS; i += batch) {
+         int count = (NUM_RECS - i < batch) ? NUM_RECS - i : batch;
+         int numInserted;
+         if ((rc = fh.InsertRecs((const char *)&recs[i], count, &rids[i],
+                                 numInserted)))
+            return (rc);
+      }
+   }
+
+   return (rmm.CloseFile(fh));
+}
+
+//
+// CountRecs
+//
+// Desc: Scan FILE1, checking the records
+// Out:  numRecs - records found
+//
+RC CountRecs(RM_Manager &rmm, int &numRecs)
+{
+   RM_FileHandle fh;
+   RM_FileScan fs;
+   RM_RecordView view;
+   const char *pData;
+   RC rc;
+
+   numRecs = 0;
+   if ((rc = rmm.OpenFile(FILE1, fh)) ||
+         (rc = fs.OpenScan(fh, INT, sizeof(int), 0, NO_OP, NULL,
+               SEQUENTIAL_HINT)))
+      return (rc);
+
+   while ((rc = fs.GetNextRec(view)) == 0) {
+      view.GetData(pData);
+      if (((const BenchRec *)pData)->r != (float)((const BenchRec *)pData)->num) {
+         cout << "record " << ((const BenchRec *)pData)->num << " is wrong\n";
+         exit(1);
+      }
+      numRecs++;
+   }
+   if (rc != RM_EOF || (rc = fs.CloseScan()))
+      return (rc);
+
+   return (rmm.CloseFile(fh));
+}
+
+int main()
+{
+   PF_Manager pfm;
+   RM_Manager rmm(pfm);
+   BenchRec *recs = new BenchRec[NUM_RECS];
+   RID *rids = new RID[NUM_RECS];
+   int batches[] = { 0, 1, 100, 10000, NUM_RECS };
+   RC rc;
+
+   cout << "********************\n";
+   cout << "RM load benchmark, " << NUM_RECS << " records of "
+      << sizeof(BenchRec) << " bytes.\n";
+
+   memset(recs, 0, NUM_RECS * sizeof(BenchRec));
+   for (int i = 0; i < NUM_RECS; i++) {
+      recs[i].num = i;
+      recs[i].r = (float)i;
+      sprintf(recs[i].str, "r%d", i);
+   }
+
+   for (unsigned int b = 0; b < sizeof(batches) / sizeof(batches[0]); b++) {
+      long long getsBefore = GetStat(PF_GETPAGE);
+      chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+      if ((rc = Load(rmm, batches[b], rids, recs)))
+         Fail(rc);
+
+      double seconds = chrono::duration<double>(
+            chrono::steady_clock::now() - start).count();
+      long long numGets = GetStat(PF_GETPAGE) - getsBefore;
+
+      int numRecs;
+      if ((rc = CountRecs(rmm, numRecs)))
+         Fail(rc);
+      if (numRecs != NUM_RECS) {
+         cout << numRecs << " records loaded, not " << NUM_RECS << "\n";
+         return (1);
+      }
+
+      char name[32];
+      if (batches[b] == 0)
+         sprintf(name, "InsertRec");
+      else
+         sprintf(name, "InsertRecs of %d", batches[b]);
+#ifdef PF_STATS
+      printf("%-22s %8.0f records/s, %6.1f ns/record, %7lld GetPage\n", name,
+            NUM_RECS / seconds, seconds * 1e9 / NUM_RECS, numGets);
+#else
+      printf("%-22s %8.0f records/s, %6.1f ns/record\n", name,
+            NUM_RECS / seconds, seconds * 1e9 / NUM_RECS);
+#endif
+   }
+
+   if ((rc = rmm.DestroyFile(FILE1)))
+      Fail(rc);
+
+   delete [] recs;
+   delete [] rids;
+   cout << "********************\n\n";
+   return (0);
+}
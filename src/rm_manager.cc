@@ -117,6 +117,10 @@ RC RM_Manager::DestroyFile(const char *fileName) {
 // Open the file with the given filename with the specified filehandle
 /* 打开一个文件,将其与RM_FileHandle对象关联*/
 RC RM_Manager::OpenFile(const char *fileName, RM_FileHandle &fileHandle) {
+    if(fileHandle.IsOpen()){
+        return RM_FILE_ALREADY_OPEN;
+    }
+
     /* 1.调用PF层打开文件*/
     PF_FileHandle pfFileHandle;
     RC rc=pfManager->OpenFile(fileName,pfFileHandle);
@@ -126,14 +130,21 @@ RC RM_Manager::OpenFile(const char *fileName, RM_FileHandle &fileHandle) {
     }
 
     /**/
-    /* 2.利用pfFileHandle中,RM层的头信息,来初始化fileHandle的成员变量*/
-    fileHandle.Open(pfFileHandle);
+    /* 2.利用pfFileHandle中,RM层的头信息,来初始化fileHandle的成员变量(fileHandle拷贝一份pfFileHandle)*/
+    if((rc=fileHandle.Open(pfFileHandle))){
+        pfManager->CloseFile(pfFileHandle);
+        return rc;
+    }
 
     return OK_RC;
 }
 
 // Close the file with the given filehandle => 关闭文件(真正在文件层面的关闭!)
 RC RM_Manager::CloseFile(RM_FileHandle &fileHandle) {
+    if(!fileHandle.IsOpen()){
+        return RM_FILE_NOT_OPEN;
+    }
+
     /* 1.获取PF层的PF_FileHandle*/
     PF_FileHandle* pfFileHandle;
     RC rc=fileHandle.GetPfFileHandle(pfFileHandle);
@@ -145,7 +156,7 @@ RC RM_Manager::CloseFile(RM_FileHandle &fileHandle) {
     /* 2.如果修改了rmFileHdr对象,需要将其写入RM文件头!*/
     if(fileHandle.IsHdrChanged()){      
         PF_PageHandle pageHandle;
-        rc=pfFileHandle->GetThisPage(1,pageHandle);       /* RM层的头*/
+        rc=pfFileHandle->GetThisPage(RM_HDR_PAGE,pageHandle);       /* RM层的头*/
         if(rc<0){
             PF_PrintError(rc);
             return RM_PF;
@@ -167,13 +178,18 @@ RC RM_Manager::CloseFile(RM_FileHandle &fileHandle) {
         
         memcpy(pPageData,&rmFileHdr,sizeof(RM_FileHdr));
 
-        pfFileHandle->MarkDirty(1);
+        pfFileHandle->MarkDirty(RM_HDR_PAGE);
 
-        pfFileHandle->UnpinPage(1);
+        pfFileHandle->UnpinPage(RM_HDR_PAGE);
     }
 
-    /* 3.关闭文件*/
-    pfManager->CloseFile(*pfFileHandle);
+    /* 3.关闭文件(仍有记录页被pin住时失败,例如RM_RecordView没有释放)*/
+    rc=pfManager->CloseFile(*pfFileHandle);
+    if(rc){
+        PF_PrintError(rc);
+        return RM_PF;
+    }
+    fileHandle.Close();
        
     return OK_RC;
 }
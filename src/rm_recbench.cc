@@ -0,0 +1,203 @@
+//
+// File:        rm_recbench.cc
+// Description: Micro-benchmark of RM_FileHandle::GetRec on buffered pages
+//
+// Every page of the file stays in the buffer, so what is timed is the RM
+// work of a record access on top of a buffer hit: checking the RID,
+// finding the slot in the page, and copying the record (RM_Record) or
+// not (RM_RecordView).  The same is timed for a scan and for the insert
+// of the records.  This is the path the page layout of RM_FileHandle
+// (slots per page, size of the bitmap, offset of the slots) is used on.
+//
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <cstring>
+#include <chrono>
+#include <unistd.h>
+#include "redbase.h"
+#include "pf.h"
+#include "rm.h"
+
+using namespace std;
+
+//
+// Defines
+//
+#define FILE1         "file1"
+#define NUM_FRAMES    100             // frames of the buffer
+#define NUM_RECS      5000            // records in the test file
+#define NUM_OPS       2000000         // record accesses per run
+
+//
+// Records of the test file
+//
+struct BenchRec {
+   int   num;
+   float r;
+   char  str[32];
+};
+
+//
+// Ways of reading the records
+//
+enum ReadMode {
+   READ_RECORD,                       // GetRec into an RM_Record
+   READ_VIEW,                         // GetRec into an RM_RecordView
+   READ_SCAN                          // scan into an RM_RecordView
+};
+
+static const char *psModeNames[] = {
+   "GetRec, RM_Record",
+   "GetRec, RM_RecordView",
+   "scan, RM_RecordView"
+};
+
+RC AddRecs(RM_FileHandle &fh, RID rids[]);
+RC Read(RM_FileHandle &fh, ReadMode mode, const RID rids[]);
+void Fail(RC rc);
+
+//
+// Fail
+//
+// Desc: Print the error of rc and exit
+//
+void Fail(RC rc)
+{
+   if (abs(rc) <= END_PF_WARN)
+      PF_PrintError(rc);
+   else
+      RM_PrintError(rc);
+   exit(1);
+}
+
+//
+// AddRecs
+//
+// Desc: Insert NUM_RECS records
+// Out:  rids - the RID of record i
+//
+RC AddRecs(RM_FileHandle &fh, RID rids[])
+{
+   BenchRec rec;
+   RC rc;
+
+   memset(&rec, 0, sizeof(rec));
+   for (int i = 0; i < NUM_RECS; i++) {
+      rec.num = i;
+      rec.r = (float)i;
+      sprintf(rec.str, "r%d", i);
+      if ((rc = fh.InsertRec((char *)&rec, rids[i])))
+         return (rc);
+   }
+
+   return (0);
+}
+
+//
+// Read
+//
+// Desc: Read NUM_OPS records one way, checking each of them.  The RIDs
+//       are taken with a stride, so that consecutive accesses go to
+//       different pages.
+//
+RC Read(RM_FileHandle &fh, ReadMode mode, const RID rids[])
+{
+   RM_Record rec;
+   RM_RecordView view;
+   const char *pData;
+   char *pRecData;
+   RC rc;
+
+   if (mode == READ_SCAN) {
+      for (int n = 0; n < NUM_OPS; ) {
+         RM_FileScan fs;
+         if ((rc = fs.OpenScan(fh, INT, sizeof(int), 0, NO_OP, NULL,
+               SEQUENTIAL_HINT)))
+            return (rc);
+         while (n < NUM_OPS && (rc = fs.GetNextRec(view)) == 0) {
+            view.GetData(pData);
+            if (((const BenchRec *)pData)->r != (float)((const BenchRec *)pData)->num) {
+               cout << "record " << ((const BenchRec *)pData)->num << " is wrong\n";
+               exit(1);
+            }
+            n++;
+         }
+         if ((rc && rc != RM_EOF) || (rc = view.Release()) ||
+               (rc = fs.CloseScan()))
+            return (rc);
+      }
+      return (0);
+   }
+
+   for (int n = 0; n < NUM_OPS; n++) {
+      int i = (int)(((long long)n * 97) % NUM_RECS);
+      if (mode == READ_RECORD) {
+         if ((rc = fh.GetRec(rids[i], rec)) ||
+               (rc = rec.GetData(pRecData)))
+            return (rc);
+         pData = pRecData;
+      }
+      else if ((rc = fh.GetRec(rids[i], view)) ||
+            (rc = view.GetData(pData)))
+         return (rc);
+
+      if (((const BenchRec *)pData)->num != i) {
+         cout << "record " << i << " is wrong\n";
+         exit(1);
+      }
+   }
+
+   return (view.Release());
+}
+
+int main()
+{
+   PF_BufferConfig config(NUM_FRAMES);
+   config.bReadAhead = FALSE;
+   PF_Manager pfm(config);
+   RM_Manager rmm(pfm);
+   RM_FileHandle fh;
+   RID *rids = new RID[NUM_RECS];
+   RC rc;
+
+   cout << "********************\n";
+   cout << "RM record access benchmark, " << NUM_OPS << " accesses to "
+      << NUM_RECS << " records of " << sizeof(BenchRec) << " bytes.\n";
+
+   unlink(FILE1);
+   if ((rc = rmm.CreateFile(FILE1, sizeof(BenchRec))) ||
+         (rc = rmm.OpenFile(FILE1, fh)))
+      Fail(rc);
+
+   chrono::steady_clock::time_point start = chrono::steady_clock::now();
+   if ((rc = AddRecs(fh, rids)))
+      Fail(rc);
+   double seconds = chrono::duration<double>(
+         chrono::steady_clock::now() - start).count();
+   printf("%-24s %6.1f ns/record\n", "InsertRec",
+         seconds * 1e9 / NUM_RECS);
+
+   // Warm the buffer up before timing
+   if ((rc = Read(fh, READ_RECORD, rids)))
+      Fail(rc);
+
+   for (int m = READ_RECORD; m <= READ_SCAN; m++) {
+      start = chrono::steady_clock::now();
+      if ((rc = Read(fh, (ReadMode)m, rids)))
+         Fail(rc);
+      seconds = chrono::duration<double>(
+            chrono::steady_clock::now() - start).count();
+      printf("%-24s %6.1f ns/record\n", psModeNames[m],
+            seconds * 1e9 / NUM_OPS);
+   }
+
+   if ((rc = rmm.CloseFile(fh)) ||
+         (rc = rmm.DestroyFile(FILE1)))
+      Fail(rc);
+
+   delete [] rids;
+   cout << "********************\n\n";
+   return (0);
+}
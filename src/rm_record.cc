@@ -23,6 +23,9 @@ RM_Record::~RM_Record() {
 }
 
 RC RM_Record::SetMembers(char* pRecordData,RID recordId,int recordSize){
+    if(isValid){                    /*重复使用同一个RM_Record时,先释放上一条记录*/
+        delete [] pRecData;
+    }
     rid=recordId;
     recSize=recordSize;
     pRecData=new char[recSize];
@@ -58,4 +61,101 @@ RC RM_Record::GetRecSize(int& recordSize) const{
     recordSize=recSize;
 
     return OK_RC;
-}
\ No newline at end of file
+}
+
+
+
+/*********************************** RM_RecordView ***********************************/
+
+// Default constructor
+RM_RecordView::RM_RecordView() {
+    pfFileHandle=NULL;
+    pRecData=NULL;
+    recSize=0;
+}
+
+// Destructor
+RM_RecordView::~RM_RecordView() {
+    Release();
+}
+
+// Move constructor: the pin goes with the record
+RM_RecordView::RM_RecordView(RM_RecordView &&view) {
+    pfFileHandle=view.pfFileHandle;
+    pRecData=view.pRecData;
+    rid=view.rid;
+    recSize=view.recSize;
+    view.pfFileHandle=NULL;
+}
+
+// Move assignment: the record held before is released
+RM_RecordView& RM_RecordView::operator=(RM_RecordView &&view) {
+    if(this!=&view){
+        Release();
+        pfFileHandle=view.pfFileHandle;
+        pRecData=view.pRecData;
+        rid=view.rid;
+        recSize=view.recSize;
+        view.pfFileHandle=NULL;
+    }
+    return *this;
+}
+
+/*接管记录所在页的一个pin;若原来引用着一条记录,先unpin*/
+void RM_RecordView::Set(PF_FileHandle* pfFileHandle,const char* pRecordData,
+                        const RID &recordId,int recordSize){
+    Release();
+    this->pfFileHandle=pfFileHandle;
+    pRecData=pRecordData;
+    rid=recordId;
+    recSize=recordSize;
+}
+
+// Unpin the page of the record
+RC RM_RecordView::Release() {
+    if(pfFileHandle==NULL){
+        return OK_RC;
+    }
+
+    PageNum pageNum;
+    rid.GetPageNum(pageNum);
+    RC rc=pfFileHandle->UnpinPage(pageNum);
+    pfFileHandle=NULL;
+    if(rc){
+        PF_PrintError(rc);
+        return RM_PF;
+    }
+    return OK_RC;
+}
+
+/* 是否引用着一条记录 */
+bool RM_RecordView::IsValid() const {
+    return pfFileHandle!=NULL;
+}
+
+// Return the data corresponding to the record, in the buffer pool
+RC RM_RecordView::GetData(const char *&pData) const {
+    if(pfFileHandle==NULL){
+        return RM_REC_NOT_VALID;
+    }
+    pData=pRecData;
+    return OK_RC;
+}
+
+// Return the RID associated with the record
+RC RM_RecordView::GetRid(RID &rid) const {
+    if(pfFileHandle==NULL){
+        return RM_REC_NOT_VALID;
+    }
+    rid=this->rid;
+    return OK_RC;
+}
+
+/* 获取记录大小(字节数)*/
+RC RM_RecordView::GetRecSize(int& recordSize) const {
+    if(pfFileHandle==NULL){
+        return RM_REC_NOT_VALID;
+    }
+    recordSize=recSize;
+    return OK_RC;
+}
@@ -45,5 +45,6 @@ RC RID::GetSlotNum(SlotNum &slotNum) const {
 RC RID::SetMembers(PageNum pageNum, SlotNum slotNum){
     this->pageNum=pageNum;
     this->slotNum=slotNum;
+    isValid=true;
     return OK_RC;
 }
\ No newline at end of file
@@ -0,0 +1,235 @@
+//
+// File:        rm_scanbench.cc
+// Description: Benchmark of the page accesses of an RM file scan
+//
+// A scan used to get the page of every record it returned once more (and
+// unpin it again) on top of the access that found the record, so that a
+// full scan cost a GetPage per record.  It now keeps the page it is on
+// pinned and only moves the pin when it crosses a page boundary.  This
+// counts the GetPage calls and times a full scan into an RM_Record, into
+// an RM_RecordView, a scan that matches one record in ten, and, as the
+// per-record cost the scan used to pay, a GetRec of every record by RID.
+//
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <cstring>
+#include <cstddef>
+#include <chrono>
+#include <unistd.h>
+#include "redbase.h"
+#include "pf.h"
+#include "rm.h"
+#include "pf_testutil.h"
+
+using namespace std;
+
+//
+// Defines
+//
+#define FILE1         "file1"
+#define NUM_RECS      100000          // records in the test file
+#define NUM_RUNS      5               // times each access pattern is run
+#define SELECT_EVERY  10              // one record in ten matches
+
+//
+// Records of the test file
+//
+struct BenchRec {
+   int   num;
+   int   mod;                         // num % SELECT_EVERY
+   char  str[32];
+};
+
+//
+// Ways of reading the records
+//
+enum ReadMode {
+   READ_LOOKUP,                       // GetRec of every RID
+   READ_SCAN_RECORD,                  // scan into an RM_Record
+   READ_SCAN_VIEW,                    // scan into an RM_RecordView
+   READ_SCAN_SELECT                   // scan for mod == 0
+};
+
+static const char *psModeNames[] = {
+   "GetRec of every record",
+   "scan, RM_Record",
+   "scan, RM_RecordView",
+   "scan, 1 record in 10"
+};
+
+RC CreateTestFile(RM_Manager &rmm, RID rids[]);
+RC ReadAll(RM_FileHandle &fh, ReadMode mode, const RID rids[], int &numRecs);
+void Fail(RC rc);
+
+//
+// Fail
+//
+// Desc: Print the error of rc and exit
+//
+void Fail(RC rc)
+{
+   if (abs(rc) <= END_PF_WARN)
+      PF_PrintError(rc);
+   else
+      RM_PrintError(rc);
+   exit(1);
+}
+
+//
+// CreateTestFile
+//
+// Desc: Create FILE1 with NUM_RECS records
+// Out:  rids - the RID of record i
+//
+RC CreateTestFile(RM_Manager &rmm, RID rids[])
+{
+   RM_FileHandle fh;
+   BenchRec rec;
+   RC rc;
+
+   memset(&rec, 0, sizeof(rec));
+   if ((rc = rmm.CreateFile(FILE1, sizeof(BenchRec))) ||
+         (rc = rmm.OpenFile(FILE1, fh)))
+      return (rc);
+
+   for (int i = 0; i < NUM_RECS; i++) {
+      rec.num = i;
+      rec.mod = i % SELECT_EVERY;
+      sprintf(rec.str, "r%d", i);
+      if ((rc = fh.InsertRec((char *)&rec, rids[i])))
+         return (rc);
+   }
+
+   return (rmm.CloseFile(fh));
+}
+
+//
+// ReadAll
+//
+// Desc: Read the records of the file one way, checking each of them
+// Out:  numRecs - records read
+//
+RC ReadAll(RM_FileHandle &fh, ReadMode mode, const RID rids[], int &numRecs)
+{
+   RM_FileScan fs;
+   RM_Record rec;
+   RM_RecordView view;
+   const char *pData;
+   char *pRecData;
+   int zero = 0;
+   RC rc;
+
+   numRecs = 0;
+   if (mode == READ_LOOKUP) {
+      for (int i = 0; i < NUM_RECS; i++) {
+         if ((rc = fh.GetRec(rids[i], rec)) ||
+               (rc = rec.GetData(pRecData)))
+            return (rc);
+         if (((BenchRec *)pRecData)->num != i) {
+            cout << "record " << i << " is wrong\n";
+            exit(1);
+         }
+         numRecs++;
+      }
+      return (0);
+   }
+
+   if (mode == READ_SCAN_SELECT)
+      rc = fs.OpenScan(fh, INT, sizeof(int), offsetof(BenchRec, mod), EQ_OP,
+            &zero, SEQUENTIAL_HINT);
+   else
+      rc = fs.OpenScan(fh, INT, sizeof(int), 0, NO_OP, NULL,
+            SEQUENTIAL_HINT);
+   if (rc)
+      return (rc);
+
+   for (;;) {
+      if (mode == READ_SCAN_VIEW) {
+         if ((rc = fs.GetNextRec(view)) == 0)
+            rc = view.GetData(pData);
+      }
+      else {
+         if ((rc = fs.GetNextRec(rec)) == 0)
+            rc = rec.GetData(pRecData);
+         pData = pRecData;
+      }
+      if (rc)
+         break;
+
+      const BenchRec *pRec = (const BenchRec *)pData;
+      if (pRec->num < 0 || pRec->num >= NUM_RECS ||
+            (mode == READ_SCAN_SELECT && pRec->mod != 0)) {
+         cout << "record " << pRec->num << " is wrong\n";
+         exit(1);
+      }
+      numRecs++;
+   }
+   if (rc != RM_EOF)
+      return (rc);
+
+   return (fs.CloseScan());
+}
+
+int main()
+{
+   PF_Manager pfm;
+   RM_Manager rmm(pfm);
+   RM_FileHandle fh;
+   RID *rids = new RID[NUM_RECS];
+   RC rc;
+
+   cout << "********************\n";
+   cout << "RM scan benchmark, " << NUM_RECS << " records of "
+      << sizeof(BenchRec) << " bytes.\n";
+
+   unlink(FILE1);
+   if ((rc = CreateTestFile(rmm, rids)) ||
+         (rc = rmm.OpenFile(FILE1, fh)))
+      Fail(rc);
+
+   int numPages;
+   fh.GetRmNumPages(numPages);
+   cout << numPages << " data pages\n";
+
+   for (int m = READ_LOOKUP; m <= READ_SCAN_SELECT; m++) {
+      int numRecs = 0;
+      long long getsBefore = GetStat(PF_GETPAGE);
+      chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+      for (int run = 0; run < NUM_RUNS; run++)
+         if ((rc = ReadAll(fh, (ReadMode)m, rids, numRecs)))
+            Fail(rc);
+
+      double seconds = chrono::duration<double>(
+            chrono::steady_clock::now() - start).count();
+      long long numGets = (GetStat(PF_GETPAGE) - getsBefore) / NUM_RUNS;
+
+#ifdef PF_STATS
+      printf("%-24s %6d records, %6lld GetPage, %6.1f ns/record\n",
+            psModeNames[m], numRecs, numGets,
+            seconds * 1e9 / ((double)numRecs * NUM_RUNS));
+
+      // A scan gets every data page once; a view pins each page once more
+      int maxGets = (m == READ_LOOKUP) ? NUM_RECS :
+         (m == READ_SCAN_VIEW) ? 2 * numPages : numPages;
+      if (numGets > maxGets) {
+         cout << numGets << " GetPage, more than " << maxGets << "\n";
+         return (1);
+      }
+#else
+      printf("%-24s %6d records, %6.1f ns/record (built without PF_STATS)\n",
+            psModeNames[m], numRecs,
+            seconds * 1e9 / ((double)numRecs * NUM_RUNS));
+#endif
+   }
+
+   if ((rc = rmm.CloseFile(fh)) ||
+         (rc = rmm.DestroyFile(FILE1)))
+      Fail(rc);
+
+   delete [] rids;
+   cout << "********************\n\n";
+   return (0);
+}
@@ -35,6 +35,7 @@ using namespace std;
 #define PROG_UNIT   50               // how frequently to give progress
                                       //   reports when adding lots of recs
 #define FEW_RECS   20                // number of records added in
+#define LOTS_OF_RECS 400             // records spread over several pages
 
 //
 // Computes the offset of a field in a record (should be in <stddef.h>)
@@ -63,12 +64,19 @@ RM_Manager rmm(pfm);                /*RM层管理器实例*/
 //
 RC Test1(void);
 RC Test2(void);
+RC Test3(void);
+RC Test4(void);
+RC Test5(void);
 
 void PrintError(RC rc);
 void LsFile(char *fileName);
 void PrintRecord(TestRec &recBuf);
 RC AddRecs(RM_FileHandle &fh, int numRecs);
 RC VerifyFile(RM_FileHandle &fh, int numRecs);
+RC VerifyViews(RM_FileHandle &fh, int numRecs);
+RC CheckRecord(const TestRec *pRecBuf, int num);
+RC CheckBitmaps(RM_FileHandle &fh);
+int NumPinned(RM_FileHandle &fh);
 RC PrintFile(RM_FileHandle &fh);
 
 RC CreateFile(char *fileName, int recordSize);
@@ -83,11 +91,14 @@ RC GetNextRecScan(RM_FileScan &fs, RM_Record &rec);
 //
 // Array of pointers to the test functions
 //
-#define NUM_TESTS       2               // number of tests
+#define NUM_TESTS       5               // number of tests
 int (*tests[])() =                      // RC doesn't work on some compilers
 {
     Test1,
-    Test2
+    Test2,
+    Test3,
+    Test4,
+    Test5
 };
 
 //
@@ -326,6 +337,160 @@ err:
     return (rc);
 }
 
+//
+// CheckRecord
+//
+// Desc: exit unless a record is the one AddRecs wrote for num
+//
+RC CheckRecord(const TestRec *pRecBuf, int num)
+{
+    char stringBuf[STRLEN];
+
+    memset(stringBuf,' ', STRLEN);
+    sprintf(stringBuf, "a%d", num);
+
+    if (pRecBuf->num != num || strcmp(pRecBuf->str, stringBuf) ||
+        pRecBuf->r != (float)num) {
+        printf("CheckRecord: invalid record = [%s, %d, %f], not %d\n",
+               pRecBuf->str, pRecBuf->num, pRecBuf->r, num);
+        exit(1);
+    }
+    return (0);
+}
+
+//
+// NumPinned
+//
+// Desc: pages of the file pinned in the buffer pool
+//
+int NumPinned(RM_FileHandle &fh)
+{
+    PF_FileHandle   *pfFileHandle;
+    PF_FileSnapshot snapshot;
+
+    fh.GetPpfFileHandle(pfFileHandle);
+    pfFileHandle->GetSnapshot(snapshot);
+    return (snapshot.numPinned);
+}
+
+//
+// VerifyViews
+//
+// Desc: verify the records added by AddRecs without copying them: scan
+//       the file with a view, then look every record up by its RID.  A
+//       view holds one pin at most, and none once released.
+//
+RC VerifyViews(RM_FileHandle &fh, int numRecs)
+{
+    RC            rc;
+    int           n;
+    const TestRec *pRecBuf;
+    RID           *rids = new RID[numRecs];
+    RM_RecordView view;
+
+    printf("\nverifying file contents in place\n");
+
+    RM_FileScan fs;
+    if ((rc=fs.OpenScan(fh,INT,sizeof(int),offsetof(TestRec, num),
+                        NO_OP, NULL, NO_HINT)))
+        return (rc);
+
+    for (rc = fs.GetNextRec(view), n = 0; rc == 0; rc = fs.GetNextRec(view), n++) {
+        if ((rc = view.GetData((const char *&)pRecBuf)) ||
+            (rc = CheckRecord(pRecBuf, pRecBuf->num)))
+            return (rc);
+        if (pRecBuf->num < 0 || pRecBuf->num >= numRecs || NumPinned(fh) != 1) {
+            printf("VerifyViews: record %d, %d pages pinned\n",
+                   pRecBuf->num, NumPinned(fh));
+            exit(1);
+        }
+        view.GetRid(rids[pRecBuf->num]);
+    }
+    if (rc != RM_EOF || (rc = fs.CloseScan()))
+        return (rc);
+
+    // The end of the scan released the last record
+    if (n != numRecs || view.IsValid() || NumPinned(fh) != 0) {
+        printf("VerifyViews: %d records, %d pages pinned\n", n, NumPinned(fh));
+        exit(1);
+    }
+
+    // A scan keeps its page pinned between records, until it is closed
+    RM_Record rec;
+    if ((rc=fs.OpenScan(fh,INT,sizeof(int),offsetof(TestRec, num),
+                        NO_OP, NULL, NO_HINT)) ||
+        (rc = fs.GetNextRec(rec)) ||
+        (rc = fs.GetNextRec(rec)))
+        return (rc);
+    if (NumPinned(fh) != 1 || (rc = fs.CloseScan()) || NumPinned(fh) != 0) {
+        printf("VerifyViews: %d pages pinned by the scan\n", NumPinned(fh));
+        exit(1);
+    }
+
+    // Point lookups
+    for (int i = 0; i < numRecs; i++) {
+        if ((rc = fh.GetRec(rids[i], view)) ||
+            (rc = view.GetData((const char *&)pRecBuf)) ||
+            (rc = CheckRecord(pRecBuf, i)))
+            return (rc);
+    }
+
+    // Moving a view moves its pin
+    RM_RecordView moved(std::move(view));
+    if (view.IsValid() || !moved.IsValid() || NumPinned(fh) != 1) {
+        printf("VerifyViews: the view did not move\n");
+        exit(1);
+    }
+    if ((rc = fh.GetRec(rids[0], view)))
+        return (rc);
+    moved = std::move(view);
+    if ((rc = moved.GetData((const char *&)pRecBuf)) ||
+        (rc = CheckRecord(pRecBuf, 0)))
+        return (rc);
+    if ((rc = moved.Release()) || NumPinned(fh) != 0) {
+        printf("VerifyViews: %d pages still pinned\n", NumPinned(fh));
+        exit(1);
+    }
+
+    delete [] rids;
+    return (0);
+}
+
+//
+// CheckBitmaps
+//
+// Desc: on every data page, the slots set in the bitmap are the slots
+//       the page header does not count as free
+//
+RC CheckBitmaps(RM_FileHandle &fh)
+{
+    RC              rc;
+    PF_FileHandle   *pfFileHandle;
+    PF_PageHandle   ph;
+    char            *pPageData;
+    int             numPages;
+
+    fh.GetPpfFileHandle(pfFileHandle);
+    fh.GetRmNumPages(numPages);
+    for (PageNum page = RM_FIRST_PAGE; page <= numPages; page++) {
+        if ((rc = pfFileHandle->GetThisPage(page, ph)) ||
+            (rc = ph.GetData(pPageData)))
+            return (rc);
+
+        RM_PageHdr *pPageHdr = (RM_PageHdr *)pPageData;
+        int numUsed = fh.CountUsedSlots(pPageData);
+        if (numUsed != pPageHdr->numSlots - pPageHdr->numFreeSlots) {
+            printf("CheckBitmaps: page %d has %d slots used, %d free of %d\n",
+                   page, numUsed, pPageHdr->numFreeSlots, pPageHdr->numSlots);
+            exit(1);
+        }
+
+        if ((rc = pfFileHandle->UnpinPage(page)))
+            return (rc);
+    }
+    return (0);
+}
+
 //
 // PrintFile
 //
@@ -510,3 +675,236 @@ RC Test2(void)
     printf("\ntest2 done ********************\n");
     return (0);
 }
+
+//
+// Test3 tests reading records in place (RM_RecordView) next to copies:
+// scans, lookups, updates and deletes over several pages.
+//
+RC Test3(void)
+{
+    RC            rc;
+    RM_FileHandle fh;
+    RM_Record     rec;
+    RM_RecordView view;
+    RID           rid(RM_FIRST_PAGE, 3);
+    TestRec       *pRecBuf;
+    const TestRec *pViewBuf;
+
+    printf("test3 starting ****************\n");
+
+    if ((rc = CreateFile(FILENAME, sizeof(TestRec))) ||
+        (rc = OpenFile(FILENAME, fh)) ||
+        (rc = AddRecs(fh, LOTS_OF_RECS)) ||
+        (rc = VerifyFile(fh, LOTS_OF_RECS)) ||
+        (rc = VerifyViews(fh, LOTS_OF_RECS)))
+        return (rc);
+
+    // An update through a copy is seen in place
+    if ((rc = fh.GetRec(rid, rec)) ||
+        (rc = rec.GetData((char *&)pRecBuf)))
+        return (rc);
+    pRecBuf->r = -1;
+    if ((rc = UpdateRec(fh, rec)) ||
+        (rc = fh.GetRec(rid, view)) ||
+        (rc = view.GetData((const char *&)pViewBuf)))
+        return (rc);
+    if (pViewBuf->r != -1) {
+        printf("Test3: the update is not seen\n");
+        exit(1);
+    }
+
+    // A deleted record is not found, and the view is released
+    if ((rc = DeleteRec(fh, rid)) ||
+        (rc = fh.GetRec(rid, view)) != RM_REC_NOT_FOUND ||
+        view.IsValid()) {
+        printf("Test3: GetRec of a deleted record returned %d\n", rc);
+        exit(1);
+    }
+
+    if ((rc = CloseFile(FILENAME, fh)))
+        return (rc);
+
+    // The file reads the same after reopening it
+    if ((rc = OpenFile(FILENAME, fh)))
+        return (rc);
+    if ((rc = fh.GetRec(RID(RM_FIRST_PAGE, 4), view)) ||
+        (rc = view.GetData((const char *&)pViewBuf)) ||
+        (rc = CheckRecord(pViewBuf, 4)) ||
+        (rc = view.Release()) ||
+        (rc = CloseFile(FILENAME, fh)))
+        return (rc);
+
+    if ((rc = DestroyFile(FILENAME)))
+        return (rc);
+
+    printf("\ntest3 done ********************\n");
+    return (0);
+}
+
+//
+// Test4 tests the slot bitmaps: a scan of a file with most of its
+// records deleted, and inserts into the holes.
+//
+RC Test4(void)
+{
+    RC            rc;
+    RM_FileHandle fh;
+    RM_FileScan   fs;
+    RM_Record     rec;
+    RID           rid;
+    TestRec       *pRecBuf;
+    SlotNum       slotNum;
+    int           n, numKept = 0;
+
+    printf("test4 starting ****************\n");
+
+    if ((rc = CreateFile(FILENAME, sizeof(TestRec))) ||
+        (rc = OpenFile(FILENAME, fh)) ||
+        (rc = AddRecs(fh, LOTS_OF_RECS)))
+        return (rc);
+
+    // Keep one record in seven: the scan has to skip whole words of the
+    // bitmaps
+    if ((rc=fs.OpenScan(fh,INT,sizeof(int),offsetof(TestRec, num),
+                        NO_OP, NULL, NO_HINT)))
+        return (rc);
+    while ((rc = GetNextRecScan(fs, rec)) == 0) {
+        if ((rc = rec.GetData((char *&)pRecBuf)) ||
+            (rc = rec.GetRid(rid)))
+            return (rc);
+        if (pRecBuf->num % 7 == 0)
+            numKept++;
+        else if ((rc = DeleteRec(fh, rid)))
+            return (rc);
+    }
+    if (rc != RM_EOF || (rc = fs.CloseScan()) ||
+        (rc = CheckBitmaps(fh)))
+        return (rc);
+
+    if ((rc=fs.OpenScan(fh,INT,sizeof(int),offsetof(TestRec, num),
+                        NO_OP, NULL, NO_HINT)))
+        return (rc);
+    for (n = 0; (rc = GetNextRecScan(fs, rec)) == 0; n++) {
+        if ((rc = rec.GetData((char *&)pRecBuf)) ||
+            (rc = CheckRecord(pRecBuf, pRecBuf->num)))
+            return (rc);
+        if (pRecBuf->num % 7 != 0) {
+            printf("Test4: deleted record %d was found\n", pRecBuf->num);
+            exit(1);
+        }
+    }
+    if (rc != RM_EOF || (rc = fs.CloseScan()))
+        return (rc);
+    if (n != numKept) {
+        printf("Test4: %d records found, not %d\n", n, numKept);
+        exit(1);
+    }
+
+    // An insert takes the first free slot of its page
+    TestRec  recBuf;
+    PageNum  pageNum;
+    memset((void *)&recBuf, 0, sizeof(recBuf));
+    if ((rc = InsertRec(fh, (char *)&recBuf, rid)) ||
+        (rc = rid.GetPageNum(pageNum)) ||
+        (rc = rid.GetSlotNum(slotNum)) ||
+        (rc = CheckBitmaps(fh)))
+        return (rc);
+    for (SlotNum slot = 0; slot < slotNum; slot++)
+        if ((rc = fh.GetRec(RID(pageNum, slot), rec))) {
+            printf("Test4: slot %d of page %d is free, the insert took %d\n",
+                   slot, pageNum, slotNum);
+            exit(1);
+        }
+
+    if ((rc = CloseFile(FILENAME, fh)) ||
+        (rc = DestroyFile(FILENAME)))
+        return (rc);
+
+    printf("\ntest4 done ********************\n");
+    return (0);
+}
+
+//
+// Test5 tests bulk loading with InsertRecs: a batch that fills the
+// holes left by deletes first, then new pages.
+//
+RC Test5(void)
+{
+    RC            rc;
+    RM_FileHandle fh;
+    RM_Record     rec;
+    TestRec       *pRecBuf;
+    TestRec       *recs = new TestRec[LOTS_OF_RECS];
+    RID           *rids = new RID[LOTS_OF_RECS];
+    int           numPages, numFirst = LOTS_OF_RECS / 4;
+    int           numInserted;
+
+    printf("test5 starting ****************\n");
+
+    memset((void *)recs, 0, LOTS_OF_RECS * sizeof(TestRec));
+    for (int i = 0; i < LOTS_OF_RECS; i++) {
+        memset(recs[i].str, ' ', STRLEN);
+        sprintf(recs[i].str, "a%d", i);
+        recs[i].num = i;
+        recs[i].r = (float)i;
+    }
+
+    // A first batch, then delete every other record of it
+    if ((rc = CreateFile(FILENAME, sizeof(TestRec))) ||
+        (rc = OpenFile(FILENAME, fh)) ||
+        (rc = fh.InsertRecs((char *)recs, numFirst, rids, numInserted)))
+        return (rc);
+    if (numInserted != numFirst) {
+        printf("Test5: %d of %d records inserted\n", numInserted, numFirst);
+        exit(1);
+    }
+    for (int i = 0; i < numFirst; i += 2)
+        if ((rc = DeleteRec(fh, rids[i])))
+            return (rc);
+
+    // The deleted records go back into the holes, then the rest into new
+    // pages
+    TestRec *holes = new TestRec[numFirst / 2];
+    RID     *holeRids = new RID[numFirst / 2];
+    for (int i = 0; i < numFirst / 2; i++)
+        holes[i] = recs[2 * i];
+    if ((rc = fh.InsertRecs((char *)holes, numFirst / 2, holeRids,
+                            numInserted)) ||
+        (rc = fh.InsertRecs((char *)&recs[numFirst],
+                            LOTS_OF_RECS - numFirst, &rids[numFirst],
+                            numInserted)) ||
+        (rc = CheckBitmaps(fh)))
+        return (rc);
+    for (int i = 0; i < numFirst / 2; i++)
+        rids[2 * i] = holeRids[i];
+    delete [] holes;
+    delete [] holeRids;
+
+    // Every RID leads to its record
+    for (int i = 0; i < LOTS_OF_RECS; i++) {
+        if ((rc = fh.GetRec(rids[i], rec)) ||
+            (rc = rec.GetData((char *&)pRecBuf)) ||
+            (rc = CheckRecord(pRecBuf, i)))
+            return (rc);
+    }
+
+    // The holes were used before new pages: no page is left half empty
+    // but the last one
+    fh.GetRmNumPages(numPages);
+    RM_FileHdr rmFileHdr;
+    fh.GetRmFileHdr(rmFileHdr);
+    if (rmFileHdr.firstFreePage != numPages && rmFileHdr.firstFreePage != RM_PAGE_LIST_END) {
+        printf("Test5: page %d of %d is free\n", rmFileHdr.firstFreePage, numPages);
+        exit(1);
+    }
+
+    if ((rc = VerifyFile(fh, LOTS_OF_RECS)) ||
+        (rc = CloseFile(FILENAME, fh)) ||
+        (rc = DestroyFile(FILENAME)))
+        return (rc);
+
+    delete [] recs;
+    delete [] rids;
+    printf("\ntest5 done ********************\n");
+    return (0);
+}
@@ -18,10 +18,10 @@
 
 #include <cstring>
 #include <iostream>
+#include <new>
 #include "statistics.h"
 
 using namespace std;
-
 //
 // Here are Statistics Keys utilized by the PF layer of the Redbase
 // project.
@@ -32,6 +32,47 @@ const char *PF_PAGENOTFOUND = "PAGENOTFOUND";
 const char *PF_READPAGE = "READPAGE";           // IO
 const char *PF_WRITEPAGE = "WRITEPAGE";         // IO
 const char *PF_FLUSHPAGES = "FLUSHPAGES";
+const char *PF_READAHEAD = "READAHEAD";         // IO
+const char *PF_BGWRITE = "BGWRITE";             // IO
+const char *PF_COALESCEDIO = "COALESCEDIO";     // IO
+const char *PF_SYNC = "SYNC";                   // IO
+const char *PF_SYNCSKIPPED = "SYNCSKIPPED";
+const char *PF_SYNCUSEC = "SYNCUSEC";
+const char *PF_EXTENT = "EXTENT";               // IO
+
+//
+// Keys of the fixed statistics, in the order of Stat_Counter
+//
+static const char *const *const ppsCounterKeys[STAT_NUM_COUNTERS] = {
+   &PF_GETPAGE,
+   &PF_PAGEFOUND,
+   &PF_PAGENOTFOUND,
+   &PF_READPAGE,
+   &PF_WRITEPAGE,
+   &PF_FLUSHPAGES,
+   &PF_READAHEAD,
+   &PF_BGWRITE,
+   &PF_COALESCEDIO,
+   &PF_SYNC,
+   &PF_SYNCSKIPPED,
+   &PF_SYNCUSEC,
+   &PF_EXTENT
+};
+
+//
+// Names of the latencies, in the order of Stat_Latency
+//
+static const char *const psLatencyNames[STAT_NUM_LATENCIES] = {
+   "READPAGE",
+   "WRITEPAGE",
+   "GETHIT",
+   "GETMISS"
+};
+
+// log2(STAT_HIST_SUB): bits of a value that pick its sub-bucket
+static const int STAT_HIST_SUB_BITS = 2;
+static_assert((1 << STAT_HIST_SUB_BITS) == STAT_HIST_SUB,
+      "STAT_HIST_SUB_BITS must match STAT_HIST_SUB");
 
 //
 // Statistic class
@@ -44,7 +85,7 @@ const char *PF_FLUSHPAGES = "FLUSHPAGES";
 Statistic::Statistic()
 {
    psKey = NULL;
-   iValue = 0;
+   lValue = 0;
 }
 
 
@@ -58,7 +99,7 @@ Statistic::Statistic(const char *psKey_)
    psKey = new char[strlen(psKey_) + 1];
    strcpy (psKey, psKey_);
 
-   iValue = 0;
+   lValue = 0;
 }
 
 //
@@ -69,7 +110,7 @@ Statistic::Statistic(const Statistic &stat)
     psKey = new char[strlen(stat.psKey)+1];
     strcpy (psKey, stat.psKey);
 
-    iValue = stat.iValue;
+    lValue = stat.lValue;
 }
 
 //
@@ -84,7 +125,7 @@ Statistic& Statistic::operator=(const Statistic &stat)
    psKey = new char[strlen(stat.psKey)+1];
    strcpy (psKey, stat.psKey);
 
-   iValue = stat.iValue;
+   lValue = stat.lValue;
 
    return *this;
 }
@@ -110,6 +151,119 @@ Boolean Statistic::operator==(const char *psKey_) const
 // This class will track a dynamic list of statistics.
 //
 
+//
+// Constructor
+//
+// The stripes get cache lines of their own: the allocation is padded so
+// that they can start on a line boundary
+//
+StatisticsMgr::StatisticsMgr()
+{
+   static_assert(sizeof(StatStripe) % STAT_CACHE_LINE == 0,
+         "StatStripe must fill whole cache lines");
+
+   pStripeMem = new char[STAT_NUM_STRIPES * sizeof(StatStripe) +
+      STAT_CACHE_LINE];
+   char *pAligned = pStripeMem + STAT_CACHE_LINE -
+      (size_t)pStripeMem % STAT_CACHE_LINE;
+   pStripes = (StatStripe *)pAligned;
+   for (int i = 0; i < STAT_NUM_STRIPES; i++)
+      new (&pStripes[i]) StatStripe();
+
+   for (int i = 0; i < STAT_NUM_COUNTERS; i++) {
+      abUsed[i].store(FALSE);
+      Set(i, 0);
+   }
+   bEnabled.store(true);
+   bLatencies.store(true);
+
+   pFiles = NULL;
+   pNoFile = new StatFile;
+   pNoFile->psName = new char[strlen("(none)") + 1];
+   strcpy(pNoFile->psName, "(none)");
+   pNoFile->fd = -1;
+   pNoFile->pNext = NULL;
+   apOpenFiles = new std::atomic<StatFile *>[STAT_MAX_FDS];
+   for (int i = 0; i < STAT_MAX_FDS; i++)
+      apOpenFiles[i].store(NULL);
+}
+
+//
+// Destructor
+//
+StatisticsMgr::~StatisticsMgr()
+{
+   delete [] pStripeMem;
+
+   delete [] apOpenFiles;
+   while (pFiles != NULL) {
+      StatFile *pNext = pFiles->pNext;
+      delete [] pFiles->psName;
+      delete pFiles;
+      pFiles = pNext;
+   }
+   delete [] pNoFile->psName;
+   delete pNoFile;
+}
+
+//
+// Enable
+//
+// Turn the counting of the fixed statistics on or off
+//
+void StatisticsMgr::Enable(const Boolean bEnable)
+{
+   bEnabled.store(bEnable != FALSE);
+}
+
+//
+// EnableLatencies
+//
+// Turn the latencies on or off, leaving the counters as they are
+//
+void StatisticsMgr::EnableLatencies(const Boolean bEnable)
+{
+   bLatencies.store(bEnable != FALSE);
+}
+
+//
+// CounterOf
+//
+// Return the index of the fixed statistic with key psKey, or -1
+//
+int StatisticsMgr::CounterOf(const char *psKey)
+{
+   for (int i = 0; i < STAT_NUM_COUNTERS; i++)
+      if (psKey == *ppsCounterKeys[i] || strcmp(psKey, *ppsCounterKeys[i]) == 0)
+         return i;
+   return -1;
+}
+
+//
+// Sum
+//
+// Value of a fixed statistic: its counters in all the stripes
+//
+long long StatisticsMgr::Sum(int counter) const
+{
+   long long lSum = 0;
+   for (int i = 0; i < STAT_NUM_STRIPES; i++)
+      lSum += pStripes[i].alValues[counter].load(std::memory_order_relaxed);
+   return lSum;
+}
+
+//
+// Set
+//
+// Give a fixed statistic the value lValue.  Not atomic with respect to
+// concurrent Adds, which may be lost.
+//
+void StatisticsMgr::Set(int counter, long long lValue)
+{
+   for (int i = 0; i < STAT_NUM_STRIPES; i++)
+      pStripes[i].alValues[counter].store(i == 0 ? lValue : 0);
+}
+
 //
 // Register
 //
@@ -130,6 +284,35 @@ RC StatisticsMgr::Register (const char *psKey, const Stat_Operation op,
    if (psKey==NULL || (op != STAT_ADDONE && piValue == NULL))
       return STAT_INVALID_ARGS;
 
+   // A fixed statistic is counted in place
+   int counter = CounterOf(psKey);
+   if (counter >= 0) {
+      long long lValue = Sum(counter);
+      switch (op) {
+         case STAT_ADDONE:
+            Add((Stat_Counter)counter);
+            return 0;
+         case STAT_ADDVALUE:
+            Add((Stat_Counter)counter, *piValue);
+            return 0;
+         case STAT_SUBVALUE:
+            Add((Stat_Counter)counter, -*piValue);
+            return 0;
+         case STAT_SETVALUE:
+            lValue = *piValue;
+            break;
+         case STAT_MULTVALUE:
+            lValue *= *piValue;
+            break;
+         case STAT_DIVVALUE:
+            lValue = lValue/(*piValue);
+            break;
+      };
+      Set(counter, lValue);
+      abUsed[counter].store(TRUE);
+      return 0;
+   }
+
    iCount = llStats.GetLength();
 
    for (i=0; i < iCount; i++) {
@@ -147,22 +330,22 @@ RC StatisticsMgr::Register (const char *psKey, const Stat_Operation op,
    // Now perform the operation over the statistic
    switch (op) {
       case STAT_ADDONE:
-         pStat->iValue++;
+         pStat->lValue++;
          break;
       case STAT_ADDVALUE:
-         pStat->iValue += *piValue;
+         pStat->lValue += *piValue;
          break;
       case STAT_SETVALUE:
-         pStat->iValue = *piValue;
+         pStat->lValue = *piValue;
          break;
       case STAT_MULTVALUE:
-         pStat->iValue *= *piValue;
+         pStat->lValue *= *piValue;
          break;
       case STAT_DIVVALUE:
-         pStat->iValue = (int) (pStat->iValue/(*piValue));
+         pStat->lValue = pStat->lValue/(*piValue);
          break;
       case STAT_SUBVALUE:
-         pStat->iValue -= *piValue;
+         pStat->lValue -= *piValue;
          break;
    };
 
@@ -187,14 +370,12 @@ RC StatisticsMgr::Print(const char *psKey)
    if (psKey==NULL)
       return STAT_INVALID_ARGS;
 
-   int *iValue = Get(psKey);
+   long long lValue;
 
-   if (iValue)
-      cout << psKey << "::" << *iValue << "\n";
-   else
+   if (GetValue(psKey, lValue))
       return STAT_UNKNOWN_KEY;
 
-   delete iValue;
+   cout << psKey << "::" << lValue << "\n";
 
    return 0;
 }
@@ -209,10 +390,38 @@ RC StatisticsMgr::Print(const char *psKey)
 // returned when done.
 //
 int *StatisticsMgr::Get(const char *psKey)
+{
+   long long lValue;
+
+   if (GetValue(psKey, lValue))
+      return NULL;
+
+   return new int((int)lValue);
+}
+
+//
+// GetValue
+//
+// Set lValue to the value of a statistic, with all its 64 bits.  Return
+// STAT_UNKNOWN_KEY if the statistic is not tracked.
+//
+RC StatisticsMgr::GetValue(const char *psKey, long long &lValue)
 {
    int i, iCount;
    Statistic *pStat = NULL;
 
+   if (psKey==NULL)
+      return STAT_INVALID_ARGS;
+
+   // A fixed statistic exists once it has been counted
+   int counter = CounterOf(psKey);
+   if (counter >= 0) {
+      if (!abUsed[counter].load())
+         return STAT_UNKNOWN_KEY;
+      lValue = Sum(counter);
+      return 0;
+   }
+
    iCount = llStats.GetLength();
 
    for (i=0; i < iCount; i++) {
@@ -223,9 +432,10 @@ int *StatisticsMgr::Get(const char *psKey)
 
    // Check to see if we found the Stat
    if (i==iCount)
-      return NULL;
+      return STAT_UNKNOWN_KEY;
 
-   return new int(pStat->iValue);
+   lValue = pStat->lValue;
+   return 0;
 }
 
 //
@@ -238,11 +448,15 @@ void StatisticsMgr::Print()
    int i, iCount;
    Statistic *pStat = NULL;
 
+   for (i=0; i < STAT_NUM_COUNTERS; i++)
+      if (abUsed[i].load())
+         cout << *ppsCounterKeys[i] << "::" << Sum(i) << "\n";
+
    iCount = llStats.GetLength();
 
    for (i=0; i < iCount; i++) {
       pStat = llStats[i];
-      cout << pStat->psKey << "::" << pStat->iValue << "\n";
+      cout << pStat->psKey << "::" << pStat->lValue << "\n";
    }
 }
 
@@ -260,6 +474,16 @@ RC StatisticsMgr::Reset(const char *psKey)
    if (psKey==NULL)
       return STAT_INVALID_ARGS;
 
+   // A fixed statistic is zeroed and no longer listed
+   int counter = CounterOf(psKey);
+   if (counter >= 0) {
+      if (!abUsed[counter].load())
+         return STAT_UNKNOWN_KEY;
+      abUsed[counter].store(FALSE);
+      Set(counter, 0);
+      return 0;
+   }
+
    iCount = llStats.GetLength();
 
    for (i=0; i < iCount; i++) {
@@ -285,6 +509,414 @@ RC StatisticsMgr::Reset(const char *psKey)
 //
 void StatisticsMgr::Reset()
 {
+   for (int i = 0; i < STAT_NUM_COUNTERS; i++) {
+      abUsed[i].store(FALSE);
+      Set(i, 0);
+   }
    llStats.Erase();
+
+   // The file records stay, other threads may be recording in them
+   lock_guard<mutex> guard(filesLatch);
+   for (StatFile *pFile = pFiles; pFile != NULL; pFile = pFile->pNext)
+      for (int i = 0; i < STAT_NUM_LATENCIES; i++)
+         pFile->aHists[i].Reset();
+   for (int i = 0; i < STAT_NUM_LATENCIES; i++)
+      pNoFile->aHists[i].Reset();
+}
+
+
+// --------------------------------------------------------------
+
+//
+// StatHistData
+//
+// A copy of one or more histograms
+//
+
+StatHistData::StatHistData()
+{
+   memset(alBuckets, 0, sizeof(alBuckets));
+   lCount = 0;
+   lSum = 0;
+   lMax = 0;
+}
+
+//
+// Merge
+//
+// Add the values of data to this one
+//
+void StatHistData::Merge(const StatHistData &data)
+{
+   for (int i = 0; i < STAT_HIST_BUCKETS; i++)
+      alBuckets[i] += data.alBuckets[i];
+   lCount += data.lCount;
+   lSum += data.lSum;
+   if (data.lMax > lMax)
+      lMax = data.lMax;
+}
+
+//
+// Percentile
+//
+// Find the bucket holding the value of rank dFraction * lCount and place
+// the value within the bucket as if its values were spread evenly
+//
+long long StatHistData::Percentile(double dFraction) const
+{
+   if (lCount == 0)
+      return 0;
+
+   long long lRank = (long long)(dFraction * lCount + 0.999999);
+   if (lRank < 1)
+      lRank = 1;
+   if (lRank > lCount)
+      lRank = lCount;
+
+   long long lBelow = 0;
+   for (int i = 0; i < STAT_HIST_BUCKETS; i++) {
+      if (lBelow + alBuckets[i] < lRank) {
+         lBelow += alBuckets[i];
+         continue;
+      }
+      long long lStart = StatHistogram::BucketStart(i);
+      long long lWidth = StatHistogram::BucketStart(i + 1) - lStart;
+      long long lValue = lStart + lWidth * (lRank - lBelow) / alBuckets[i];
+      return (lValue < lMax) ? lValue : lMax;
+   }
+   return lMax;
 }
 
+//
+// StatHistogram
+//
+// Each value is counted in its bucket with one atomic add.  The buckets
+// of a value v >= STAT_HIST_SUB are found from its highest bit e and the
+// STAT_HIST_SUB_BITS bits below it, so that bucket b covers
+// [(SUB + b%SUB) << (b/SUB - 1), (SUB + b%SUB + 1) << (b/SUB - 1)).
+// Smaller values get a bucket each.
+//
+
+StatHistogram::StatHistogram()
+{
+   Reset();
+}
+
+//
+// Bucket
+//
+int StatHistogram::Bucket(long long lNanos)
+{
+   if (lNanos < STAT_HIST_SUB)
+      return (lNanos < 0) ? 0 : (int)lNanos;
+
+   int e = 63 - __builtin_clzll((unsigned long long)lNanos);
+   int sub = (int)(lNanos >> (e - STAT_HIST_SUB_BITS)) & (STAT_HIST_SUB - 1);
+   return STAT_HIST_SUB * (e - STAT_HIST_SUB_BITS + 1) + sub;
+}
+
+//
+// BucketStart
+//
+long long StatHistogram::BucketStart(int bucket)
+{
+   if (bucket < STAT_HIST_SUB)
+      return bucket;
+
+   int shift = bucket / STAT_HIST_SUB - 1;
+   if (shift >= 64 - STAT_HIST_SUB_BITS - 1)
+      return 0x7fffffffffffffffLL;
+   return (long long)(STAT_HIST_SUB + bucket % STAT_HIST_SUB) << shift;
+}
+
+//
+// Record
+//
+void StatHistogram::Record(long long lNanos)
+{
+   if (lNanos < 0)
+      lNanos = 0;
+
+   alBuckets[Bucket(lNanos)].fetch_add(1, memory_order_relaxed);
+   lSum.fetch_add(lNanos, memory_order_relaxed);
+
+   long long lOld = lMax.load(memory_order_relaxed);
+   while (lNanos > lOld &&
+         !lMax.compare_exchange_weak(lOld, lNanos, memory_order_relaxed))
+      ;
+}
+
+//
+// Read
+//
+// The copy is not a snapshot: values recorded meanwhile may be half in it
+//
+void StatHistogram::Read(StatHistData &data) const
+{
+   StatHistData mine;
+
+   for (int i = 0; i < STAT_HIST_BUCKETS; i++) {
+      mine.alBuckets[i] = alBuckets[i].load(memory_order_relaxed);
+      mine.lCount += mine.alBuckets[i];
+   }
+   mine.lSum = lSum.load(memory_order_relaxed);
+   mine.lMax = lMax.load(memory_order_relaxed);
+
+   data.Merge(mine);
+}
+
+//
+// Reset
+//
+void StatHistogram::Reset()
+{
+   for (int i = 0; i < STAT_HIST_BUCKETS; i++)
+      alBuckets[i].store(0, memory_order_relaxed);
+   lSum.store(0, memory_order_relaxed);
+   lMax.store(0, memory_order_relaxed);
+}
+
+// --------------------------------------------------------------
+
+//
+// FindFile
+//
+// Desc: Record of the file named psName.  filesLatch must be held.
+// In:   bCreate - add a record if there is none
+// Ret:  the record, NULL if there is none and bCreate is FALSE
+//
+StatFile *StatisticsMgr::FindFile(const char *psName, int bCreate)
+{
+   StatFile **ppLast = &pFiles;
+
+   for (StatFile *pFile = pFiles; pFile != NULL; pFile = pFile->pNext) {
+      if (strcmp(pFile->psName, psName) == 0)
+         return pFile;
+      ppLast = &pFile->pNext;
+   }
+
+   if (!bCreate)
+      return NULL;
+
+   StatFile *pFile = new StatFile;
+   pFile->psName = new char[strlen(psName) + 1];
+   strcpy(pFile->psName, psName);
+   pFile->fd = -1;
+   pFile->pNext = NULL;
+   *ppLast = pFile;
+   return pFile;
+}
+
+//
+// OpenFile
+//
+// Desc: Record the latencies of descriptor fd under psName from now on
+//
+void StatisticsMgr::OpenFile(const int fd, const char *psName)
+{
+   if (psName == NULL)
+      return;
+
+   lock_guard<mutex> guard(filesLatch);
+   StatFile *pFile = FindFile(psName, TRUE);
+   pFile->fd = fd;
+   if (fd >= 0 && fd < STAT_MAX_FDS)
+      apOpenFiles[fd].store(pFile, memory_order_release);
+}
+
+//
+// CloseFile
+//
+// Desc: Descriptor fd is closed; its record is kept for the reports
+//
+void StatisticsMgr::CloseFile(const int fd)
+{
+   if (fd < 0 || fd >= STAT_MAX_FDS)
+      return;
+
+   lock_guard<mutex> guard(filesLatch);
+   StatFile *pFile = apOpenFiles[fd].load(memory_order_relaxed);
+   if (pFile != NULL && pFile->fd == fd)
+      pFile->fd = -1;
+   apOpenFiles[fd].store(NULL, memory_order_release);
+}
+
+//
+// AddLatency
+//
+// Records are never freed before the manager, so a record found here
+// stays valid even if the file is closed meanwhile
+//
+void StatisticsMgr::AddLatency(const int fd, const Stat_Latency latency,
+                               const long long lNanos)
+{
+   if (!IsTiming())
+      return;
+
+   StatFile *pFile = NULL;
+   if (fd >= 0 && fd < STAT_MAX_FDS)
+      pFile = apOpenFiles[fd].load(memory_order_acquire);
+   if (pFile == NULL)
+      pFile = pNoFile;
+
+   pFile->aHists[latency].Record(lNanos);
+}
+
+//
+// GetLatency
+//
+// Desc: Add the latencies of an operation to data
+// In:   psName - file name, NULL for all the files
+// Ret:  STAT_UNKNOWN_KEY if no file of that name was opened
+//
+RC StatisticsMgr::GetLatency(const char *psName, const Stat_Latency latency,
+                             StatHistData &data)
+{
+   if (latency < 0 || latency >= STAT_NUM_LATENCIES)
+      return STAT_INVALID_ARGS;
+
+   lock_guard<mutex> guard(filesLatch);
+
+   if (psName != NULL) {
+      StatFile *pFile = FindFile(psName, FALSE);
+      if (pFile == NULL)
+         return STAT_UNKNOWN_KEY;
+      pFile->aHists[latency].Read(data);
+      return 0;
+   }
+
+   for (StatFile *pFile = pFiles; pFile != NULL; pFile = pFile->pNext)
+      pFile->aHists[latency].Read(data);
+   pNoFile->aHists[latency].Read(data);
+   return 0;
+}
+
+//
+// DumpName
+//
+// Write a name as a JSON string, or as a CSV field (quoted if need be)
+//
+static void DumpName(ostream &os, const char *psName, const Stat_Format format)
+{
+   if (format == STAT_FORMAT_CSV && strpbrk(psName, ",\"\n") == NULL) {
+      os << psName;
+      return;
+   }
+
+   os << '"';
+   for (const char *p = psName; *p; p++) {
+      if (*p == '"')
+         os << ((format == STAT_FORMAT_JSON) ? "\\\"" : "\"\"");
+      else if (*p == '\\' && format == STAT_FORMAT_JSON)
+         os << "\\\\";
+      else if (*p == '\n' && format == STAT_FORMAT_JSON)
+         os << "\\n";
+      else
+         os << *p;
+   }
+   os << '"';
+}
+
+//
+// DumpLatency
+//
+// Write the summary of one histogram: one JSON object or one CSV line
+//
+static void DumpLatency(ostream &os, const Stat_Format format,
+                        const char *psName, int fd, const char *psOp,
+                        const StatHistData &data, Boolean bFirst)
+{
+   long long alPcts[3] = { data.Percentile(0.50), data.Percentile(0.99),
+                           data.Percentile(0.999) };
+
+   if (format == STAT_FORMAT_CSV) {
+      DumpName(os, psName, format);
+      os << "," << fd << "," << psOp << "," << data.lCount << ","
+         << data.lSum << "," << data.lMax << "," << alPcts[0] << ","
+         << alPcts[1] << "," << alPcts[2] << "\n";
+      return;
+   }
+
+   os << (bFirst ? "\n    " : ",\n    ") << "{\"file\": ";
+   DumpName(os, psName, format);
+   os << ", \"fd\": " << fd << ", \"op\": \"" << psOp << "\", \"count\": "
+      << data.lCount << ", \"sum_ns\": " << data.lSum << ", \"max_ns\": "
+      << data.lMax << ", \"p50_ns\": " << alPcts[0] << ", \"p99_ns\": "
+      << alPcts[1] << ", \"p999_ns\": " << alPcts[2] << "}";
+}
+
+//
+// Dump
+//
+// JSON: {"counters": {key: value, ...}, "latencies": [{file, fd, op,
+// count, sum_ns, max_ns, p50_ns, p99_ns, p999_ns}, ...]}.  CSV: a header,
+// then a line per counter (file and fd empty, value in count) and one per
+// latency.  The file "*" sums all the files, "(none)" is I/O done on
+// descriptors that were not open through a PF_Manager.
+//
+void StatisticsMgr::Dump(ostream &os, const Stat_Format format)
+{
+   Boolean bFirst = TRUE;
+
+   if (format == STAT_FORMAT_CSV)
+      os << "file,fd,metric,count,sum_ns,max_ns,p50_ns,p99_ns,p999_ns\n";
+   else
+      os << "{\n  \"counters\": {";
+
+   // The counters, fixed then dynamic
+   for (int i = 0; i < STAT_NUM_COUNTERS + llStats.GetLength(); i++) {
+      const char *psKey;
+      long long lValue;
+      if (i < STAT_NUM_COUNTERS) {
+         if (!abUsed[i].load())
+            continue;
+         psKey = *ppsCounterKeys[i];
+         lValue = Sum(i);
+      } else {
+         Statistic *pStat = llStats[i - STAT_NUM_COUNTERS];
+         psKey = pStat->psKey;
+         lValue = pStat->lValue;
+      }
+
+      if (format == STAT_FORMAT_CSV) {
+         os << ",,";
+         DumpName(os, psKey, format);
+         os << "," << lValue << ",,,,,\n";
+      } else {
+         os << (bFirst ? "\n    " : ",\n    ");
+         DumpName(os, psKey, format);
+         os << ": " << lValue;
+      }
+      bFirst = FALSE;
+   }
+
+   if (format == STAT_FORMAT_JSON)
+      os << (bFirst ? "},\n" : "\n  },\n") << "  \"latencies\": [";
+   bFirst = TRUE;
+
+   // The latencies, for all the files then per file
+   lock_guard<mutex> guard(filesLatch);
+   for (int op = 0; op < STAT_NUM_LATENCIES; op++) {
+      StatHistData all;
+      for (StatFile *pFile = pFiles; pFile != NULL; pFile = pFile->pNext)
+         pFile->aHists[op].Read(all);
+      pNoFile->aHists[op].Read(all);
+      DumpLatency(os, format, "*", -1, psLatencyNames[op], all, bFirst);
+      bFirst = FALSE;
+   }
+   for (StatFile *pFile = pFiles; ; pFile = pFile->pNext) {
+      if (pFile == NULL)
+         pFile = pNoFile;
+      for (int op = 0; op < STAT_NUM_LATENCIES; op++) {
+         StatHistData data;
+         pFile->aHists[op].Read(data);
+         DumpLatency(os, format, pFile->psName, pFile->fd,
+               psLatencyNames[op], data, FALSE);
+      }
+      if (pFile == pNoFile)
+         break;
+   }
+
+   if (format == STAT_FORMAT_JSON)
+      os << "\n  ]\n}\n";
+}
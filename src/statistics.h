@@ -47,6 +47,10 @@ const int STAT_BASE = 9000;
 
 // This include must come after the common defines
 #include "linkedlist.h"    // Template class for the link list
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <ostream>
 
 // A single statistic will be tracked by a Statistic class
 class Statistic {
@@ -69,9 +73,10 @@ public:
     // tracking
     char *psKey;
 
-    // Currently, I have only allowed the statistic to track integer values.
+    // Currently, I have only allowed the statistic to track integer values
+    // (64 bits, so that long running servers do not overflow them).
     // Initial value will be 0.
-    int iValue;
+    long long lValue;
 };
 
 // These are the different operations that a single statistic can undergo
@@ -85,12 +90,144 @@ enum Stat_Operation {
     STAT_SUBVALUE
 };
 
+// Statistics updated on hot paths (every page access) have a fixed index
+// and are counted with StatisticsMgr::Add: an atomic add on a counter of
+// the calling thread's stripe, with no lookup, lock or allocation.  Each
+// has a key below, through which Get, Print, Reset and Register still
+// see it.  Only the PF layer has such counters so far; the other layers
+// register theirs by key (StatisticsMgr::Register).
+enum Stat_Counter {
+    STAT_PF_GETPAGE,
+    STAT_PF_PAGEFOUND,
+    STAT_PF_PAGENOTFOUND,
+    STAT_PF_READPAGE,
+    STAT_PF_WRITEPAGE,
+    STAT_PF_FLUSHPAGES,
+    STAT_PF_READAHEAD,
+    STAT_PF_BGWRITE,
+    STAT_PF_COALESCEDIO,
+    STAT_PF_SYNC,
+    STAT_PF_SYNCSKIPPED,
+    STAT_PF_SYNCUSEC,
+    STAT_PF_EXTENT,
+    STAT_NUM_COUNTERS
+};
+
+// Threads are spread over this many copies of the counters; Get sums them
+const int STAT_NUM_STRIPES = 16;
+const int STAT_CACHE_LINE  = 64;
+
+// One copy of the counters, padded to whole cache lines
+struct StatStripe {
+    std::atomic<long long> alValues[STAT_NUM_COUNTERS];
+    char pad[STAT_CACHE_LINE - STAT_NUM_COUNTERS *
+             sizeof(std::atomic<long long>) % STAT_CACHE_LINE];
+};
+
+// Latencies are kept per file in histograms, one per operation below
+enum Stat_Latency {
+    STAT_LAT_READPAGE,       // a read request, from submission to completion
+    STAT_LAT_WRITEPAGE,      // a write request (one or more adjacent pages)
+    STAT_LAT_GETHIT,         // a GetPage that found the page in the buffer
+    STAT_LAT_GETMISS,        // a GetPage that had to read the page
+    STAT_NUM_LATENCIES
+};
+
+// Histogram buckets are logarithmic: STAT_HIST_SUB buckets per power of
+// two of nanoseconds (so a percentile is off by 1/STAT_HIST_SUB at most)
+const int STAT_HIST_SUB     = 4;
+const int STAT_HIST_BUCKETS = 64 * STAT_HIST_SUB;
+
+// Files are found by file descriptor below this; others share a record
+const int STAT_MAX_FDS      = 1024;
+
+// Formats of StatisticsMgr::Dump
+enum Stat_Format {
+    STAT_FORMAT_JSON,
+    STAT_FORMAT_CSV
+};
+
+// A copy of a histogram, which can be added to and queried
+struct StatHistData {
+    long long alBuckets[STAT_HIST_BUCKETS];
+    long long lCount;        // # of values
+    long long lSum;          // their sum, in nanoseconds
+    long long lMax;          // the largest
+
+    StatHistData();
+    void Merge(const StatHistData &data);
+    // Value below which a fraction dFraction of the values lie
+    // (interpolated within its bucket), 0 if there are none
+    long long Percentile(double dFraction) const;
+};
+
+// A latency histogram, updated without locks
+class StatHistogram {
+public:
+    StatHistogram();
+
+    void Record(long long lNanos);
+    // Add the values recorded to data
+    void Read(StatHistData &data) const;
+    void Reset();
+
+    // Bucket of a value, and the first value of a bucket
+    static int Bucket(long long lNanos);
+    static long long BucketStart(int bucket);
+
+private:
+    std::atomic<long long> alBuckets[STAT_HIST_BUCKETS];
+    std::atomic<long long> lSum;
+    std::atomic<long long> lMax;
+};
+
+// The latencies of one file (by name: a file reopened keeps its record)
+struct StatFile {
+    char          *psName;   // file name
+    int           fd;        // descriptor while open, -1 once closed
+    StatHistogram aHists[STAT_NUM_LATENCIES];
+    StatFile      *pNext;    // next file of the manager
+};
+
 // The StatisticsMgr will track a group of statistics
 class StatisticsMgr {
 
 public:
-    StatisticsMgr() {};
-    ~StatisticsMgr() {};
+    StatisticsMgr();
+    ~StatisticsMgr();
+
+    // Count lValue for a fixed statistic.  Thread safe and lock free.
+    void Add(const Stat_Counter counter, const long long lValue = 1);
+
+    // Turn Add and AddLatency on or off (on by default), to measure what
+    // they cost.  EnableLatencies turns off the latencies alone: timing a
+    // page access costs about as much as the access.  Callers only time
+    // what IsTiming says will be recorded.
+    void Enable(const Boolean bEnable);
+    void EnableLatencies(const Boolean bEnable);
+    Boolean IsTiming() const;
+
+    // Clock of the latencies, in nanoseconds
+    static long long Now();
+
+    // Files opened and closed: latencies are recorded per file.  A file
+    // opened again under the same name goes on with the same record.
+    void OpenFile(const int fd, const char *psName);
+    void CloseFile(const int fd);
+
+    // Record a latency of the file with descriptor fd (of no file if it
+    // is not open).  Thread safe and lock free.
+    void AddLatency(const int fd, const Stat_Latency latency,
+                    const long long lNanos);
+
+    // Latencies of an operation for the file named psName, or for all the
+    // files if psName is NULL; added to data
+    RC GetLatency(const char *psName, const Stat_Latency latency,
+                  StatHistData &data);
+
+    // Write every statistic and the latency summaries (count, sum, max,
+    // p50, p99, p999), per file and for all of them, as JSON or CSV
+    void Dump(std::ostream &os, const Stat_Format format);
 
     // Add a new statistic or register a change to an existing statistic.
     // The piValue for can be NULL, except for those operations that require
@@ -100,8 +237,10 @@ public:
                 const int *const piValue = NULL);
 
     // Get will return the value associated with a particular statistic.
-    // Caller is responsible for deleting the memory returned.
+    // Caller is responsible for deleting the memory returned.  The value
+    // is cut to an int; GetValue gives all 64 bits.
     int *Get(const char *psKey);
+    RC GetValue(const char *psKey, long long &lValue);
 
     // Print out a specific statistic
     RC Print(const char *psKey);
@@ -116,9 +255,82 @@ public:
     void Reset();
 
 private:
-    LinkList<Statistic> llStats;
+    // Index of a fixed statistic by key, or -1
+    static int CounterOf(const char *psKey);
+    // Sum of a fixed statistic over the stripes
+    long long Sum(int counter) const;
+    // Make a fixed statistic lValue (for the other Register operations)
+    void Set(int counter, long long lValue);
+    // Record of a file by name, created if asked; filesLatch held
+    StatFile *FindFile(const char *psName, int bCreate);
+    // Stripe of the calling thread
+    static int ThreadStripe();
+
+    LinkList<Statistic> llStats;             // the other statistics
+
+    char *pStripeMem;                        // allocation holding pStripes
+    StatStripe *pStripes;                    // STAT_NUM_STRIPES copies,
+                                             // cache line aligned
+    std::atomic<char> abUsed[STAT_NUM_COUNTERS]; // counted since reset
+    std::atomic<bool> bEnabled;              // see Enable
+    std::atomic<bool> bLatencies;            // see EnableLatencies
+
+    std::mutex filesLatch;                   // guards the list of files
+    StatFile *pFiles;                        // every file seen, in order
+    StatFile *pNoFile;                       // latencies of no open file
+    std::atomic<StatFile *> *apOpenFiles;    // open files by descriptor
 };
 
+//
+// ThreadStripe
+//
+// Threads take the stripes in turn the first time they count something
+//
+inline int StatisticsMgr::ThreadStripe()
+{
+    static std::atomic<int> iNextStripe(0);
+    static thread_local int iStripe = -1;
+
+    if (iStripe < 0)
+        iStripe = iNextStripe.fetch_add(1) % STAT_NUM_STRIPES;
+    return iStripe;
+}
+
+//
+// Add
+//
+// No other thread writes the counters of the stripe in the common case,
+// so the add stays in this core's cache
+//
+inline void StatisticsMgr::Add(const Stat_Counter counter, const long long lValue)
+{
+    if (!bEnabled.load(std::memory_order_relaxed))
+        return;
+
+    pStripes[ThreadStripe()].alValues[counter].fetch_add(lValue,
+        std::memory_order_relaxed);
+    if (!abUsed[counter].load(std::memory_order_relaxed))
+        abUsed[counter].store(TRUE, std::memory_order_relaxed);
+}
+
+//
+// IsTiming
+//
+inline Boolean StatisticsMgr::IsTiming() const
+{
+    return bEnabled.load(std::memory_order_relaxed) &&
+        bLatencies.load(std::memory_order_relaxed);
+}
+
+//
+// Now
+//
+inline long long StatisticsMgr::Now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
 //
 // Return codes
 //
@@ -136,6 +348,13 @@ extern const char *PF_PAGENOTFOUND;
 extern const char *PF_READPAGE;         // IO
 extern const char *PF_WRITEPAGE;        // IO
 extern const char *PF_FLUSHPAGES;
+extern const char *PF_READAHEAD;        // IO, pages read ahead
+extern const char *PF_BGWRITE;          // IO, pages written in the background
+extern const char *PF_COALESCEDIO;      // IO, writes of several adjacent pages
+extern const char *PF_SYNC;             // IO, fdatasync calls
+extern const char *PF_SYNCSKIPPED;      // syncs asked for files with nothing to sync
+extern const char *PF_SYNCUSEC;         // microseconds spent in fdatasync
+extern const char *PF_EXTENT;           // IO, pages preallocated in extents
 
 #endif
 